@@ -2,95 +2,818 @@
 #include "Engine.h"
 #include "Renderer/ResourceFactory.h"
 #include "Misc/Utils.h"
+#include "Cook/CookManifest.h"
 
-static AssetUUID s_AssetUUIDCounter = 0; // puzza, ma per il momento va bene
+#include <algorithm>
 
-void AssetManager::Init(u32 asyncLoaderThreads)
+// what a load is charged before its file is read, as a multiple of the file size. fixed once the real size is known.
+// glb: the file, kept until it's decoded (the parsed binary chunk points into it) + 48 byte vertices decoded from ~32 bytes of attributes
+constexpr u64 MESH_MEMORY_ESTIMATE = 3;
+// png/jpg: rgba8 pixels are usually 4-10x the compressed file
+constexpr u64 TEXTURE_MEMORY_ESTIMATE = 8;
+
+static u64 EstimateLoadMemory(const std::filesystem::path& path, u64 fileSizeMultiplier)
 {
-	m_AsyncLoader.Start(asyncLoaderThreads);
+	std::error_code error;
+	u64 fileSize = (u64)std::filesystem::file_size(path, error);
+	return error ? 0 : fileSize * fileSizeMultiplier;
+}
+
+void AssetManager::Init(const TaskPoolConfig& loaderConfig, const IOQueueConfig& ioConfig, u64 memoryBudgetBytes)
+{
+	m_MemoryBudget.SetLimit(memoryBudgetBytes);
+	m_IOQueue.Start(ioConfig);
+	m_AsyncLoader.Start(loaderConfig);
 }
 
 void AssetManager::Shutdown()
 {
+	// io first, its callbacks submit to the pool
+	m_IOQueue.Stop();
 	m_AsyncLoader.Stop();
 }
 
-Mesh* AssetManager::LoadMesh(const std::filesystem::path& path)
+Handle<Mesh> AssetManager::LoadMesh(const std::filesystem::path& path, ETaskPriority priority)
 {
-	Mesh* mesh = new Mesh(); // todo: decent allocator
+	CacheKey key = GetCacheKey(path);
+	if (CacheEntry* entry = FindCachedAsset(key, EAssetType::Mesh))
+	{
+		JoinLoad(*entry, priority);
+		return { entry->second.index, entry->second.generation };
+	}
+
+	Handle<Mesh> handle = m_Meshes.Create();
+	StreamMesh(AddCachedAsset(key, EAssetType::Mesh, handle.index, handle.generation), priority);
+	return handle;
+}
+
+void AssetManager::StreamMesh(CacheEntry& entry, ETaskPriority priority)
+{
+	Mesh* mesh = Peek(Handle<Mesh>{ entry.second.index, entry.second.generation });
+	std::filesystem::path path = entry.first;
+
+	LoadRequest* request = BeginRequest(entry, mesh, priority);
+
+	request->packEntry = FindPackEntry(entry);
+	if (request->packEntry)
+	{
+		QueuePackLoad(request);
+		return;
+	}
+
+	request->cookedPath = GetCookedPath(entry);
+	if (!request->cookedPath.empty())
+	{
+		StreamCookedMesh(mesh, request);
+		return;
+	}
+
+	mesh->Processing = m_MeshProcessing;
+	MeshLoadJob* job = mesh->BeginLoad(path, m_DecodeMeshesToStaging);
+
+	// memory budget -> read (io queue, or a mapping) -> parse -> decode every chunk (fan out) -> create gpu objects (fan in) -> upload.
+	// every stage is created with the request priority of that moment, so a SetLoadPriority() also reaches the stages spawned later
+	bool mapFile = m_MeshFileAccess == EMeshFileAccess::Map;
+	TaskPool::TaskHandle parseTask = m_AsyncLoader.CreateTask([this, mesh, job, request, mapFile]() {
+		if (mapFile)
+			request->fileSize = mesh->MapFile(job);
+
+		u32 chunkCount = mesh->Parse(job);
+		if (chunkCount == 0)
+		{
+			// unreadable or nothing to draw, no gpu objects for it
+			mesh->AbortLoad(job);
+			Async::Start(m_AsyncLoader, FailLoad(mesh, request));
+			return;
+		}
+
+		ETaskPriority priority = request->priority.load();
+
+		// the vertex/index arrays are allocated, from now on the charge is exact: the file (read, or as much of the mapping
+		// as the decode will touch) + decoded data, unless it's decoded into staging memory. what the processing reads is
+		// decoded in ram until FinishLoad() writes it there
+		u64 vertexBytes = mesh->GetVertices().size_bytes();
+		u64 indexBytes = mesh->GetIndices().size_bytes();
+		u64 decodedBytes = mesh->HasStagedData() ? 0 : vertexBytes + indexBytes;
+		u64 scratchBytes = 0;
+		if (mesh->HasStagedData())
+			scratchBytes = (mesh->Processing.ReadsIndices() ? indexBytes : 0) + (mesh->Processing.ReadsVertices() ? vertexBytes : 0);
+		SetBudgetCharge(request, request->fileSize + decodedBytes + scratchBytes);
+
+		TaskPool::TaskHandle createTask = m_AsyncLoader.CreateTask([this, mesh, job, request, decodedBytes]() {
+			mesh->FinishLoad(job);
+			mesh->CreateOnGPU();
+
+			// the parsed gltf is gone with the job
+			SetBudgetCharge(request, decodedBytes);
+		}, priority);
+
+		TaskPool::TaskHandle uploadTask = m_AsyncLoader.Then(createTask, [this, mesh, request]() {
+			UploadMesh(mesh, request);
+		}, priority);
+
+		TrackTask(request, m_AsyncLoader.GetRef(createTask));
+		TrackTask(request, m_AsyncLoader.GetRef(uploadTask));
+
+		for (u32 i = 0; i < chunkCount; i++)
+		{
+			TaskPool::TaskHandle decodeTask = m_AsyncLoader.CreateTask([mesh, job, i]() {
+				mesh->DecodeChunk(job, i);
+			}, priority);
+
+			m_AsyncLoader.Precede(decodeTask, createTask);
+			TrackTask(request, m_AsyncLoader.GetRef(decodeTask));
+			m_AsyncLoader.Submit(decodeTask);
+		}
+
+		m_AsyncLoader.Submit(uploadTask);
+		m_AsyncLoader.Submit(createTask);
+	}, priority);
+
+	TrackTask(request, m_AsyncLoader.GetRef(parseTask));
 
-	m_AsyncLoader.AddTask([mesh, path]() {
-		// disk -> ram
-		mesh->Load(path);
-		mesh->CreateOnGPU();
-		LOG_INFO("Asset manager: Mesh %s loaded on ram! (%.2f MB)", path.string().c_str(), Utils::BytesToMegabytes(mesh->GetMemoryFootprint()));
-		// ram -> vram
-		PendingLoadingRes res;
-		res.mesh = mesh;
-		res.size = mesh->GetMemoryFootprint();
-		res.type = EResourceType::MeshBuffer;
-		g_ResourceFactory.PushLoading(res);
+	// nothing is read until the load fits in the memory budget. the io thread only hands the bytes over, the parse runs on the loader pool
+	request->budgetCharge = EstimateLoadMemory(path, MESH_MEMORY_ESTIMATE);
+	m_MemoryBudget.Acquire(request->budgetCharge, priority, mesh, [this, mesh, job, request, parseTask, mapFile]() {
+		// mapped on the loader pool by the parse itself
+		if (mapFile)
+		{
+			m_AsyncLoader.Submit(parseTask);
+			return;
+		}
+
+		m_IOQueue.Read(request->path, request->priority.load(), mesh, [this, mesh, job, request, parseTask](IOBuffer&& file) {
+			request->fileSize = file.Size();
+			mesh->SetFile(job, std::move(file));
+			m_AsyncLoader.Submit(parseTask);
+		});
 	});
+}
+
+void AssetManager::StreamCookedMesh(Mesh* mesh, LoadRequest* request)
+{
+	// map the file (or the pack) and point into it, no io queue (the pages come in as the upload reads them) and nothing to decode
+	request->budgetCharge = request->packEntry ? request->packEntry->size : EstimateLoadMemory(request->cookedPath, 1);
+	m_MemoryBudget.Acquire(request->budgetCharge, request->priority.load(), mesh, [this, mesh, request]() {
+		TaskPool::TaskHandle loadTask = m_AsyncLoader.CreateTask([this, mesh, request]() {
+			bool cooked = request->packEntry ? mesh->LoadCooked(m_Pack.GetData(*request->packEntry), request->path.string())
+				: mesh->LoadCooked(request->cookedPath);
+
+			if (!cooked)
+			{
+				// cooked by another version: the whole gltf load on this worker
+				LOG_WARN("Asset manager: falling back to %ls", request->path.c_str());
+				mesh->LoadGltf(request->path);
+			}
+
+			if (mesh->GetVertexBufferSize() == 0)
+			{
+				// no source to fall back to, or unreadable too
+				mesh->ClearData();
+				Async::Start(m_AsyncLoader, FailLoad(mesh, request));
+				return;
+			}
+
+			mesh->CreateOnGPU();
+			SetBudgetCharge(request, mesh->GetMemoryFootprint());
+			UploadMesh(mesh, request);
+		}, request->priority.load());
 
-	RegisterAsset(mesh, EAssetType::Mesh);
-	return mesh;
+		TrackTask(request, m_AsyncLoader.GetRef(loadTask));
+		m_AsyncLoader.Submit(loadTask);
+	});
+}
+
+Handle<Texture> AssetManager::LoadTexture(const std::filesystem::path& path, ETaskPriority priority)
+{
+	CacheKey key = GetCacheKey(path);
+	if (CacheEntry* entry = FindCachedAsset(key, EAssetType::Texture))
+	{
+		JoinLoad(*entry, priority);
+		return { entry->second.index, entry->second.generation };
+	}
+
+	Handle<Texture> handle = m_Textures.Create();
+	StreamTexture(AddCachedAsset(key, EAssetType::Texture, handle.index, handle.generation), priority);
+	return handle;
 }
 
-Texture* AssetManager::LoadTexture(const std::filesystem::path& path)
+void AssetManager::StreamTexture(CacheEntry& entry, ETaskPriority priority)
 {
-	Texture* texture = new Texture(); // todo: decent allocator
+	Texture* texture = Peek(Handle<Texture>{ entry.second.index, entry.second.generation });
+	std::filesystem::path path = entry.first;
+
+	LoadRequest* request = BeginRequest(entry, texture, priority);
 
-	m_AsyncLoader.AddTask([texture, path]() {
-		// disk -> ram
-		texture->Load(path);
-		texture->CreateOnGPU();
-		LOG_INFO("Asset manager: Texture %s loaded on ram! (%.2f MB)", path.string().c_str(), Utils::BytesToMegabytes(texture->GetMemoryFootprint()));
-		// ram -> vram
-		PendingLoadingRes res;
-		res.texture = texture;
-		res.size = texture->GetMemoryFootprint();
-		res.type = EResourceType::Texture;
-		g_ResourceFactory.PushLoading(res);
+	request->packEntry = FindPackEntry(entry);
+	if (request->packEntry)
+	{
+		QueuePackLoad(request);
+		return;
+	}
+
+	// cooked: the pixels are mapped as they are, nothing to decode
+	request->cookedPath = GetCookedPath(entry);
+	request->budgetCharge = request->cookedPath.empty() ? EstimateLoadMemory(path, TEXTURE_MEMORY_ESTIMATE) : EstimateLoadMemory(request->cookedPath, 1);
+	StreamTextureData(texture, request);
+}
+
+void AssetManager::StreamTextureData(Texture* texture, LoadRequest* request)
+{
+	m_MemoryBudget.Acquire(request->budgetCharge, request->priority.load(), texture, [this, texture, request]() {
+		TrackTask(request, Async::Spawn(m_AsyncLoader, LoadTextureAsync(texture, request), request->priority.load()));
 	});
+}
+
+void AssetManager::QueuePackLoad(LoadRequest* request)
+{
+	m_PendingPackLoads.push_back(request);
+	if (!m_PackFlushQueued)
+	{
+		m_PackFlushQueued = true;
+		Async::Start(m_AsyncLoader, FlushPackLoadsNextFrame());
+	}
+}
 
-	RegisterAsset(texture, EAssetType::Texture);
-	return texture;
+AsyncTask<> AssetManager::FlushPackLoadsNextFrame()
+{
+	// everything asked for until then goes in the same batch
+	co_await Async::NextFrame();
+	FlushPackLoads();
 }
 
-u32 AssetManager::CheckLoadedAssets()
+void AssetManager::FlushPackLoads()
 {
-	std::vector<PendingLoadingRes> loaded;
-	u32 freshlyLoadedCount = g_ResourceFactory.PullLoaded(loaded);
+	m_PackFlushQueued = false;
 
-	for (PendingLoadingRes& res : loaded)
+	std::vector<const PackEntry*> entries;
+	entries.reserve(m_PendingPackLoads.size());
+	for (LoadRequest* request : m_PendingPackLoads)
 	{
-		switch (res.type)
+		entries.push_back(request->packEntry);
+		m_PackStats.bytes += request->packEntry->size;
+	}
+
+	// the disk gets one sequential read per run of neighbours instead of a page fault storm from the workers
+	m_PackStats.reads += m_Pack.Prefetch(entries);
+	m_PackStats.loads += m_PendingPackLoads.size();
+
+	for (LoadRequest* request : m_PendingPackLoads)
+	{
+		void* assetRes = GetAssetRes(*request->cached);
+		if (request->cached->type == EAssetType::Mesh)
 		{
-		case EResourceType::Texture:
-			res.texture->m_IsLoaded = true;
-			if (!res.texture->KeepCPUData)
-				res.texture->ClearData();
-			break;
+			StreamCookedMesh((Mesh*)assetRes, request);
+		}
+		else
+		{
+			request->budgetCharge = request->packEntry->size;
+			StreamTextureData((Texture*)assetRes, request);
+		}
+	}
+	m_PendingPackLoads.clear();
+}
 
-		case EResourceType::MeshBuffer:
-			res.mesh->m_IsLoaded = true;
-			if (!res.mesh->KeepCPUData)
-				res.mesh->ClearData();
-			break;
+void AssetManager::DestroyAssets()
+{
+	m_Meshes.ForEach([this](Handle<Mesh> handle, Mesh& mesh) {
+		g_ResourceFactory.DestroyMesh(&mesh);
+		m_MeshSlots[handle.index].entry = nullptr;
+	});
+	m_Textures.ForEach([this](Handle<Texture> handle, Texture& texture) {
+		g_ResourceFactory.DestroyTexture(&texture);
+		m_TextureSlots[handle.index].entry = nullptr;
+	});
+
+	m_Meshes.Clear();
+	m_Textures.Clear();
+
+	m_AssetCache.clear();
+	m_InFlightLoads.clear();
+
+	m_EvictedAssets.clear();
+	m_ReleasedAssets.clear();
+	m_ResidentBytes = 0;
+	m_ResidentCount = 0;
+	m_EvictedBytes = 0;
+}
+
+void AssetManager::UpdateResidency(u32 framesInFlight)
+{
+	u64 frame = m_FrameNumber.fetch_add(1, std::memory_order_relaxed) + 1;
+
+	// used since they were evicted, back on the way to the gpu
+	for (size_t i = 0; i < m_EvictedAssets.size();)
+	{
+		CacheEntry* entry = m_EvictedAssets[i];
+		if (GetSlot(entry->second).lastUsedFrame.load(std::memory_order_relaxed) >= entry->second.evictedFrame)
+		{
+			m_EvictedAssets[i] = m_EvictedAssets.back();
+			m_EvictedAssets.pop_back();
+			Restream(*entry, ETaskPriority::Visible);
+		}
+		else
+		{
+			i++;
+		}
+	}
+
+	auto isInUse = [this, frame, framesInFlight](const CachedAsset& cached) {
+		return GetSlot(cached).lastUsedFrame.load(std::memory_order_relaxed) + framesInFlight >= frame;
+	};
+
+	// nobody holds them anymore. an in-flight load finishes first, the tasks use the asset
+	for (size_t i = 0; i < m_ReleasedAssets.size();)
+	{
+		CacheEntry* entry = m_ReleasedAssets[i];
+		CachedAsset& cached = entry->second;
+
+		bool keep = cached.refCount == 0 && (cached.residency == EResidency::Loading || isInUse(cached));
+		if (keep)
+		{
+			i++;
+			continue;
 		}
+
+		m_ReleasedAssets[i] = m_ReleasedAssets.back();
+		m_ReleasedAssets.pop_back();
+
+		cached.releasePending = false;
+		if (cached.refCount == 0)
+			DestroyAsset(*entry);
+	}
+
+	if (m_ResidentBytes <= m_ResidencyBudget)
+		return;
+
+	// least recently used first
+	m_EvictionCandidates.clear();
+	for (CacheEntry& entry : m_AssetCache)
+	{
+		if (entry.second.residency == EResidency::Resident && !isInUse(entry.second))
+			m_EvictionCandidates.push_back(&entry);
 	}
 
-	return freshlyLoadedCount;
+	std::sort(m_EvictionCandidates.begin(), m_EvictionCandidates.end(), [this](const CacheEntry* a, const CacheEntry* b) {
+		return GetSlot(a->second).lastUsedFrame.load(std::memory_order_relaxed) < GetSlot(b->second).lastUsedFrame.load(std::memory_order_relaxed);
+	});
+
+	for (CacheEntry* entry : m_EvictionCandidates)
+	{
+		if (m_ResidentBytes <= m_ResidencyBudget)
+			break;
+		Evict(*entry);
+	}
 }
 
-AssetUUID AssetManager::RegisterAsset(void* assetRes, EAssetType type)
+void AssetManager::Evict(CacheEntry& entry)
 {
-	Asset newAsset;
-	newAsset.uuid = ++s_AssetUUIDCounter;
-	newAsset.assetRes = assetRes;
-	newAsset.type = type;
+	CachedAsset& cached = entry.second;
+	check(cached.residency == EResidency::Resident);
 
-	m_AssetsDB[newAsset.uuid] = newAsset;
+	// the cpu copy goes too (KeepCPUData or not), the restream reads the file again
+	switch (cached.type)
+	{
+	case EAssetType::Mesh:
+	{
+		Mesh* mesh = Peek(Handle<Mesh>{ cached.index, cached.generation });
+		g_ResourceFactory.DestroyMesh(mesh);
+		mesh->m_IsLoaded = false;
+		mesh->ClearData();
+		mesh->m_Submeshes.clear();
+		break;
+	}
+
+	case EAssetType::Texture:
+	{
+		Texture* texture = Peek(Handle<Texture>{ cached.index, cached.generation });
+		g_ResourceFactory.DestroyTexture(texture);
+		texture->m_IsLoaded = false;
+		texture->ClearData();
+		break;
+	}
+	}
+
+	cached.residency = EResidency::Evicted;
+	cached.evictedFrame = m_FrameNumber.load(std::memory_order_relaxed);
 
-	return newAsset.uuid;
+	m_ResidentBytes -= cached.gpuBytes;
+	m_ResidentCount--;
+	m_EvictedBytes += cached.gpuBytes;
+	m_EvictionCount++;
+	m_EvictedAssets.push_back(&entry);
+
+	LOG_INFO("Asset manager: %ls evicted (%.2f MB)", entry.first.c_str(), Utils::BytesToMegabytes(cached.gpuBytes));
+}
+
+void AssetManager::Restream(CacheEntry& entry, ETaskPriority priority)
+{
+	CachedAsset& cached = entry.second;
+	check(cached.residency == EResidency::Evicted);
+
+	cached.residency = EResidency::Loading;
+	m_EvictedBytes -= cached.gpuBytes;
+	m_RestreamCount++;
+
+	if (cached.type == EAssetType::Mesh)
+		StreamMesh(entry, priority);
+	else
+		StreamTexture(entry, priority);
+}
+
+void AssetManager::ReleaseAsset(AssetSlot& slot, u32 generation)
+{
+	if (!slot.entry || slot.entry->second.generation != generation)
+		return; // stale handle
+
+	CachedAsset& cached = slot.entry->second;
+	check(cached.refCount > 0);
+	if (--cached.refCount == 0 && !cached.releasePending)
+	{
+		cached.releasePending = true;
+		m_ReleasedAssets.push_back(slot.entry);
+	}
+}
+
+void AssetManager::OnLoaded(AssetSlot& slot, u32 generation, LoadCallback&& callback, ELoadCallbackThread thread)
+{
+	if (!slot.entry || slot.entry->second.generation != generation)
+		return; // stale handle, there's no load to wait for
+
+	CachedAsset& cached = slot.entry->second;
+	if (cached.residency == EResidency::Resident || cached.residency == EResidency::Failed)
+	{
+		RunLoadCallback(std::move(callback), thread);
+		return;
+	}
+
+	// loading, or evicted until a Get() streams it back
+	cached.loadCallbacks.push_back({ std::move(callback), thread });
+}
+
+void AssetManager::RunLoadCallbacks(CachedAsset& cached)
+{
+	if (cached.loadCallbacks.empty())
+		return;
+
+	// taken out first, a callback can attach new ones
+	std::vector<PendingCallback> callbacks = std::move(cached.loadCallbacks);
+	cached.loadCallbacks.clear();
+
+	for (PendingCallback& pending : callbacks)
+		RunLoadCallback(std::move(pending.callback), pending.thread);
+}
+
+void AssetManager::RunLoadCallback(LoadCallback&& callback, ELoadCallbackThread thread)
+{
+	if (thread == ELoadCallbackThread::Main)
+		callback();
+	else
+		m_AsyncLoader.AddTask([callback = std::move(callback)]() mutable { callback(); });
+}
+
+void AssetManager::DestroyAsset(CacheEntry& entry)
+{
+	CachedAsset& cached = entry.second;
+
+	// the gpu memory goes the same way as an eviction
+	if (cached.residency == EResidency::Resident)
+		Evict(entry);
+
+	if (cached.residency == EResidency::Evicted)
+	{
+		m_EvictedBytes -= cached.gpuBytes;
+		m_EvictedAssets.erase(std::find(m_EvictedAssets.begin(), m_EvictedAssets.end(), &entry));
+	}
+
+	GetSlot(cached).entry = nullptr;
+	if (cached.type == EAssetType::Mesh)
+		m_Meshes.Destroy({ cached.index, cached.generation });
+	else
+		m_Textures.Destroy({ cached.index, cached.generation });
+
+	// the key lives in the node being erased
+	CacheKey key = entry.first;
+	m_AssetCache.erase(key);
+}
+
+ResidencyStats AssetManager::GetResidencyStats() const
+{
+	ResidencyStats stats;
+	stats.budgetBytes = m_ResidencyBudget;
+	stats.residentBytes = m_ResidentBytes;
+	stats.residentCount = m_ResidentCount;
+	stats.evictedBytes = m_EvictedBytes;
+	stats.evictedCount = (u32)m_EvictedAssets.size();
+	stats.evictions = m_EvictionCount;
+	stats.restreams = m_RestreamCount;
+	return stats;
+}
+
+bool AssetManager::SetLoadPriority(const void* assetRes, ETaskPriority priority)
+{
+	auto it = m_InFlightLoads.find(assetRes);
+	if (it == m_InFlightLoads.end())
+		return false;
+
+	LoadRequest* request = it->second.get();
+	request->priority.store(priority);
+
+	{
+		std::lock_guard<std::mutex> lock(request->tasksLock);
+		for (TaskPool::TaskRef task : request->tasks)
+			m_AsyncLoader.Reprioritize(task, priority);
+	}
+
+	// might be waiting for memory, for the disk or for the staging buffer already
+	m_MemoryBudget.SetPriority(assetRes, priority);
+	m_IOQueue.SetPriority(assetRes, priority);
+	g_ResourceFactory.SetUploadPriority(assetRes, priority);
+	return true;
+}
+
+AssetManager::LoadRequest* AssetManager::BeginRequest(CacheEntry& entry, const void* assetRes, ETaskPriority priority)
+{
+	std::unique_ptr<LoadRequest>& request = m_InFlightLoads[assetRes];
+	request = std::make_unique<LoadRequest>();
+	request->priority = priority;
+	request->cached = &entry.second;
+	request->path = entry.first;
+	return request.get();
+}
+
+void AssetManager::TrackTask(LoadRequest* request, TaskPool::TaskRef task)
+{
+	std::lock_guard<std::mutex> lock(request->tasksLock);
+	request->tasks.push_back(task);
+}
+
+void AssetManager::SetBudgetCharge(LoadRequest* request, u64 bytes)
+{
+	// growing never waits (the load is already going), shrinking lets the waiting loads in
+	m_MemoryBudget.Adjust((s64)bytes - (s64)request->budgetCharge);
+	request->budgetCharge = bytes;
+}
+
+void AssetManager::UploadMesh(Mesh* mesh, LoadRequest* request)
+{
+	LOG_INFO("Asset manager: Mesh %s loaded on %s! (%.2f MB)", mesh->DebugName.c_str(), mesh->HasStagedData() ? "staging memory" : "ram",
+		Utils::BytesToMegabytes(mesh->GetMemoryFootprint()));
+
+	PendingLoadingRes res;
+	res.mesh = mesh;
+	res.size = mesh->GetMemoryFootprint();
+	res.type = EResourceType::MeshBuffer;
+	res.priority = request->priority.load();
+	Async::Start(m_AsyncLoader, UploadAndPublish(res, request));
+}
+
+AsyncTask<> AssetManager::LoadTextureAsync(Texture* texture, LoadRequest* request)
+{
+	// cooked: mapped on this worker (the file or the pack), the upload reads the pages straight from the mapping
+	bool cooked = false;
+	if (request->packEntry)
+		cooked = texture->LoadCooked(m_Pack.GetData(*request->packEntry), request->path.string());
+	else if (!request->cookedPath.empty())
+		cooked = texture->LoadCooked(request->cookedPath);
+	texture->DebugName = request->path.string();
+
+	if (!cooked)
+	{
+		if (request->packEntry || !request->cookedPath.empty())
+			LOG_WARN("Asset manager: falling back to %ls", request->path.c_str());
+
+		// disk -> ram, read on the io threads, decoded back on the loader pool
+		IOBuffer file = co_await m_IOQueue.ReadAsync(request->path, request->priority.load(), texture);
+		texture->LoadFromMemory(file.Data(), file.Size());
+	}
+
+	SetBudgetCharge(request, texture->GetMemoryFootprint());
+
+	if (!texture->GetMemoryFootprint())
+	{
+		co_await FailLoad(texture, request);
+		co_return;
+	}
+
+	texture->CreateOnGPU();
+	LOG_INFO("Asset manager: Texture %s loaded on ram! (%.2f MB)", texture->DebugName.c_str(), Utils::BytesToMegabytes(texture->GetMemoryFootprint()));
+
+	PendingLoadingRes res;
+	res.texture = texture;
+	res.size = texture->GetMemoryFootprint();
+	res.type = EResourceType::Texture;
+	res.priority = request->priority.load();
+	co_await UploadAndPublish(res, request);
+}
+
+AsyncTask<> AssetManager::UploadAndPublish(PendingLoadingRes res, LoadRequest* request)
+{
+	// nobody waits for the copy, the coroutine sleeps until the upload timeline gets there
+	co_await g_ResourceFactory.Upload(res);
+
+	co_await Async::NextFrame();
+
+	switch (res.type)
+	{
+	case EResourceType::Texture:
+		res.texture->m_IsLoaded = true;
+		if (!res.texture->KeepCPUData)
+			res.texture->ClearData();
+		break;
+
+	case EResourceType::MeshBuffer:
+		res.mesh->m_IsLoaded = true;
+		if (!res.mesh->KeepCPUData)
+			res.mesh->ClearData();
+		break;
+	}
+
+	// the cpu copy is freed or kept on purpose (KeepCPUData), either way it's out of the budget
+	SetBudgetCharge(request, 0);
+
+	// resident from now on, it's just arrived so it's the most recently used
+	CachedAsset& cached = *request->cached;
+	cached.residency = EResidency::Resident;
+	cached.gpuBytes = res.size;
+	GetSlot(cached).lastUsedFrame.store(m_FrameNumber.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	m_ResidentBytes += res.size;
+	m_ResidentCount++;
+
+	m_InFlightLoads.erase(res.type == EResourceType::Texture ? (const void*)res.texture : (const void*)res.mesh);
+
+	// everyone who asked to know while it was loading
+	RunLoadCallbacks(cached);
+}
+
+AsyncTask<> AssetManager::FailLoad(const void* assetRes, LoadRequest* request)
+{
+	SetBudgetCharge(request, 0);
+
+	// never becomes loaded
+	co_await Async::NextFrame();
+	CachedAsset& cached = *request->cached;
+	cached.residency = EResidency::Failed;
+	m_InFlightLoads.erase(assetRes);
+	RunLoadCallbacks(cached);
+}
+
+LoadingPipelineStats AssetManager::GetPipelineStats() const
+{
+	LoadingPipelineStats stats;
+	stats.io = m_IOQueue.GetStats();
+	stats.decode = m_AsyncLoader.GetStats();
+	stats.memory = m_MemoryBudget.GetStats();
+	stats.pendingUploadBytes = g_ResourceFactory.GetPendingUploadBytes();
+	return stats;
+}
+
+bool AssetManager::LoadCookManifest(const std::filesystem::path& manifestPath)
+{
+	CookManifest manifest;
+	if (!manifest.Load(manifestPath))
+	{
+		LOG_WARN("Asset manager: no cook manifest %ls, loading the sources", manifestPath.c_str());
+		return false;
+	}
+
+	std::filesystem::path manifestDir = manifestPath.parent_path();
+	std::filesystem::path assetsRoot = manifestDir / manifest.AssetsRoot;
+
+	for (const auto& [source, entry] : manifest.GetEntries())
+	{
+		CookedSource& cooked = m_CookedSources[GetCacheKey(assetsRoot / source)];
+		cooked.cookedPath = manifestDir / entry.cooked;
+		cooked.sourceSize = entry.sourceSize;
+		cooked.sourceTime = entry.sourceTime;
+	}
+
+	LOG_INFO("Asset manager: %zu cooked assets in %ls", manifest.GetEntries().size(), manifestPath.c_str());
+	return true;
+}
+
+// the source on disk is the one that was cooked, or it's gone (shipped without sources).
+// edited since the cook: the source wins until the next cook
+static bool IsCookedSourceCurrent(const std::filesystem::path& path, u64 sourceSize, s64 sourceTime)
+{
+	std::error_code error;
+	u64 size = (u64)std::filesystem::file_size(path, error);
+	return error || (size == sourceSize && CookManifest::GetFileTime(path) == sourceTime);
+}
+
+bool AssetManager::MountPack(const std::filesystem::path& packPath)
+{
+	m_PackEntries.clear();
+	if (!m_Pack.Open(packPath))
+	{
+		LOG_WARN("Asset manager: no asset pack %ls, loading loose files", packPath.c_str());
+		return false;
+	}
+
+	std::filesystem::path root = packPath.parent_path() / std::filesystem::path(m_Pack.GetRoot());
+	for (const PackEntry& entry : m_Pack.GetEntries())
+	{
+		// raw entries aren't assets the loaders know
+		if (entry.kind != EPackEntryKind::Raw)
+			m_PackEntries[GetCacheKey(root / std::filesystem::path(m_Pack.GetName(entry)))] = &entry;
+	}
+
+	LOG_INFO("Asset manager: mounted %ls, %zu assets", packPath.c_str(), m_PackEntries.size());
+	return true;
+}
+
+AssetPackStats AssetManager::GetPackStats() const
+{
+	AssetPackStats stats = m_PackStats;
+	stats.entries = (u32)m_Pack.GetEntries().size();
+	return stats;
+}
+
+const PackEntry* AssetManager::FindPackEntry(const CacheEntry& entry) const
+{
+	auto it = m_PackEntries.find(entry.first);
+	if (it == m_PackEntries.end())
+		return nullptr;
+
+	const PackEntry* packEntry = it->second;
+	EPackEntryKind kind = entry.second.type == EAssetType::Mesh ? EPackEntryKind::Mesh : EPackEntryKind::Texture;
+	if (packEntry->kind != kind || !IsCookedSourceCurrent(entry.first, packEntry->sourceSize, packEntry->sourceTime))
+		return nullptr;
+
+	return packEntry;
+}
+
+std::filesystem::path AssetManager::GetCookedPath(const CacheEntry& entry) const
+{
+	std::filesystem::path path = entry.first;
+
+	auto it = m_CookedSources.find(entry.first);
+	if (it != m_CookedSources.end() && IsCookedSourceCurrent(path, it->second.sourceSize, it->second.sourceTime))
+		return it->second.cookedPath;
+
+	if (entry.second.type == EAssetType::Mesh && Mesh::IsCookedUpToDate(path))
+		return Mesh::GetCookedPath(path);
+
+	return {};
+}
+
+AssetManager::CacheKey AssetManager::GetCacheKey(const std::filesystem::path& path)
+{
+	// assets/./car.glb, assets\car.glb and the absolute path are the same file
+	std::error_code error;
+	std::filesystem::path absolute = std::filesystem::absolute(path, error);
+	return (error ? path : absolute).lexically_normal().make_preferred().native();
+}
+
+AssetManager::CacheEntry* AssetManager::FindCachedAsset(const CacheKey& key, EAssetType type)
+{
+	auto it = m_AssetCache.find(key);
+	if (it == m_AssetCache.end())
+		return nullptr;
+
+	CachedAsset& cached = it->second;
+	check(cached.type == type); // same file loaded as a mesh and as a texture?
+	cached.refCount++;
+	return &*it;
+}
+
+AssetManager::CacheEntry& AssetManager::AddCachedAsset(const CacheKey& key, EAssetType type, u32 index, u32 generation)
+{
+	CacheEntry& entry = *m_AssetCache.try_emplace(key).first;
+	entry.second.type = type;
+	entry.second.index = index;
+	entry.second.generation = generation;
+	entry.second.refCount = 1;
+
+	AssetSlot& slot = GetSlot(entry.second);
+	slot.entry = &entry;
+	slot.lastUsedFrame.store(m_FrameNumber.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	return entry;
+}
+
+void* AssetManager::GetAssetRes(const CachedAsset& cached) const
+{
+	if (cached.type == EAssetType::Mesh)
+		return m_Meshes.Get({ cached.index, cached.generation });
+	return m_Textures.Get({ cached.index, cached.generation });
+}
+
+void AssetManager::JoinLoad(CacheEntry& entry, ETaskPriority priority)
+{
+	// evicted: the caller gets it back once it's streamed again
+	if (entry.second.residency == EResidency::Evicted)
+	{
+		m_EvictedAssets.erase(std::find(m_EvictedAssets.begin(), m_EvictedAssets.end(), &entry));
+		Restream(entry, priority);
+	}
+
+	const void* assetRes = GetAssetRes(entry.second);
+	auto load = m_InFlightLoads.find(assetRes);
+	if (load != m_InFlightLoads.end())
+	{
+		// join the load, a more urgent request drags it forward
+		LoadRequest* request = load->second.get();
+		if (priority < request->priority.load())
+			SetLoadPriority(assetRes, priority);
+	}
 }
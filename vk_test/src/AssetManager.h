@@ -2,9 +2,17 @@
 
 #include "Core/Core.h"
 #include "Async/TaskPool.h"
+#include "Async/AsyncTask.h"
+#include "Async/IOQueue.h"
+#include "Async/MemoryBudget.h"
+#include "Misc/SlotMap.h"
+#include "Misc/InplaceFunction.h"
+#include "Misc/AssetPack.h"
 #include "Renderer/Mesh.h"
 #include "Renderer/Texture.h"
+#include "Renderer/ResourceFactory.h"
 #include <unordered_map>
+#include <memory>
 
 enum class EAssetType
 {
@@ -12,32 +20,312 @@ enum class EAssetType
 	Texture
 };
 
-using AssetUUID = u64;
+struct LoadingPipelineStats
+{
+	IOQueueStats io;
+	TaskPoolStats decode;
+	MemoryBudgetStats memory;
+	u64 pendingUploadBytes = 0;
+};
+
+struct ResidencyStats
+{
+	u64 budgetBytes = 0;
+	u64 residentBytes = 0;  // gpu memory of the assets on the gpu
+	u32 residentCount = 0;
+	u64 evictedBytes = 0;   // what the evicted assets held when they were evicted
+	u32 evictedCount = 0;
+	u64 evictions = 0;      // totals since Init()
+	u64 restreams = 0;
+};
+
+struct AssetPackStats
+{
+	u32 entries = 0;  // in the mounted pack
+	u64 loads = 0;    // assets loaded from it, totals since Init()
+	u64 reads = 0;    // read requests they took, neighbours in the pack share one
+	u64 bytes = 0;
+};
 
-struct Asset
+// where an OnLoaded() callback runs
+enum class ELoadCallbackThread
 {
-	AssetUUID uuid;
-	void* assetRes;
-	EAssetType type;
+	Main,  // in Async::RunMainThreadQueue() at the start of a frame, with the rest of the publishing
+	Loader // a task on the loader pool
 };
 
+// the load is over: the asset is on the gpu, or it failed and IsLoaded() stays false
+using LoadCallback = InplaceFunction<void(), 48>;
+
+// decoded but not on the gpu yet: file + parsed + decoded data of the loads in flight
+constexpr u64 DEFAULT_LOADING_MEMORY_BUDGET = 512ull * 1024 * 1024;
+
+// gpu memory the loaded assets can hold before the least recently used ones are evicted
+constexpr u64 DEFAULT_RESIDENCY_BUDGET = 1024ull * 1024 * 1024;
+
+// slots of the asset pools, allocated up front
+constexpr u32 MAX_MESHES = 4096;
+constexpr u32 MAX_TEXTURES = 4096;
+
 class AssetManager
 {
+	enum class EResidency
+	{
+		Loading,  // in flight, first load or restream
+		Resident,
+		Evicted,  // gpu and cpu data gone, streamed again on the next Get()
+		Failed    // never becomes loaded
+	};
+
+	struct PendingCallback
+	{
+		LoadCallback callback;
+		ELoadCallbackThread thread;
+	};
+
+	// one per file, whoever asks for it again gets the same asset. main thread only
+	struct CachedAsset
+	{
+		EAssetType type;
+		u32 index = 0;      // handle of the asset in the pool of its type
+		u32 generation = 0;
+		u32 refCount = 0;   // LoadX() calls that returned it minus Release() calls
+		bool releasePending = false; // in m_ReleasedAssets
+
+		EResidency residency = EResidency::Loading;
+		u64 gpuBytes = 0;       // set when it reaches the gpu, kept while evicted
+		u64 evictedFrame = 0;
+
+		std::vector<PendingCallback> loadCallbacks; // OnLoaded() calls waiting for the load in flight or the restream
+	};
+
+	// an async load that hasn't reached the gpu yet
+	struct LoadRequest
+	{
+		std::atomic<ETaskPriority> priority;
+
+		std::mutex tasksLock;
+		std::vector<TaskPool::TaskRef> tasks; // every task of the load, the finished ones are ignored by Reprioritize()
+
+		// bytes held in the loading memory budget: an estimate from the file size until the real size is known.
+		// only touched by one stage at a time, the task graph / coroutine orders them
+		u64 budgetCharge = 0;
+		u64 fileSize = 0; // set by the io stage
+
+		std::filesystem::path path;       // source file
+		std::filesystem::path cookedPath; // file to stream from instead of the source, empty = decode the source
+		const PackEntry* packEntry = nullptr; // in the mounted pack, wins over cookedPath
+
+		CachedAsset* cached = nullptr;
+	};
+
+	using CacheKey = std::filesystem::path::string_type;
+	// unordered_map nodes don't move, the key is the path to stream from
+	using CacheEntry = std::pair<const CacheKey, CachedAsset>;
+
+	// per pool slot, indexed like the handles
+	struct AssetSlot
+	{
+		std::atomic<u64> lastUsedFrame = 0; // written by Get(), any thread
+		CacheEntry* entry = nullptr;        // main thread only
+	};
+
 public:
-	void Init(u32 asyncLoaderThreads);
+	void Init(const TaskPoolConfig& loaderConfig, const IOQueueConfig& ioConfig = {}, u64 memoryBudgetBytes = DEFAULT_LOADING_MEMORY_BUDGET);
 	void Shutdown();
 
-	Mesh* LoadMesh(const std::filesystem::path& path);
-	Texture* LoadTexture(const std::filesystem::path& path);
+	// the asset of a path is loaded once and shared: asking again returns the same handle, joining the load if it's
+	// still in flight (and raising its priority if the new request is more urgent). main thread only
+	Handle<Mesh> LoadMesh(const std::filesystem::path& path, ETaskPriority priority = ETaskPriority::Visible);
+	Handle<Texture> LoadTexture(const std::filesystem::path& path, ETaskPriority priority = ETaskPriority::Visible);
+
+	// gives back what LoadX() returned. at zero references the asset is destroyed once no frame in flight can use it,
+	// the handles become stale
+	inline void Release(Handle<Mesh> handle) { ReleaseAsset(m_MeshSlots[handle.index], handle.generation); }
+	inline void Release(Handle<Texture> handle) { ReleaseAsset(m_TextureSlots[handle.index], handle.generation); }
+
+	// O(1), any thread. nullptr for a null or stale handle, the asset may still be loading or evicted (IsLoaded()).
+	// counts as a use for the residency: an evicted asset is streamed again by the next UpdateResidency()
+	inline Mesh* Get(Handle<Mesh> handle) const { return MarkUsed(m_Meshes.Get(handle), m_MeshSlots[handle.index]); }
+	inline Texture* Get(Handle<Texture> handle) const { return MarkUsed(m_Textures.Get(handle), m_TextureSlots[handle.index]); }
+
+	// same as Get() without counting as a use (ui, stats)
+	inline Mesh* Peek(Handle<Mesh> handle) const { return m_Meshes.Get(handle); }
+	inline Texture* Peek(Handle<Texture> handle) const { return m_Textures.Get(handle); }
+
+	// fn(Handle<T>, T&) on every asset, a linear walk over the pool. main thread only
+	template<typename F>
+	inline void ForEachMesh(F&& fn) { m_Meshes.ForEach(std::forward<F>(fn)); }
+	template<typename F>
+	inline void ForEachTexture(F&& fn) { m_Textures.ForEach(std::forward<F>(fn)); }
+
+	// gpu objects and cpu memory of every asset. the loader must be stopped and the device idle
+	void DestroyAssets();
 
-	u32 CheckLoadedAssets();
+	// moves an in-flight load to another priority class (tasks not started yet + queued gpu upload). false if it's already loaded
+	inline bool SetLoadPriority(Handle<Mesh> handle, ETaskPriority priority) { return SetLoadPriority((const void*)Peek(handle), priority); }
+	inline bool SetLoadPriority(Handle<Texture> handle, ETaskPriority priority) { return SetLoadPriority((const void*)Peek(handle), priority); }
+
+	// callback for the end of the load: right away if the asset is already loaded (or failed), else once the load in
+	// flight or the restream of the evicted asset is over. dropped if the asset is destroyed first or the handle is stale.
+	// the loads are published by Async::RunMainThreadQueue(), nothing is polled. main thread only
+	inline void OnLoaded(Handle<Mesh> handle, LoadCallback&& callback, ELoadCallbackThread thread = ELoadCallbackThread::Main) { OnLoaded(m_MeshSlots[handle.index], handle.generation, std::move(callback), thread); }
+	inline void OnLoaded(Handle<Texture> handle, LoadCallback&& callback, ELoadCallbackThread thread = ELoadCallbackThread::Main) { OnLoaded(m_TextureSlots[handle.index], handle.generation, std::move(callback), thread); }
+
+	// sources cooked by vk_cook (Cook/Cooker.h) stream from the cooked files of the manifest as long as the source on disk
+	// is the one that was cooked, or is gone. false if there's no manifest of this cooker version. main thread, before the loads
+	bool LoadCookManifest(const std::filesystem::path& manifestPath);
+
+	// pack written by vk_cook --pack, mapped once for good: its assets load from it before the manifest and the loose
+	// files, with the same check of the sources. false if it can't be opened. main thread, before the loads
+	bool MountPack(const std::filesystem::path& packPath);
+	AssetPackStats GetPackStats() const;
+
+	// the loader workers, also used for data parallel work while loading (ParallelFor & co.)
+	inline TaskPool& GetTaskPool() { return m_AsyncLoader; }
+
+	// loads over the budget wait before reading their file, a smaller limit doesn't touch the ones already going
+	inline void SetMemoryBudget(u64 bytes) { m_MemoryBudget.SetLimit(bytes); }
+	inline MemoryBudget& GetMemoryBudget() { return m_MemoryBudget; }
+
+	// how the gltf meshes get at their source file: Read through the io queue (default) or Map, no io queue and no heap
+	// copy of the file, the pages come in as the parse and the decode touch them. main thread, for the loads started after
+	inline void SetMeshFileAccess(EMeshFileAccess access) { m_MeshFileAccess = access; }
+
+	// the gltf meshes without KeepCPUData are decoded straight into staging memory (see Mesh::BeginLoad), on by default.
+	// off: decoded in ram and copied into the upload slots. main thread, for the loads started after
+	inline void SetDecodeMeshesToStaging(bool enabled) { m_DecodeMeshesToStaging = enabled; }
+
+	// what the gltf mesh loads do to the decoded data (Mesh::Processing), the vertex cache order and the compact indices
+	// by default: the others read the vertices back, a staged load decodes them in ram first. the cooked meshes have what
+	// the cooker did (the orders and the compact indices by default). main thread, for the loads started after
+	inline void SetMeshProcessing(const MeshProcessing& processing) { m_MeshProcessing = processing; }
+
+	// counters since Init() of the io and decode stages, diff two samples for the utilisation over a window
+	LoadingPipelineStats GetPipelineStats() const;
+
+	// main thread, once per frame before anything calls Get(): starts a new frame, streams back the evicted assets used
+	// since they were evicted, destroys the released ones and evicts the least recently used assets while over budget.
+	// only assets not used in the last framesInFlight frames are touched, no command buffer in flight can reference them
+	void UpdateResidency(u32 framesInFlight);
+
+	// over budget only evicts what's not in use, the assets drawn every frame can go over it
+	inline void SetResidencyBudget(u64 bytes) { m_ResidencyBudget = bytes; }
+	inline u64 GetResidencyBudget() const { return m_ResidencyBudget; }
+	ResidencyStats GetResidencyStats() const;
 
 private:
-	AssetUUID RegisterAsset(void* assetRes, EAssetType type);
+	bool SetLoadPriority(const void* assetRes, ETaskPriority priority);
+
+	static CacheKey GetCacheKey(const std::filesystem::path& path);
+	// nullptr if the path was never asked for
+	CacheEntry* FindCachedAsset(const CacheKey& key, EAssetType type);
+	CacheEntry& AddCachedAsset(const CacheKey& key, EAssetType type, u32 index, u32 generation);
+	// one more LoadX() call for an asset we already have
+	void JoinLoad(CacheEntry& entry, ETaskPriority priority);
+
+	inline AssetSlot& GetSlot(const CachedAsset& cached) const { return (cached.type == EAssetType::Mesh ? m_MeshSlots : m_TextureSlots)[cached.index]; }
+	void* GetAssetRes(const CachedAsset& cached) const;
+
+	// cooked file to stream the asset from: the manifest one, then the .vkmesh next to a mesh. empty = decode the source
+	std::filesystem::path GetCookedPath(const CacheEntry& entry) const;
+	// nullptr if there's no pack, the asset isn't in it or its source changed since it was packed
+	const PackEntry* FindPackEntry(const CacheEntry& entry) const;
+
+	template<typename T>
+	inline T* MarkUsed(T* asset, AssetSlot& slot) const
+	{
+		// the load first, most Get() calls are for assets already used this frame
+		u64 frame = m_FrameNumber.load(std::memory_order_relaxed);
+		if (asset && slot.lastUsedFrame.load(std::memory_order_relaxed) != frame)
+			slot.lastUsedFrame.store(frame, std::memory_order_relaxed);
+		return asset;
+	}
+
+	// disk -> gpu for the asset of the entry, first load or restream
+	void StreamMesh(CacheEntry& entry, ETaskPriority priority);
+	void StreamTexture(CacheEntry& entry, ETaskPriority priority);
+	void Restream(CacheEntry& entry, ETaskPriority priority);
+	void Evict(CacheEntry& entry);
+	void ReleaseAsset(AssetSlot& slot, u32 generation);
+	void OnLoaded(AssetSlot& slot, u32 generation, LoadCallback&& callback, ELoadCallbackThread thread);
+	// the load of the asset is over, every callback waiting for it goes
+	void RunLoadCallbacks(CachedAsset& cached);
+	void RunLoadCallback(LoadCallback&& callback, ELoadCallbackThread thread);
+	void DestroyAsset(CacheEntry& entry);
+
+	// the pack loads asked for in a frame start together at the next one: sorted by offset, one read per run of neighbours
+	void QueuePackLoad(LoadRequest* request);
+	AsyncTask<> FlushPackLoadsNextFrame();
+	void FlushPackLoads();
+
+	// request->packEntry or request->cookedPath set
+	void StreamCookedMesh(Mesh* mesh, LoadRequest* request);
+	// request->budgetCharge set
+	void StreamTextureData(Texture* texture, LoadRequest* request);
+
+	LoadRequest* BeginRequest(CacheEntry& entry, const void* assetRes, ETaskPriority priority);
+	static void TrackTask(LoadRequest* request, TaskPool::TaskRef task);
+	// moves the budget charge of the load to bytes, 0 gives it all back
+	void SetBudgetCharge(LoadRequest* request, u64 bytes);
+
+	// cpu data ready, gpu objects created: hands the mesh to UploadAndPublish()
+	void UploadMesh(Mesh* mesh, LoadRequest* request);
+
+	AsyncTask<> LoadTextureAsync(Texture* texture, LoadRequest* request);
+	// ram -> vram, then marks the asset loaded on the main thread
+	AsyncTask<> UploadAndPublish(PendingLoadingRes res, LoadRequest* request);
+	// unreadable (the error is already logged), nothing on the gpu: out of the budget, then Failed on the main thread and
+	// the OnLoaded() callbacks run
+	AsyncTask<> FailLoad(const void* assetRes, LoadRequest* request);
 
 private:
+	MemoryBudget m_MemoryBudget;
+	IOQueue m_IOQueue;
 	TaskPool m_AsyncLoader;
 
-	// todo: allocate with decent allocator
-	std::unordered_map<AssetUUID, Asset> m_AssetsDB;
+	// the assets live here, the pointers are stable (the loading stages use them) and the handles are what gets passed around
+	SlotMap<Mesh> m_Meshes{ MAX_MESHES };
+	SlotMap<Texture> m_Textures{ MAX_TEXTURES };
+
+	std::unique_ptr<AssetSlot[]> m_MeshSlots = std::make_unique<AssetSlot[]>(MAX_MESHES);
+	std::unique_ptr<AssetSlot[]> m_TextureSlots = std::make_unique<AssetSlot[]>(MAX_TEXTURES);
+
+	// main thread only, keyed by the absolute normalized path
+	std::unordered_map<CacheKey, CachedAsset> m_AssetCache;
+
+	// from LoadCookManifest(), same keys as m_AssetCache
+	struct CookedSource
+	{
+		std::filesystem::path cookedPath;
+		u64 sourceSize = 0; // the source as it was cooked
+		s64 sourceTime = 0;
+	};
+	std::unordered_map<CacheKey, CookedSource> m_CookedSources;
+
+	// from MountPack(), main thread only but the pack itself (read by the loads)
+	AssetPack m_Pack;
+	std::unordered_map<CacheKey, const PackEntry*> m_PackEntries;
+	std::vector<LoadRequest*> m_PendingPackLoads;
+	bool m_PackFlushQueued = false;
+	AssetPackStats m_PackStats;
+
+	EMeshFileAccess m_MeshFileAccess = EMeshFileAccess::Read;
+	bool m_DecodeMeshesToStaging = true;
+	MeshProcessing m_MeshProcessing = { .optimizeVertexCache = true, .compactIndices = true };
+
+	// residency, main thread only but the frame number (read by Get())
+	std::atomic<u64> m_FrameNumber = 1;
+	u64 m_ResidencyBudget = DEFAULT_RESIDENCY_BUDGET;
+	u64 m_ResidentBytes = 0;
+	u32 m_ResidentCount = 0;
+	u64 m_EvictedBytes = 0;
+	u64 m_EvictionCount = 0;
+	u64 m_RestreamCount = 0;
+	std::vector<CacheEntry*> m_EvictedAssets;
+	std::vector<CacheEntry*> m_ReleasedAssets; // zero references, waiting to be destroyed
+	std::vector<CacheEntry*> m_EvictionCandidates; // scratch of UpdateResidency()
+
+	// main thread only, removed once the asset is on the gpu
+	std::unordered_map<const void*, std::unique_ptr<LoadRequest>> m_InFlightLoads;
 };
\ No newline at end of file
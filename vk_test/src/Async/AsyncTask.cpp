@@ -0,0 +1,69 @@
+#include "AsyncTask.h"
+
+#include <atomic>
+
+// intrusive stack of the posted coroutines, newest first. the main thread takes the whole of it at once
+static std::atomic<Async::MainThreadNode*> s_MainThreadQueue = nullptr;
+
+TaskPool::TaskRef Async::Spawn(TaskPool& pool, AsyncTask<> task, ETaskPriority priority)
+{
+	AsyncTask<>::Handle handle = task.Release();
+	check(handle);
+
+	handle.promise().pool = &pool;
+	handle.promise().priority = priority;
+
+	TaskPool::TaskHandle first = pool.CreateTask([handle]() { handle.resume(); }, priority);
+	TaskPool::TaskRef ref = pool.GetRef(first);
+	pool.Submit(first);
+	return ref;
+}
+
+void Async::Start(TaskPool& pool, AsyncTask<> task, ETaskPriority priority)
+{
+	AsyncTask<>::Handle handle = task.Release();
+	check(handle);
+
+	handle.promise().pool = &pool;
+	handle.promise().priority = priority;
+	handle.resume();
+}
+
+void Async::PostToMainThread(MainThreadNode* node)
+{
+	MainThreadNode* head = s_MainThreadQueue.load(std::memory_order_relaxed);
+	do
+	{
+		node->next = head;
+	} while (!s_MainThreadQueue.compare_exchange_weak(head, node, std::memory_order_release, std::memory_order_relaxed));
+}
+
+u32 Async::RunMainThreadQueue()
+{
+	// the idle frame: one load, no lock, no exchange
+	if (!s_MainThreadQueue.load(std::memory_order_relaxed))
+		return 0;
+
+	MainThreadNode* node = s_MainThreadQueue.exchange(nullptr, std::memory_order_acquire);
+
+	// newest first -> posting order
+	MainThreadNode* ordered = nullptr;
+	while (node)
+	{
+		MainThreadNode* next = node->next;
+		node->next = ordered;
+		ordered = node;
+		node = next;
+	}
+
+	u32 count = 0;
+	while (ordered)
+	{
+		// the node is gone with the awaiter once the coroutine runs
+		MainThreadNode* next = ordered->next;
+		ordered->handle.resume();
+		ordered = next;
+		count++;
+	}
+	return count;
+}
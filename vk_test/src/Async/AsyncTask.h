@@ -0,0 +1,294 @@
+#pragma once
+
+#include "Core/CoreMinimal.h"
+#include "TaskPool.h"
+
+#include <coroutine>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// coroutine running on a TaskPool. lets a multi step load be written top to bottom:
+//
+//     AsyncTask<> LoadThing(Thing* thing)
+//     {
+//         IOBuffer file = co_await ioQueue.ReadAsync(path);        // io thread reads, resumes on a worker
+//         thing->Decode(file);
+//         co_await g_ResourceFactory.Upload(res);                  // no thread waits for the copy
+//         co_await Async::NextFrame();                             // main thread, start of the next frame
+//         thing->m_IsLoaded = true;
+//     }
+//
+//     Async::Spawn(pool, LoadThing(thing));
+//
+// the task is lazy: nothing runs until it's spawned on a pool or co_awaited by another AsyncTask (it then inherits
+// the pool and priority of the awaiter, and resumes it when done). a spawned task deletes itself when it finishes.
+// the thread scratch is rolled back at the end of every pool task, so scratch memory must not live across a co_await
+template<typename T = void>
+class AsyncTask;
+
+namespace Async {
+
+	// who resumes a suspended coroutine: a pool task when it has a pool, inline otherwise
+	struct Continuation
+	{
+		std::coroutine_handle<> handle;
+		TaskPool* pool = nullptr;
+		ETaskPriority priority = ETaskPriority::Inherit;
+
+		inline explicit operator bool() const { return (bool)handle; }
+
+		void Schedule() const
+		{
+			check(handle);
+			if (pool)
+			{
+				std::coroutine_handle<> h = handle;
+				pool->AddTask([h]() { h.resume(); }, priority);
+			}
+			else
+			{
+				handle.resume();
+			}
+		}
+	};
+
+	struct PromiseBase
+	{
+		TaskPool* pool = nullptr;
+		ETaskPriority priority = ETaskPriority::Inherit;
+		std::coroutine_handle<> awaiter; // resumed when the task is done, empty for spawned tasks
+
+		struct FinalAwaiter
+		{
+			inline bool await_ready() const noexcept { return false; }
+
+			template<typename Promise>
+			std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> h) noexcept
+			{
+				std::coroutine_handle<> awaiter = h.promise().awaiter;
+				if (awaiter)
+					return awaiter; // symmetric transfer, no stack growth on long await chains
+
+				h.destroy();
+				return std::noop_coroutine();
+			}
+
+			inline void await_resume() const noexcept {}
+		};
+
+		inline std::suspend_always initial_suspend() const noexcept { return {}; }
+		inline FinalAwaiter final_suspend() const noexcept { return {}; }
+		inline void unhandled_exception() { check(0); }
+	};
+
+	template<typename Promise>
+	inline Continuation MakeContinuation(std::coroutine_handle<Promise> h, ETaskPriority priority = ETaskPriority::Inherit)
+	{
+		static_assert(std::is_base_of_v<PromiseBase, Promise>, "only AsyncTask coroutines can await this");
+		Promise& promise = h.promise();
+		return { h, promise.pool, priority == ETaskPriority::Inherit ? promise.priority : priority };
+	}
+
+}
+
+template<typename T>
+class AsyncTask
+{
+public:
+	struct promise_type : Async::PromiseBase
+	{
+		std::optional<T> value;
+
+		inline AsyncTask get_return_object() { return AsyncTask(std::coroutine_handle<promise_type>::from_promise(*this)); }
+
+		template<typename U>
+		inline void return_value(U&& result) { value.emplace(std::forward<U>(result)); }
+	};
+
+	using Handle = std::coroutine_handle<promise_type>;
+
+	AsyncTask() = default;
+	explicit AsyncTask(Handle handle) : m_Handle(handle) {}
+
+	AsyncTask(AsyncTask&& other) noexcept : m_Handle(std::exchange(other.m_Handle, nullptr)) {}
+	AsyncTask& operator=(AsyncTask&& other) noexcept
+	{
+		if (this != &other)
+		{
+			if (m_Handle)
+				m_Handle.destroy();
+			m_Handle = std::exchange(other.m_Handle, nullptr);
+		}
+		return *this;
+	}
+
+	AsyncTask(const AsyncTask&) = delete;
+	AsyncTask& operator=(const AsyncTask&) = delete;
+
+	~AsyncTask()
+	{
+		if (m_Handle)
+			m_Handle.destroy();
+	}
+
+	inline Handle Release() { return std::exchange(m_Handle, nullptr); }
+
+	// co_await task: starts it right away on the awaiting thread, the awaiter continues when it's done
+	struct Awaiter
+	{
+		Handle handle;
+
+		inline bool await_ready() const noexcept { return false; }
+
+		template<typename Promise>
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> awaiter) noexcept
+		{
+			static_assert(std::is_base_of_v<Async::PromiseBase, Promise>, "only AsyncTask coroutines can await this");
+			handle.promise().pool = awaiter.promise().pool;
+			handle.promise().priority = awaiter.promise().priority;
+			handle.promise().awaiter = awaiter;
+			return handle;
+		}
+
+		T await_resume()
+		{
+			check(handle.promise().value);
+			T result = std::move(*handle.promise().value);
+			handle.destroy();
+			return result;
+		}
+	};
+
+	inline Awaiter operator co_await() && noexcept { return { Release() }; }
+
+private:
+	Handle m_Handle;
+};
+
+template<>
+class AsyncTask<void>
+{
+public:
+	struct promise_type : Async::PromiseBase
+	{
+		inline AsyncTask get_return_object() { return AsyncTask(std::coroutine_handle<promise_type>::from_promise(*this)); }
+		inline void return_void() {}
+	};
+
+	using Handle = std::coroutine_handle<promise_type>;
+
+	AsyncTask() = default;
+	explicit AsyncTask(Handle handle) : m_Handle(handle) {}
+
+	AsyncTask(AsyncTask&& other) noexcept : m_Handle(std::exchange(other.m_Handle, nullptr)) {}
+	AsyncTask& operator=(AsyncTask&& other) noexcept
+	{
+		if (this != &other)
+		{
+			if (m_Handle)
+				m_Handle.destroy();
+			m_Handle = std::exchange(other.m_Handle, nullptr);
+		}
+		return *this;
+	}
+
+	AsyncTask(const AsyncTask&) = delete;
+	AsyncTask& operator=(const AsyncTask&) = delete;
+
+	~AsyncTask()
+	{
+		if (m_Handle)
+			m_Handle.destroy();
+	}
+
+	inline Handle Release() { return std::exchange(m_Handle, nullptr); }
+
+	struct Awaiter
+	{
+		Handle handle;
+
+		inline bool await_ready() const noexcept { return false; }
+
+		template<typename Promise>
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> awaiter) noexcept
+		{
+			static_assert(std::is_base_of_v<Async::PromiseBase, Promise>, "only AsyncTask coroutines can await this");
+			handle.promise().pool = awaiter.promise().pool;
+			handle.promise().priority = awaiter.promise().priority;
+			handle.promise().awaiter = awaiter;
+			return handle;
+		}
+
+		inline void await_resume() { handle.destroy(); }
+	};
+
+	inline Awaiter operator co_await() && noexcept { return { Release() }; }
+
+private:
+	Handle m_Handle;
+};
+
+namespace Async {
+
+	// runs the task on the pool, it deletes itself when done. the ref is the one of the first step (for Reprioritize)
+	TaskPool::TaskRef Spawn(TaskPool& pool, AsyncTask<> task, ETaskPriority priority = ETaskPriority::Inherit);
+
+	// same as Spawn() but the first step runs right away on the calling thread, the next ones on the pool
+	void Start(TaskPool& pool, AsyncTask<> task, ETaskPriority priority = ETaskPriority::Inherit);
+
+	// continues on a worker of the pool the coroutine runs on. a priority other than Inherit sticks for the next awaits
+	struct RunOnWorker
+	{
+		ETaskPriority priority = ETaskPriority::Inherit;
+
+		inline bool await_ready() const noexcept { return false; }
+
+		template<typename Promise>
+		void await_suspend(std::coroutine_handle<Promise> h)
+		{
+			if (priority != ETaskPriority::Inherit)
+				h.promise().priority = priority;
+
+			Continuation continuation = MakeContinuation(h);
+			check(continuation.pool); // awaited outside of a pool
+			continuation.Schedule();
+		}
+
+		inline void await_resume() const noexcept {}
+	};
+
+	// a coroutine waiting for the main thread. lives in the awaiter, so in the coroutine frame: posting never allocates
+	struct MainThreadNode
+	{
+		std::coroutine_handle<> handle;
+		MainThreadNode* next = nullptr;
+	};
+
+	// lock free, any thread. the node must stay alive until it's resumed
+	void PostToMainThread(MainThreadNode* node);
+
+	// continues on the main thread at the start of the next frame (RunMainThreadQueue())
+	struct NextFrame
+	{
+		MainThreadNode node;
+
+		inline bool await_ready() const noexcept { return false; }
+
+		template<typename Promise>
+		void await_suspend(std::coroutine_handle<Promise> h)
+		{
+			static_assert(std::is_base_of_v<PromiseBase, Promise>, "only AsyncTask coroutines can await this");
+			node.handle = h;
+			PostToMainThread(&node);
+		}
+
+		inline void await_resume() const noexcept {}
+	};
+
+	// main thread, once per frame: resumes everything posted before the call in posting order, what gets posted
+	// meanwhile waits for the next one. a single atomic load when nothing is waiting
+	u32 RunMainThreadQueue();
+
+}
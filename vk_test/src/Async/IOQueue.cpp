@@ -0,0 +1,261 @@
+#include "IOQueue.h"
+#include "Core/CpuTopology.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+static inline u64 NowUs()
+{
+	using namespace std::chrono;
+	return (u64)duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+IOBuffer& IOBuffer::operator=(IOBuffer&& other) noexcept
+{
+	if (this != &other)
+	{
+		Reset();
+		m_Data = std::exchange(other.m_Data, nullptr);
+		m_Size = std::exchange(other.m_Size, 0);
+		m_Owner = std::exchange(other.m_Owner, nullptr);
+		m_Charged = std::exchange(other.m_Charged, 0);
+	}
+	return *this;
+}
+
+void IOBuffer::Reset()
+{
+	free(m_Data);
+	m_Data = nullptr;
+	m_Size = 0;
+
+	if (m_Owner)
+		m_Owner->Release(m_Charged);
+
+	m_Owner = nullptr;
+	m_Charged = 0;
+}
+
+IOBuffer IOBuffer::Allocate(u64 size)
+{
+	IOBuffer buffer;
+	buffer.m_Data = static_cast<u8*>(malloc(size + IO_BUFFER_PADDING));
+	check(buffer.m_Data);
+	buffer.m_Size = size;
+	memset(buffer.m_Data + size, 0, IO_BUFFER_PADDING);
+	return buffer;
+}
+
+static bool ReadWholeFile(const std::filesystem::path& path, IOBuffer& outBuffer)
+{
+	FILE* file;
+	errno_t err = _wfopen_s(&file, path.c_str(), L"rb");
+	if (err)
+	{
+		LOG_ERR("Unable to open file: %ls", path.c_str());
+		return false;
+	}
+
+	_fseeki64(file, 0, SEEK_END);
+	s64 size = _ftelli64(file);
+	_fseeki64(file, 0, SEEK_SET);
+
+	bool ok = size > 0;
+	if (ok)
+	{
+		outBuffer = IOBuffer::Allocate((u64)size);
+		size_t read = fread(outBuffer.Data(), 1, (size_t)size, file);
+		if (read != (size_t)size)
+		{
+			LOG_ERR("Short read on file: %ls (%zu of %lld bytes)", path.c_str(), read, size);
+			outBuffer.Reset();
+			ok = false;
+		}
+	}
+
+	fclose(file);
+	return ok;
+}
+
+IOQueue::~IOQueue()
+{
+	Stop();
+}
+
+void IOQueue::Start(const IOQueueConfig& config)
+{
+	check(m_Threads.empty());
+	check(config.threadCount > 0);
+
+	m_Config = config;
+	m_Stop = false;
+
+	m_Threads.reserve(config.threadCount);
+	for (u32 i = 0; i < config.threadCount; i++)
+	{
+		m_Threads.emplace_back([this]() { IOThreadLoop(); });
+		ResetThreadAffinity(m_Threads.back());
+	}
+}
+
+void IOQueue::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+		m_Stop = true;
+	}
+	m_CondVar.notify_all();
+
+	for (std::thread& thread : m_Threads)
+	{
+		if (thread.joinable())
+			thread.join();
+	}
+	m_Threads.clear();
+
+	// never started, their callbacks are dropped
+	m_Requests.clear();
+}
+
+void IOQueue::Read(std::filesystem::path path, ETaskPriority priority, const void* tag, Callback&& onComplete)
+{
+	// the size decides when the request fits in the budget, stat it here and not under the lock
+	std::error_code error;
+	u64 size = (u64)std::filesystem::file_size(path, error);
+
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+
+		Request& request = m_Requests.emplace_back();
+		request.path = std::move(path);
+		request.size = error ? 0 : size;
+		request.priority = priority == ETaskPriority::Inherit ? TaskPool::GetCurrentPriority() : priority;
+		request.tag = tag;
+		request.sequence = m_NextSequence++;
+		request.onComplete = std::move(onComplete);
+	}
+
+	m_CondVar.notify_one();
+}
+
+void IOQueue::SetPriority(const void* tag, ETaskPriority priority)
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	for (Request& request : m_Requests)
+	{
+		if (request.tag == tag)
+			request.priority = priority;
+	}
+}
+
+IOBuffer IOQueue::ReadFileNow(const std::filesystem::path& path)
+{
+	IOBuffer buffer;
+	ReadWholeFile(path, buffer);
+	return buffer;
+}
+
+bool IOQueue::PickRequest(Request& outRequest)
+{
+	if (m_Requests.empty())
+		return false;
+
+	size_t best = 0;
+	for (size_t i = 1; i < m_Requests.size(); i++)
+	{
+		const Request& candidate = m_Requests[i];
+		const Request& current = m_Requests[best];
+		if (candidate.priority < current.priority || (candidate.priority == current.priority && candidate.sequence < current.sequence))
+			best = i;
+	}
+
+	Request& request = m_Requests[best];
+	if (m_InFlightBytes > 0 && m_InFlightBytes + request.size > m_Config.maxInFlightBytes)
+	{
+		// the decode side is behind, wait for it to release some buffers
+		if (!m_StallStartUs)
+			m_StallStartUs = NowUs();
+		return false;
+	}
+
+	if (m_StallStartUs)
+	{
+		m_BudgetStallUs.fetch_add(NowUs() - m_StallStartUs, std::memory_order_relaxed);
+		m_StallStartUs = 0;
+	}
+
+	m_InFlightBytes += request.size;
+	outRequest = std::move(request);
+
+	if (best != m_Requests.size() - 1)
+		request = std::move(m_Requests.back());
+	m_Requests.pop_back();
+	return true;
+}
+
+void IOQueue::Release(u64 bytes)
+{
+	if (!bytes)
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+		check(m_InFlightBytes >= bytes);
+		m_InFlightBytes -= bytes;
+	}
+	m_CondVar.notify_all();
+}
+
+void IOQueue::IOThreadLoop()
+{
+	while (true)
+	{
+		Request request;
+		{
+			std::unique_lock<std::mutex> lock(m_Lock);
+			m_CondVar.wait(lock, [this, &request]() { return m_Stop || PickRequest(request); });
+
+			if (m_Stop)
+				break;
+		}
+
+		u64 startUs = NowUs();
+		IOBuffer buffer;
+		ReadWholeFile(request.path, buffer);
+		m_BusyUs.fetch_add(NowUs() - startUs, std::memory_order_relaxed);
+
+		m_RequestCount.fetch_add(1, std::memory_order_relaxed);
+		m_BytesRead.fetch_add(buffer.Size(), std::memory_order_relaxed);
+
+		// the buffer gives the charged bytes back when the decode stage is done with it
+		if (buffer.IsEmpty())
+		{
+			Release(request.size);
+		}
+		else
+		{
+			buffer.m_Owner = this;
+			buffer.m_Charged = request.size;
+		}
+
+		request.onComplete(std::move(buffer));
+	}
+}
+
+IOQueueStats IOQueue::GetStats() const
+{
+	IOQueueStats stats;
+	stats.requests = m_RequestCount.load(std::memory_order_relaxed);
+	stats.bytesRead = m_BytesRead.load(std::memory_order_relaxed);
+	stats.busyUs = m_BusyUs.load(std::memory_order_relaxed);
+	stats.threadCount = (u32)m_Threads.size();
+
+	std::lock_guard<std::mutex> lock(m_Lock);
+	stats.budgetStallUs = m_BudgetStallUs.load(std::memory_order_relaxed) + (m_StallStartUs ? NowUs() - m_StallStartUs : 0);
+	stats.inFlightBytes = m_InFlightBytes;
+	stats.queuedRequests = m_Requests.size();
+	return stats;
+}
@@ -0,0 +1,163 @@
+#pragma once
+
+#include "Core/CoreMinimal.h"
+#include "Misc/InplaceFunction.h"
+#include "TaskPool.h"
+#include "AsyncTask.h"
+
+#include <filesystem>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <atomic>
+
+class IOQueue;
+
+// zeroed bytes after the end of every buffer, parsers like simdjson read a bit past the data (SIMDJSON_PADDING)
+constexpr u64 IO_BUFFER_PADDING = 64;
+
+// a whole file in memory. move only, counts against the in-flight budget of its queue until it's destroyed or Reset()
+class IOBuffer
+{
+public:
+	IOBuffer() = default;
+	~IOBuffer() { Reset(); }
+
+	IOBuffer(IOBuffer&& other) noexcept { *this = std::move(other); }
+	IOBuffer& operator=(IOBuffer&& other) noexcept;
+
+	IOBuffer(const IOBuffer&) = delete;
+	IOBuffer& operator=(const IOBuffer&) = delete;
+
+	// frees the memory and gives the bytes back to the queue budget
+	void Reset();
+
+	static IOBuffer Allocate(u64 size);
+
+	inline u8* Data() { return m_Data; }
+	inline const u8* Data() const { return m_Data; }
+	inline u64 Size() const { return m_Size; }
+	inline bool IsEmpty() const { return m_Size == 0; }
+
+private:
+	friend class IOQueue;
+
+	u8* m_Data = nullptr;
+	u64 m_Size = 0;
+	IOQueue* m_Owner = nullptr;
+	u64 m_Charged = 0; // bytes taken from the owner budget
+};
+
+struct IOQueueConfig
+{
+	u32 threadCount = 2;                          // blocking reads, a couple of threads keep a disk queue busy
+	u64 maxInFlightBytes = 256ull * 1024 * 1024;  // read or being read, not yet released by the decode stage
+};
+
+struct IOQueueStats
+{
+	u64 requests = 0;
+	u64 bytesRead = 0;
+	u64 busyUs = 0;          // summed over the io threads, time spent inside reads
+	u64 budgetStallUs = 0;   // time the next request waited for decoded buffers to be released
+	u64 inFlightBytes = 0;
+	u64 queuedRequests = 0;
+	u32 threadCount = 0;
+};
+
+// the disk side of the loading pipeline: a few threads doing blocking whole file reads, so the decode workers never
+// sit on the disk. the completion callback runs on the io thread and should just hand the buffer to a TaskPool.
+// the highest priority request goes first (fifo inside a class); a request only starts if its file fits in the
+// in-flight budget, or if nothing else is in flight so a file bigger than the budget can't block the queue forever
+class IOQueue
+{
+public:
+	using Callback = InplaceFunction<void(IOBuffer&&), 48>;
+
+	IOQueue() = default;
+	~IOQueue();
+
+	IOQueue(const IOQueue&) = delete;
+	IOQueue& operator=(const IOQueue&) = delete;
+
+	void Start(const IOQueueConfig& config);
+	void Stop();
+
+	// onComplete gets an empty buffer if the file can't be read. tag is for SetPriority() (the asset pointer)
+	void Read(std::filesystem::path path, ETaskPriority priority, const void* tag, Callback&& onComplete);
+
+	// moves the queued reads with this tag to another priority, no-op for the ones already reading
+	void SetPriority(const void* tag, ETaskPriority priority);
+
+	// co_await queue.ReadAsync(path): the coroutine continues on its pool with the file in memory
+	struct ReadAwaiter
+	{
+		IOQueue* queue;
+		std::filesystem::path path;
+		ETaskPriority priority;
+		const void* tag;
+		IOBuffer result;
+
+		inline bool await_ready() const noexcept { return false; }
+
+		template<typename Promise>
+		void await_suspend(std::coroutine_handle<Promise> h)
+		{
+			Async::Continuation continuation = Async::MakeContinuation(h, priority);
+
+			// the awaiter lives in the suspended coroutine frame until it's resumed
+			queue->Read(std::move(path), continuation.priority, tag, [this, continuation](IOBuffer&& buffer) {
+				result = std::move(buffer);
+				continuation.Schedule();
+			});
+		}
+
+		inline IOBuffer await_resume() { return std::move(result); }
+	};
+
+	inline ReadAwaiter ReadAsync(std::filesystem::path path, ETaskPriority priority = ETaskPriority::Inherit, const void* tag = nullptr)
+	{
+		return { this, std::move(path), priority, tag, {} };
+	}
+
+	// blocking read on the calling thread, not counted in any budget
+	static IOBuffer ReadFileNow(const std::filesystem::path& path);
+
+	IOQueueStats GetStats() const;
+	inline const IOQueueConfig& GetConfig() const { return m_Config; }
+
+private:
+	struct Request
+	{
+		std::filesystem::path path;
+		u64 size = 0; // from the file system when queued, the budget is charged with it
+		ETaskPriority priority = ETaskPriority::Visible;
+		const void* tag = nullptr;
+		u64 sequence = 0;
+		Callback onComplete;
+	};
+
+	void IOThreadLoop();
+	bool PickRequest(Request& outRequest); // m_Lock held
+	void Release(u64 bytes);
+
+private:
+	friend class IOBuffer;
+
+	IOQueueConfig m_Config;
+	std::vector<std::thread> m_Threads;
+
+	mutable std::mutex m_Lock;
+	std::condition_variable m_CondVar;
+	std::vector<Request> m_Requests;
+	u64 m_InFlightBytes = 0; // charged by requests being read + buffers not released yet
+	u64 m_NextSequence = 0;
+	u64 m_StallStartUs = 0;  // 0 = the queue is not waiting for budget
+	bool m_Stop = false;
+
+	std::atomic<u64> m_RequestCount = 0;
+	std::atomic<u64> m_BytesRead = 0;
+	std::atomic<u64> m_BusyUs = 0;
+	std::atomic<u64> m_BudgetStallUs = 0;
+};
@@ -0,0 +1,165 @@
+#include "MemoryBudget.h"
+
+#include <algorithm>
+#include <chrono>
+
+static inline u64 NowUs()
+{
+	using namespace std::chrono;
+	return (u64)duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+void MemoryBudget::SetLimit(u64 limitBytes)
+{
+	std::vector<Callback> granted;
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+		m_LimitBytes.store(limitBytes, std::memory_order_relaxed);
+		GrantWaiting(granted);
+	}
+	RunGranted(granted);
+}
+
+void MemoryBudget::Acquire(u64 bytes, ETaskPriority priority, const void* tag, Callback&& onGranted)
+{
+	std::vector<Callback> granted;
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+
+		if (m_Waiting.empty() && Fits(bytes))
+		{
+			Charge(bytes);
+		}
+		else
+		{
+			// queued behind the others, it might still be the most urgent one
+			u64 sequence = m_NextSequence++;
+
+			Request& request = m_Waiting.emplace_back();
+			request.bytes = bytes;
+			request.priority = priority == ETaskPriority::Inherit ? TaskPool::GetCurrentPriority() : priority;
+			request.tag = tag;
+			request.sequence = sequence;
+			request.queuedAtUs = NowUs();
+			request.onGranted = std::move(onGranted);
+
+			GrantWaiting(granted);
+
+			for (const Request& waiting : m_Waiting)
+			{
+				if (waiting.sequence == sequence)
+				{
+					m_DeferredCount++;
+					break;
+				}
+			}
+		}
+	}
+
+	// empty if it went in the queue
+	if (onGranted)
+		onGranted();
+	RunGranted(granted);
+}
+
+void MemoryBudget::SetPriority(const void* tag, ETaskPriority priority)
+{
+	std::vector<Callback> granted;
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+		for (Request& request : m_Waiting)
+		{
+			if (request.tag == tag)
+				request.priority = priority;
+		}
+
+		// the new head of the queue might fit where the old one didn't
+		GrantWaiting(granted);
+	}
+	RunGranted(granted);
+}
+
+void MemoryBudget::Adjust(s64 deltaBytes)
+{
+	if (!deltaBytes)
+		return;
+
+	std::vector<Callback> granted;
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+		if (deltaBytes > 0)
+		{
+			Charge((u64)deltaBytes);
+			return;
+		}
+
+		check(m_UsedBytes >= (u64)-deltaBytes);
+		m_UsedBytes -= (u64)-deltaBytes;
+		GrantWaiting(granted);
+	}
+	RunGranted(granted);
+}
+
+void MemoryBudget::Charge(u64 bytes)
+{
+	m_UsedBytes += bytes;
+	m_PeakUsedBytes = std::max(m_PeakUsedBytes, m_UsedBytes);
+}
+
+void MemoryBudget::GrantWaiting(std::vector<Callback>& outGranted)
+{
+	u64 nowUs = 0;
+
+	while (!m_Waiting.empty())
+	{
+		size_t best = 0;
+		for (size_t i = 1; i < m_Waiting.size(); i++)
+		{
+			const Request& candidate = m_Waiting[i];
+			const Request& current = m_Waiting[best];
+			if (candidate.priority < current.priority || (candidate.priority == current.priority && candidate.sequence < current.sequence))
+				best = i;
+		}
+
+		Request& request = m_Waiting[best];
+		if (!Fits(request.bytes))
+			break;
+
+		if (!nowUs)
+			nowUs = NowUs();
+
+		Charge(request.bytes);
+		m_WaitUs += nowUs - request.queuedAtUs;
+		outGranted.push_back(std::move(request.onGranted));
+
+		if (best != m_Waiting.size() - 1)
+			request = std::move(m_Waiting.back());
+		m_Waiting.pop_back();
+	}
+}
+
+void MemoryBudget::RunGranted(std::vector<Callback>& granted)
+{
+	for (Callback& onGranted : granted)
+		onGranted();
+}
+
+MemoryBudgetStats MemoryBudget::GetStats() const
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+
+	MemoryBudgetStats stats;
+	stats.limitBytes = m_LimitBytes.load(std::memory_order_relaxed);
+	stats.usedBytes = m_UsedBytes;
+	stats.peakUsedBytes = m_PeakUsedBytes;
+	stats.waitingRequests = m_Waiting.size();
+	stats.deferredRequests = m_DeferredCount;
+	stats.waitUs = m_WaitUs;
+	return stats;
+}
+
+void MemoryBudget::ResetPeak()
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	m_PeakUsedBytes = m_UsedBytes;
+}
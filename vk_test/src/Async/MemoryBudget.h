@@ -0,0 +1,81 @@
+#pragma once
+
+#include "Core/CoreMinimal.h"
+#include "Misc/InplaceFunction.h"
+#include "TaskPool.h"
+
+#include <mutex>
+#include <vector>
+#include <atomic>
+
+struct MemoryBudgetStats
+{
+	u64 limitBytes = 0;
+	u64 usedBytes = 0;
+	u64 peakUsedBytes = 0;     // since the last ResetPeak()
+	u64 waitingRequests = 0;
+	u64 deferredRequests = 0;  // total requests that had to wait for memory
+	u64 waitUs = 0;            // summed over the requests, time between Acquire() and the grant
+};
+
+// counts bytes held by loads that are not done yet and defers the ones that would go over the limit.
+// nothing blocks: a deferred request keeps its callback and it runs when enough memory is given back, on the
+// thread that gave it back. the highest priority request goes first (fifo inside a class) and the ones behind it
+// wait even if they would fit, so a big load can't be starved by small ones. a request bigger than the whole
+// budget is granted when nothing else is held
+class MemoryBudget
+{
+public:
+	using Callback = InplaceFunction<void(), 64>;
+
+	explicit MemoryBudget(u64 limitBytes = ~0ull) : m_LimitBytes(limitBytes) {}
+
+	MemoryBudget(const MemoryBudget&) = delete;
+	MemoryBudget& operator=(const MemoryBudget&) = delete;
+
+	// a bigger limit grants the requests that fit now, a smaller one only affects the next grants
+	void SetLimit(u64 limitBytes);
+	inline u64 GetLimit() const { return m_LimitBytes.load(std::memory_order_relaxed); }
+
+	// onGranted runs inline if the bytes fit right away. tag is for SetPriority() (the asset pointer)
+	void Acquire(u64 bytes, ETaskPriority priority, const void* tag, Callback&& onGranted);
+
+	// moves the waiting requests with this tag to another priority, no-op for the granted ones
+	void SetPriority(const void* tag, ETaskPriority priority);
+
+	// resizes a granted charge without waiting (an estimate turning into the real size). a negative delta gives
+	// memory back and may grant waiting requests
+	void Adjust(s64 deltaBytes);
+	inline void Release(u64 bytes) { Adjust(-(s64)bytes); }
+
+	MemoryBudgetStats GetStats() const;
+	void ResetPeak();
+
+private:
+	struct Request
+	{
+		u64 bytes = 0;
+		ETaskPriority priority = ETaskPriority::Visible;
+		const void* tag = nullptr;
+		u64 sequence = 0;
+		u64 queuedAtUs = 0;
+		Callback onGranted;
+	};
+
+	inline bool Fits(u64 bytes) const { return m_UsedBytes == 0 || m_UsedBytes + bytes <= m_LimitBytes.load(std::memory_order_relaxed); }
+	void Charge(u64 bytes); // m_Lock held
+
+	// grants what fits in priority order, the callbacks are run by the caller outside of the lock
+	void GrantWaiting(std::vector<Callback>& outGranted); // m_Lock held
+	static void RunGranted(std::vector<Callback>& granted);
+
+private:
+	mutable std::mutex m_Lock;
+	std::vector<Request> m_Waiting;
+	std::atomic<u64> m_LimitBytes;
+	u64 m_UsedBytes = 0;
+	u64 m_PeakUsedBytes = 0;
+	u64 m_NextSequence = 0;
+	u64 m_DeferredCount = 0;
+	u64 m_WaitUs = 0;
+};
@@ -0,0 +1,182 @@
+#pragma once
+
+#include "Core/CoreMinimal.h"
+#include "Core/Platform.h"
+
+#include <atomic>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+// bounded lock free queues over a power of 2 ring, allocated once. nothing blocks: a push on a full ring or a pop on an
+// empty one just fails, what to do then (drop, yield, sleep) is up to the caller. the producer and consumer indices sit
+// on their own cache lines, the two sides only share the slots they hand over.
+
+// many producers, one consumer (Vyukov's bounded queue with a single reader). every slot carries a sequence number:
+// a producer claims a ticket with one CAS on the tail, writes the slot and publishes it by bumping its sequence.
+// FIFO in ticket order: a producer preempted between the claim and the publish holds back the items behind it
+// until it's done (TryPop() says empty meanwhile)
+template<typename T>
+class MPSCRing
+{
+	struct Slot
+	{
+		std::atomic<u64> sequence;
+		T value;
+	};
+
+public:
+	explicit MPSCRing(u32 capacity)
+		: m_Slots(std::make_unique<Slot[]>(capacity))
+		, m_Mask(capacity - 1)
+	{
+		// here and not at class scope, T can be a nested struct of a class that's still incomplete there
+		static_assert(std::is_default_constructible_v<T> && std::is_move_assignable_v<T>, "MPSCRing stores default constructible, movable values");
+		check(capacity > 0 && (capacity & (capacity - 1)) == 0); // power of 2
+		for (u32 i = 0; i < capacity; i++)
+			m_Slots[i].sequence.store(i, std::memory_order_relaxed);
+	}
+
+	MPSCRing(const MPSCRing&) = delete;
+	MPSCRing& operator=(const MPSCRing&) = delete;
+
+	// any thread. false if full
+	template<typename U>
+	bool TryPush(U&& value)
+	{
+		u64 tail = m_Tail.load(std::memory_order_relaxed);
+		Slot* slot;
+		while (true)
+		{
+			slot = &m_Slots[tail & m_Mask];
+			u64 sequence = slot->sequence.load(std::memory_order_acquire);
+			s64 diff = (s64)(sequence - tail);
+
+			if (diff == 0)
+			{
+				// free slot for this ticket, claim it
+				if (m_Tail.compare_exchange_weak(tail, tail + 1, std::memory_order_relaxed, std::memory_order_relaxed))
+					break;
+			}
+			else if (diff < 0)
+			{
+				// the consumer hasn't freed it since the last lap
+				return false;
+			}
+			else
+			{
+				// another producer got the ticket first
+				tail = m_Tail.load(std::memory_order_relaxed);
+			}
+		}
+
+		slot->value = std::forward<U>(value);
+		slot->sequence.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	// consumer only. false if empty
+	bool TryPop(T& outValue)
+	{
+		Slot& slot = m_Slots[m_Head & m_Mask];
+		if (slot.sequence.load(std::memory_order_acquire) != m_Head + 1)
+			return false;
+
+		outValue = std::move(slot.value);
+
+		// free for the producers of the next lap
+		slot.sequence.store(m_Head + m_Mask + 1, std::memory_order_release);
+		m_Head++;
+		return true;
+	}
+
+	inline u32 GetCapacity() const { return (u32)(m_Mask + 1); }
+
+private:
+	std::unique_ptr<Slot[]> m_Slots;
+	u64 m_Mask;
+
+	alignas(CACHELINE_SIZE) std::atomic<u64> m_Tail = 0; // producers
+	alignas(CACHELINE_SIZE) u64 m_Head = 0;              // consumer only
+};
+
+// one producer, one consumer. each side keeps a copy of the other one's index and only reloads it when the ring looks
+// full (or empty), so a steady stream costs no cache line ping-pong per item
+template<typename T>
+class SPSCRing
+{
+public:
+	explicit SPSCRing(u32 capacity)
+		: m_Items(std::make_unique<T[]>(capacity))
+		, m_Mask(capacity - 1)
+	{
+		static_assert(std::is_default_constructible_v<T> && std::is_move_assignable_v<T>, "SPSCRing stores default constructible, movable values");
+		check(capacity > 0 && (capacity & (capacity - 1)) == 0); // power of 2
+	}
+
+	SPSCRing(const SPSCRing&) = delete;
+	SPSCRing& operator=(const SPSCRing&) = delete;
+
+	// producer only. false if full
+	template<typename U>
+	bool TryPush(U&& value)
+	{
+		u64 tail = m_Tail.load(std::memory_order_relaxed);
+		if (tail - m_CachedHead > m_Mask)
+		{
+			m_CachedHead = m_Head.load(std::memory_order_acquire);
+			if (tail - m_CachedHead > m_Mask)
+				return false;
+		}
+
+		m_Items[tail & m_Mask] = std::forward<U>(value);
+		m_Tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	// consumer only. the oldest item, left in the ring, nullptr if empty
+	T* Peek()
+	{
+		u64 head = m_Head.load(std::memory_order_relaxed);
+		if (head == m_CachedTail)
+		{
+			m_CachedTail = m_Tail.load(std::memory_order_acquire);
+			if (head == m_CachedTail)
+				return nullptr;
+		}
+
+		return &m_Items[head & m_Mask];
+	}
+
+	// consumer only, after a Peek() that returned an item
+	void Pop()
+	{
+		u64 head = m_Head.load(std::memory_order_relaxed);
+		check(head != m_CachedTail);
+		m_Head.store(head + 1, std::memory_order_release);
+	}
+
+	// consumer only. false if empty
+	bool TryPop(T& outValue)
+	{
+		T* item = Peek();
+		if (!item)
+			return false;
+
+		outValue = std::move(*item);
+		Pop();
+		return true;
+	}
+
+	inline u32 GetCapacity() const { return (u32)(m_Mask + 1); }
+
+private:
+	std::unique_ptr<T[]> m_Items;
+	u64 m_Mask;
+
+	alignas(CACHELINE_SIZE) std::atomic<u64> m_Head = 0; // written by the consumer
+	u64 m_CachedTail = 0;                                 // consumer only
+
+	alignas(CACHELINE_SIZE) std::atomic<u64> m_Tail = 0; // written by the producer
+	u64 m_CachedHead = 0;                                 // producer only
+};
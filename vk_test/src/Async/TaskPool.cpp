@@ -0,0 +1,781 @@
+#include "TaskPool.h"
+
+#include <algorithm>
+#include <chrono>
+
+// spin a little before parking, a task usually shows up right after another one
+constexpr u32 IDLE_SPIN_ROUNDS = 32;
+
+static thread_local const TaskPool* s_CurrentPool = nullptr;
+static thread_local s32 s_CurrentWorkerIndex = -1;
+static thread_local u32 s_ExternalRngState = 0x2545F491u; // stealing from threads that aren't workers
+static thread_local ETaskPriority s_CurrentPriority = ETaskPriority::Visible;
+static thread_local u64 s_ClaimTimeMs = 0; // clock of the last starvation check, 0 when nothing could starve
+
+static inline u32 XorShift(u32& state)
+{
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+static inline u64 NowMs()
+{
+	using namespace std::chrono;
+	return (u64)duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+static inline u64 NowUs()
+{
+	using namespace std::chrono;
+	return (u64)duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+TaskPool::~TaskPool()
+{
+	Stop();
+	FreePendingTasks();
+}
+
+void TaskPool::Start(u32 threadCount)
+{
+	TaskPoolConfig config;
+	config.threadCount = threadCount;
+	config.pinThreads = false;
+	Start(config);
+}
+
+u32 TaskPool::ResolveThreadCount(const TaskPoolConfig& config)
+{
+	if (config.threadCount)
+		return config.threadCount;
+
+	const CpuTopology& topology = GetCpuTopology();
+	u32 coreCount = topology.GetPhysicalCoreCount();
+	u32 freeCores = coreCount > config.firstCore ? coreCount - config.firstCore : 1;
+
+	u32 threadCount = config.useSmt ? freeCores * topology.GetSmtWidth() : freeCores;
+	if (config.maxThreads)
+		threadCount = std::min(threadCount, config.maxThreads);
+
+	return std::max(threadCount, 1u);
+}
+
+void TaskPool::Start(const TaskPoolConfig& config)
+{
+	check(!m_Workers);
+
+	u32 threadCount = ResolveThreadCount(config);
+
+	m_NumWorkers = threadCount;
+	m_Workers = std::make_unique<WorkerState[]>(threadCount);
+	m_Stop = false;
+	m_StartUs = NowUs();
+
+	// neighbouring workers on neighbouring cores, so they steal from someone sharing their l3 first
+	const CpuTopology& topology = GetCpuTopology();
+	u32 coreCount = topology.GetPhysicalCoreCount();
+	u32 firstCore = config.firstCore < coreCount ? config.firstCore : 0;
+	u32 freeCores = coreCount - firstCore;
+
+	u32 pinnedCount = 0;
+	for (u32 i = 0; i < threadCount; i++)
+	{
+		m_Workers[i].rngState = 0x9E3779B9u * (i + 1);
+		m_Workers[i].context.threadIndex = (int)i;
+		m_Workers[i].context.scratch.Init(WORKER_SCRATCH_SIZE);
+		m_Workers[i].thread = std::thread([this, i]() { WorkerLoop(i); });
+
+		if (config.pinThreads)
+		{
+			u32 core = firstCore + i % freeCores;
+			if (SetThreadAffinity(m_Workers[i].thread, topology.GetCoreCpus(core)))
+				pinnedCount++;
+		}
+		else
+		{
+			// floating over every cpu, not the one of the thread starting the pool
+			ResetThreadAffinity(m_Workers[i].thread);
+		}
+	}
+
+	if (config.pinThreads)
+	{
+		LOG_INFO("TaskPool: %u workers, %u pinned on cores %u..%u of %u", threadCount, pinnedCount,
+			firstCore, firstCore + std::min(threadCount, freeCores) - 1, coreCount);
+	}
+}
+
+void TaskPool::RequestStop()
+{
+	m_Stop.store(true, std::memory_order_seq_cst);
+	m_WakeEpoch.fetch_add(1, std::memory_order_seq_cst);
+	m_WakeEpoch.notify_all();
+}
+
+void TaskPool::Stop()
+{
+	RequestStop();
+
+	for (u32 i = 0; i < m_NumWorkers; i++)
+	{
+		if (m_Workers[i].thread.joinable())
+			m_Workers[i].thread.join();
+	}
+}
+
+s32 TaskPool::GetCurrentWorkerIndex() const
+{
+	return s_CurrentPool == this ? s_CurrentWorkerIndex : -1;
+}
+
+ETaskPriority TaskPool::GetCurrentPriority()
+{
+	return s_CurrentPriority;
+}
+
+TaskPoolStats TaskPool::GetStats() const
+{
+	TaskPoolStats stats;
+	stats.enqueuedTasks = m_ExternalEnqueued.load(std::memory_order_relaxed);
+	stats.heapAllocations = m_HeapAllocations.load(std::memory_order_relaxed);
+	stats.reprioritizedTasks = m_Reprioritized.load(std::memory_order_relaxed);
+
+	for (u32 i = 0; i < m_NumWorkers; i++)
+	{
+		stats.enqueuedTasks += m_Workers[i].enqueuedTasks.load(std::memory_order_relaxed);
+		stats.executedTasks += m_Workers[i].executedTasks.load(std::memory_order_relaxed);
+		stats.stolenTasks += m_Workers[i].stolenTasks.load(std::memory_order_relaxed);
+		stats.parkCount += m_Workers[i].parkCount.load(std::memory_order_relaxed);
+		stats.promotedTasks += m_Workers[i].promotedTasks.load(std::memory_order_relaxed);
+		stats.parkedUs += m_Workers[i].parkedUs.load(std::memory_order_relaxed);
+	}
+
+	u64 nowUs = NowUs();
+	for (u32 i = 0; i < m_NumWorkers; i++)
+	{
+		u64 parkedSinceUs = m_Workers[i].parkedSinceUs.load(std::memory_order_relaxed);
+		if (parkedSinceUs)
+			stats.parkedUs += nowUs - std::min(nowUs, parkedSinceUs);
+	}
+
+	stats.uptimeUs = m_NumWorkers ? nowUs - m_StartUs : 0;
+	stats.workerCount = m_NumWorkers;
+	return stats;
+}
+
+void TaskPool::Precede(TaskHandle before, TaskHandle after)
+{
+	check(before && after);
+	check(!before->submitted); // it could be already running, too late to wire it
+	check(!after->submitted);
+
+	if (before->successorCount < INLINE_SUCCESSORS)
+	{
+		before->successors[before->successorCount++] = after;
+	}
+	else
+	{
+		if (before->overflowSuccessors.size() == before->overflowSuccessors.capacity())
+			m_HeapAllocations.fetch_add(1, std::memory_order_relaxed);
+
+		before->overflowSuccessors.push_back(after);
+	}
+
+	after->pendingCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+void TaskPool::Submit(TaskHandle task)
+{
+	check(!task->submitted);
+	task->submitted = true;
+	Release(task);
+}
+
+TaskPool::TaskRef TaskPool::GetRef(TaskHandle task) const
+{
+	check(task && !task->submitted);
+
+	if (task->poolIndex == INVALID_NODE)
+		return (TaskRef)(uintptr_t)task | STANDALONE_REF_BIT;
+
+	u32 generation = StateGeneration(task->state.load(std::memory_order_relaxed));
+	return ((TaskRef)generation << 32) | (task->poolIndex + 1);
+}
+
+TaskPool::TaskNode* TaskPool::NodeFromRef(TaskRef ref) const
+{
+	if (ref & STANDALONE_REF_BIT)
+		return (TaskNode*)(uintptr_t)(ref & ~STANDALONE_REF_BIT);
+
+	return NodeAt((u32)ref - 1);
+}
+
+bool TaskPool::Reprioritize(TaskRef ref, ETaskPriority priority)
+{
+	check(priority != ETaskPriority::Inherit);
+
+	// standalone nodes are deleted after running, a second reference would dangle
+	if (ref == INVALID_TASK_REF || (ref & STANDALONE_REF_BIT))
+		return false;
+
+	TaskNode* node = NodeFromRef(ref);
+	u32 generation = (u32)(ref >> 32);
+	u32 lane = (u32)priority;
+
+	u64 state = node->state.load(std::memory_order_seq_cst);
+	while (true)
+	{
+		// recycled, running or done: too late
+		ENodeState kind = StateKind(state);
+		if (StateGeneration(state) != generation || (kind != NodePending && kind != NodeQueued))
+			return false;
+
+		if (StatePriority(state) == lane)
+			return true;
+
+		if (node->state.compare_exchange_weak(state, MakeState(generation, lane, kind), std::memory_order_seq_cst))
+			break;
+	}
+
+	// still waiting for its predecessors: Schedule() picks the new lane up.
+	// already queued: queue it again in the new lane, the first reference that gets claimed wins
+	if (StateKind(state) == NodeQueued)
+	{
+		PushRef(ref, lane);
+		WakeOne();
+	}
+
+	m_Reprioritized.fetch_add(1, std::memory_order_relaxed);
+	return true;
+}
+
+void TaskPool::Release(TaskNode* node)
+{
+	if (node->pendingCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		Schedule(node);
+}
+
+void TaskPool::Schedule(TaskNode* node)
+{
+	check(m_NumWorkers > 0);
+
+	// pending -> queued (+1 on the state byte), the lane is read in the same atomic so a concurrent Reprioritize() is never lost
+	static_assert(NodeQueued == NodePending + 1);
+	u64 state = node->state.fetch_add(1, std::memory_order_seq_cst);
+	check(StateKind(state) == NodePending);
+
+	TaskRef ref = node->poolIndex == INVALID_NODE
+		? (TaskRef)(uintptr_t)node | STANDALONE_REF_BIT
+		: ((TaskRef)StateGeneration(state) << 32) | (node->poolIndex + 1);
+
+	PushRef(ref, StatePriority(state));
+	WakeOne();
+}
+
+void TaskPool::PushRef(TaskRef ref, u32 lane)
+{
+	s32 self = GetCurrentWorkerIndex();
+	if (self >= 0)
+	{
+		// spawned from a worker: lock free push on its own deque
+		m_Workers[self].deques[lane].Push(ref);
+		m_Workers[self].enqueuedTasks.fetch_add(1, std::memory_order_relaxed);
+	}
+	else
+	{
+		u32 target = m_NextInbox.fetch_add(1, std::memory_order_relaxed) % m_NumWorkers;
+		WorkerState& worker = m_Workers[target];
+
+		std::lock_guard<std::mutex> lock(worker.inboxLock);
+		worker.inboxes[lane].push_back(ref);
+		worker.inboxCounts[lane].fetch_add(1, std::memory_order_release);
+		m_ExternalEnqueued.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+void TaskPool::WakeOne()
+{
+	// bumping the epoch makes a worker that is about to park bail out of the wait
+	m_WakeEpoch.fetch_add(1, std::memory_order_seq_cst);
+	if (m_Sleepers.load(std::memory_order_seq_cst) > 0)
+		m_WakeEpoch.notify_one();
+}
+
+void TaskPool::WorkerLoop(u32 workerIndex)
+{
+	s_CurrentPool = this;
+	s_CurrentWorkerIndex = (s32)workerIndex;
+
+	WorkerState& self = m_Workers[workerIndex];
+	SetThreadContext(&self.context);
+	u32 idleRounds = 0;
+
+	while (!m_Stop.load(std::memory_order_acquire))
+	{
+		if (TaskNode* node = FindTask((s32)workerIndex))
+		{
+			Execute(node);
+			idleRounds = 0;
+			continue;
+		}
+
+		if (++idleRounds < IDLE_SPIN_ROUNDS)
+		{
+			std::this_thread::yield();
+			continue;
+		}
+
+		// park: read the epoch first, then look for work one last time.
+		// anything submitted after the load bumps the epoch and the wait returns immediately
+		u32 epoch = m_WakeEpoch.load(std::memory_order_seq_cst);
+		m_Sleepers.fetch_add(1, std::memory_order_seq_cst);
+
+		TaskNode* node = FindTask((s32)workerIndex);
+		if (!node && !m_Stop.load(std::memory_order_seq_cst))
+		{
+			self.parkCount.fetch_add(1, std::memory_order_relaxed);
+
+			u64 parkedSinceUs = NowUs();
+			self.parkedSinceUs.store(parkedSinceUs, std::memory_order_relaxed);
+			m_WakeEpoch.wait(epoch, std::memory_order_seq_cst);
+			self.parkedSinceUs.store(0, std::memory_order_relaxed);
+			self.parkedUs.fetch_add(NowUs() - parkedSinceUs, std::memory_order_relaxed);
+		}
+
+		m_Sleepers.fetch_sub(1, std::memory_order_seq_cst);
+		idleRounds = 0;
+
+		if (node)
+			Execute(node);
+	}
+
+	SetThreadContext(nullptr);
+	s_CurrentPool = nullptr;
+	s_CurrentWorkerIndex = -1;
+}
+
+bool TaskPool::LaneHasWork(u32 lane) const
+{
+	for (u32 i = 0; i < m_NumWorkers; i++)
+	{
+		if (!m_Workers[i].deques[lane].IsEmpty() || m_Workers[i].inboxCounts[lane].load(std::memory_order_relaxed) > 0)
+			return true;
+	}
+	return false;
+}
+
+u32 TaskPool::FindStarvingLane(s32 workerIndex)
+{
+	// looks at every worker, once every few tasks is plenty
+	if (workerIndex >= 0)
+	{
+		u32& countdown = m_Workers[workerIndex].starvationCheckCountdown;
+		if (countdown > 0)
+		{
+			countdown--;
+			return TASK_PRIORITY_COUNT;
+		}
+		countdown = STARVATION_CHECK_INTERVAL;
+	}
+
+	bool hasWork[TASK_PRIORITY_COUNT];
+	for (u32 lane = 0; lane < TASK_PRIORITY_COUNT; lane++)
+	{
+		hasWork[lane] = LaneHasWork(lane);
+
+		// an empty lane starts aging when something shows up, not from when it was last served
+		if (!hasWork[lane] && m_LaneServedMs[lane].load(std::memory_order_relaxed) != 0)
+			m_LaneServedMs[lane].store(0, std::memory_order_relaxed);
+	}
+
+	// only a lane below the first busy one can starve, most of the time there's none and we skip the clock
+	u32 lane = 0;
+	while (lane < TASK_PRIORITY_COUNT && !hasWork[lane])
+		lane++;
+
+	s_ClaimTimeMs = 0;
+	for (lane++; lane < TASK_PRIORITY_COUNT; lane++)
+	{
+		if (!hasWork[lane])
+			continue;
+
+		if (s_ClaimTimeMs == 0)
+			s_ClaimTimeMs = NowMs();
+
+		u64 servedMs = m_LaneServedMs[lane].load(std::memory_order_relaxed);
+		if (servedMs == 0)
+			m_LaneServedMs[lane].compare_exchange_strong(servedMs, s_ClaimTimeMs, std::memory_order_relaxed);
+		else if (s_ClaimTimeMs > servedMs && s_ClaimTimeMs - servedMs > LANE_PROMOTE_MS[lane])
+			return lane;
+	}
+
+	return TASK_PRIORITY_COUNT;
+}
+
+TaskPool::TaskNode* TaskPool::FindTask(s32 workerIndex)
+{
+	u32 starvingLane = FindStarvingLane(workerIndex);
+	if (starvingLane < TASK_PRIORITY_COUNT)
+	{
+		if (TaskNode* node = FindTaskInLane(workerIndex, starvingLane))
+		{
+			if (workerIndex >= 0)
+				m_Workers[workerIndex].promotedTasks.fetch_add(1, std::memory_order_relaxed);
+			return node;
+		}
+	}
+
+	for (u32 lane = 0; lane < TASK_PRIORITY_COUNT; lane++)
+	{
+		if (TaskNode* node = FindTaskInLane(workerIndex, lane))
+			return node;
+	}
+
+	return nullptr;
+}
+
+TaskPool::TaskNode* TaskPool::FindTaskInLane(s32 workerIndex, u32 lane)
+{
+	if (workerIndex >= 0)
+	{
+		WorkerState& self = m_Workers[workerIndex];
+
+		// Pop() has a full fence even when empty, most lanes are empty most of the time
+		TaskRef ref = INVALID_TASK_REF;
+		while (!self.deques[lane].IsEmpty() && self.deques[lane].Pop(ref))
+		{
+			if (TaskNode* node = ClaimRef(ref, lane))
+				return node;
+		}
+
+		if (TaskNode* node = TakeFromInbox(self, lane, true))
+			return node;
+	}
+
+	return TrySteal(workerIndex, lane);
+}
+
+TaskPool::TaskNode* TaskPool::ClaimRef(TaskRef ref, u32 lane)
+{
+	TaskNode* node = NodeFromRef(ref);
+	u32 generation = (ref & STANDALONE_REF_BIT) ? 0 : (u32)(ref >> 32);
+
+	u64 state = node->state.load(std::memory_order_acquire);
+	while (StateGeneration(state) == generation && StateKind(state) == NodeQueued)
+	{
+		if (node->state.compare_exchange_weak(state, MakeState(generation, StatePriority(state), NodeRunning), std::memory_order_acq_rel))
+		{
+			// restart the aging with the clock of the last starvation check (0 = no competition, start on the next one)
+			if (m_LaneServedMs[lane].load(std::memory_order_relaxed) != s_ClaimTimeMs)
+				m_LaneServedMs[lane].store(s_ClaimTimeMs, std::memory_order_relaxed);
+			return node;
+		}
+	}
+
+	// the other reference got it first
+	return nullptr;
+}
+
+TaskPool::TaskNode* TaskPool::TakeFromInbox(WorkerState& worker, u32 lane, bool takeAll)
+{
+	if (worker.inboxCounts[lane].load(std::memory_order_acquire) == 0)
+		return nullptr;
+
+	std::unique_lock<std::mutex> lock(worker.inboxLock, std::defer_lock);
+	if (takeAll)
+		lock.lock();
+	else if (!lock.try_lock())
+		return nullptr;
+
+	std::vector<TaskRef>& inbox = worker.inboxes[lane];
+	if (inbox.empty())
+		return nullptr;
+
+	TaskRef ref = inbox.front();
+
+	if (takeAll)
+	{
+		// move everything else in the deque so the other workers can steal it without touching the lock,
+		// pushed in reverse so the owner pops them in submission order
+		for (size_t i = inbox.size() - 1; i > 0; i--)
+			worker.deques[lane].Push(inbox[i]);
+
+		inbox.clear();
+	}
+	else
+	{
+		inbox.erase(inbox.begin());
+	}
+
+	worker.inboxCounts[lane].store((u32)inbox.size(), std::memory_order_release);
+	lock.unlock();
+
+	// a stale ref just means no luck this time, the caller moves on
+	return ClaimRef(ref, lane);
+}
+
+TaskPool::TaskNode* TaskPool::TrySteal(s32 thiefIndex, u32 lane)
+{
+	u32& rngState = thiefIndex >= 0 ? m_Workers[thiefIndex].rngState : s_ExternalRngState;
+	u32 start = XorShift(rngState) % m_NumWorkers;
+
+	for (u32 i = 0; i < m_NumWorkers; i++)
+	{
+		u32 victimIndex = (start + i) % m_NumWorkers;
+		if ((s32)victimIndex == thiefIndex)
+			continue;
+
+		WorkerState& victim = m_Workers[victimIndex];
+
+		TaskNode* node = nullptr;
+		TaskRef ref = INVALID_TASK_REF;
+		while (!node && !victim.deques[lane].IsEmpty() && victim.deques[lane].Steal(ref))
+			node = ClaimRef(ref, lane);
+
+		if (!node)
+			node = TakeFromInbox(victim, lane, false);
+
+		if (node)
+		{
+			if (thiefIndex >= 0)
+				m_Workers[thiefIndex].stolenTasks.fetch_add(1, std::memory_order_relaxed);
+			return node;
+		}
+	}
+
+	return nullptr;
+}
+
+bool TaskPool::TryRunPendingTask()
+{
+	if (m_NumWorkers == 0)
+		return false;
+
+	TaskNode* node = FindTask(GetCurrentWorkerIndex());
+	if (!node)
+		return false;
+
+	Execute(node);
+	return true;
+}
+
+void TaskPool::RunParallelJob(ParallelJob& job, u64 begin, u64 end, u64 grainSize)
+{
+	job.begin = begin;
+	job.end = end;
+	job.grainSize = grainSize;
+	job.chunkCount = (end - begin + grainSize - 1) / grainSize;
+
+	// the caller is a worker too, one helper less
+	u32 helperCount = (u32)std::min<u64>(m_NumWorkers, job.chunkCount - 1);
+	job.activeHelpers.store(helperCount, std::memory_order_relaxed);
+
+	for (u32 i = 0; i < helperCount; i++)
+	{
+		AddTask([&job]() {
+			RunParallelChunks(job);
+			job.activeHelpers.fetch_sub(1, std::memory_order_release);
+		});
+	}
+
+	RunParallelChunks(job);
+
+	// the job lives on our stack: wait for every helper to be done with it, helping out meanwhile.
+	// a helper that hasn't started yet finds no chunks left and leaves right away
+	while (job.activeHelpers.load(std::memory_order_acquire) > 0)
+	{
+		if (!TryRunPendingTask())
+			std::this_thread::yield();
+	}
+}
+
+void TaskPool::RunParallelChunks(ParallelJob& job)
+{
+	while (true)
+	{
+		u64 chunkIndex = job.nextChunk.fetch_add(1, std::memory_order_relaxed);
+		if (chunkIndex >= job.chunkCount)
+			break;
+
+		u64 chunkBegin = job.begin + chunkIndex * job.grainSize;
+		u64 chunkEnd = std::min(chunkBegin + job.grainSize, job.end);
+		job.body(job.context, chunkIndex, chunkBegin, chunkEnd);
+	}
+}
+
+void TaskPool::Execute(TaskNode* node)
+{
+	// nested calls (TryRunPendingTask from inside a task) take their own marker, so rolling back never hits the caller's data
+	ThreadContext& context = GetThreadContext();
+	LinearAllocator::Marker scratchMarker = context.scratch.GetMarker();
+
+	// tasks created from inside inherit the lane
+	ETaskPriority parentPriority = s_CurrentPriority;
+	s_CurrentPriority = (ETaskPriority)StatePriority(node->state.load(std::memory_order_relaxed));
+
+	node->proc(context);
+
+	s_CurrentPriority = parentPriority;
+	context.scratch.ResetTo(scratchMarker);
+
+	// successors go on this worker's deque, they'll likely touch the same data
+	for (u32 i = 0; i < node->successorCount; i++)
+		Release(node->successors[i]);
+
+	for (TaskNode* successor : node->overflowSuccessors)
+		Release(successor);
+
+	FreeNode(node);
+
+	s32 self = GetCurrentWorkerIndex();
+	if (self >= 0)
+		m_Workers[self].executedTasks.fetch_add(1, std::memory_order_relaxed);
+}
+
+void TaskPool::FreePendingTasks()
+{
+	for (u32 i = 0; i < m_NumWorkers; i++)
+	{
+		WorkerState& worker = m_Workers[i];
+
+		for (u32 lane = 0; lane < TASK_PRIORITY_COUNT; lane++)
+		{
+			// claim before freeing, a reprioritized task has two references
+			TaskRef ref = INVALID_TASK_REF;
+			while (worker.deques[lane].Steal(ref))
+			{
+				if (TaskNode* node = ClaimRef(ref, lane))
+					FreeNode(node);
+			}
+
+			for (TaskRef pending : worker.inboxes[lane])
+			{
+				if (TaskNode* node = ClaimRef(pending, lane))
+					FreeNode(node);
+			}
+
+			worker.inboxes[lane].clear();
+			worker.inboxCounts[lane] = 0;
+		}
+	}
+}
+
+TaskPool::TaskNode* TaskPool::AllocNode(ETaskPriority priority)
+{
+	TaskNode* node = nullptr;
+
+	s32 self = GetCurrentWorkerIndex();
+	if (self >= 0 && m_Workers[self].nodeCacheCount > 0)
+	{
+		WorkerState& worker = m_Workers[self];
+		node = worker.nodeCache[--worker.nodeCacheCount];
+	}
+	else
+	{
+		node = PopFreeNode();
+		if (!node)
+			node = GrowNodeStorage();
+	}
+
+	if (priority == ETaskPriority::Inherit)
+		priority = s_CurrentPriority;
+
+	u32 generation = StateGeneration(node->state.load(std::memory_order_relaxed));
+	node->state.store(MakeState(generation, (u32)priority, NodePending), std::memory_order_relaxed);
+
+	node->pendingCount.store(1, std::memory_order_relaxed);
+	node->successorCount = 0;
+	node->overflowSuccessors.clear();
+	node->submitted = false;
+	return node;
+}
+
+void TaskPool::FreeNode(TaskNode* node)
+{
+	node->proc.Reset();
+
+	if (node->poolIndex == INVALID_NODE)
+	{
+		delete node;
+		return;
+	}
+
+	// new generation: stale references to this node can't claim it anymore. wraps at 31 bits, a reference would have
+	// to sit in a queue for 2^31 reuses of its node to match again
+	u32 generation = (StateGeneration(node->state.load(std::memory_order_relaxed)) + 1) & GENERATION_MASK;
+	node->state.store(MakeState(generation, 0, NodeFree), std::memory_order_release);
+
+	s32 self = GetCurrentWorkerIndex();
+	if (self >= 0 && m_Workers[self].nodeCacheCount < WORKER_NODE_CACHE)
+	{
+		WorkerState& worker = m_Workers[self];
+		worker.nodeCache[worker.nodeCacheCount++] = node;
+	}
+	else
+	{
+		PushFreeNode(node);
+	}
+}
+
+TaskPool::TaskNode* TaskPool::PopFreeNode()
+{
+	u64 head = m_FreeNodesHead.load(std::memory_order_acquire);
+	while ((u32)head != 0)
+	{
+		// nodes are never returned to the heap, reading a stale 'next' is fine, the tag makes the cas fail
+		TaskNode* node = NodeAt((u32)head - 1);
+		u64 next = node->nextFree.load(std::memory_order_relaxed);
+		u64 newHead = (((head >> 32) + 1) << 32) | next;
+
+		if (m_FreeNodesHead.compare_exchange_weak(head, newHead, std::memory_order_acquire, std::memory_order_acquire))
+			return node;
+	}
+
+	return nullptr;
+}
+
+void TaskPool::PushFreeNode(TaskNode* node)
+{
+	u64 head = m_FreeNodesHead.load(std::memory_order_relaxed);
+	u64 newHead;
+	do
+	{
+		node->nextFree.store((u32)head, std::memory_order_relaxed);
+		newHead = (((head >> 32) + 1) << 32) | (node->poolIndex + 1);
+	}
+	while (!m_FreeNodesHead.compare_exchange_weak(head, newHead, std::memory_order_release, std::memory_order_relaxed));
+}
+
+TaskPool::TaskNode* TaskPool::GrowNodeStorage()
+{
+	std::lock_guard<std::mutex> lock(m_NodeStorageLock);
+
+	// someone else might have grown it while we were waiting
+	if (TaskNode* node = PopFreeNode())
+		return node;
+
+	m_HeapAllocations.fetch_add(1, std::memory_order_relaxed);
+
+	if (m_NodeChunkCount == MAX_NODE_CHUNKS)
+	{
+		// way too many tasks in flight, don't crash but stop recycling
+		LOG_WARN("TaskPool: node storage exhausted (%u tasks in flight)", MAX_NODE_CHUNKS * NODE_CHUNK_SIZE);
+		return new TaskNode();
+	}
+
+	u32 chunkIndex = m_NodeChunkCount;
+	m_NodeChunks[chunkIndex] = std::make_unique<TaskNode[]>(NODE_CHUNK_SIZE);
+	m_NodeChunkCount++;
+
+	TaskNode* chunk = m_NodeChunks[chunkIndex].get();
+	for (u32 i = 0; i < NODE_CHUNK_SIZE; i++)
+		chunk[i].poolIndex = chunkIndex * NODE_CHUNK_SIZE + i;
+
+	// keep the first one, the rest goes in the free list
+	for (u32 i = 1; i < NODE_CHUNK_SIZE; i++)
+		PushFreeNode(&chunk[i]);
+
+	return &chunk[0];
+}
@@ -1,93 +1,356 @@
 #pragma once
 
+#include "Core/CoreMinimal.h"
+#include "Core/Platform.h"
+#include "Core/CpuTopology.h"
+#include "Misc/InplaceFunction.h"
+#include "WorkStealingDeque.h"
+#include "ThreadContext.h"
+
 #include <thread>
 #include <functional>
 #include <mutex>
-#include <deque>
 #include <vector>
-#include <condition_variable>
+#include <atomic>
+#include <memory>
+
+// scheduling lanes, a worker always serves the highest non empty lane first.
+// a lane that hasn't been served for a while gets promoted to the top so nothing starves (see LANE_PROMOTE_MS)
+enum class ETaskPriority : u8
+{
+	Critical,   // needed this frame
+	Visible,    // on screen, default for work submitted from outside the pool
+	Prefetch,   // likely needed soon
+	Background, // whenever there's nothing better to do
+	Inherit     // same as the task that is creating it, Visible outside of tasks
+};
+
+constexpr u32 TASK_PRIORITY_COUNT = (u32)ETaskPriority::Inherit;
 
-struct ThreadContext
+struct TaskPoolStats
 {
-	int threadIndex;
+	u64 enqueuedTasks = 0;
+	u64 executedTasks = 0;
+	u64 stolenTasks = 0;
+	u64 parkCount = 0;
+	u64 heapAllocations = 0; // task node chunks + successor lists that didn't fit inline
+	u64 promotedTasks = 0;   // run out of priority order because their lane was starving
+	u64 reprioritizedTasks = 0;
+	u64 parkedUs = 0;  // summed over the workers, the ones parked right now included
+	u64 uptimeUs = 0;  // since Start(), utilisation = 1 - parkedUs / (uptimeUs * workerCount)
+	u32 workerCount = 0;
 };
 
+struct TaskPoolConfig
+{
+	u32 threadCount = 0;    // 0 = sized from the cpu topology: one worker per physical core from firstCore on
+	u32 maxThreads = 0;     // cap for the automatic size, 0 = none
+	u32 firstCore = 1;      // cores before this one are left to the main/render thread (see GetCpuTopology())
+	bool useSmt = false;    // automatic size counts smt siblings too
+	bool pinThreads = true; // every worker is pinned to one physical core (any of its smt siblings)
+};
+
+// bytes available for the task lambda captures
+constexpr size_t TASK_INLINE_SIZE = 64;
+
+// work stealing task pool:
+// - every worker owns a Chase-Lev deque, tasks spawned from a worker go straight into its own deque (no locks)
+// - tasks submitted from outside the pool are spread round robin over small per-worker inboxes
+// - idle workers steal from the others and then park on an atomic epoch, no spinning while there's nothing to do
+//
+// tasks can form a graph: CreateTask() returns a handle that doesn't run until Submit(), Precede(a, b) makes b wait for a.
+// a task becomes ready when all its predecessors are done and it has been submitted, so fan-out/fan-in joins are just
+// a bunch of Precede() calls. handles are only valid until they're submitted (the pool frees the task after running it),
+// so wire everything before calling Submit() on the predecessor.
+//
+// tasks don't allocate: the lambda is stored inline (TASK_INLINE_SIZE) and the task nodes are recycled through
+// per-worker caches backed by a lock free free list. the pool only hits the heap to grow the node storage.
+//
+// a task is either void() or void(ThreadContext&), the second one gets the context of the thread running it
+// (worker index, scratch arena rolled back when the task returns, command pool slot).
+//
+// every worker has one deque and one inbox per priority lane. a submitted task can be moved to another lane with
+// Reprioritize(): a second reference is queued in the new lane and whoever claims the task first runs it,
+// the other reference is dropped when it's popped (node generation + state live in one atomic).
 class TaskPool
 {
+	struct TaskNode;
+
 public:
-	using Task = std::function<void()>;
+	using Task = InplaceFunction<void(ThreadContext&), TASK_INLINE_SIZE>;
+	using TaskHandle = TaskNode*;
+	using TaskRef = u64; // stays valid (and harmless) after the task is done, unlike TaskHandle
+
+	static constexpr TaskRef INVALID_TASK_REF = 0;
 
 public:
 	TaskPool() = default;
+	~TaskPool();
+
+	TaskPool(const TaskPool&) = delete;
+	TaskPool& operator=(const TaskPool&) = delete;
+
+	void Start(const TaskPoolConfig& config);
+	void Start(u32 threadCount); // fixed size, unpinned
+
+	// what Start() resolves a config to on this machine
+	static u32 ResolveThreadCount(const TaskPoolConfig& config);
 
-	void Start(uint32_t threadCount)
+	template<typename T>
+	void AddTask(T&& taskProc, ETaskPriority priority = ETaskPriority::Inherit)
 	{
-		m_Workers.reserve(threadCount);
-		for (uint32_t i = 0; i < threadCount; i++)
-		{
-			m_Workers.emplace_back([this, i]() {
-				while (true)
-				{
-					std::unique_lock<std::mutex> lck(m_QueueMutex);
-					m_CondVar.wait(lck, [this]() { return !m_TaskQueue.empty() || m_Stop; });
-
-					if (m_Stop)
-					{
-						lck.unlock();
-						break;
-					}
-
-					Task task = std::move(m_TaskQueue.front());
-					m_TaskQueue.pop_front();
-					m_DequeuedTasks++;
-					lck.unlock();
-
-					// task({i})? puo essere utile per alcuni sistemi che utilizzano le risorse separate per thread?
-					task();
-				}
-			});
-		}
+		Submit(CreateTask(std::forward<T>(taskProc), priority));
 	}
 
-	~TaskPool()
+	// graph api
+	template<typename T>
+	TaskHandle CreateTask(T&& taskProc, ETaskPriority priority = ETaskPriority::Inherit)
 	{
-		Stop();
+		TaskNode* node = AllocNode(priority);
+		if constexpr (std::is_invocable_v<std::decay_t<T>&, ThreadContext&>)
+			node->proc = Task(std::forward<T>(taskProc));
+		else
+			node->proc = Task([proc = std::forward<T>(taskProc)](ThreadContext&) mutable { proc(); });
+		return node;
 	}
 
+	// continuation: creates a task that runs after 'before', still needs to be submitted
 	template<typename T>
-	void AddTask(T taskProc)
+	TaskHandle Then(TaskHandle before, T&& taskProc, ETaskPriority priority = ETaskPriority::Inherit)
 	{
-		std::lock_guard<std::mutex> lock(m_QueueMutex);
-		m_TaskQueue.emplace_back(taskProc);
-		m_CondVar.notify_one();
+		TaskHandle after = CreateTask(std::forward<T>(taskProc), priority);
+		Precede(before, after);
+		return after;
 	}
 
-	void RequestStop()
+	// 'after' won't start until 'before' is done. 'before' must not be submitted yet
+	void Precede(TaskHandle before, TaskHandle after);
+	void Submit(TaskHandle task);
+
+	// take it before Submit(), the handle is gone once the task runs
+	TaskRef GetRef(TaskHandle task) const;
+
+	// moves a task that hasn't started yet to another lane. false if it's already running or done
+	bool Reprioritize(TaskRef task, ETaskPriority priority);
+
+	// priority of the task running on the calling thread, Visible outside of tasks
+	static ETaskPriority GetCurrentPriority();
+
+	// splits [begin, end) in chunks of grainSize and calls fn(chunkBegin, chunkEnd) on the workers.
+	// the calling thread processes chunks too and runs other pending tasks while waiting instead of blocking,
+	// so it's fine to call it from inside a task. a range that fits in one grain runs inline
+	template<typename F>
+	void ParallelFor(u64 begin, u64 end, u64 grainSize, F&& fn)
 	{
-		std::lock_guard<std::mutex> lock(m_QueueMutex);
-		m_Stop = true;
-		m_CondVar.notify_all();
+		if (end <= begin)
+			return;
+
+		if (end - begin <= grainSize || m_NumWorkers == 0)
+		{
+			fn(begin, end);
+			return;
+		}
+
+		using Functor = std::remove_reference_t<F>;
+		ParallelJob job;
+		job.body = [](void* context, u64 chunkIndex, u64 chunkBegin, u64 chunkEnd) {
+			(*static_cast<Functor*>(context))(chunkBegin, chunkEnd);
+		};
+		job.context = (void*)&fn;
+		RunParallelJob(job, begin, end, grainSize);
 	}
 
-	void Stop()
+	// map(chunkBegin, chunkEnd) -> T on every chunk (in parallel), then the partial results are combined in chunk order
+	template<typename T, typename MapF, typename CombineF>
+	T ParallelReduce(u64 begin, u64 end, u64 grainSize, T identity, MapF&& map, CombineF&& combine)
 	{
-		RequestStop();
+		if (end <= begin)
+			return identity;
+
+		if (end - begin <= grainSize || m_NumWorkers == 0)
+			return combine(identity, map(begin, end));
 
-		for (auto& worker : m_Workers)
+		struct ReduceContext
 		{
-			if (worker.joinable())
-				worker.join();
-		}
+			std::remove_reference_t<MapF>* map;
+			T* partials;
+		};
+
+		// partials live in the caller scratch, tasks run while we wait roll back to markers taken after this
+		LinearAllocator& scratch = GetThreadContext().scratch;
+		ScratchScope scratchScope(scratch);
+		std::vector<T, ScratchAllocator<T>> partials((size_t)((end - begin + grainSize - 1) / grainSize), identity, ScratchAllocator<T>(scratch));
+		ReduceContext reduceContext = { &map, partials.data() };
+
+		ParallelJob job;
+		job.body = [](void* context, u64 chunkIndex, u64 chunkBegin, u64 chunkEnd) {
+			ReduceContext* reduce = static_cast<ReduceContext*>(context);
+			reduce->partials[chunkIndex] = (*reduce->map)(chunkBegin, chunkEnd);
+		};
+		job.context = &reduceContext;
+		RunParallelJob(job, begin, end, grainSize);
+
+		T result = identity;
+		for (T& partial : partials)
+			result = combine(result, partial);
+
+		return result;
 	}
 
-	inline uint32_t NumWorkers() const { return (uint32_t)m_Workers.size(); }
+	// runs one pending task on the calling thread, false if there was nothing to do. works from any thread
+	bool TryRunPendingTask();
+
+	void RequestStop();
+	void Stop();
+
+	inline u32 NumWorkers() const { return m_NumWorkers; }
+
+	// -1 if the calling thread is not a worker of this pool
+	s32 GetCurrentWorkerIndex() const;
+
+	TaskPoolStats GetStats() const;
+
+private:
+	static constexpr u32 INLINE_SUCCESSORS = 4;
+	static constexpr u32 INVALID_NODE = 0xffffffff;
+	static constexpr u32 NODE_CHUNK_SIZE = 256;
+	static constexpr u32 MAX_NODE_CHUNKS = 1024;
+	static constexpr u32 WORKER_NODE_CACHE = 128;
+
+	// a lane that waited this long while the others were being served jumps the queue
+	static constexpr u64 LANE_PROMOTE_MS[TASK_PRIORITY_COUNT] = { 0, 30, 100, 250 };
+	static constexpr u32 STARVATION_CHECK_INTERVAL = 16; // tasks
+
+	// node state word: generation (31) | priority (8) | state (8)
+	enum ENodeState : u8
+	{
+		NodeFree,
+		NodePending, // created, waiting for predecessors or Submit()
+		NodeQueued,
+		NodeRunning
+	};
+
+	static constexpr u64 STANDALONE_REF_BIT = 1ull << 63; // ref is a pointer to a standalone node, no generation
+	// a pool ref is generation << 32 | index + 1, the generation wraps before it reaches STANDALONE_REF_BIT
+	static constexpr u32 GENERATION_MASK = 0x7fffffff;
+
+	static inline u64 MakeState(u32 generation, u32 priority, ENodeState state) { return ((u64)(generation & GENERATION_MASK) << 32) | (priority << 8) | state; }
+	static inline u32 StateGeneration(u64 state) { return (u32)(state >> 32) & GENERATION_MASK; }
+	static inline u32 StatePriority(u64 state) { return (u32)(state >> 8) & 0xff; }
+	static inline ENodeState StateKind(u64 state) { return (ENodeState)(state & 0xff); }
+
+	struct alignas(CACHELINE_SIZE) TaskNode
+	{
+		Task proc;
+		std::atomic<u32> pendingCount = 1; // unfinished predecessors + 1 held until Submit()
+		u32 successorCount = 0;
+		TaskNode* successors[INLINE_SUCCESSORS] = {};
+		std::vector<TaskNode*> overflowSuccessors; // keeps its capacity when the node is recycled
+
+		std::atomic<u64> state = 0;
+
+		u32 poolIndex = INVALID_NODE; // INVALID_NODE = standalone node, deleted when freed
+		std::atomic<u32> nextFree = 0;
+		bool submitted = false;
+	};
+
+	struct ParallelJob
+	{
+		using Body = void(*)(void* context, u64 chunkIndex, u64 chunkBegin, u64 chunkEnd);
+
+		Body body = nullptr;
+		void* context = nullptr;
+		u64 begin = 0;
+		u64 end = 0;
+		u64 grainSize = 0;
+		u64 chunkCount = 0;
+
+		alignas(CACHELINE_SIZE) std::atomic<u64> nextChunk = 0;
+		alignas(CACHELINE_SIZE) std::atomic<u32> activeHelpers = 0;
+	};
+
+	struct alignas(CACHELINE_SIZE) WorkerState
+	{
+		WorkStealingDeque<TaskRef> deques[TASK_PRIORITY_COUNT];
+
+		// external submissions
+		std::mutex inboxLock;
+		std::vector<TaskRef> inboxes[TASK_PRIORITY_COUNT];
+		std::atomic<u32> inboxCounts[TASK_PRIORITY_COUNT] = {};
+
+		// recycled task nodes, owner only
+		TaskNode* nodeCache[WORKER_NODE_CACHE];
+		u32 nodeCacheCount = 0;
+
+		std::thread thread;
+		u32 rngState = 0;
+		u32 starvationCheckCountdown = 0;
+
+		ThreadContext context;
+
+		// stats, written by the owner only
+		std::atomic<u64> enqueuedTasks = 0;
+		std::atomic<u64> executedTasks = 0;
+		std::atomic<u64> stolenTasks = 0;
+		std::atomic<u64> parkCount = 0;
+		std::atomic<u64> promotedTasks = 0;
+		std::atomic<u64> parkedUs = 0;
+		std::atomic<u64> parkedSinceUs = 0; // 0 = not parked
+	};
+
+	void WorkerLoop(u32 workerIndex);
+
+	void Release(TaskNode* node);
+	void Schedule(TaskNode* node);
+	void PushRef(TaskRef ref, u32 lane);
+	void WakeOne();
+
+	// every lookup claims the node, stale refs (already run through another lane) are dropped on the way
+	TaskNode* FindTask(s32 workerIndex);
+	TaskNode* FindTaskInLane(s32 workerIndex, u32 lane);
+	// takeAll: the owner, waits for the lock, claims the first ref and moves the others into its deque. otherwise (a thief)
+	// only if the lock is free, one ref
+	TaskNode* TakeFromInbox(WorkerState& worker, u32 lane, bool takeAll);
+	TaskNode* TrySteal(s32 thiefIndex, u32 lane);
+	TaskNode* ClaimRef(TaskRef ref, u32 lane);
+	u32 FindStarvingLane(s32 workerIndex);
+	bool LaneHasWork(u32 lane) const;
+
+	void Execute(TaskNode* node);
+	void FreePendingTasks();
+
+	void RunParallelJob(ParallelJob& job, u64 begin, u64 end, u64 grainSize);
+	static void RunParallelChunks(ParallelJob& job);
+
+	// node storage
+	TaskNode* AllocNode(ETaskPriority priority);
+	void FreeNode(TaskNode* node);
+	TaskNode* PopFreeNode();
+	void PushFreeNode(TaskNode* node);
+	TaskNode* GrowNodeStorage();
+	inline TaskNode* NodeAt(u32 index) const { return &m_NodeChunks[index / NODE_CHUNK_SIZE][index % NODE_CHUNK_SIZE]; }
+	TaskNode* NodeFromRef(TaskRef ref) const;
 
 private:
-	std::vector<std::thread> m_Workers;
-	std::deque<Task> m_TaskQueue;
-	std::mutex m_QueueMutex;
-	std::condition_variable m_CondVar;
-
-	uint32_t m_DequeuedTasks = 0; // debug
-	bool m_Stop = false;
-};
\ No newline at end of file
+	std::unique_ptr<WorkerState[]> m_Workers;
+	u32 m_NumWorkers = 0;
+	u64 m_StartUs = 0;
+
+	alignas(CACHELINE_SIZE) std::atomic<u32> m_NextInbox = 0;
+	alignas(CACHELINE_SIZE) std::atomic<u32> m_WakeEpoch = 0;
+	std::atomic<u32> m_Sleepers = 0;
+	std::atomic<bool> m_Stop = false;
+
+	// when every lane was last served (0 = empty at the last check), for the starvation check
+	alignas(CACHELINE_SIZE) std::atomic<u64> m_LaneServedMs[TASK_PRIORITY_COUNT] = {};
+	std::atomic<u64> m_Reprioritized = 0;
+
+	// global free list of task nodes: low 32 bits = index + 1 (0 = empty), high 32 bits = ABA tag
+	alignas(CACHELINE_SIZE) std::atomic<u64> m_FreeNodesHead = 0;
+	alignas(CACHELINE_SIZE) std::atomic<u64> m_ExternalEnqueued = 0;
+	std::atomic<u64> m_HeapAllocations = 0;
+
+	std::mutex m_NodeStorageLock;
+	std::unique_ptr<TaskNode[]> m_NodeChunks[MAX_NODE_CHUNKS];
+	u32 m_NodeChunkCount = 0;
+};
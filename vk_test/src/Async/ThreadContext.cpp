@@ -0,0 +1,34 @@
+#include "ThreadContext.h"
+
+static thread_local ThreadContext* s_ThreadContext = nullptr;
+static thread_local ThreadContext s_DefaultContext;
+
+ThreadContext& GetThreadContext()
+{
+	if (s_ThreadContext)
+		return *s_ThreadContext;
+
+	if (!s_DefaultContext.scratch.IsInitialized())
+		s_DefaultContext.scratch.Init(EXTERNAL_SCRATCH_SIZE);
+
+	return s_DefaultContext;
+}
+
+void SetThreadContext(ThreadContext* context)
+{
+	s_ThreadContext = context;
+}
+
+void* ScratchMalloc(size_t size)
+{
+	return GetThreadContext().scratch.Alloc(size);
+}
+
+void* ScratchRealloc(void* ptr, size_t oldSize, size_t newSize)
+{
+	return GetThreadContext().scratch.Realloc(ptr, oldSize, newSize);
+}
+
+void ScratchFree(void* ptr)
+{
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "Core/CoreMinimal.h"
+#include "Misc/LinearAllocator.h"
+
+#include <vulkan/vulkan.h>
+
+constexpr u64 WORKER_SCRATCH_SIZE = 4 * 1024 * 1024;
+constexpr u64 EXTERNAL_SCRATCH_SIZE = 1 * 1024 * 1024; // main thread, gpu loader, ...
+
+// per thread state handed to the tasks.
+// scratch is rolled back after every task, so anything allocated there must not outlive the task
+struct ThreadContext
+{
+	int threadIndex = -1; // worker index inside its pool, -1 for threads that aren't pool workers
+	LinearAllocator scratch;
+	VkCommandPool commandPool = VK_NULL_HANDLE; // created on first use, see ResourceFactory::GetThreadCommandPool()
+};
+
+// context of the calling thread: the worker one inside a pool, a lazily created one for any other thread
+ThreadContext& GetThreadContext();
+
+// workers install their own context, nullptr goes back to the default one
+void SetThreadContext(ThreadContext* context);
+
+// plain malloc/realloc/free on top of the thread scratch, for c libraries (stb_image).
+// free is a no-op, the memory goes away when the current task ends
+void* ScratchMalloc(size_t size);
+void* ScratchRealloc(void* ptr, size_t oldSize, size_t newSize);
+void ScratchFree(void* ptr);
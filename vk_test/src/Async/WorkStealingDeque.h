@@ -0,0 +1,146 @@
+#pragma once
+
+#include "Core/CoreMinimal.h"
+#include "Core/Platform.h"
+
+#include <atomic>
+#include <vector>
+#include <type_traits>
+
+// Chase-Lev work stealing deque (Le, Pop, Cohen, Zappa Nardelli - "Correct and Efficient Work-Stealing for Weak Memory Models")
+// the owner thread pushes and pops at the bottom (LIFO, cache friendly), any other thread steals from the top (FIFO).
+// T must be trivially copyable (we only store pointers to tasks).
+template<typename T>
+class WorkStealingDeque
+{
+	static_assert(std::is_trivially_copyable_v<T>, "WorkStealingDeque only stores trivially copyable values");
+
+	struct Ring
+	{
+		s64 capacity;
+		s64 mask;
+		std::atomic<T>* slots;
+
+		explicit Ring(s64 cap)
+			: capacity(cap), mask(cap - 1), slots(new std::atomic<T>[cap])
+		{
+		}
+
+		~Ring()
+		{
+			delete[] slots;
+		}
+
+		inline T Get(s64 i) const { return slots[i & mask].load(std::memory_order_relaxed); }
+		inline void Put(s64 i, T value) { slots[i & mask].store(value, std::memory_order_relaxed); }
+
+		Ring* Grow(s64 bottom, s64 top) const
+		{
+			Ring* bigger = new Ring(capacity * 2);
+			for (s64 i = top; i != bottom; i++)
+				bigger->Put(i, Get(i));
+			return bigger;
+		}
+	};
+
+public:
+	explicit WorkStealingDeque(s64 initialCapacity = 1024)
+	{
+		check(initialCapacity > 0 && (initialCapacity & (initialCapacity - 1)) == 0); // power of 2
+		m_Ring.store(new Ring(initialCapacity), std::memory_order_relaxed);
+	}
+
+	~WorkStealingDeque()
+	{
+		delete m_Ring.load(std::memory_order_relaxed);
+		for (Ring* ring : m_Retired)
+			delete ring;
+	}
+
+	WorkStealingDeque(const WorkStealingDeque&) = delete;
+	WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+	// owner only
+	void Push(T value)
+	{
+		s64 bottom = m_Bottom.load(std::memory_order_relaxed);
+		s64 top = m_Top.load(std::memory_order_acquire);
+		Ring* ring = m_Ring.load(std::memory_order_relaxed);
+
+		if (bottom - top > ring->capacity - 1)
+		{
+			// thieves may still be reading the old ring, keep it alive until the deque dies
+			m_Retired.push_back(ring);
+			ring = ring->Grow(bottom, top);
+			m_Ring.store(ring, std::memory_order_release);
+		}
+
+		ring->Put(bottom, value);
+		m_Bottom.store(bottom + 1, std::memory_order_release); // publishes the slot to thieves
+	}
+
+	// owner only
+	bool Pop(T& outValue)
+	{
+		s64 bottom = m_Bottom.load(std::memory_order_relaxed) - 1;
+		Ring* ring = m_Ring.load(std::memory_order_relaxed);
+		m_Bottom.store(bottom, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		s64 top = m_Top.load(std::memory_order_relaxed);
+
+		if (top > bottom)
+		{
+			// empty
+			m_Bottom.store(bottom + 1, std::memory_order_relaxed);
+			return false;
+		}
+
+		outValue = ring->Get(bottom);
+
+		if (top == bottom)
+		{
+			// last element, race against thieves
+			bool won = m_Top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+			m_Bottom.store(bottom + 1, std::memory_order_relaxed);
+			return won;
+		}
+
+		return true;
+	}
+
+	// any thread, can fail spuriously when racing with other thieves or the owner
+	bool Steal(T& outValue)
+	{
+		s64 top = m_Top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		s64 bottom = m_Bottom.load(std::memory_order_acquire);
+
+		if (top >= bottom)
+			return false;
+
+		Ring* ring = m_Ring.load(std::memory_order_acquire);
+		T value = ring->Get(top);
+
+		if (!m_Top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			return false;
+
+		outValue = value;
+		return true;
+	}
+
+	// approximation, only good for heuristics
+	inline s64 Size() const
+	{
+		s64 bottom = m_Bottom.load(std::memory_order_relaxed);
+		s64 top = m_Top.load(std::memory_order_relaxed);
+		return bottom > top ? bottom - top : 0;
+	}
+
+	inline bool IsEmpty() const { return Size() == 0; }
+
+private:
+	alignas(CACHELINE_SIZE) std::atomic<s64> m_Top = 0;
+	alignas(CACHELINE_SIZE) std::atomic<s64> m_Bottom = 0;
+	alignas(CACHELINE_SIZE) std::atomic<Ring*> m_Ring = nullptr;
+	std::vector<Ring*> m_Retired; // owner only
+};
@@ -0,0 +1,2000 @@
+#include "Benchmarks.h"
+#include "Async/TaskPool.h"
+#include "Misc/Timer.h"
+#include "Misc/Utils.h"
+#include "Misc/AssetPack.h"
+#include "Async/RingQueue.h"
+#include "Renderer/VertexDecode.h"
+#include "Renderer/MeshOptimizer.h"
+#include "Engine.h"
+
+#include "fastgltf/glm_element_traits.hpp"
+#include "fastgltf/core.hpp"
+#include "fastgltf/tools.hpp"
+
+#include <algorithm>
+#include <deque>
+#include <array>
+#include <cmath>
+#include <condition_variable>
+#include <fstream>
+#include <random>
+#include <thread>
+
+namespace {
+
+	// the pool before work stealing (single mutex + deque + condvar), kept here only as a baseline
+	class LegacyTaskPool
+	{
+	public:
+		using Task = std::function<void()>;
+
+		void Start(u32 threadCount)
+		{
+			m_Workers.reserve(threadCount);
+			for (u32 i = 0; i < threadCount; i++)
+			{
+				m_Workers.emplace_back([this]() {
+					while (true)
+					{
+						std::unique_lock<std::mutex> lck(m_QueueMutex);
+						m_CondVar.wait(lck, [this]() { return !m_TaskQueue.empty() || m_Stop; });
+
+						if (m_Stop)
+							break;
+
+						Task task = std::move(m_TaskQueue.front());
+						m_TaskQueue.pop_front();
+						lck.unlock();
+
+						task();
+					}
+				});
+			}
+		}
+
+		~LegacyTaskPool()
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_QueueMutex);
+				m_Stop = true;
+				m_CondVar.notify_all();
+			}
+
+			for (auto& worker : m_Workers)
+				worker.join();
+		}
+
+		template<typename T>
+		void AddTask(T&& taskProc)
+		{
+			std::lock_guard<std::mutex> lock(m_QueueMutex);
+			m_TaskQueue.emplace_back(std::forward<T>(taskProc));
+			m_CondVar.notify_one();
+		}
+
+	private:
+		std::vector<std::thread> m_Workers;
+		std::deque<Task> m_TaskQueue;
+		std::mutex m_QueueMutex;
+		std::condition_variable m_CondVar;
+		bool m_Stop = false;
+	};
+
+	struct alignas(CACHELINE_SIZE) Counter
+	{
+		std::atomic<u64> value = 0;
+	};
+
+	inline u64 FakeWork(u64 seed)
+	{
+		// a few ns of alu work so we measure scheduling and not just the counter
+		for (u32 i = 0; i < 32; i++)
+			seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+		return seed;
+	}
+
+	inline void WaitFor(const Counter& counter, u64 target)
+	{
+		while (counter.value.load(std::memory_order_acquire) < target)
+			std::this_thread::yield();
+	}
+
+	// every task submitted by the main thread
+	template<typename Pool>
+	double FlatSubmit(u32 threadCount, u64 taskCount, TaskPoolStats* outStats = nullptr)
+	{
+		Pool pool;
+		pool.Start(threadCount);
+
+		Counter done;
+		Timer timer;
+		timer.Start();
+
+		for (u64 i = 0; i < taskCount; i++)
+		{
+			pool.AddTask([&done, i]() {
+				volatile u64 sink = FakeWork(i);
+				(void)sink;
+				done.value.fetch_add(1, std::memory_order_release);
+			});
+		}
+
+		WaitFor(done, taskCount);
+		u64 elapsedMs = std::max<u64>(timer.ElapsedMs(), 1);
+
+		if constexpr (std::is_same_v<Pool, TaskPool>)
+		{
+			if (outStats)
+				*outStats = pool.GetStats();
+		}
+
+		return (double)taskCount / ((double)elapsedMs / 1000.0);
+	}
+
+	// a few root tasks fanning out from inside the pool (what a staged asset load looks like)
+	template<typename Pool>
+	double NestedSpawn(u32 threadCount, u64 taskCount)
+	{
+		Pool pool;
+		pool.Start(threadCount);
+
+		const u64 rootCount = 16;
+		const u64 childrenPerRoot = taskCount / rootCount;
+
+		Counter done;
+		Timer timer;
+		timer.Start();
+
+		for (u64 r = 0; r < rootCount; r++)
+		{
+			pool.AddTask([&pool, &done, childrenPerRoot]() {
+				for (u64 i = 0; i < childrenPerRoot; i++)
+				{
+					pool.AddTask([&done, i]() {
+						volatile u64 sink = FakeWork(i);
+						(void)sink;
+						done.value.fetch_add(1, std::memory_order_release);
+					});
+				}
+			});
+		}
+
+		WaitFor(done, rootCount * childrenPerRoot);
+		u64 elapsedMs = std::max<u64>(timer.ElapsedMs(), 1);
+
+		return (double)(rootCount * childrenPerRoot) / ((double)elapsedMs / 1000.0);
+	}
+
+	inline void BusyWaitUs(u64 us)
+	{
+		Timer timer;
+		timer.Start();
+		while (timer.ElapsedUs() < us)
+			;
+	}
+
+	// read -> decode -> finish, like a small mesh load. returns the refs of the three stages
+	std::array<TaskPool::TaskRef, 3> SimulatedLoad(TaskPool& pool, ETaskPriority priority, u64 stageUs, Counter& done)
+	{
+		TaskPool::TaskHandle read = pool.CreateTask([stageUs]() { BusyWaitUs(stageUs); }, priority);
+		TaskPool::TaskHandle decode = pool.Then(read, [stageUs]() { BusyWaitUs(stageUs); }, priority);
+		TaskPool::TaskHandle finish = pool.Then(decode, [stageUs, &done]() {
+			BusyWaitUs(stageUs);
+			done.value.fetch_add(1, std::memory_order_release);
+		}, priority);
+
+		std::array<TaskPool::TaskRef, 3> refs = { pool.GetRef(read), pool.GetRef(decode), pool.GetRef(finish) };
+		pool.Submit(finish);
+		pool.Submit(decode);
+		pool.Submit(read);
+		return refs;
+	}
+
+	enum class ELatencyMode
+	{
+		Fifo,        // same class as the background loads, what the single queue did
+		Critical,    // submitted as critical
+		Reprioritized // submitted as background, bumped to critical right after
+	};
+
+	// ms from submission to completion of one load while the pool is busy with backgroundLoads others
+	double MeasureLoadLatency(u32 threads, u32 backgroundLoads, u64 stageUs, ELatencyMode mode)
+	{
+		TaskPool pool;
+		pool.Start(threads);
+
+		Counter backgroundDone;
+		for (u32 i = 0; i < backgroundLoads; i++)
+			SimulatedLoad(pool, ETaskPriority::Background, stageUs, backgroundDone);
+
+		// let the workers get going
+		BusyWaitUs(stageUs * 2);
+
+		Counter done;
+		Timer timer;
+		timer.Start();
+
+		ETaskPriority priority = mode == ELatencyMode::Critical ? ETaskPriority::Critical : ETaskPriority::Background;
+		std::array<TaskPool::TaskRef, 3> refs = SimulatedLoad(pool, priority, stageUs, done);
+
+		if (mode == ELatencyMode::Reprioritized)
+		{
+			for (TaskPool::TaskRef ref : refs)
+				pool.Reprioritize(ref, ETaskPriority::Critical);
+		}
+
+		WaitFor(done, 1);
+		double latencyMs = timer.ElapsedUs() / 1000.0;
+
+		WaitFor(backgroundDone, backgroundLoads);
+		return latencyMs;
+	}
+
+	// read (fill a private buffer) -> decode (ParallelFor over it) -> checksum, the buffer travels between workers
+	double LoadThroughput(const TaskPoolConfig& config, u32 loadCount, u64 wordsPerLoad)
+	{
+		constexpr u64 DECODE_GRAIN = 16 * 1024;
+
+		TaskPool pool;
+		pool.Start(config);
+
+		std::vector<std::vector<u32>> buffers(loadCount);
+		Counter done;
+		Counter checksum;
+
+		Timer timer;
+		timer.Start();
+
+		for (u32 i = 0; i < loadCount; i++)
+		{
+			std::vector<u32>* buffer = &buffers[i];
+
+			TaskPool::TaskHandle read = pool.CreateTask([buffer, wordsPerLoad, i]() {
+				buffer->resize(wordsPerLoad);
+				for (u64 w = 0; w < wordsPerLoad; w++)
+					(*buffer)[w] = (u32)(w * 2654435761u) ^ i;
+			});
+
+			TaskPool::TaskHandle decode = pool.Then(read, [&pool, buffer]() {
+				pool.ParallelFor(0, buffer->size(), DECODE_GRAIN, [buffer](u64 begin, u64 end) {
+					for (u64 w = begin; w < end; w++)
+						(*buffer)[w] = (u32)FakeWork((*buffer)[w]);
+				});
+			});
+
+			TaskPool::TaskHandle finish = pool.Then(decode, [buffer, &done, &checksum]() {
+				u64 sum = 0;
+				for (u32 word : *buffer)
+					sum += word;
+
+				checksum.value.fetch_add(sum, std::memory_order_relaxed);
+				*buffer = {};
+				done.value.fetch_add(1, std::memory_order_release);
+			});
+
+			pool.Submit(finish);
+			pool.Submit(decode);
+			pool.Submit(read);
+		}
+
+		WaitFor(done, loadCount);
+		u64 elapsedUs = std::max<u64>(timer.ElapsedUs(), 1);
+
+		return (double)loadCount / ((double)elapsedUs / 1e6);
+	}
+
+	struct BudgetedLoadResult
+	{
+		u64 peakResidentBytes = 0; // over the working set before the loads
+		MemoryBudgetStats budget;
+		UploadCopyStats uploads; // during the loads (the scene's uploads too if it's still loading)
+		double seconds = 0.0;
+	};
+
+	// meshes through a private AssetManager until they're all on the gpu, sampling the working set meanwhile.
+	// the meshes are destroyed at the end
+	BudgetedLoadResult LoadMeshesWithBudget(const std::vector<std::filesystem::path>& paths, u64 budgetBytes, bool decodeToStaging = true)
+	{
+		TaskPoolConfig config;
+		config.pinThreads = false; // the scene loader already sits on the worker cores
+
+		AssetManager loader;
+		loader.Init(config, {}, budgetBytes);
+		loader.SetDecodeMeshesToStaging(decodeToStaging);
+
+		BudgetedLoadResult result;
+		u64 baseline = Utils::GetProcessResidentBytes();
+		UploadCopyStats uploadsBefore = g_ResourceFactory.GetUploadCopyStats();
+
+		Timer timer;
+		timer.Start();
+
+		std::vector<Handle<Mesh>> meshes;
+		for (const std::filesystem::path& path : paths)
+			meshes.push_back(loader.LoadMesh(path));
+
+		u32 loaded = 0;
+		for (Handle<Mesh> mesh : meshes)
+			loader.OnLoaded(mesh, [&loaded]() { loaded++; });
+
+		// the loads are published on the main thread, we're blocking it: do what Update() does
+		while (true)
+		{
+			g_ResourceFactory.RetireUploads();
+			Async::RunMainThreadQueue();
+
+			u64 resident = Utils::GetProcessResidentBytes();
+			result.peakResidentBytes = std::max(result.peakResidentBytes, resident - std::min(resident, baseline));
+
+			if (loaded == meshes.size())
+				break;
+
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+
+		result.seconds = (double)timer.ElapsedUs() / 1e6;
+		result.budget = loader.GetMemoryBudget().GetStats();
+
+		UploadCopyStats uploadsAfter = g_ResourceFactory.GetUploadCopyStats();
+		result.uploads.uploads = uploadsAfter.uploads - uploadsBefore.uploads;
+		result.uploads.copiedBytes = uploadsAfter.copiedBytes - uploadsBefore.copiedBytes;
+		result.uploads.prestagedBytes = uploadsAfter.prestagedBytes - uploadsBefore.prestagedBytes;
+
+		loader.Shutdown();
+		loader.DestroyAssets(); // uploaded and not drawn, nothing to wait for
+		return result;
+	}
+
+	// the main thread queue before it went lock free (mutex + swapped vectors), kept here only as a baseline
+	struct LegacyMainThreadQueue
+	{
+		std::mutex lock;
+		std::vector<std::coroutine_handle<>> queue;
+		std::vector<std::coroutine_handle<>> running;
+
+		u32 Run()
+		{
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				if (queue.empty())
+					return 0;
+
+				running.swap(queue);
+			}
+
+			u32 count = (u32)running.size();
+			for (std::coroutine_handle<> handle : running)
+				handle.resume();
+
+			running.clear();
+			return count;
+		}
+	};
+
+	AsyncTask<> PublishNextFrame(std::atomic<u32>* published)
+	{
+		co_await Async::NextFrame();
+		published->fetch_add(1, std::memory_order_relaxed);
+	}
+
+	// an upload request as the workers queue them, about the size of a PendingLoadingRes
+	struct QueueItem
+	{
+		u32 producer = 0;
+		u32 sequence = 0;
+		u64 payload[8] = {};
+	};
+
+	struct QueueContention
+	{
+		double itemsPerSec = 0.0;
+		double pushNs = 0.0; // average time a producer spends in a push, waiting included
+	};
+
+	// producers -> one consumer, the way the upload queue was before the rings: mutex + vector + condvar,
+	// the consumer takes everything queued at once
+	QueueContention MeasureMutexQueue(u32 producers, u32 itemsPerProducer)
+	{
+		std::mutex lock;
+		std::condition_variable condVar;
+		std::vector<QueueItem> queue;
+		std::atomic<u64> pushNs = 0;
+
+		Timer timer;
+		timer.Start();
+
+		std::vector<std::thread> threads;
+		for (u32 p = 0; p < producers; p++)
+		{
+			threads.emplace_back([&, p]() {
+				Timer pushTimer;
+				pushTimer.Start();
+				for (u32 i = 0; i < itemsPerProducer; i++)
+				{
+					std::lock_guard<std::mutex> guard(lock);
+					queue.push_back(QueueItem{ p, i });
+					condVar.notify_all();
+				}
+				pushNs += pushTimer.ElapsedUs() * 1000;
+			});
+		}
+
+		u64 total = (u64)producers * itemsPerProducer;
+		u64 received = 0;
+		std::vector<QueueItem> batch;
+		while (received < total)
+		{
+			{
+				std::unique_lock<std::mutex> guard(lock);
+				condVar.wait(guard, [&queue]() { return !queue.empty(); });
+				batch.swap(queue);
+			}
+			received += batch.size();
+			batch.clear();
+		}
+
+		for (std::thread& thread : threads)
+			thread.join();
+
+		QueueContention result;
+		result.itemsPerSec = (double)total / ((double)std::max<u64>(timer.ElapsedUs(), 1) / 1e6);
+		result.pushNs = (double)pushNs.load() / (double)total;
+		return result;
+	}
+
+	// same traffic through the MPSC ring, the consumer sleeps on a counter the producers bump.
+	// checks that every item arrives once and in order per producer
+	QueueContention MeasureRingQueue(u32 producers, u32 itemsPerProducer, bool& outValid)
+	{
+		MPSCRing<QueueItem> ring(4096);
+		std::atomic<u32> wakeups = 0;
+		std::atomic<u64> pushNs = 0;
+
+		Timer timer;
+		timer.Start();
+
+		std::vector<std::thread> threads;
+		for (u32 p = 0; p < producers; p++)
+		{
+			threads.emplace_back([&, p]() {
+				Timer pushTimer;
+				pushTimer.Start();
+				for (u32 i = 0; i < itemsPerProducer; i++)
+				{
+					while (!ring.TryPush(QueueItem{ p, i }))
+						std::this_thread::yield();
+					wakeups.fetch_add(1, std::memory_order_release);
+					wakeups.notify_one();
+				}
+				pushNs += pushTimer.ElapsedUs() * 1000;
+			});
+		}
+
+		u64 total = (u64)producers * itemsPerProducer;
+		u64 received = 0;
+		std::vector<u32> nextSequence(producers, 0);
+		outValid = true;
+
+		QueueItem item;
+		while (received < total)
+		{
+			u32 seen = wakeups.load(std::memory_order_acquire);
+			bool any = false;
+			while (ring.TryPop(item))
+			{
+				outValid &= item.producer < producers && item.sequence == nextSequence[item.producer];
+				nextSequence[item.producer] = item.sequence + 1;
+				received++;
+				any = true;
+			}
+
+			if (!any)
+				wakeups.wait(seen, std::memory_order_acquire);
+		}
+
+		for (std::thread& thread : threads)
+			thread.join();
+
+		for (u32 p = 0; p < producers; p++)
+			outValid &= nextSequence[p] == itemsPerProducer;
+		outValid &= !ring.TryPop(item); // nothing left over
+
+		QueueContention result;
+		result.itemsPerSec = (double)total / ((double)std::max<u64>(timer.ElapsedUs(), 1) / 1e6);
+		result.pushNs = (double)pushNs.load() / (double)total;
+		return result;
+	}
+
+	// one producer streaming a counter through a small SPSC ring, false if anything is lost, doubled or reordered
+	bool StressSpscRing(u64 count, double& outItemsPerSec)
+	{
+		SPSCRing<u64> ring(1024);
+
+		Timer timer;
+		timer.Start();
+
+		std::thread producer([&ring, count]() {
+			for (u64 i = 0; i < count; i++)
+			{
+				while (!ring.TryPush(i))
+					std::this_thread::yield();
+			}
+		});
+
+		bool valid = true;
+		u64 expected = 0;
+		u64 value = 0;
+		while (expected < count)
+		{
+			if (ring.TryPop(value))
+			{
+				valid &= value == expected;
+				expected++;
+			}
+			else
+			{
+				std::this_thread::yield();
+			}
+		}
+
+		producer.join();
+		valid &= !ring.TryPop(value);
+
+		outItemsPerSec = (double)count / ((double)std::max<u64>(timer.ElapsedUs(), 1) / 1e6);
+		return valid;
+	}
+
+	// best of a few runs, us
+	template<typename F>
+	u64 BestOfUs(u32 runs, F&& fn)
+	{
+		u64 best = ~0ull;
+		for (u32 run = 0; run < runs; run++)
+		{
+			Timer timer;
+			timer.Start();
+			fn();
+			best = std::min(best, timer.ElapsedUs());
+		}
+		return best;
+	}
+
+	// reads a byte of every page: a mapped file costs its page faults only when something (the upload) reads it
+	u64 TouchPages(const u8* data, u64 size)
+	{
+		constexpr u64 PAGE_SIZE = 4096;
+		u64 sum = 0;
+		for (u64 offset = 0; offset < size; offset += PAGE_SIZE)
+			sum += data[offset];
+		return sum;
+	}
+
+	// one attribute format of the vertex kernel benchmark
+	struct AttributeFormat
+	{
+		const char* name;
+		EVertexAttribute attribute;
+		EComponentType componentType;
+		u32 componentCount;
+		bool normalized;
+	};
+
+	u64 GetComponentBytes(EComponentType componentType)
+	{
+		switch (componentType)
+		{
+		case EComponentType::S8:
+		case EComponentType::U8:
+			return 1;
+		case EComponentType::S16:
+		case EComponentType::U16:
+			return 2;
+		default:
+			return 4;
+		}
+	}
+
+	fastgltf::ComponentType ToGltfComponentType(EComponentType componentType)
+	{
+		switch (componentType)
+		{
+		case EComponentType::S8:
+			return fastgltf::ComponentType::Byte;
+		case EComponentType::U8:
+			return fastgltf::ComponentType::UnsignedByte;
+		case EComponentType::S16:
+			return fastgltf::ComponentType::Short;
+		case EComponentType::U16:
+			return fastgltf::ComponentType::UnsignedShort;
+		case EComponentType::U32:
+			return fastgltf::ComponentType::UnsignedInt;
+		default:
+			return fastgltf::ComponentType::Float;
+		}
+	}
+
+	// tightly packed random elements, floats in a mesh-like range
+	AttributeStream MakeAttributeStream(std::vector<u8>& storage, u64 count, EComponentType componentType, u32 componentCount, bool normalized)
+	{
+		u64 componentBytes = GetComponentBytes(componentType);
+		storage.resize(count * componentCount * componentBytes);
+
+		u32 seed = 0x9E3779B9u;
+		auto next = [&seed]() {
+			seed ^= seed << 13;
+			seed ^= seed >> 17;
+			seed ^= seed << 5;
+			return seed;
+		};
+
+		if (componentType == EComponentType::Float)
+		{
+			for (u64 i = 0; i < storage.size(); i += sizeof(float))
+			{
+				float value = (float)(next() % 20000) / 1000.0f - 10.0f;
+				memcpy(&storage[i], &value, sizeof(float));
+			}
+		}
+		else
+		{
+			for (u8& byte : storage)
+				byte = (u8)next();
+		}
+
+		AttributeStream stream;
+		stream.data = storage.data();
+		stream.stride = componentCount * componentBytes;
+		stream.componentCount = componentCount;
+		stream.componentType = componentType;
+		stream.normalized = normalized;
+		return stream;
+	}
+
+	// the decode before the kernels: one fastgltf conversion per element, one pass over the vertices per attribute
+	template<typename T, typename F>
+	void DecodeElementByElement(const AttributeStream& stream, u64 count, F&& store)
+	{
+		fastgltf::ComponentType componentType = ToGltfComponentType(stream.componentType);
+		for (u64 i = 0; i < count; i++)
+			store(i, fastgltf::internal::getAccessorElementAt<T>(componentType, (const std::byte*)stream.data + i * stream.stride, stream.normalized));
+	}
+
+	// peak working set over the one before fn(), sampled by a thread every millisecond while it runs
+	template<typename F>
+	u64 PeakResidentDuring(F&& fn)
+	{
+		u64 baseline = Utils::GetProcessResidentBytes();
+		std::atomic<bool> done = false;
+		u64 peak = baseline;
+
+		std::thread sampler([&]() {
+			while (!done.load(std::memory_order_relaxed))
+			{
+				peak = std::max(peak, Utils::GetProcessResidentBytes());
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+		});
+
+		fn();
+		done = true;
+		sampler.join();
+
+		peak = std::max(peak, Utils::GetProcessResidentBytes());
+		return peak - std::min(peak, baseline);
+	}
+
+	// the gltf load before the staged one: the whole file in a GltfDataBuffer, the glb binary chunk copied again by the
+	// parser, then one fastgltf conversion per element and attribute. kept here only as a baseline
+	void LegacyLoadGltf(const std::filesystem::path& path, std::vector<Vertex>& vertices, std::vector<Index>& indices)
+	{
+		vertices.clear();
+		indices.clear();
+
+		fastgltf::Expected<fastgltf::GltfDataBuffer> data = fastgltf::GltfDataBuffer::FromPath(path);
+		if (!data)
+			return;
+
+		fastgltf::Parser parser;
+		fastgltf::Expected<fastgltf::Asset> gltf = parser.loadGltfBinary(data.get(), path.parent_path(), fastgltf::Options::LoadExternalBuffers);
+		if (!gltf)
+			return;
+
+		for (const fastgltf::Mesh& mesh : gltf->meshes)
+		{
+			for (const fastgltf::Primitive& primitive : mesh.primitives)
+			{
+				u64 vertexOffset = vertices.size();
+				const fastgltf::Accessor& positions = gltf->accessors[primitive.findAttribute("POSITION")->accessorIndex];
+				vertices.resize(vertexOffset + positions.count, Vertex{ {}, 0.0f, { 1, 0, 0 }, 0.0f, glm::vec4{ 1.0f } });
+
+				fastgltf::iterateAccessor<std::uint32_t>(gltf.get(), gltf->accessors[primitive.indicesAccessor.value()], [&](std::uint32_t index) {
+					indices.push_back(index + (Index)vertexOffset);
+				});
+				fastgltf::iterateAccessorWithIndex<glm::vec3>(gltf.get(), positions, [&](glm::vec3 v, size_t i) {
+					vertices[vertexOffset + i].position = v;
+				});
+
+				auto normals = primitive.findAttribute("NORMAL");
+				if (normals != primitive.attributes.end())
+				{
+					fastgltf::iterateAccessorWithIndex<glm::vec3>(gltf.get(), gltf->accessors[normals->accessorIndex], [&](glm::vec3 v, size_t i) {
+						vertices[vertexOffset + i].normal = v;
+					});
+				}
+
+				auto uvs = primitive.findAttribute("TEXCOORD_0");
+				if (uvs != primitive.attributes.end())
+				{
+					fastgltf::iterateAccessorWithIndex<glm::vec2>(gltf.get(), gltf->accessors[uvs->accessorIndex], [&](glm::vec2 v, size_t i) {
+						vertices[vertexOffset + i].uv_x = v.x;
+						vertices[vertexOffset + i].uv_y = v.y;
+					});
+				}
+			}
+		}
+	}
+
+	// a glb with a single size x size grid: float3 positions and normals, float2 uvs and u32 indices. written a row at
+	// a time, the whole file is never in memory
+	bool WriteGridGlb(const std::filesystem::path& path, u32 size)
+	{
+		u64 vertexCount = (u64)size * size;
+		u64 indexCount = 6ull * (size - 1) * (size - 1);
+		u64 positionsSize = vertexCount * 12;
+		u64 uvsSize = vertexCount * 8;
+		u64 indicesSize = indexCount * 4;
+		u64 binarySize = 2 * positionsSize + uvsSize + indicesSize;
+
+		char json[2048];
+		snprintf(json, sizeof(json),
+			"{\"asset\":{\"version\":\"2.0\"},\"buffers\":[{\"byteLength\":%llu}],"
+			"\"bufferViews\":[{\"buffer\":0,\"byteOffset\":0,\"byteLength\":%llu},{\"buffer\":0,\"byteOffset\":%llu,\"byteLength\":%llu},"
+			"{\"buffer\":0,\"byteOffset\":%llu,\"byteLength\":%llu},{\"buffer\":0,\"byteOffset\":%llu,\"byteLength\":%llu}],"
+			"\"accessors\":[{\"bufferView\":0,\"componentType\":5126,\"count\":%llu,\"type\":\"VEC3\",\"min\":[0,0,0],\"max\":[%u,0,%u]},"
+			"{\"bufferView\":1,\"componentType\":5126,\"count\":%llu,\"type\":\"VEC3\"},"
+			"{\"bufferView\":2,\"componentType\":5126,\"count\":%llu,\"type\":\"VEC2\"},"
+			"{\"bufferView\":3,\"componentType\":5125,\"count\":%llu,\"type\":\"SCALAR\"}],"
+			"\"meshes\":[{\"primitives\":[{\"attributes\":{\"POSITION\":0,\"NORMAL\":1,\"TEXCOORD_0\":2},\"indices\":3}]}]}",
+			binarySize, positionsSize, positionsSize, positionsSize, 2 * positionsSize, uvsSize, 2 * positionsSize + uvsSize, indicesSize,
+			vertexCount, size - 1, size - 1, vertexCount, vertexCount, indexCount);
+
+		// chunks are 4 byte aligned, the json with spaces
+		std::string jsonChunk = json;
+		jsonChunk.resize((jsonChunk.size() + 3) & ~3ull, ' ');
+
+		std::ofstream file(path, std::ios::binary);
+		if (!file)
+			return false;
+
+		auto writeU32 = [&file](u32 value) { file.write((const char*)&value, sizeof(value)); };
+		writeU32(0x46546C67); // "glTF"
+		writeU32(2);
+		writeU32((u32)(12 + 8 + jsonChunk.size() + 8 + binarySize));
+		writeU32((u32)jsonChunk.size());
+		writeU32(0x4E4F534A); // "JSON"
+		file.write(jsonChunk.data(), jsonChunk.size());
+		writeU32((u32)binarySize);
+		writeU32(0x004E4942); // "BIN"
+
+		std::vector<float> row(size * 3);
+		for (u32 z = 0; z < size; z++)
+		{
+			for (u32 x = 0; x < size; x++)
+			{
+				row[x * 3 + 0] = (float)x;
+				row[x * 3 + 1] = 0.0f;
+				row[x * 3 + 2] = (float)z;
+			}
+			file.write((const char*)row.data(), size * 12);
+		}
+
+		for (u32 x = 0; x < size; x++)
+		{
+			row[x * 3 + 0] = 0.0f;
+			row[x * 3 + 1] = 1.0f;
+			row[x * 3 + 2] = 0.0f;
+		}
+		for (u32 z = 0; z < size; z++)
+			file.write((const char*)row.data(), size * 12);
+
+		for (u32 z = 0; z < size; z++)
+		{
+			for (u32 x = 0; x < size; x++)
+			{
+				row[x * 2 + 0] = (float)x / (size - 1);
+				row[x * 2 + 1] = (float)z / (size - 1);
+			}
+			file.write((const char*)row.data(), size * 8);
+		}
+
+		std::vector<u32> quads(6 * (size - 1));
+		for (u32 z = 0; z + 1 < size; z++)
+		{
+			for (u32 x = 0; x + 1 < size; x++)
+			{
+				u32 i = z * size + x;
+				u32* quad = &quads[x * 6];
+				quad[0] = i;
+				quad[1] = i + size;
+				quad[2] = i + 1;
+				quad[3] = i + 1;
+				quad[4] = i + size;
+				quad[5] = i + size + 1;
+			}
+			file.write((const char*)quads.data(), quads.size() * sizeof(u32));
+		}
+
+		return (bool)file;
+	}
+
+	// size x size vertices, quads row by row: the order most exporters write a regular mesh in
+	std::vector<Index> MakeGridIndices(u32 size)
+	{
+		std::vector<Index> indices;
+		indices.reserve(6ull * (size - 1) * (size - 1));
+		for (u32 z = 0; z + 1 < size; z++)
+		{
+			for (u32 x = 0; x + 1 < size; x++)
+			{
+				Index i = z * size + x;
+				indices.insert(indices.end(), { i, i + size, i + 1, i + 1, i + size, i + size + 1 });
+			}
+		}
+		return indices;
+	}
+
+	// uv sphere, ring by ring from a pole to the other. the pole rows are fans of thin triangles
+	std::vector<Index> MakeSphereIndices(u32 rings, u32 segments)
+	{
+		std::vector<Index> indices;
+		for (u32 r = 0; r < rings; r++)
+		{
+			for (u32 s = 0; s < segments; s++)
+			{
+				Index i = r * (segments + 1) + s;
+				Index below = i + segments + 1;
+				if (r > 0)
+					indices.insert(indices.end(), { i, below, i + 1 });
+				if (r + 1 < rings)
+					indices.insert(indices.end(), { i + 1, below, below + 1 });
+			}
+		}
+		return indices;
+	}
+
+	// outward facing (counter clockwise seen from outside), appended to the arrays
+	void AppendSphere(std::vector<Vertex>& vertices, std::vector<Index>& indices, glm::vec3 center, float radius, u32 rings, u32 segments)
+	{
+		Index base = (Index)vertices.size();
+		for (u32 r = 0; r <= rings; r++)
+		{
+			for (u32 s = 0; s <= segments; s++)
+			{
+				float theta = 3.14159265f * r / rings;
+				float phi = 2.0f * 3.14159265f * s / segments;
+				glm::vec3 normal(std::sin(theta) * std::cos(phi), std::cos(theta), -std::sin(theta) * std::sin(phi));
+
+				Vertex& vertex = vertices.emplace_back();
+				vertex.position = center + normal * radius;
+				vertex.normal = normal;
+				vertex.uv_x = (float)s / segments;
+				vertex.uv_y = (float)r / rings;
+				vertex.color = glm::vec4(normal, 1.0f);
+			}
+		}
+
+		for (Index index : MakeSphereIndices(rings, segments))
+			indices.push_back(base + index);
+	}
+
+	// the vertices in random order, the indices follow them: what a welding pass with a hash map leaves
+	void ShuffleVertices(std::vector<Vertex>& vertices, std::vector<Index>& indices, u32 seed)
+	{
+		std::vector<Index> order(vertices.size());
+		for (u64 i = 0; i < order.size(); i++)
+			order[i] = (Index)i;
+		std::shuffle(order.begin(), order.end(), std::mt19937(seed));
+
+		std::vector<Vertex> shuffled(vertices.size());
+		std::vector<Index> remap(vertices.size());
+		for (u64 i = 0; i < order.size(); i++)
+		{
+			shuffled[i] = vertices[order[i]];
+			remap[order[i]] = (Index)i;
+		}
+
+		vertices.swap(shuffled);
+		for (Index& index : indices)
+			index = remap[index];
+	}
+
+	// the triangles in random order, what a tool that doesn't care about it exports
+	void ShuffleTriangles(std::vector<Index>& indices, u32 seed)
+	{
+		std::vector<std::array<Index, 3>> triangles(indices.size() / 3);
+		memcpy(triangles.data(), indices.data(), triangles.size() * sizeof(triangles[0]));
+		std::shuffle(triangles.begin(), triangles.end(), std::mt19937(seed));
+		memcpy(indices.data(), triangles.data(), triangles.size() * sizeof(triangles[0]));
+	}
+
+	// every triangle rotated to start at its smallest index (the winding stays), sorted. same for the same triangles in any order
+	std::vector<std::array<Index, 3>> GetCanonicalTriangles(std::span<const Index> indices)
+	{
+		std::vector<std::array<Index, 3>> triangles(indices.size() / 3);
+		for (u64 t = 0; t < triangles.size(); t++)
+		{
+			const Index* corners = &indices[t * 3];
+			u32 first = corners[1] < corners[0] ? (corners[2] < corners[1] ? 2 : 1) : (corners[2] < corners[0] ? 2 : 0);
+			triangles[t] = { corners[first], corners[(first + 1) % 3], corners[(first + 2) % 3] };
+		}
+		std::sort(triangles.begin(), triangles.end());
+		return triangles;
+	}
+
+	// every draw of the mesh against its decoded data (KeepCPUData): the indices it reads + its vertex offset. the
+	// vertex buffer is the decoded vertices as they are
+	bool IsCompactLayoutValid(const Mesh& mesh)
+	{
+		std::span<const Vertex> vertices = mesh.GetVertices();
+		std::span<const Index> indices = mesh.GetIndices();
+		std::span<const u8> indexData = mesh.GetIndexData();
+		if (mesh.GetVertexBufferSize() != vertices.size_bytes() || memcmp(mesh.GetVertexData().data(), vertices.data(), vertices.size_bytes()) != 0)
+			return false;
+
+		for (u64 i = 0; i < mesh.GetSubmeshes().size(); i++)
+		{
+			const Submesh& submesh = mesh.GetSubmeshes()[i];
+			const SubmeshDraw& draw = mesh.GetDraws()[i];
+			u32 indexSize = draw.indexType == VK_INDEX_TYPE_UINT16 ? sizeof(u16) : sizeof(u32);
+			if (draw.indexCount != submesh.indexCount || draw.indexBufferOffset % indexSize != 0
+				|| draw.indexBufferOffset + (u64)draw.indexCount * indexSize > indexData.size())
+				return false;
+
+			for (u32 j = 0; j < draw.indexCount; j++)
+			{
+				const u8* index = indexData.data() + draw.indexBufferOffset + (u64)j * indexSize;
+				u32 value = indexSize == sizeof(u16) ? *(const u16*)index : *(const u32*)index;
+				if ((u64)value + draw.vertexOffset != indices[submesh.indexOffset + j])
+					return false;
+			}
+		}
+		return true;
+	}
+
+}
+
+void Bench::TaskPoolThroughput()
+{
+	constexpr u64 TASK_COUNT = 200000;
+	u32 maxThreads = std::max(1u, std::thread::hardware_concurrency());
+
+	LOG_INFO("TaskPool benchmark: %llu tasks per run, Mtasks/sec (legacy -> work stealing)", TASK_COUNT);
+
+	for (u32 threads = 1; threads <= maxThreads; threads = threads < maxThreads ? std::min(threads * 2, maxThreads) : threads + 1)
+	{
+		double flatLegacy = FlatSubmit<LegacyTaskPool>(threads, TASK_COUNT);
+		TaskPoolStats stats;
+		double flatNew = FlatSubmit<TaskPool>(threads, TASK_COUNT, &stats);
+		double nestedLegacy = NestedSpawn<LegacyTaskPool>(threads, TASK_COUNT);
+		double nestedNew = NestedSpawn<TaskPool>(threads, TASK_COUNT);
+
+		LOG_INFO("  %2u threads | external submit: %.2f -> %.2f (x%.2f) | nested spawn: %.2f -> %.2f (x%.2f)", threads,
+			flatLegacy / 1e6, flatNew / 1e6, flatNew / flatLegacy,
+			nestedLegacy / 1e6, nestedNew / 1e6, nestedNew / nestedLegacy);
+
+		// std::function in the legacy pool heap allocates as soon as the capture is bigger than its small buffer
+		LOG_INFO("             heap allocations per enqueued task: %.5f (%llu allocs, %llu tasks)",
+			(double)stats.heapAllocations / (double)std::max<u64>(stats.enqueuedTasks, 1), stats.heapAllocations, stats.enqueuedTasks);
+	}
+}
+
+void Bench::ParallelLoops()
+{
+	u32 threads = std::max(1u, std::thread::hardware_concurrency());
+
+	TaskPool pool;
+	pool.Start(threads);
+
+	constexpr u64 GRAIN_SIZE = 16 * 1024;
+	const u64 elementCounts[] = { 1000000, 4000000, 16000000 };
+
+	LOG_INFO("ParallelFor benchmark: %u workers + caller, grain %llu, ms (serial -> parallel)", threads, GRAIN_SIZE);
+
+	for (u64 count : elementCounts)
+	{
+		std::vector<float> src(count);
+		std::vector<float> dst(count);
+		for (u64 i = 0; i < count; i++)
+			src[i] = (float)(i % 1024);
+
+		auto transform = [&](u64 begin, u64 end) {
+			for (u64 i = begin; i < end; i++)
+				dst[i] = std::sqrt(src[i]) * 0.5f + 1.0f;
+		};
+
+		auto sum = [&](u64 begin, u64 end) {
+			double acc = 0.0;
+			for (u64 i = begin; i < end; i++)
+				acc += src[i];
+			return acc;
+		};
+
+		Timer timer;
+
+		timer.Start();
+		transform(0, count);
+		u64 forSerial = timer.ElapsedUs();
+
+		timer.Start();
+		pool.ParallelFor(0, count, GRAIN_SIZE, transform);
+		u64 forParallel = timer.ElapsedUs();
+
+		timer.Start();
+		volatile double serialSum = sum(0, count);
+		u64 reduceSerial = timer.ElapsedUs();
+
+		timer.Start();
+		volatile double parallelSum = pool.ParallelReduce(0, count, GRAIN_SIZE, 0.0, sum, [](double a, double b) { return a + b; });
+		u64 reduceParallel = timer.ElapsedUs();
+
+		LOG_INFO("  %8llu elements | for: %.2f -> %.2f | reduce: %.2f -> %.2f (sums %.0f / %.0f)", count,
+			forSerial / 1000.0, forParallel / 1000.0, reduceSerial / 1000.0, reduceParallel / 1000.0, (double)serialSum, (double)parallelSum);
+	}
+}
+
+void Bench::PriorityLatency()
+{
+	constexpr u32 BACKGROUND_LOADS = 256;
+	constexpr u64 STAGE_US = 500;
+	u32 threads = std::max(1u, std::thread::hardware_concurrency());
+
+	double fifo = MeasureLoadLatency(threads, BACKGROUND_LOADS, STAGE_US, ELatencyMode::Fifo);
+	double critical = MeasureLoadLatency(threads, BACKGROUND_LOADS, STAGE_US, ELatencyMode::Critical);
+	double reprioritized = MeasureLoadLatency(threads, BACKGROUND_LOADS, STAGE_US, ELatencyMode::Reprioritized);
+
+	// the queue drains in ~ BACKGROUND_LOADS * 3 * STAGE_US / threads, a critical load should only wait for the stages already running
+	LOG_INFO("Priority latency: %u workers, %u background loads queued (3 x %llu us stages)", threads, BACKGROUND_LOADS, STAGE_US);
+	LOG_INFO("  same class (fifo): %.2f ms | critical: %.2f ms | background bumped to critical: %.2f ms", fifo, critical, reprioritized);
+}
+
+void Bench::LoadAffinity()
+{
+	constexpr u32 LOAD_COUNT = 256;
+	constexpr u64 WORDS_PER_LOAD = 512 * 1024; // 2MB per load
+	constexpr u32 RUNS = 3;
+
+	const CpuTopology& topology = GetCpuTopology();
+
+	TaskPoolConfig fixed;
+	fixed.threadCount = 4; // what main() used to hard code
+	fixed.pinThreads = false;
+
+	TaskPoolConfig floating;
+	floating.pinThreads = false;
+
+	TaskPoolConfig pinned;
+	pinned.pinThreads = true;
+
+	// best of a few runs, the first one also pays for the page faults
+	double fixedRate = 0.0, floatingRate = 0.0, pinnedRate = 0.0;
+	for (u32 run = 0; run < RUNS; run++)
+	{
+		fixedRate = std::max(fixedRate, LoadThroughput(fixed, LOAD_COUNT, WORDS_PER_LOAD));
+		floatingRate = std::max(floatingRate, LoadThroughput(floating, LOAD_COUNT, WORDS_PER_LOAD));
+		pinnedRate = std::max(pinnedRate, LoadThroughput(pinned, LOAD_COUNT, WORDS_PER_LOAD));
+	}
+
+	LOG_INFO("Load throughput: %u loads x %llu KB, %u physical cores / %u logical cpus / %u L3 groups%s", LOAD_COUNT, WORDS_PER_LOAD * 4 / 1024,
+		topology.GetPhysicalCoreCount(), topology.logicalCpuCount, topology.l3GroupCount, topology.detected ? "" : " (not detected, no pinning)");
+	LOG_INFO("  fixed 4 workers: %.1f loads/s | %u workers floating: %.1f loads/s | %u workers pinned: %.1f loads/s (x%.2f vs floating)",
+		fixedRate, TaskPool::ResolveThreadCount(floating), floatingRate, TaskPool::ResolveThreadCount(pinned), pinnedRate, pinnedRate / floatingRate);
+}
+
+void Bench::LoadingMemoryBudget()
+{
+	constexpr u32 COPIES = 16;
+	constexpr u64 BUDGET = 256ull * 1024 * 1024;
+	constexpr u32 GRID_SIZE = 1000; // ~55 MB glb, 70 MB decoded: the 16 decoded copies are over twice budget + staging
+
+	// the asset cache would turn the copies into a single load, every copy gets its own file
+	const std::filesystem::path copiesDir = std::filesystem::temp_directory_path() / "vk_test_bench";
+	std::error_code error;
+	std::filesystem::create_directories(copiesDir, error);
+
+	std::vector<std::filesystem::path> copies;
+	for (u32 i = 0; i < COPIES; i++)
+	{
+		std::filesystem::path& copy = copies.emplace_back(copiesDir / ("budget_" + std::to_string(i) + ".glb"));
+		if (!WriteGridGlb(copy, GRID_SIZE))
+		{
+			LOG_WARN("Loading memory budget: unable to write %s", copy.string().c_str());
+			return;
+		}
+	}
+
+	u64 fileBytes = (u64)std::filesystem::file_size(copies[0], error);
+	u64 decodedBytes = (u64)GRID_SIZE * GRID_SIZE * sizeof(Vertex) + 6ull * (GRID_SIZE - 1) * (GRID_SIZE - 1) * sizeof(Index);
+
+	// decoded in ram, all of it charged. budgeted first: the unlimited run leaves the staging buffer pages resident and
+	// would hide part of the peak
+	BudgetedLoadResult budgeted = LoadMeshesWithBudget(copies, BUDGET, false);
+	BudgetedLoadResult unlimited = LoadMeshesWithBudget(copies, ~0ull, false);
+
+	std::filesystem::remove_all(copiesDir, error);
+
+	// the mapped staging buffer becomes resident as the uploads touch it, it isn't charged. the unlimited run has to
+	// go over too, or the loads were too small to tell anything
+	u64 stagingBytes = g_ResourceFactory.GetStagingBufferSize();
+	u64 allowedResident = BUDGET + stagingBytes;
+	bool chargeOk = budgeted.budget.peakUsedBytes <= BUDGET;
+	bool residentOk = budgeted.peakResidentBytes <= allowedResident;
+	bool unlimitedOver = unlimited.peakResidentBytes > allowedResident;
+
+	LOG_INFO("Loading memory budget: %u x %u^2 grid glb (%.1f MB file, %.1f MB decoded), %.0f MB decoded in total", COPIES, GRID_SIZE,
+		Utils::BytesToMegabytes(fileBytes), Utils::BytesToMegabytes(decodedBytes), Utils::BytesToMegabytes(decodedBytes * COPIES));
+	LOG_INFO("  unlimited: %.2fs, peak charged %.1f MB, peak resident +%.1f MB",
+		unlimited.seconds, Utils::BytesToMegabytes(unlimited.budget.peakUsedBytes), Utils::BytesToMegabytes(unlimited.peakResidentBytes));
+	LOG_INFO("  %.0f MB budget: %.2fs, peak charged %.1f MB, peak resident +%.1f MB, %llu loads deferred (%.1f ms waiting on average)",
+		Utils::BytesToMegabytes(BUDGET), budgeted.seconds, Utils::BytesToMegabytes(budgeted.budget.peakUsedBytes), Utils::BytesToMegabytes(budgeted.peakResidentBytes),
+		budgeted.budget.deferredRequests, budgeted.budget.deferredRequests ? budgeted.budget.waitUs / 1000.0 / budgeted.budget.deferredRequests : 0.0);
+
+	if (chargeOk && residentOk && unlimitedOver)
+		LOG_INFO("  PASS: peak resident under budget + %.0f MB staging, the unlimited run went over it", Utils::BytesToMegabytes(stagingBytes));
+	else
+		LOG_ERR("  FAIL: %s", !chargeOk ? "the budget was exceeded (estimate too low?)" : !residentOk ? "peak resident over budget + staging"
+			: "the unlimited run stayed under budget + staging too, nothing was tested");
+}
+
+void Bench::CookedMeshLoad()
+{
+	constexpr u32 RUNS = 5;
+	// the large scene: ~215 MB glb, 275 MB decoded
+	constexpr u32 GRID_SIZE = 2000;
+
+	// cooked into temp, the assets folder is left alone
+	const std::filesystem::path cookDir = std::filesystem::temp_directory_path() / "vk_test_bench";
+	std::error_code error;
+	std::filesystem::create_directories(cookDir, error);
+
+	const std::filesystem::path gridPath = cookDir / "grid.glb";
+	if (!WriteGridGlb(gridPath, GRID_SIZE))
+	{
+		LOG_WARN("Cooked mesh load: unable to write %s", gridPath.string().c_str());
+		return;
+	}
+
+	const std::filesystem::path paths[] = {
+		std::filesystem::path("assets") / "basicmesh.glb",
+		std::filesystem::path("assets") / "car.glb",
+		std::filesystem::path("assets") / "diorama.glb",
+		gridPath,
+	};
+
+	LOG_INFO("Cooked mesh load: best of %u warm runs, gltf (parse + decode) vs .vkmesh (mapped, then every page read)", RUNS);
+
+	for (const std::filesystem::path& path : paths)
+	{
+		if (!std::filesystem::exists(path, error))
+		{
+			LOG_WARN("  %s not found, skipped", path.string().c_str());
+			continue;
+		}
+
+		Mesh gltfMesh;
+		u64 gltfUs = BestOfUs(RUNS, [&]() {
+			gltfMesh.ClearData();
+			gltfMesh.LoadGltf(path);
+		});
+
+		std::filesystem::path cookedPath = cookDir / path.filename();
+		cookedPath.replace_extension(".vkmesh");
+		if (!gltfMesh.SaveCooked(cookedPath))
+			continue;
+
+		Mesh cookedMesh;
+		u64 mapUs = BestOfUs(RUNS, [&]() { cookedMesh.LoadCooked(cookedPath); });
+
+		volatile u64 sink = 0;
+		u64 touchedUs = BestOfUs(RUNS, [&]() {
+			cookedMesh.LoadCooked(cookedPath);
+			sink = sink + TouchPages(cookedMesh.GetVertexData().data(), cookedMesh.GetVertexBufferSize())
+				+ TouchPages(cookedMesh.GetIndexData().data(), cookedMesh.GetIndexBufferSize());
+		});
+
+		bool same = gltfMesh.GetVertexBufferSize() == cookedMesh.GetVertexBufferSize() && gltfMesh.GetIndexBufferSize() == cookedMesh.GetIndexBufferSize()
+			&& gltfMesh.GetSubmeshes().size() == cookedMesh.GetSubmeshes().size()
+			&& memcmp(gltfMesh.GetVertexData().data(), cookedMesh.GetVertexData().data(), gltfMesh.GetVertexBufferSize()) == 0
+			&& memcmp(gltfMesh.GetIndexData().data(), cookedMesh.GetIndexData().data(), gltfMesh.GetIndexBufferSize()) == 0;
+
+		LOG_INFO("  %s: %llu vertices, %llu indices, %.1f MB", path.string().c_str(),
+			(u64)gltfMesh.GetVertices().size(), (u64)gltfMesh.GetIndices().size(), Utils::BytesToMegabytes(gltfMesh.GetMemoryFootprint()));
+		LOG_INFO("    gltf %.2f ms | cooked %.3f ms mapped (x%.0f), %.2f ms with every page read (x%.1f) | %s",
+			gltfUs / 1000.0, mapUs / 1000.0, (double)gltfUs / (double)std::max<u64>(mapUs, 1),
+			touchedUs / 1000.0, (double)gltfUs / (double)std::max<u64>(touchedUs, 1), same ? "same data" : "DATA MISMATCH");
+
+		cookedMesh.ClearData();
+		std::filesystem::remove(cookedPath, error);
+	}
+
+	std::filesystem::remove(gridPath, error);
+}
+
+void Bench::AssetPackLoad()
+{
+	constexpr u32 ASSET_COUNT = 3000;
+	constexpr u32 ASSETS_PER_DIR = 100;
+	constexpr u64 MIN_SIZE = 1024;
+	constexpr u64 MAX_SIZE = 16 * 1024;
+	constexpr u32 RUNS = 3;
+
+	const std::filesystem::path benchDir = std::filesystem::temp_directory_path() / "vk_test_bench" / "pack";
+	const std::filesystem::path packPath = benchDir / "bench.vkpack";
+	std::error_code error;
+	std::filesystem::remove_all(benchDir, error);
+
+	// random sizes, same seed every time
+	std::vector<PackSource> sources;
+	std::vector<u8> bytes(MAX_SIZE);
+	u64 totalBytes = 0;
+	u32 seed = 12345;
+	auto random = [&seed]() { seed = seed * 1664525u + 1013904223u; return seed >> 8; };
+
+	for (u32 i = 0; i < ASSET_COUNT; i++)
+	{
+		char name[64];
+		snprintf(name, sizeof(name), "dir%02u/asset%04u.bin", i / ASSETS_PER_DIR, i);
+
+		PackSource& source = sources.emplace_back();
+		source.name = name;
+		source.file = benchDir / "loose" / name;
+		std::filesystem::create_directories(source.file.parent_path(), error);
+
+		u64 size = MIN_SIZE + random() % (MAX_SIZE - MIN_SIZE);
+		for (u64 b = 0; b < size; b++)
+			bytes[b] = (u8)random();
+
+		std::ofstream file(source.file, std::ios::binary | std::ios::trunc);
+		file.write((const char*)bytes.data(), (std::streamsize)size);
+		totalBytes += size;
+	}
+
+	if (!WriteAssetPack(packPath, "loose", sources))
+		return;
+
+	LOG_INFO("Asset pack: %u assets, %.1f MB, best of %u warm runs (the os file cache is not flushed)", ASSET_COUNT, Utils::BytesToMegabytes(totalBytes), RUNS);
+
+	volatile u64 sink = 0;
+
+	// every load opens, reads and closes its file
+	u64 looseUs = BestOfUs(RUNS, [&]() {
+		for (const PackSource& source : sources)
+		{
+			IOBuffer file = IOQueue::ReadFileNow(source.file);
+			sink = sink + file.Size();
+		}
+	});
+
+	// startup: map + table of contents check
+	AssetPack pack;
+	u64 openUs = BestOfUs(RUNS, [&]() { pack.Open(packPath); });
+
+	// every load is a lookup and a view, the whole batch is one prefetch per run of neighbours
+	u32 reads = 0;
+	std::vector<const PackEntry*> entries;
+	u64 packUs = BestOfUs(RUNS, [&]() {
+		entries.clear();
+		for (const PackSource& source : sources)
+			entries.push_back(pack.Find(source.name));
+
+		reads = pack.Prefetch(entries);
+
+		for (const PackEntry* entry : entries)
+		{
+			std::span<const u8> data = pack.GetData(*entry);
+			sink = sink + TouchPages(data.data(), data.size());
+		}
+	});
+
+	bool same = entries.size() == sources.size();
+	for (size_t i = 0; i < sources.size() && same; i++)
+	{
+		IOBuffer file = IOQueue::ReadFileNow(sources[i].file);
+		std::span<const u8> data = pack.GetData(*entries[i]);
+		same = data.size() == file.Size() && memcmp(data.data(), file.Data(), data.size()) == 0 && pack.Verify(*entries[i]);
+	}
+
+	LOG_INFO("  loose files: %.2f ms (%u open + read)", looseUs / 1000.0, ASSET_COUNT);
+	LOG_INFO("  pack: %.3f ms open, %.2f ms loads (%u reads) -> x%.1f | %s", openUs / 1000.0, packUs / 1000.0, reads,
+		(double)looseUs / (double)std::max<u64>(openUs + packUs, 1), same ? "same data" : "DATA MISMATCH");
+
+	pack.Close();
+	std::filesystem::remove_all(benchDir, error);
+}
+
+void Bench::MainThreadQueue()
+{
+	constexpr u32 IDLE_FRAMES = 10000000;
+	constexpr u32 POSTED = 200000;
+	u32 threads = std::max(1u, std::thread::hardware_concurrency());
+
+	// frames where nothing finished, what every frame paid before a single load was done
+	LegacyMainThreadQueue legacy;
+	u32 sink = 0;
+
+	Timer timer;
+	timer.Start();
+	for (u32 i = 0; i < IDLE_FRAMES; i++)
+		sink += legacy.Run();
+	u64 legacyUs = timer.ElapsedUs();
+
+	timer.Start();
+	for (u32 i = 0; i < IDLE_FRAMES; i++)
+		sink += Async::RunMainThreadQueue();
+	u64 lockFreeUs = timer.ElapsedUs();
+
+	// coroutines posted from every worker while the main thread drains them
+	TaskPool pool;
+	pool.Start(threads);
+
+	std::atomic<u32> published = 0;
+	u32 drains = 0;
+
+	timer.Start();
+	for (u32 i = 0; i < POSTED; i++)
+		Async::Spawn(pool, PublishNextFrame(&published));
+
+	while (published.load(std::memory_order_relaxed) < POSTED)
+	{
+		if (Async::RunMainThreadQueue())
+			drains++;
+	}
+	u64 drainUs = std::max<u64>(timer.ElapsedUs(), 1);
+
+	pool.Stop();
+
+	LOG_INFO("Main thread queue: idle frame %.2f ns (mutex) -> %.2f ns (lock free) (%u)", legacyUs * 1000.0 / IDLE_FRAMES, lockFreeUs * 1000.0 / IDLE_FRAMES, sink);
+	LOG_INFO("  %u coroutines posted from %u workers, drained in %u passes: %.2f ms (%.1f ns each)", POSTED, threads, drains,
+		drainUs / 1000.0, drainUs * 1000.0 / POSTED);
+}
+
+void Bench::UploadQueues()
+{
+	constexpr u32 PRODUCERS = 16;
+	constexpr u32 ITEMS_PER_PRODUCER = 250000;
+	constexpr u64 SPSC_ITEMS = 4000000;
+	constexpr u32 RUNS = 3;
+
+	LOG_INFO("Upload queues: %u producer threads x %u items -> 1 consumer (%u hardware threads)", PRODUCERS, ITEMS_PER_PRODUCER,
+		std::thread::hardware_concurrency());
+
+	QueueContention bestMutex, bestRing;
+	bool valid = true;
+	for (u32 run = 0; run < RUNS; run++)
+	{
+		QueueContention mutexRun = MeasureMutexQueue(PRODUCERS, ITEMS_PER_PRODUCER);
+		bool runValid = false;
+		QueueContention ringRun = MeasureRingQueue(PRODUCERS, ITEMS_PER_PRODUCER, runValid);
+		valid &= runValid;
+
+		if (mutexRun.itemsPerSec > bestMutex.itemsPerSec)
+			bestMutex = mutexRun;
+		if (ringRun.itemsPerSec > bestRing.itemsPerSec)
+			bestRing = ringRun;
+	}
+
+	LOG_INFO("  mutex + vector: %.2f Mitems/s, %.0f ns per push", bestMutex.itemsPerSec / 1e6, bestMutex.pushNs);
+	LOG_INFO("  mpsc ring:      %.2f Mitems/s, %.0f ns per push (x%.2f)", bestRing.itemsPerSec / 1e6, bestRing.pushNs, bestRing.itemsPerSec / bestMutex.itemsPerSec);
+
+	double spscItemsPerSec = 0.0;
+	bool spscValid = StressSpscRing(SPSC_ITEMS, spscItemsPerSec);
+	LOG_INFO("  spsc ring:      %.2f Mitems/s over %llu items", spscItemsPerSec / 1e6, SPSC_ITEMS);
+
+	if (valid && spscValid)
+		LOG_INFO("  PASS: %llu mpsc + %llu spsc items, none lost or reordered", (u64)RUNS * PRODUCERS * ITEMS_PER_PRODUCER, SPSC_ITEMS);
+	else
+		LOG_ERR("  FAIL: mpsc %s, spsc %s", valid ? "ok" : "lost or reordered items", spscValid ? "ok" : "lost or reordered items");
+}
+
+void Bench::VertexKernels()
+{
+	constexpr u64 VERTEX_COUNT = 1000000;
+	constexpr u32 RUNS = 5;
+
+	const AttributeFormat formats[] = {
+		{ "position float3", EVertexAttribute::Position, EComponentType::Float, 3, false },
+		{ "position s16 norm", EVertexAttribute::Position, EComponentType::S16, 3, true },
+		{ "normal float3", EVertexAttribute::Normal, EComponentType::Float, 3, false },
+		{ "normal s16 norm", EVertexAttribute::Normal, EComponentType::S16, 3, true },
+		{ "normal s8 norm", EVertexAttribute::Normal, EComponentType::S8, 3, true },
+		{ "uv float2", EVertexAttribute::UV, EComponentType::Float, 2, false },
+		{ "uv u16 norm", EVertexAttribute::UV, EComponentType::U16, 2, true },
+		{ "uv u8 norm", EVertexAttribute::UV, EComponentType::U8, 2, true },
+		{ "color float4", EVertexAttribute::Color, EComponentType::Float, 4, false },
+		{ "color float3", EVertexAttribute::Color, EComponentType::Float, 3, false },
+		{ "color u16 norm", EVertexAttribute::Color, EComponentType::U16, 4, true },
+		{ "color u8 norm", EVertexAttribute::Color, EComponentType::U8, 4, true },
+	};
+
+	const ESimdLevel levels[] = { ESimdLevel::Scalar, ESimdLevel::SSE2, ESimdLevel::AVX2 };
+	const bool hasAvx2 = GetSimdLevel() >= ESimdLevel::AVX2;
+
+	LOG_INFO("Vertex kernels: %llu vertices, best of %u, Mvertices/s (x vs scalar)%s", VERTEX_COUNT, RUNS, hasAvx2 ? "" : ", no avx2 on this cpu");
+
+	std::vector<Vertex> vertices(VERTEX_COUNT);
+	std::vector<Vertex> reference(VERTEX_COUNT);
+	bool valid = true;
+
+	// Mvertices/s of every level, 0 for one the cpu doesn't have. same() checks the output of each one
+	auto measure = [&](double* outRates, auto&& run, auto&& same) {
+		for (u32 l = 0; l < 3; l++)
+		{
+			outRates[l] = 0.0;
+			if (levels[l] == ESimdLevel::AVX2 && !hasAvx2)
+				continue;
+
+			u64 us = BestOfUs(RUNS, [&]() { run(levels[l]); });
+			outRates[l] = (double)VERTEX_COUNT / (double)std::max<u64>(us, 1);
+			valid &= same();
+		}
+	};
+	auto sameVertices = [&]() { return memcmp(vertices.data(), reference.data(), VERTEX_COUNT * sizeof(Vertex)) == 0; };
+
+	// one attribute at a time, every path against the scalar one
+	for (const AttributeFormat& format : formats)
+	{
+		std::vector<u8> storage;
+		AttributeStream stream = MakeAttributeStream(storage, VERTEX_COUNT, format.componentType, format.componentCount, format.normalized);
+
+		std::fill(reference.begin(), reference.end(), Vertex{});
+		std::fill(vertices.begin(), vertices.end(), Vertex{});
+		DecodeAttribute(reference.data(), VERTEX_COUNT, stream, format.attribute, ESimdLevel::Scalar);
+
+		double rates[3];
+		measure(rates, [&](ESimdLevel level) { DecodeAttribute(vertices.data(), VERTEX_COUNT, stream, format.attribute, level); }, sameVertices);
+		LOG_INFO("  %-17s | scalar %6.1f | sse2 %6.1f (x%.2f) | avx2 %6.1f (x%.2f)", format.name, rates[0], rates[1], rates[1] / rates[0], rates[2], rates[2] / rates[0]);
+	}
+
+	// indices + the vertex offset
+	const EComponentType indexTypes[] = { EComponentType::U8, EComponentType::U16, EComponentType::U32 };
+	std::vector<Index> indices(VERTEX_COUNT);
+	std::vector<Index> referenceIndices(VERTEX_COUNT);
+	for (EComponentType indexType : indexTypes)
+	{
+		std::vector<u8> storage;
+		AttributeStream stream = MakeAttributeStream(storage, VERTEX_COUNT, indexType, 1, false);
+		DecodeIndices(referenceIndices.data(), VERTEX_COUNT, stream, 1000, ESimdLevel::Scalar);
+
+		double rates[3];
+		measure(rates, [&](ESimdLevel level) { DecodeIndices(indices.data(), VERTEX_COUNT, stream, 1000, level); }, [&]() { return indices == referenceIndices; });
+		LOG_INFO("  indices u%-8llu | scalar %6.1f | sse2 %6.1f (x%.2f) | avx2 %6.1f (x%.2f)", GetComponentBytes(indexType) * 8, rates[0], rates[1], rates[1] / rates[0], rates[2], rates[2] / rates[0]);
+	}
+
+	// a whole vertex as most gltfs have it: the old element by element decode with a pass per attribute,
+	// the kernels with a pass per attribute, the kernels in one blocked pass
+	std::vector<u8> positions, normals, uvs;
+	VertexStreams streams;
+	streams.position = MakeAttributeStream(positions, VERTEX_COUNT, EComponentType::Float, 3, false);
+	streams.normal = MakeAttributeStream(normals, VERTEX_COUNT, EComponentType::Float, 3, false);
+	streams.uv = MakeAttributeStream(uvs, VERTEX_COUNT, EComponentType::Float, 2, false);
+
+	u64 elementUs = BestOfUs(RUNS, [&]() {
+		DecodeElementByElement<glm::vec3>(streams.position, VERTEX_COUNT, [&](u64 i, glm::vec3 v) {
+			Vertex& vertex = reference[i];
+			vertex.position = v;
+			vertex.normal = { 1, 0, 0 };
+			vertex.color = glm::vec4{ 1.f };
+			vertex.uv_x = 0;
+			vertex.uv_y = 0;
+		});
+		DecodeElementByElement<glm::vec3>(streams.normal, VERTEX_COUNT, [&](u64 i, glm::vec3 v) { reference[i].normal = v; });
+		DecodeElementByElement<glm::vec2>(streams.uv, VERTEX_COUNT, [&](u64 i, glm::vec2 v) {
+			reference[i].uv_x = v.x;
+			reference[i].uv_y = v.y;
+		});
+	});
+	double elementRate = (double)VERTEX_COUNT / (double)std::max<u64>(elementUs, 1);
+
+	double passRates[3];
+	measure(passRates, [&](ESimdLevel level) {
+		DecodeAttribute(vertices.data(), VERTEX_COUNT, streams.position, EVertexAttribute::Position, level);
+		DecodeAttribute(vertices.data(), VERTEX_COUNT, streams.normal, EVertexAttribute::Normal, level);
+		DecodeAttribute(vertices.data(), VERTEX_COUNT, streams.uv, EVertexAttribute::UV, level);
+		DecodeAttribute(vertices.data(), VERTEX_COUNT, streams.color, EVertexAttribute::Color, level);
+	}, sameVertices);
+
+	double blockedRates[3];
+	measure(blockedRates, [&](ESimdLevel level) { DecodeVertices(vertices.data(), VERTEX_COUNT, streams, level); }, sameVertices);
+
+	LOG_INFO("  vertex f3 + f3 + f2, x vs the old element by element decode (%.1f):", elementRate);
+	LOG_INFO("    pass per attribute | scalar %6.1f (x%.2f) | sse2 %6.1f (x%.2f) | avx2 %6.1f (x%.2f)", passRates[0], passRates[0] / elementRate,
+		passRates[1], passRates[1] / elementRate, passRates[2], passRates[2] / elementRate);
+	LOG_INFO("    one blocked pass   | scalar %6.1f (x%.2f) | sse2 %6.1f (x%.2f) | avx2 %6.1f (x%.2f)", blockedRates[0], blockedRates[0] / elementRate,
+		blockedRates[1], blockedRates[1] / elementRate, blockedRates[2], blockedRates[2] / elementRate);
+
+	if (valid)
+		LOG_INFO("  PASS: every path gives the same vertices and indices as the scalar one, the whole vertex the same as fastgltf");
+	else
+		LOG_ERR("  FAIL: some path gives different vertices or indices than the scalar one");
+}
+
+void Bench::MappedGltfLoad()
+{
+	constexpr u32 RUNS = 3;
+	// ~500 MB of glb
+	constexpr u32 GRID_SIZE = 3000;
+
+	const std::filesystem::path benchDir = std::filesystem::temp_directory_path() / "vk_test_bench";
+	std::error_code error;
+	std::filesystem::create_directories(benchDir, error);
+
+	const std::filesystem::path gridPath = benchDir / "grid.glb";
+	if (!WriteGridGlb(gridPath, GRID_SIZE))
+	{
+		LOG_WARN("Mapped gltf load: unable to write %s", gridPath.string().c_str());
+		return;
+	}
+
+	const std::filesystem::path paths[] = {
+		std::filesystem::path("assets") / "basicmesh.glb",
+		std::filesystem::path("assets") / "car.glb",
+		std::filesystem::path("assets") / "diorama.glb",
+		gridPath,
+	};
+
+	LOG_INFO("Mapped gltf load: best of %u warm runs, peak working set over the one before the load (sampled every ms)", RUNS);
+	LOG_INFO("  old: file copy + binary chunk copy + per element decode | read: file copy, decode from it | mapped: no copy, decode from the mapping");
+
+	bool allSame = true;
+	for (const std::filesystem::path& path : paths)
+	{
+		u64 fileSize = (u64)std::filesystem::file_size(path, error);
+		if (error)
+		{
+			LOG_WARN("  %s not found, skipped", path.string().c_str());
+			continue;
+		}
+
+		// in the page cache for every mode
+		IOQueue::ReadFileNow(path);
+
+		std::vector<Vertex> legacyVertices;
+		std::vector<Index> legacyIndices;
+		u64 legacyPeak = PeakResidentDuring([&]() { LegacyLoadGltf(path, legacyVertices, legacyIndices); });
+		u64 legacyUs = BestOfUs(RUNS, [&]() { LegacyLoadGltf(path, legacyVertices, legacyIndices); });
+		legacyVertices = {};
+		legacyIndices = {};
+
+		Mesh readMesh;
+		u64 readPeak = PeakResidentDuring([&]() { readMesh.LoadGltf(path, EMeshFileAccess::Read); });
+		u64 readUs = BestOfUs(RUNS, [&]() {
+			readMesh.ClearData();
+			readMesh.LoadGltf(path, EMeshFileAccess::Read);
+		});
+
+		// the read mesh stays around for the comparison, it's part of the baseline of the mapped load
+		Mesh mappedMesh;
+		u64 mappedPeak = PeakResidentDuring([&]() { mappedMesh.LoadGltf(path, EMeshFileAccess::Map); });
+		u64 mappedUs = BestOfUs(RUNS, [&]() {
+			mappedMesh.ClearData();
+			mappedMesh.LoadGltf(path, EMeshFileAccess::Map);
+		});
+
+		bool same = readMesh.GetVertexBufferSize() == mappedMesh.GetVertexBufferSize() && readMesh.GetIndexBufferSize() == mappedMesh.GetIndexBufferSize()
+			&& readMesh.GetVertexBufferSize() > 0
+			&& memcmp(readMesh.GetVertices().data(), mappedMesh.GetVertices().data(), readMesh.GetVertexBufferSize()) == 0
+			&& memcmp(readMesh.GetIndices().data(), mappedMesh.GetIndices().data(), readMesh.GetIndexBufferSize()) == 0;
+		allSame &= same;
+
+		LOG_INFO("  %s: %.1f MB file, %llu vertices, %llu indices, %.1f MB decoded", path.filename().string().c_str(), Utils::BytesToMegabytes(fileSize),
+			(u64)readMesh.GetVertices().size(), (u64)readMesh.GetIndices().size(), Utils::BytesToMegabytes(readMesh.GetMemoryFootprint()));
+		LOG_INFO("    old    %8.2f ms  peak +%7.1f MB", legacyUs / 1000.0, Utils::BytesToMegabytes(legacyPeak));
+		LOG_INFO("    read   %8.2f ms  peak +%7.1f MB", readUs / 1000.0, Utils::BytesToMegabytes(readPeak));
+		LOG_INFO("    mapped %8.2f ms  peak +%7.1f MB (file pages included, clean: the os can drop them) | %s",
+			mappedUs / 1000.0, Utils::BytesToMegabytes(mappedPeak), same ? "same data" : "DATA MISMATCH");
+	}
+
+	std::filesystem::remove(gridPath, error);
+
+	if (allSame)
+		LOG_INFO("  PASS: the mapped loads decode the same data as the read ones");
+	else
+		LOG_ERR("  FAIL: a mapped load decoded different data");
+}
+
+void Bench::MeshStagingDecode()
+{
+	constexpr u32 COPIES = 8;
+	constexpr u32 GRID_SIZE = 600; // ~20 MB glb, 25 MB decoded
+
+	// every copy gets its own file, the asset cache would turn them into a single load
+	const std::filesystem::path copiesDir = std::filesystem::temp_directory_path() / "vk_test_bench";
+	std::error_code error;
+	std::filesystem::create_directories(copiesDir, error);
+
+	std::vector<std::filesystem::path> copies;
+	for (u32 i = 0; i < COPIES; i++)
+	{
+		std::filesystem::path& copy = copies.emplace_back(copiesDir / ("grid_" + std::to_string(i) + ".glb"));
+		if (!WriteGridGlb(copy, GRID_SIZE))
+		{
+			LOG_WARN("Mesh staging decode: unable to write %s", copy.string().c_str());
+			return;
+		}
+	}
+
+	u64 fileBytes = (u64)std::filesystem::file_size(copies[0], error);
+	u64 decodedBytes = (u64)GRID_SIZE * GRID_SIZE * sizeof(Vertex) + 6ull * (GRID_SIZE - 1) * (GRID_SIZE - 1) * sizeof(Index);
+
+	BudgetedLoadResult ram = LoadMeshesWithBudget(copies, ~0ull, false);
+	BudgetedLoadResult staged = LoadMeshesWithBudget(copies, ~0ull, true);
+
+	std::filesystem::remove_all(copiesDir, error);
+
+	// cpu writes of every mesh: the file read, the decode, the memcpy of the loader thread into its upload slot
+	auto logResult = [&](const char* name, const BudgetedLoadResult& result) {
+		double copiedPerMesh = Utils::BytesToMegabytes(result.uploads.copiedBytes) / COPIES;
+		double decodedToRam = result.uploads.prestagedBytes < decodedBytes * COPIES ? Utils::BytesToMegabytes(decodedBytes * COPIES - result.uploads.prestagedBytes) / COPIES : 0.0;
+		double decodedToStaging = Utils::BytesToMegabytes(result.uploads.prestagedBytes) / COPIES;
+
+		LOG_INFO("  %-8s %.2fs, peak resident +%.1f MB | per mesh: %.1f MB read, decoded %.1f MB to ram + %.1f MB to staging, %.1f MB memcpy'd = %.1f MB written",
+			name, result.seconds, Utils::BytesToMegabytes(result.peakResidentBytes), Utils::BytesToMegabytes(fileBytes), decodedToRam, decodedToStaging,
+			copiedPerMesh, Utils::BytesToMegabytes(fileBytes) + decodedToRam + decodedToStaging + copiedPerMesh);
+	};
+
+	LOG_INFO("Mesh staging decode: %u x %u^2 grid glb (%.1f MB file, %.1f MB decoded), through a private asset manager until on the gpu",
+		COPIES, GRID_SIZE, Utils::BytesToMegabytes(fileBytes), Utils::BytesToMegabytes(decodedBytes));
+	logResult("ram", ram);
+	logResult("staging", staged);
+
+	// the staging memory can be full of other loads, those go through ram and the loader copy
+	if (staged.uploads.prestagedBytes >= decodedBytes * COPIES)
+		LOG_INFO("  PASS: every mesh decoded into staging memory, no loader copy");
+	else
+		LOG_ERR("  FAIL: %.1f MB of %.1f MB decoded into staging memory", Utils::BytesToMegabytes(staged.uploads.prestagedBytes), Utils::BytesToMegabytes(decodedBytes * COPIES));
+}
+
+void Bench::VertexCacheOptimize()
+{
+	constexpr u32 RUNS = 3;
+
+	struct IndexedMesh
+	{
+		std::string name;
+		std::vector<Index> indices;
+		std::vector<Submesh> submeshes;
+	};
+	std::vector<IndexedMesh> meshes;
+
+	// the included assets as they're exported, nothing processed
+	const std::filesystem::path paths[] = {
+		std::filesystem::path("assets") / "basicmesh.glb",
+		std::filesystem::path("assets") / "car.glb",
+		std::filesystem::path("assets") / "diorama.glb",
+	};
+
+	for (const std::filesystem::path& path : paths)
+	{
+		std::error_code error;
+		if (!std::filesystem::exists(path, error))
+		{
+			LOG_WARN("Vertex cache: %s not found, skipped", path.string().c_str());
+			continue;
+		}
+
+		Mesh mesh;
+		mesh.LoadGltf(path);
+		meshes.push_back({ path.filename().string(), { mesh.GetIndices().begin(), mesh.GetIndices().end() }, mesh.GetSubmeshes() });
+	}
+
+	auto addSynthetic = [&meshes](const char* name, std::vector<Index>&& indices) {
+		Submesh submesh = { 0, (u32)indices.size() };
+		meshes.push_back({ name, std::move(indices), { submesh } });
+	};
+
+	addSynthetic("grid 512^2", MakeGridIndices(512));
+	std::vector<Index> shuffledGrid = MakeGridIndices(512);
+	ShuffleTriangles(shuffledGrid, 1);
+	addSynthetic("grid 512^2 shuffled", std::move(shuffledGrid));
+	addSynthetic("sphere 256x512", MakeSphereIndices(256, 512));
+	std::vector<Index> shuffledSphere = MakeSphereIndices(256, 512);
+	ShuffleTriangles(shuffledSphere, 2);
+	addSynthetic("sphere 256x512 shuffled", std::move(shuffledSphere));
+
+	// no locality at all, about 6 triangles per vertex like a closed mesh: what's left is the cache size
+	std::vector<Index> soup(300000);
+	std::mt19937 random(3);
+	for (Index& index : soup)
+		index = random() % 50000;
+	addSynthetic("random soup", std::move(soup));
+
+	LOG_INFO("Vertex cache: tipsify per submesh, fifo of %u, best of %u. ACMR = vertex shader runs per triangle, ATVR = per vertex", VERTEX_CACHE_SIZE, RUNS);
+
+	bool valid = true;
+	bool neverWorse = true;
+	for (IndexedMesh& mesh : meshes)
+	{
+		auto analyze = [&mesh](const std::vector<Index>& indices) {
+			VertexCacheStats stats;
+			for (const Submesh& submesh : mesh.submeshes)
+				stats.Add(AnalyzeVertexCache(std::span<const Index>(indices).subspan(submesh.indexOffset, submesh.indexCount)));
+			return stats;
+		};
+
+		VertexCacheStats before = analyze(mesh.indices);
+
+		std::vector<Index> optimized;
+		u64 us = BestOfUs(RUNS, [&]() {
+			optimized = mesh.indices;
+			for (const Submesh& submesh : mesh.submeshes)
+				OptimizeVertexCache(std::span<Index>(optimized).subspan(submesh.indexOffset, submesh.indexCount));
+		});
+
+		VertexCacheStats after = analyze(optimized);
+
+		// same triangles, same winding, submesh by submesh
+		bool same = optimized.size() == mesh.indices.size();
+		for (const Submesh& submesh : mesh.submeshes)
+		{
+			same = same && GetCanonicalTriangles(std::span<const Index>(optimized).subspan(submesh.indexOffset, submesh.indexCount))
+				== GetCanonicalTriangles(std::span<const Index>(mesh.indices).subspan(submesh.indexOffset, submesh.indexCount));
+		}
+		valid &= same;
+		neverWorse &= after.acmr <= before.acmr + 0.01;
+
+		LOG_INFO("  %-24s %9llu tris %3llu submeshes  ACMR %.3f -> %.3f  ATVR %.3f -> %.3f  %8.2f ms (%.1f Mtris/s) | %s", mesh.name.c_str(),
+			before.triangleCount, (u64)mesh.submeshes.size(), before.acmr, after.acmr, before.atvr, after.atvr, us / 1000.0,
+			(double)before.triangleCount / (double)std::max<u64>(us, 1), same ? "same triangles" : "TRIANGLES CHANGED");
+	}
+
+	if (valid && neverWorse)
+		LOG_INFO("  PASS: same triangles in every submesh, no ACMR got worse");
+	else
+		LOG_ERR("  FAIL: %s", valid ? "an ACMR got worse" : "the reordering changed the triangles");
+}
+
+void Bench::MeshOrderOptimize()
+{
+	struct TestMesh
+	{
+		std::string name;
+		std::vector<Vertex> vertices;
+		std::vector<Index> indices;
+		std::vector<Submesh> submeshes;
+	};
+	std::vector<TestMesh> meshes;
+
+	const std::filesystem::path paths[] = {
+		std::filesystem::path("assets") / "basicmesh.glb",
+		std::filesystem::path("assets") / "car.glb",
+		std::filesystem::path("assets") / "diorama.glb",
+	};
+
+	for (const std::filesystem::path& path : paths)
+	{
+		std::error_code error;
+		if (!std::filesystem::exists(path, error))
+		{
+			LOG_WARN("Mesh order: %s not found, skipped", path.string().c_str());
+			continue;
+		}
+
+		Mesh mesh;
+		mesh.LoadGltf(path);
+		TestMesh& test = meshes.emplace_back();
+		test.name = path.filename().string();
+		test.vertices.assign(mesh.GetVertices().begin(), mesh.GetVertices().end());
+		test.indices.assign(mesh.GetIndices().begin(), mesh.GetIndices().end());
+		test.submeshes = mesh.GetSubmeshes();
+	}
+
+	auto addSynthetic = [&meshes](const char* name) -> TestMesh& {
+		TestMesh& test = meshes.emplace_back();
+		test.name = name;
+		return test;
+	};
+
+	// convex: nothing to gain on overdraw, every pixel is shaded once with the back faces culled
+	TestMesh& sphere = addSynthetic("sphere");
+	AppendSphere(sphere.vertices, sphere.indices, glm::vec3(0.0f), 1.0f, 128, 256);
+
+	TestMesh& shuffledSphere = addSynthetic("sphere, shuffled vertices");
+	AppendSphere(shuffledSphere.vertices, shuffledSphere.indices, glm::vec3(0.0f), 1.0f, 128, 256);
+	ShuffleVertices(shuffledSphere.vertices, shuffledSphere.indices, 1);
+
+	// 4 shells around each other written from the inside: the worst order from every side
+	TestMesh& shells = addSynthetic("nested shells");
+	for (u32 i = 1; i <= 4; i++)
+		AppendSphere(shells.vertices, shells.indices, glm::vec3(0.0f), (float)i, 64, 128);
+
+	std::mt19937 random(2);
+	std::uniform_real_distribution<float> position(-4.0f, 4.0f);
+	TestMesh& scattered = addSynthetic("64 scattered spheres");
+	for (u32 i = 0; i < 64; i++)
+		AppendSphere(scattered.vertices, scattered.indices, glm::vec3(position(random), position(random), position(random)), 0.8f, 16, 32);
+
+	for (TestMesh& test : meshes)
+	{
+		if (test.submeshes.empty())
+			test.submeshes.push_back({ 0, (u32)test.indices.size() });
+	}
+
+	LOG_INFO("Mesh order: per submesh, the orders of Mesh::Processing one after the other. ACMR over a fifo of %u, overfetch over %u lines of 64 bytes,",
+		VERTEX_CACHE_SIZE, VERTEX_FETCH_CACHE_LINES);
+	LOG_INFO("  overdraw rasterized on the cpu (%u^2, back faces culled, 14 views around the mesh)", OVERDRAW_RESOLUTION);
+
+	bool valid = true;
+	OverdrawStats overdrawTotal[2];
+	VertexFetchStats fetchTotal[2];
+	for (TestMesh& test : meshes)
+	{
+		auto overdraw = [&test](const std::vector<Index>& indices) {
+			OverdrawStats stats;
+			for (const Submesh& submesh : test.submeshes)
+				stats.Add(AnalyzeOverdraw(std::span<const Index>(indices).subspan(submesh.indexOffset, submesh.indexCount), test.vertices));
+			return stats;
+		};
+		auto cache = [&test](const std::vector<Index>& indices) {
+			VertexCacheStats stats;
+			for (const Submesh& submesh : test.submeshes)
+				stats.Add(AnalyzeVertexCache(std::span<const Index>(indices).subspan(submesh.indexOffset, submesh.indexCount)));
+			return stats;
+		};
+		auto forEachSubmesh = [&test](std::vector<Index>& indices, auto&& fn) {
+			for (const Submesh& submesh : test.submeshes)
+				fn(std::span<Index>(indices).subspan(submesh.indexOffset, submesh.indexCount));
+		};
+
+		// as loaded
+		OverdrawStats loadedOverdraw = overdraw(test.indices);
+		VertexCacheStats loadedCache = cache(test.indices);
+		VertexFetchStats loadedFetch = AnalyzeVertexFetch(test.indices);
+
+		// + vertex cache
+		std::vector<Index> cacheOrder = test.indices;
+		Timer timer;
+		timer.Start();
+		forEachSubmesh(cacheOrder, [](std::span<Index> indices) { OptimizeVertexCache(indices); });
+		u64 cacheUs = timer.ElapsedUs();
+		OverdrawStats cacheOverdraw = overdraw(cacheOrder);
+		VertexCacheStats cacheCache = cache(cacheOrder);
+
+		// + overdraw
+		std::vector<Index> overdrawOrder = cacheOrder;
+		timer.Start();
+		forEachSubmesh(overdrawOrder, [&test](std::span<Index> indices) { OptimizeOverdraw(indices, test.vertices); });
+		u64 overdrawUs = timer.ElapsedUs();
+		OverdrawStats sortedOverdraw = overdraw(overdrawOrder);
+		VertexCacheStats sortedCache = cache(overdrawOrder);
+		VertexFetchStats sortedFetch = AnalyzeVertexFetch(overdrawOrder);
+
+		// + vertex fetch, same triangles in the same order: every corner has to read the same vertex
+		std::vector<Index> fetchIndices = overdrawOrder;
+		std::vector<Vertex> fetchVertices(test.vertices.size());
+		timer.Start();
+		OptimizeVertexFetch(fetchVertices.data(), test.vertices, fetchIndices);
+		u64 fetchUs = timer.ElapsedUs();
+		VertexFetchStats remappedFetch = AnalyzeVertexFetch(fetchIndices);
+
+		bool same = GetCanonicalTriangles(overdrawOrder) == GetCanonicalTriangles(test.indices);
+		for (u64 i = 0; same && i < fetchIndices.size(); i++)
+			same = memcmp(&fetchVertices[fetchIndices[i]], &test.vertices[overdrawOrder[i]], sizeof(Vertex)) == 0;
+		valid &= same;
+
+		overdrawTotal[0].Add(cacheOverdraw);
+		overdrawTotal[1].Add(sortedOverdraw);
+		fetchTotal[0].Add(sortedFetch);
+		fetchTotal[1].Add(remappedFetch);
+
+		LOG_INFO("  %s: %llu triangles, %llu vertices, %llu submeshes | %s", test.name.c_str(), (u64)test.indices.size() / 3, (u64)test.vertices.size(),
+			(u64)test.submeshes.size(), same ? "same triangles" : "TRIANGLES CHANGED");
+		LOG_INFO("    as loaded      ACMR %.3f  overdraw %.3f  overfetch %.3f", loadedCache.acmr, loadedOverdraw.overdraw, loadedFetch.overfetch);
+		LOG_INFO("    + vertex cache ACMR %.3f  overdraw %.3f                    %8.2f ms", cacheCache.acmr, cacheOverdraw.overdraw, cacheUs / 1000.0);
+		LOG_INFO("    + overdraw     ACMR %.3f  overdraw %.3f  overfetch %.3f  %8.2f ms", sortedCache.acmr, sortedOverdraw.overdraw, sortedFetch.overfetch, overdrawUs / 1000.0);
+		LOG_INFO("    + fetch order                              overfetch %.3f  %8.2f ms", remappedFetch.overfetch, fetchUs / 1000.0);
+	}
+
+	bool better = overdrawTotal[1].overdraw <= overdrawTotal[0].overdraw && fetchTotal[1].overfetch <= fetchTotal[0].overfetch;
+	if (valid && better)
+		LOG_INFO("  PASS: same triangles, all meshes: overdraw %.3f -> %.3f with the clusters sorted, overfetch %.3f -> %.3f with the fetch order",
+			overdrawTotal[0].overdraw, overdrawTotal[1].overdraw, fetchTotal[0].overfetch, fetchTotal[1].overfetch);
+	else
+		LOG_ERR("  FAIL: %s", valid ? "the overdraw or the overfetch got worse" : "the reordering changed the triangles");
+}
+
+void Bench::CompactMeshLayout()
+{
+	constexpr u32 RUNS = 5;
+	// 90000 vertices in a single submesh, its indices stay 32 bit
+	constexpr u32 GRID_SIZE = 300;
+	const MeshProcessing compact = { .compactIndices = true };
+
+	const std::filesystem::path cookDir = std::filesystem::temp_directory_path() / "vk_test_bench";
+	std::error_code error;
+	std::filesystem::create_directories(cookDir, error);
+
+	const std::filesystem::path gridPath = cookDir / "grid.glb";
+	if (!WriteGridGlb(gridPath, GRID_SIZE))
+	{
+		LOG_WARN("Compact mesh layout: unable to write %s", gridPath.string().c_str());
+		return;
+	}
+
+	const std::filesystem::path paths[] = {
+		std::filesystem::path("assets") / "basicmesh.glb",
+		std::filesystem::path("assets") / "car.glb",
+		std::filesystem::path("assets") / "diorama.glb",
+		gridPath,
+	};
+
+	LOG_INFO("Compact mesh layout: indices relative to the submesh, 16 bit under 65536 vertices. loads best of %u warm runs", RUNS);
+
+	bool valid = true;
+	MeshLayoutStats total;
+	for (const std::filesystem::path& path : paths)
+	{
+		if (!std::filesystem::exists(path, error))
+		{
+			LOG_WARN("  %s not found, skipped", path.string().c_str());
+			continue;
+		}
+
+		Mesh fullMesh;
+		u64 fullUs = BestOfUs(RUNS, [&]() {
+			fullMesh.ClearData();
+			fullMesh.LoadGltf(path);
+		});
+
+		Mesh compactMesh;
+		compactMesh.Processing = compact;
+		u64 compactUs = BestOfUs(RUNS, [&]() {
+			compactMesh.ClearData();
+			compactMesh.LoadGltf(path);
+		});
+
+		// the decoded data kept to check the layout against, then through the cooked file
+		Mesh checkedMesh;
+		checkedMesh.Processing = compact;
+		checkedMesh.KeepCPUData = true;
+		checkedMesh.LoadGltf(path);
+		bool same = IsCompactLayoutValid(checkedMesh);
+
+		std::filesystem::path cookedPath = cookDir / path.filename();
+		cookedPath.replace_extension(".vkmesh");
+		Mesh cookedMesh;
+		bool cooked = compactMesh.SaveCooked(cookedPath) && cookedMesh.LoadCooked(cookedPath);
+		same &= cooked && cookedMesh.GetDraws().size() == checkedMesh.GetDraws().size()
+			&& cookedMesh.GetVertexBufferSize() == checkedMesh.GetVertexBufferSize() && cookedMesh.GetIndexBufferSize() == checkedMesh.GetIndexBufferSize()
+			&& memcmp(cookedMesh.GetVertexData().data(), checkedMesh.GetVertexData().data(), checkedMesh.GetVertexBufferSize()) == 0
+			&& memcmp(cookedMesh.GetIndexData().data(), checkedMesh.GetIndexData().data(), checkedMesh.GetIndexBufferSize()) == 0;
+		valid &= same;
+		cookedMesh.ClearData();
+		std::filesystem::remove(cookedPath, error);
+
+		const MeshLayoutStats& stats = checkedMesh.GetLayoutStats();
+		total.fullBytes += stats.fullBytes;
+		total.bytes += stats.bytes;
+		total.fullFetchBytes += stats.fullFetchBytes;
+		total.fetchBytes += stats.fetchBytes;
+
+		u32 index16Count = 0;
+		for (const SubmeshDraw& draw : checkedMesh.GetDraws())
+			index16Count += draw.indexType == VK_INDEX_TYPE_UINT16 ? 1 : 0;
+
+		LOG_INFO("  %s: %llu vertices, %llu indices, 16 bit indices in %u/%llu submeshes | %s", path.filename().string().c_str(),
+			(u64)checkedMesh.GetVertices().size(), (u64)checkedMesh.GetIndices().size(), index16Count, (u64)checkedMesh.GetDraws().size(),
+			same ? "same data" : "DATA MISMATCH");
+		LOG_INFO("    buffers %.2f -> %.2f MB, read by a draw %.2f -> %.2f MB, load %.2f -> %.2f ms", Utils::BytesToMegabytes(stats.fullBytes),
+			Utils::BytesToMegabytes(stats.bytes), Utils::BytesToMegabytes(stats.fullFetchBytes), Utils::BytesToMegabytes(stats.fetchBytes),
+			fullUs / 1000.0, compactUs / 1000.0);
+	}
+
+	std::filesystem::remove(gridPath, error);
+
+	auto saved = [](u64 full, u64 compact) { return full ? 100.0 * (1.0 - (double)compact / (double)full) : 0.0; };
+	if (valid)
+		LOG_INFO("  PASS: the layout decodes to the same data, all meshes: buffers -%.0f%%, read by a draw -%.0f%%",
+			saved(total.fullBytes, total.bytes), saved(total.fullFetchBytes, total.fetchBytes));
+	else
+		LOG_ERR("  FAIL: the compact layout doesn't decode to the loaded data");
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "Core/CoreMinimal.h"
+
+// debug benchmarks, triggered from the imgui window. results go to the log
+namespace Bench {
+
+	// tasks/sec of the work stealing pool vs the old single queue pool, 1..N threads
+	void TaskPoolThroughput();
+
+	// serial loop vs ParallelFor/ParallelReduce on million element ranges
+	void ParallelLoops();
+
+	// how long a critical "load" waits behind a saturated background queue: fifo vs priority lanes vs reprioritized
+	void PriorityLatency();
+
+	// staged loads/sec with the topology sized pool, workers pinned vs floating (and the old fixed 4 threads)
+	void LoadAffinity();
+
+	// peak working set while loading copies of a generated big glb, with and without the loading memory budget
+	void LoadingMemoryBudget();
+
+	// mesh load into cpu memory: gltf parse + decode vs the cooked .vkmesh mapped in place, the included glbs and a
+	// generated large grid
+	void CookedMeshLoad();
+
+	// thousands of small assets: loose files (open + read each) vs one mapped pack (lookup + coalesced prefetch + page reads)
+	void AssetPackLoad();
+
+	// cost of a frame where no load finished (the old locked queue vs the lock free one), then coroutines posted by the workers and drained
+	void MainThreadQueue();
+
+	// stress of the upload rings (millions of items, checks none is lost or reordered) + 16 producers on the mpsc ring vs a mutex queue
+	void UploadQueues();
+
+	// accessor -> Vertex kernels per attribute format and index size (scalar, sse2, avx2), then a whole vertex:
+	// the old element by element decode vs a pass per attribute vs one blocked pass
+	void VertexKernels();
+
+	// gltf load of the included glbs and a ~500 MB generated one: the old copies vs the file read vs the file mapped
+	// (time and peak working set), the two new ones must decode the same data
+	void MappedGltfLoad();
+
+	// gltf meshes through the asset manager until they're on the gpu: decoded in ram + copied by the loader thread vs
+	// decoded straight into staging memory. bytes written by the cpu per mesh, time and peak working set
+	void MeshStagingDecode();
+
+	// post transform cache order: ACMR/ATVR of the included glbs and some generated meshes (in order, shuffled, random)
+	// before and after the triangle reordering of the loads, and what it costs
+	void VertexCacheOptimize();
+
+	// the vertex cache order, then the overdraw cluster sort, then the vertex fetch order on the included glbs and some
+	// generated meshes (convex, shuffled vertices, nested shells, scattered spheres): ACMR, overfetch and the overdraw
+	// rasterized on the cpu after each step
+	void MeshOrderOptimize();
+
+	// the compact indices of the included glbs and a generated grid over 65535 vertices: decoded back against the full
+	// data, through a .vkmesh too. buffer sizes, bytes read by a draw, load time
+	void CompactMeshLayout();
+
+}
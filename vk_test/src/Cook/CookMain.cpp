@@ -0,0 +1,56 @@
+#include "Engine.h"
+#include "Cooker.h"
+#include "CookManifest.h"
+#include "Misc/Utils.h"
+
+#include <string>
+
+// vk_cook [assets dir] [cache dir] [--force] [--pack] [--no-optimize]
+// cooks the assets tree into the cache dir, run it from the vk_test directory for the defaults
+int main(int argc, char** argv)
+{
+	CookerConfig config;
+
+	int positional = 0;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg == "--force")
+			config.force = true;
+		else if (arg == "--pack")
+			config.pack = true;
+		else if (arg == "--no-optimize")
+		{
+			config.meshProcessing.optimizeVertexCache = false;
+			config.meshProcessing.optimizeOverdraw = false;
+			config.meshProcessing.optimizeVertexFetch = false;
+		}
+		else if (arg.starts_with("--") || positional == 2)
+		{
+			LOG_ERR("usage: vk_cook [assets dir = assets] [cache dir = cooked] [--force] [--pack] [--no-optimize]");
+			return 1;
+		}
+		else if (positional++ == 0)
+			config.assetsDir = arg;
+		else
+			config.cacheDir = arg;
+	}
+
+	// nothing else runs, every core cooks. the loader pool is the one the mesh passes use too (Mesh.cpp)
+	TaskPoolConfig poolConfig;
+	poolConfig.firstCore = 0;
+	g_AssetManager.Init(poolConfig);
+
+	LOG_INFO("Cooker: %ls -> %ls", config.assetsDir.c_str(), config.cacheDir.c_str());
+	CookerStats stats = CookAssets(config, g_AssetManager.GetTaskPool());
+
+	g_AssetManager.Shutdown();
+
+	LOG_INFO("Cooker: %u sources, %u cooked (%.2f MB), %u up to date, %u reused, %u failed in %.2f s",
+		stats.sources, stats.cooked, Utils::BytesToMegabytes(stats.cookedBytes), stats.upToDate, stats.reused, stats.failed, stats.seconds);
+
+	if (config.pack)
+		LOG_INFO("Cooker: %s %.2f MB", COOK_PACK_NAME, Utils::BytesToMegabytes(stats.packBytes));
+
+	return stats.failed ? 1 : 0;
+}
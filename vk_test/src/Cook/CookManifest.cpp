@@ -0,0 +1,106 @@
+#include "CookManifest.h"
+
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <algorithm>
+
+// vk_cook <cooker version>
+// root <assets root>
+// <content key hex> <source size> <source time> <cooked file> <source>   (tab separated, the source goes last)
+
+bool CookManifest::Load(const std::filesystem::path& path)
+{
+	m_Entries.clear();
+	AssetsRoot.clear();
+
+	std::ifstream file(path);
+	if (!file)
+		return false;
+
+	std::string tag;
+	u32 version = 0;
+	if (!(file >> tag >> version) || tag != "vk_cook" || version != COOKER_VERSION)
+		return false;
+
+	std::string root;
+	if (!(file >> tag) || tag != "root" || !std::getline(file >> std::ws, root))
+		return false;
+	AssetsRoot = root;
+
+	std::string line;
+	while (std::getline(file, line))
+	{
+		if (line.empty())
+			continue;
+
+		std::istringstream fields(line);
+		CookManifestEntry entry;
+		std::string source;
+		if (!(fields >> std::hex >> entry.contentKey >> std::dec >> entry.sourceSize >> entry.sourceTime >> entry.cooked)
+			|| !std::getline(fields >> std::ws, source))
+		{
+			LOG_WARN("Cook manifest: skipping a bad line in %ls", path.c_str());
+			continue;
+		}
+
+		m_Entries[source] = std::move(entry);
+	}
+
+	return true;
+}
+
+bool CookManifest::Save(const std::filesystem::path& path) const
+{
+	// sorted, two cooks of the same tree write the same file
+	std::vector<const std::pair<const std::string, CookManifestEntry>*> sorted;
+	sorted.reserve(m_Entries.size());
+	for (const auto& it : m_Entries)
+		sorted.push_back(&it);
+	std::sort(sorted.begin(), sorted.end(), [](const auto* a, const auto* b) { return a->first < b->first; });
+
+	std::filesystem::path tempPath = path;
+	tempPath += ".tmp";
+
+	{
+		std::ofstream file(tempPath, std::ios::trunc);
+		file << "vk_cook " << COOKER_VERSION << "\n";
+		file << "root " << AssetsRoot.generic_string() << "\n";
+
+		for (const auto* it : sorted)
+		{
+			const CookManifestEntry& entry = it->second;
+			file << std::hex << entry.contentKey << std::dec << '\t' << entry.sourceSize << '\t' << entry.sourceTime << '\t'
+				<< entry.cooked << '\t' << it->first << "\n";
+		}
+
+		if (!file)
+		{
+			LOG_ERR("Unable to write cook manifest: %ls", tempPath.c_str());
+			return false;
+		}
+	}
+
+	std::error_code error;
+	std::filesystem::rename(tempPath, path, error);
+	if (error)
+	{
+		LOG_ERR("Unable to write cook manifest: %ls", path.c_str());
+		std::filesystem::remove(tempPath, error);
+		return false;
+	}
+	return true;
+}
+
+const CookManifestEntry* CookManifest::Find(const std::string& source) const
+{
+	auto it = m_Entries.find(source);
+	return it != m_Entries.end() ? &it->second : nullptr;
+}
+
+s64 CookManifest::GetFileTime(const std::filesystem::path& path)
+{
+	std::error_code error;
+	std::filesystem::file_time_type time = std::filesystem::last_write_time(path, error);
+	return error ? 0 : (s64)time.time_since_epoch().count();
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "Core/CoreMinimal.h"
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+
+// bumped when the cooker output changes in a way the formats don't tell (decode, defaults): everything is cooked again
+constexpr u32 COOKER_VERSION = 1;
+
+// written next to the cooked files
+constexpr const char* COOK_MANIFEST_NAME = "manifest.txt";
+// every cooked file in one AssetPack, vk_cook --pack
+constexpr const char* COOK_PACK_NAME = "assets.vkpack";
+
+struct CookManifestEntry
+{
+	u64 contentKey = 0;  // source bytes + cooker version + cook options, the cooked file is named after it
+	u64 sourceSize = 0;  // size and write time of the source when it was cooked, a cheap check before hashing it again
+	s64 sourceTime = 0;
+	std::string cooked;  // file name in the manifest directory
+};
+
+// source -> cooked file of a cook, text: a header line, the assets root (relative to the manifest) and one line per source.
+// sources are relative to the assets root with '/' separators
+class CookManifest
+{
+public:
+	// false if it's missing or written by another cooker version
+	bool Load(const std::filesystem::path& path);
+	bool Save(const std::filesystem::path& path) const;
+
+	// nullptr if the source wasn't cooked
+	const CookManifestEntry* Find(const std::string& source) const;
+	inline void Add(const std::string& source, const CookManifestEntry& entry) { m_Entries[source] = entry; }
+
+	inline const std::unordered_map<std::string, CookManifestEntry>& GetEntries() const { return m_Entries; }
+
+	// as written in the file, relative to the manifest directory
+	std::filesystem::path AssetsRoot;
+
+	// write time as stored in the manifest, 0 if the file is missing
+	static s64 GetFileTime(const std::filesystem::path& path);
+
+private:
+	std::unordered_map<std::string, CookManifestEntry> m_Entries;
+};
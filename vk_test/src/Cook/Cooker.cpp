@@ -0,0 +1,250 @@
+#include "Cooker.h"
+#include "CookManifest.h"
+
+#include "Async/TaskPool.h"
+#include "Async/IOQueue.h"
+#include "Misc/Utils.h"
+#include "Misc/Timer.h"
+#include "Misc/AssetPack.h"
+#include "Renderer/Mesh.h"
+#include "Renderer/MeshFormat.h"
+#include "Renderer/Texture.h"
+#include "Renderer/TextureFormat.h"
+
+#include <atomic>
+#include <mutex>
+#include <algorithm>
+#include <unordered_set>
+
+enum class ECookType
+{
+	Mesh,
+	Texture
+};
+
+struct CookSource
+{
+	std::filesystem::path path;
+	std::string name; // relative to the assets dir, '/' separators
+	ECookType type;
+};
+
+static bool GetCookType(const std::filesystem::path& path, ECookType& outType)
+{
+	std::string extension = path.extension().string();
+	std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return (char)tolower(c); });
+
+	if (extension == ".glb")
+		outType = ECookType::Mesh;
+	else if (extension == ".png" || extension == ".jpg" || extension == ".jpeg")
+		outType = ECookType::Texture;
+	else
+		return false;
+
+	return true;
+}
+
+// whatever changes the cooked bytes for the same source goes in here
+static u64 GetOptionsHash(ECookType type, const CookerConfig& config)
+{
+	u32 options[5] = {};
+	if (type == ECookType::Mesh)
+	{
+		options[0] = COOKED_MESH_VERSION;
+		options[1] = sizeof(Vertex);
+		options[2] = sizeof(Submesh);
+		options[3] = (config.meshProcessing.optimizeVertexCache ? 1 : 0) | (config.meshProcessing.optimizeOverdraw ? 2 : 0)
+			| (config.meshProcessing.optimizeVertexFetch ? 4 : 0) | (config.meshProcessing.compactIndices ? 8 : 0);
+	}
+	else
+	{
+		options[0] = COOKED_TEXTURE_VERSION;
+		options[1] = EImageFormat::RGBA8;
+	}
+	options[4] = (u32)type;
+
+	return Utils::Hash64(options, sizeof(options));
+}
+
+static std::string GetCookedName(u64 contentKey, ECookType type)
+{
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx%s", (unsigned long long)contentKey, type == ECookType::Mesh ? ".vkmesh" : ".vktex");
+	return name;
+}
+
+static bool Cook(const CookSource& source, IOBuffer&& file, TaskPool& pool, const CookerConfig& config, const std::filesystem::path& cookedPath)
+{
+	if (source.type == ECookType::Mesh)
+	{
+		// the staged load with the chunks decoded in parallel, the workers help while we wait
+		Mesh mesh;
+		mesh.Processing = config.meshProcessing;
+		MeshLoadJob* job = mesh.BeginLoad(source.path);
+		mesh.SetFile(job, std::move(file));
+
+		u32 chunkCount = mesh.Parse(job);
+		pool.ParallelFor(0, chunkCount, 1, [&mesh, job](u64 begin, u64 end) {
+			for (u64 i = begin; i < end; i++)
+				mesh.DecodeChunk(job, (u32)i);
+		});
+		mesh.FinishLoad(job);
+
+		return mesh.GetVertexBufferSize() > 0 && mesh.SaveCooked(cookedPath);
+	}
+
+	Texture texture;
+	texture.DebugName = source.path.string();
+	texture.LoadFromMemory(file.Data(), file.Size());
+	file.Reset();
+
+	return texture.GetMemoryFootprint() && texture.SaveCooked(cookedPath);
+}
+
+CookerStats CookAssets(const CookerConfig& config, TaskPool& pool)
+{
+	Timer timer;
+	timer.Start();
+	CookerStats stats;
+
+	std::error_code error;
+	std::filesystem::create_directories(config.cacheDir, error);
+	if (error)
+	{
+		LOG_ERR("Cooker: unable to create %ls", config.cacheDir.c_str());
+		return stats;
+	}
+
+	std::filesystem::path manifestPath = config.cacheDir / COOK_MANIFEST_NAME;
+
+	CookManifest previous;
+	if (!config.force && !previous.Load(manifestPath))
+		LOG_INFO("Cooker: no manifest of this cooker version, cooking everything");
+
+	std::vector<CookSource> sources;
+	for (auto it = std::filesystem::recursive_directory_iterator(config.assetsDir, error); !error && it != std::filesystem::recursive_directory_iterator(); it.increment(error))
+	{
+		ECookType type;
+		if (!it->is_regular_file() || !GetCookType(it->path(), type))
+			continue;
+
+		CookSource& source = sources.emplace_back();
+		source.path = it->path();
+		source.name = it->path().lexically_relative(config.assetsDir).generic_string();
+		source.type = type;
+	}
+
+	if (error)
+	{
+		LOG_ERR("Cooker: unable to walk %ls", config.assetsDir.c_str());
+		return stats;
+	}
+
+	stats.sources = (u32)sources.size();
+
+	CookManifest manifest;
+	manifest.AssetsRoot = std::filesystem::relative(config.assetsDir, config.cacheDir, error);
+	if (error || manifest.AssetsRoot.empty())
+		manifest.AssetsRoot = std::filesystem::absolute(config.assetsDir);
+
+	std::mutex manifestLock;
+	std::unordered_set<u64> claimedKeys; // guarded by manifestLock, two sources with the same bytes are cooked once
+	std::atomic<u32> cooked = 0, upToDate = 0, reused = 0, failed = 0;
+	std::atomic<u64> cookedBytes = 0;
+
+	// one source per chunk, a big mesh fans its primitives out to the other workers
+	pool.ParallelFor(0, sources.size(), 1, [&](u64 begin, u64 end) {
+		for (u64 i = begin; i < end; i++)
+		{
+			const CookSource& source = sources[i];
+
+			std::error_code fileError;
+			CookManifestEntry entry;
+			entry.sourceSize = (u64)std::filesystem::file_size(source.path, fileError);
+			entry.sourceTime = CookManifest::GetFileTime(source.path);
+			const CookManifestEntry* last = previous.Find(source.name);
+			if (last && last->sourceSize == entry.sourceSize && last->sourceTime == entry.sourceTime
+				&& std::filesystem::exists(config.cacheDir / last->cooked, fileError))
+			{
+				upToDate++;
+				std::lock_guard<std::mutex> lock(manifestLock);
+				manifest.Add(source.name, *last);
+				continue;
+			}
+
+			IOBuffer file = IOQueue::ReadFileNow(source.path);
+			if (file.IsEmpty())
+			{
+				LOG_ERR("Cooker: unable to read %ls", source.path.c_str());
+				failed++;
+				continue;
+			}
+
+			u64 contentHash = Utils::Hash64(file.Data(), file.Size());
+			u64 keyParts[3] = { contentHash, COOKER_VERSION, GetOptionsHash(source.type, config) };
+			entry.contentKey = Utils::Hash64(keyParts, sizeof(keyParts));
+			entry.cooked = GetCookedName(entry.contentKey, source.type);
+
+			bool claimed;
+			{
+				std::lock_guard<std::mutex> lock(manifestLock);
+				claimed = !claimedKeys.insert(entry.contentKey).second;
+			}
+
+			std::filesystem::path cookedPath = config.cacheDir / entry.cooked;
+			if (claimed || (!config.force && std::filesystem::exists(cookedPath, fileError)))
+			{
+				// touched, renamed or copied: same bytes, same cooked file
+				reused++;
+			}
+			else if (Cook(source, std::move(file), pool, config, cookedPath))
+			{
+				cooked++;
+				cookedBytes += (u64)std::filesystem::file_size(cookedPath, fileError);
+				LOG_INFO("Cooker: %s -> %s", source.name.c_str(), entry.cooked.c_str());
+			}
+			else
+			{
+				LOG_ERR("Cooker: unable to cook %s", source.name.c_str());
+				failed++;
+				continue;
+			}
+
+			std::lock_guard<std::mutex> lock(manifestLock);
+			manifest.Add(source.name, entry);
+		}
+	});
+
+	// the failed sources are left out, the runtime loads them from the source
+	if (!manifest.Save(manifestPath))
+		failed++;
+
+	if (config.pack)
+	{
+		std::vector<PackSource> packSources;
+		for (const auto& [name, entry] : manifest.GetEntries())
+		{
+			PackSource& source = packSources.emplace_back();
+			source.name = name;
+			source.file = config.cacheDir / entry.cooked;
+			source.kind = std::filesystem::path(entry.cooked).extension() == ".vkmesh" ? EPackEntryKind::Mesh : EPackEntryKind::Texture;
+			source.sourceSize = entry.sourceSize;
+			source.sourceTime = entry.sourceTime;
+		}
+
+		// the root is relative to the pack, same directory as the manifest
+		std::filesystem::path packPath = config.cacheDir / COOK_PACK_NAME;
+		if (WriteAssetPack(packPath, manifest.AssetsRoot.generic_string(), std::move(packSources)))
+			stats.packBytes = (u64)std::filesystem::file_size(packPath, error);
+		else
+			failed++;
+	}
+
+	stats.cooked = cooked;
+	stats.upToDate = upToDate;
+	stats.reused = reused;
+	stats.failed = failed;
+	stats.cookedBytes = cookedBytes;
+	stats.seconds = timer.ElapsedUs() / 1000000.0;
+	return stats;
+}
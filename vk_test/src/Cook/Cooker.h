@@ -0,0 +1,34 @@
+#pragma once
+
+#include "Core/CoreMinimal.h"
+#include "Renderer/Mesh.h"
+#include <filesystem>
+
+class TaskPool;
+
+struct CookerConfig
+{
+	std::filesystem::path assetsDir = "assets";
+	std::filesystem::path cacheDir = "cooked"; // cooked files + manifest
+	bool force = false; // cook everything, the cache is ignored
+	bool pack = false;  // + cacheDir/assets.vkpack with every cooked file
+	// baked into the .vkmesh, part of the cook options
+	MeshProcessing meshProcessing = { .optimizeVertexCache = true, .optimizeOverdraw = true, .optimizeVertexFetch = true, .compactIndices = true };
+};
+
+struct CookerStats
+{
+	u32 sources = 0;
+	u32 cooked = 0;    // converted by this run
+	u32 upToDate = 0;  // same size and write time as the last cook, not even read
+	u32 reused = 0;    // changed on disk but the content key was already in the cache
+	u32 failed = 0;
+	u64 cookedBytes = 0; // written by this run
+	u64 packBytes = 0;
+	double seconds = 0.0;
+};
+
+// .glb -> .vkmesh, .png/.jpg -> .vktex for every file under assetsDir. the cooked files are content addressed
+// (source bytes + COOKER_VERSION + cook options) so only what changed is cooked again, one source per task on the pool.
+// writes cacheDir/manifest.txt, what AssetManager::LoadCookManifest() reads (and the pack for AssetManager::MountPack())
+CookerStats CookAssets(const CookerConfig& config, TaskPool& pool);
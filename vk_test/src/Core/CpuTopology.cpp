@@ -0,0 +1,325 @@
+#include "CpuTopology.h"
+
+#include <map>
+#include <tuple>
+
+#ifdef _WIN32
+	#define WIN32_LEAN_AND_MEAN
+	#include <Windows.h>
+#else
+	#include <pthread.h>
+	#include <sched.h>
+	#include <fstream>
+	#include <string>
+#endif
+
+// gathered per logical cpu before grouping them into cores
+struct LogicalCpuInfo
+{
+	u32 id;
+	u32 package;
+	u64 coreKey; // unique per physical core inside its package
+	u64 l3Key;   // unique per last level cache
+};
+
+static void BuildTopology(CpuTopology& topology, std::vector<LogicalCpuInfo>& cpus)
+{
+	std::map<u64, u32> l3Groups;
+	std::map<u32, u32> packages;
+	std::map<std::tuple<u32, u64>, u32> coreIndices;
+
+	std::sort(cpus.begin(), cpus.end(), [](const LogicalCpuInfo& a, const LogicalCpuInfo& b) { return a.id < b.id; });
+
+	for (const LogicalCpuInfo& cpu : cpus)
+	{
+		u32 l3Group = l3Groups.try_emplace(cpu.l3Key, (u32)l3Groups.size()).first->second;
+		u32 package = packages.try_emplace(cpu.package, (u32)packages.size()).first->second;
+
+		auto [it, isNewCore] = coreIndices.try_emplace({ cpu.package, cpu.coreKey }, (u32)topology.cores.size());
+		if (isNewCore)
+		{
+			CpuCore& core = topology.cores.emplace_back();
+			core.package = package;
+			core.l3Group = l3Group;
+		}
+		topology.cores[it->second].logicalCpus.push_back(cpu.id);
+	}
+
+	std::stable_sort(topology.cores.begin(), topology.cores.end(), [](const CpuCore& a, const CpuCore& b) {
+		return std::tie(a.package, a.l3Group) < std::tie(b.package, b.l3Group);
+	});
+
+	topology.logicalCpuCount = (u32)cpus.size();
+	topology.l3GroupCount = (u32)l3Groups.size();
+	topology.packageCount = (u32)packages.size();
+	topology.detected = !topology.cores.empty();
+}
+
+#ifdef _WIN32
+
+static bool DetectTopology(CpuTopology& topology)
+{
+	DWORD size = 0;
+	GetLogicalProcessorInformationEx(RelationAll, nullptr, &size);
+	if (GetLastError() != ERROR_INSUFFICIENT_BUFFER)
+		return false;
+
+	std::vector<u8> buffer(size);
+	if (!GetLogicalProcessorInformationEx(RelationAll, (PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX)buffer.data(), &size))
+		return false;
+
+	struct GroupSet
+	{
+		WORD group;
+		KAFFINITY mask;
+	};
+
+	std::vector<GroupSet> coreSets;
+	std::vector<GroupSet> l3Sets;
+	std::vector<GroupSet> packageSets;
+
+	for (DWORD offset = 0; offset < size; )
+	{
+		auto* info = (PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX)(buffer.data() + offset);
+
+		switch (info->Relationship)
+		{
+		case RelationProcessorCore:
+			coreSets.push_back({ info->Processor.GroupMask[0].Group, info->Processor.GroupMask[0].Mask });
+			break;
+
+		case RelationProcessorPackage:
+			for (WORD i = 0; i < info->Processor.GroupCount; i++)
+				packageSets.push_back({ info->Processor.GroupMask[i].Group, info->Processor.GroupMask[i].Mask });
+			break;
+
+		case RelationCache:
+			if (info->Cache.Level == 3)
+				l3Sets.push_back({ info->Cache.GroupMask.Group, info->Cache.GroupMask.Mask });
+			break;
+		}
+
+		offset += info->Size;
+	}
+
+	auto findSet = [](const std::vector<GroupSet>& sets, WORD group, u32 bit) -> u64 {
+		for (size_t i = 0; i < sets.size(); i++)
+		{
+			if (sets[i].group == group && (sets[i].mask & ((KAFFINITY)1 << bit)))
+				return i;
+		}
+		return ~0ull;
+	};
+
+	// logical cpu id = group * 64 + bit, see SetThreadAffinity()
+	std::vector<LogicalCpuInfo> cpus;
+	for (size_t coreIndex = 0; coreIndex < coreSets.size(); coreIndex++)
+	{
+		const GroupSet& core = coreSets[coreIndex];
+		for (u32 bit = 0; bit < 64; bit++)
+		{
+			if (!(core.mask & ((KAFFINITY)1 << bit)))
+				continue;
+
+			u64 package = findSet(packageSets, core.group, bit);
+			u64 l3 = findSet(l3Sets, core.group, bit);
+
+			LogicalCpuInfo& cpu = cpus.emplace_back();
+			cpu.id = core.group * 64 + bit;
+			cpu.package = package == ~0ull ? 0 : (u32)package;
+			cpu.coreKey = coreIndex;
+			cpu.l3Key = l3 == ~0ull ? cpu.package : l3; // no l3: the package is the sharing domain
+		}
+	}
+
+	BuildTopology(topology, cpus);
+	return topology.detected;
+}
+
+static bool ApplyAffinity(HANDLE thread, const std::vector<u32>& logicalCpus)
+{
+	if (logicalCpus.empty())
+		return false;
+
+	GROUP_AFFINITY affinity = {};
+	affinity.Group = (WORD)(logicalCpus[0] / 64);
+	for (u32 cpu : logicalCpus)
+	{
+		if (cpu / 64 == affinity.Group)
+			affinity.Mask |= (KAFFINITY)1 << (cpu % 64);
+	}
+
+	return SetThreadGroupAffinity(thread, &affinity, nullptr) != 0;
+}
+
+bool SetThreadAffinity(std::thread& thread, const std::vector<u32>& logicalCpus)
+{
+	return GetCpuTopology().detected && ApplyAffinity((HANDLE)thread.native_handle(), logicalCpus);
+}
+
+bool SetCurrentThreadAffinity(const std::vector<u32>& logicalCpus)
+{
+	return GetCpuTopology().detected && ApplyAffinity(GetCurrentThread(), logicalCpus);
+}
+
+bool ResetThreadAffinity(std::thread& thread)
+{
+	return true;
+}
+
+#else
+
+static bool ReadSysfsValue(const std::string& path, std::string& outValue)
+{
+	std::ifstream file(path);
+	return (bool)std::getline(file, outValue);
+}
+
+// "0-3,8,10-11"
+static std::vector<u32> ParseCpuList(const std::string& list)
+{
+	std::vector<u32> cpus;
+
+	size_t pos = 0;
+	while (pos < list.size())
+	{
+		size_t end = list.find(',', pos);
+		if (end == std::string::npos)
+			end = list.size();
+
+		std::string range = list.substr(pos, end - pos);
+		size_t dash = range.find('-');
+		if (!range.empty())
+		{
+			u32 first = (u32)std::stoul(range.substr(0, dash));
+			u32 last = dash == std::string::npos ? first : (u32)std::stoul(range.substr(dash + 1));
+			for (u32 cpu = first; cpu <= last; cpu++)
+				cpus.push_back(cpu);
+		}
+
+		pos = end + 1;
+	}
+
+	return cpus;
+}
+
+// the affinity of the process before anything pinned itself, read with the topology
+static std::vector<u32> s_ProcessCpus;
+
+static bool DetectTopology(CpuTopology& topology)
+{
+	const std::string root = "/sys/devices/system/cpu/";
+
+	cpu_set_t processSet;
+	CPU_ZERO(&processSet);
+	if (sched_getaffinity(0, sizeof(processSet), &processSet) == 0)
+	{
+		for (u32 cpu = 0; cpu < CPU_SETSIZE; cpu++)
+		{
+			if (CPU_ISSET(cpu, &processSet))
+				s_ProcessCpus.push_back(cpu);
+		}
+	}
+
+	std::string online;
+	if (!ReadSysfsValue(root + "online", online))
+		return false;
+
+	std::vector<LogicalCpuInfo> cpus;
+	for (u32 id : ParseCpuList(online))
+	{
+		std::string cpuDir = root + "cpu" + std::to_string(id) + "/";
+		std::string package, coreId;
+		if (!ReadSysfsValue(cpuDir + "topology/physical_package_id", package) || !ReadSysfsValue(cpuDir + "topology/core_id", coreId))
+			return false;
+
+		LogicalCpuInfo& cpu = cpus.emplace_back();
+		cpu.id = id;
+		cpu.package = (u32)std::stoul(package);
+		cpu.coreKey = std::stoull(coreId);
+		cpu.l3Key = ~0ull;
+
+		// the l3 is keyed by the lowest cpu sharing it
+		for (u32 index = 0; ; index++)
+		{
+			std::string cacheDir = cpuDir + "cache/index" + std::to_string(index) + "/";
+			std::string level;
+			if (!ReadSysfsValue(cacheDir + "level", level))
+				break;
+
+			std::string sharedList;
+			if (level == "3" && ReadSysfsValue(cacheDir + "shared_cpu_list", sharedList))
+			{
+				std::vector<u32> shared = ParseCpuList(sharedList);
+				if (!shared.empty())
+					cpu.l3Key = *std::min_element(shared.begin(), shared.end());
+			}
+		}
+
+		if (cpu.l3Key == ~0ull)
+			cpu.l3Key = (1ull << 32) | cpu.package; // no l3: the package is the sharing domain
+	}
+
+	BuildTopology(topology, cpus);
+	return topology.detected;
+}
+
+static bool ApplyAffinity(pthread_t thread, const std::vector<u32>& logicalCpus)
+{
+	if (logicalCpus.empty())
+		return false;
+
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for (u32 cpu : logicalCpus)
+		CPU_SET(cpu, &set);
+
+	return pthread_setaffinity_np(thread, sizeof(set), &set) == 0;
+}
+
+bool SetThreadAffinity(std::thread& thread, const std::vector<u32>& logicalCpus)
+{
+	return GetCpuTopology().detected && ApplyAffinity(thread.native_handle(), logicalCpus);
+}
+
+bool SetCurrentThreadAffinity(const std::vector<u32>& logicalCpus)
+{
+	return GetCpuTopology().detected && ApplyAffinity(pthread_self(), logicalCpus);
+}
+
+bool ResetThreadAffinity(std::thread& thread)
+{
+	return GetCpuTopology().detected && ApplyAffinity(thread.native_handle(), s_ProcessCpus);
+}
+
+#endif
+
+const CpuTopology& GetCpuTopology()
+{
+	static CpuTopology s_Topology = []() {
+		CpuTopology topology;
+		if (!DetectTopology(topology))
+		{
+			// every logical cpu is a core, no affinity
+			topology = {};
+			u32 count = std::max(1u, std::thread::hardware_concurrency());
+			for (u32 i = 0; i < count; i++)
+				topology.cores.push_back({ 0, 0, { i } });
+
+			topology.logicalCpuCount = count;
+			topology.l3GroupCount = 1;
+			topology.packageCount = 1;
+			topology.detected = false;
+
+			LOG_WARN("CPU topology: detection failed, assuming %u cores", count);
+		}
+		else
+		{
+			LOG_INFO("CPU topology: %u packages, %u physical cores, %u logical cpus, %u L3 groups",
+				topology.packageCount, topology.GetPhysicalCoreCount(), topology.logicalCpuCount, topology.l3GroupCount);
+		}
+		return topology;
+	}();
+
+	return s_Topology;
+}
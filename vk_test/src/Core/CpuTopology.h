@@ -0,0 +1,42 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+// one physical core and its smt siblings
+struct CpuCore
+{
+	u32 package = 0;
+	u32 l3Group = 0;              // cores with the same value share the last level cache
+	std::vector<u32> logicalCpus; // os cpu ids, the first one is the primary thread of the core
+};
+
+// what the machine looks like, read once from sysfs (linux) or GetLogicalProcessorInformationEx (windows).
+// when detection fails every logical cpu is its own core and affinity is left alone
+struct CpuTopology
+{
+	std::vector<CpuCore> cores; // ordered by package, then l3 group, then core id: neighbours share caches
+	u32 logicalCpuCount = 0;
+	u32 l3GroupCount = 0;
+	u32 packageCount = 0;
+	bool detected = false;
+
+	inline u32 GetPhysicalCoreCount() const { return (u32)cores.size(); }
+	inline u32 GetSmtWidth() const { return cores.empty() ? 1 : std::max<u32>(1, logicalCpuCount / (u32)cores.size()); }
+
+	// logical cpus of the core, wraps around when coreIndex is past the last core
+	inline const std::vector<u32>& GetCoreCpus(u32 coreIndex) const { return cores[coreIndex % cores.size()].logicalCpus; }
+};
+
+const CpuTopology& GetCpuTopology();
+
+// restricts a thread to a set of logical cpus. false if the os refused (or there's no topology to work with).
+// on windows the set must be inside one processor group (64 cpus), the cpus of other groups are ignored
+bool SetThreadAffinity(std::thread& thread, const std::vector<u32>& logicalCpus);
+bool SetCurrentThreadAffinity(const std::vector<u32>& logicalCpus);
+// back to every cpu the process could run on when the topology was read, for the threads that aren't pinned: a linux
+// thread starts with the affinity of the one creating it (a pinned main thread), a windows one with the process one
+bool ResetThreadAffinity(std::thread& thread);
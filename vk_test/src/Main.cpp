@@ -29,6 +29,9 @@
 #include "Renderer/Mesh.h"
 
 #include "Math/Math.h"
+#include "Bench/Benchmarks.h"
+#include "Misc/Utils.h"
+#include "Cook/CookManifest.h"
 
 struct FrameData
 {
@@ -778,8 +781,14 @@ struct LoadingState
 
 LoadingState g_LoadingState;
 
-static std::vector<Mesh*> g_Meshes;
-static std::vector<Texture*> g_Textures;
+// counts the loads as they're published, instead of polling every frame
+static void CountLoaded()
+{
+	g_LoadingState.currentlyLoaded++;
+}
+
+static std::vector<Handle<Mesh>> g_Meshes;
+static std::vector<Handle<Texture>> g_Textures;
 
 static glm::vec3 s_CamPos = { 3.3f, 1.3f, -13.0f };
 static glm::vec3 s_CamRot = { 0.0f, 0.0f, 0.0f };
@@ -789,7 +798,7 @@ static ImVec2 s_MousePos = {};
 static float s_MouseSens = 0.1f;
 
 static UniBuffLighting s_UniBuffLighting = {};
-static Texture* s_BoundTexture = nullptr;
+static Handle<Texture> s_BoundTexture;
 
 void LoadGeometry()
 {
@@ -813,13 +822,15 @@ void LoadGeometry()
 
 	for (const auto& meshPath : meshesToLoad)
 	{
-		Mesh* mesh = g_AssetManager.LoadMesh(meshPath);
+		Handle<Mesh> mesh = g_AssetManager.LoadMesh(meshPath);
+		g_AssetManager.OnLoaded(mesh, CountLoaded);
 		g_Meshes.push_back(mesh);
 	}
 
 	for (const auto& texturePath : texturesToLoad)
 	{
-		Texture* texture = g_AssetManager.LoadTexture(texturePath);
+		Handle<Texture> texture = g_AssetManager.LoadTexture(texturePath);
+		g_AssetManager.OnLoaded(texture, CountLoaded);
 		g_Textures.push_back(texture);
 	}
 
@@ -832,18 +843,9 @@ void LoadGeometry()
 	s_UniBuffLighting.sunColor = glm::vec4(1.0f);
 	s_UniBuffLighting.viewPos = glm::vec4(1.0f);
 
+	// the asset manager owns them, g_Meshes/g_Textures can list the same shared asset more than once
 	g_RendererContext.QueueShutdownFunc([]() {
-		for (auto mesh : g_Meshes)
-		{
-			VkUtils::DestroyBuffer(g_RendererContext.GetDevice(), mesh->GetVertexBuffer());
-			VkUtils::DestroyBuffer(g_RendererContext.GetDevice(), mesh->GetIndexBuffer());
-			delete mesh;
-		}
-		for (auto texture : g_Textures)
-		{
-			VkUtils::DestroyImage(g_RendererContext.GetDevice(), texture->GetImage());
-			delete texture;
-		}
+		g_AssetManager.DestroyAssets();
 	});
 }
 
@@ -904,23 +906,82 @@ void ImGuii()
 		std::filesystem::path meshPath = std::filesystem::path("assets") / "car.glb";
 		for (u32 i = 0; i < 16; i++)
 		{
-			Mesh* meshRes = g_AssetManager.LoadMesh(meshPath);
+			Handle<Mesh> meshRes = g_AssetManager.LoadMesh(meshPath, ETaskPriority::Background);
+			g_AssetManager.OnLoaded(meshRes, CountLoaded);
 			g_Meshes.push_back(meshRes);
 		}
 
 		g_LoadingState.loadTarget += 16;
 	}
 
+	ImGui::SameLine();
+	if (ImGui::Button("Rush pending meshes"))
+	{
+		for (Handle<Mesh> mesh : g_Meshes)
+		{
+			if (!g_AssetManager.Peek(mesh)->IsLoaded())
+				g_AssetManager.SetLoadPriority(mesh, ETaskPriority::Critical);
+		}
+	}
+
+	// loading pipeline utilisation over the last second: io threads busy reading, decode workers not parked
+	{
+		static LoadingPipelineStats lastStats = g_AssetManager.GetPipelineStats();
+		static double lastStatsTime = g_Time;
+		static float ioBusy = 0.0f, ioStalled = 0.0f, decodeBusy = 0.0f;
+
+		if (g_Time - lastStatsTime > 1.0f)
+		{
+			LoadingPipelineStats stats = g_AssetManager.GetPipelineStats();
+			double windowUs = (g_Time - lastStatsTime) * 1e6;
+
+			ioBusy = (float)((stats.io.busyUs - lastStats.io.busyUs) / (windowUs * std::max(1u, stats.io.threadCount)));
+			ioStalled = (float)((stats.io.budgetStallUs - lastStats.io.budgetStallUs) / windowUs);
+			decodeBusy = 1.0f - (float)((stats.decode.parkedUs - lastStats.decode.parkedUs) / (windowUs * std::max(1u, stats.decode.workerCount)));
+
+			lastStats = stats;
+			lastStatsTime = g_Time;
+		}
+
+		const IOQueueStats& io = lastStats.io;
+		ImGui::Text("I/O: %u threads, %.0f%% busy, %.0f%% waiting for budget, %.1f MB in flight, %llu queued",
+			io.threadCount, ioBusy * 100.0f, ioStalled * 100.0f, Utils::BytesToMegabytes(io.inFlightBytes), io.queuedRequests);
+		ImGui::Text("Decode: %u workers, %.0f%% busy", lastStats.decode.workerCount, std::clamp(decodeBusy, 0.0f, 1.0f) * 100.0f);
+
+		// live, not windowed
+		MemoryBudgetStats memory = g_AssetManager.GetMemoryBudget().GetStats();
+		ImGui::Text("Loading memory: %.1f / %.0f MB (peak %.1f MB), %llu loads waiting, %.1f MB waiting for upload",
+			Utils::BytesToMegabytes(memory.usedBytes), Utils::BytesToMegabytes(memory.limitBytes), Utils::BytesToMegabytes(memory.peakUsedBytes),
+			memory.waitingRequests, Utils::BytesToMegabytes(g_ResourceFactory.GetPendingUploadBytes()));
+
+		ResidencyStats residency = g_AssetManager.GetResidencyStats();
+		ImGui::Text("VRAM: %u resident (%.1f MB), %u evicted (%.1f MB), %llu evictions, %llu restreams",
+			residency.residentCount, Utils::BytesToMegabytes(residency.residentBytes), residency.evictedCount, Utils::BytesToMegabytes(residency.evictedBytes),
+			residency.evictions, residency.restreams);
+
+		int budgetMB = (int)(residency.budgetBytes / (1024 * 1024));
+		if (ImGui::SliderInt("VRAM budget (MB)", &budgetMB, 0, 4096))
+			g_AssetManager.SetResidencyBudget((u64)budgetMB * 1024 * 1024);
+
+		AssetPackStats pack = g_AssetManager.GetPackStats();
+		if (pack.entries)
+		{
+			ImGui::Text("Pack: %u entries, %llu loads (%.1f MB) in %llu reads",
+				pack.entries, pack.loads, Utils::BytesToMegabytes(pack.bytes), pack.reads);
+		}
+	}
+
 	ImGui::Separator();
 
-	if (ImGui::BeginCombo("Texture", s_BoundTexture ? s_BoundTexture->DebugName.c_str() : "Nulla :("))
+	Texture* boundTexture = g_AssetManager.Get(s_BoundTexture);
+	if (ImGui::BeginCombo("Texture", boundTexture ? boundTexture->DebugName.c_str() : "Nulla :("))
 	{
-		if (ImGui::Selectable("Nulla :(", s_BoundTexture == nullptr))
-			s_BoundTexture = nullptr;
+		if (ImGui::Selectable("Nulla :(", s_BoundTexture.IsNull()))
+			s_BoundTexture = {};
 
-		for (Texture* texture : g_Textures)
+		for (Handle<Texture> texture : g_Textures)
 		{
-			if (ImGui::Selectable(texture->DebugName.c_str(), texture == s_BoundTexture))
+			if (ImGui::Selectable(g_AssetManager.Peek(texture)->DebugName.c_str(), texture == s_BoundTexture))
 				s_BoundTexture = texture;
 		}
 
@@ -968,17 +1029,87 @@ void ImGuii()
 
 	ImGui::Checkbox("Deferred (broken)", &s_Deferred);
 
+	ImGui::Separator();
+
+	if (ImGui::CollapsingHeader("Assets"))
+	{
+		// the name is written by the loader, only read it once the asset is published
+		g_AssetManager.ForEachMesh([](Handle<Mesh> handle, Mesh& mesh) {
+			if (mesh.IsLoaded())
+				ImGui::BulletText("Mesh [%u:%u] %s", handle.index, handle.generation, mesh.DebugName.c_str());
+			else
+				ImGui::BulletText("Mesh [%u:%u] loading...", handle.index, handle.generation);
+		});
+
+		g_AssetManager.ForEachTexture([](Handle<Texture> handle, Texture& texture) {
+			if (texture.IsLoaded())
+				ImGui::BulletText("Texture [%u:%u] %s", handle.index, handle.generation, texture.DebugName.c_str());
+			else
+				ImGui::BulletText("Texture [%u:%u] loading...", handle.index, handle.generation);
+		});
+	}
+
+	// benchmarks block the main thread, results go to the log
+	if (ImGui::CollapsingHeader("Benchmarks"))
+	{
+		if (ImGui::Button("TaskPool throughput"))
+			Bench::TaskPoolThroughput();
+
+		if (ImGui::Button("ParallelFor / ParallelReduce"))
+			Bench::ParallelLoops();
+
+		if (ImGui::Button("Priority load latency"))
+			Bench::PriorityLatency();
+
+		if (ImGui::Button("Load throughput (affinity on/off)"))
+			Bench::LoadAffinity();
+
+		if (ImGui::Button("Loading memory budget (16 x grid glb)"))
+			Bench::LoadingMemoryBudget();
+
+		if (ImGui::Button("Cooked mesh load (gltf vs .vkmesh)"))
+			Bench::CookedMeshLoad();
+
+		if (ImGui::Button("Asset pack vs loose files (3000 small assets)"))
+			Bench::AssetPackLoad();
+
+		if (ImGui::Button("Main thread queue (idle frame + drain)"))
+			Bench::MainThreadQueue();
+
+		if (ImGui::Button("Upload queues (stress + 16 producers)"))
+			Bench::UploadQueues();
+
+		if (ImGui::Button("Vertex decode kernels (scalar / sse2 / avx2)"))
+			Bench::VertexKernels();
+
+		if (ImGui::Button("Mapped gltf load (old / read / mapped, 500 MB grid)"))
+			Bench::MappedGltfLoad();
+
+		if (ImGui::Button("Mesh decode into staging (8 x 600^2 grid)"))
+			Bench::MeshStagingDecode();
+
+		if (ImGui::Button("Vertex cache optimization (ACMR / ATVR)"))
+			Bench::VertexCacheOptimize();
+
+		if (ImGui::Button("Mesh order (vertex cache / overdraw / vertex fetch)"))
+			Bench::MeshOrderOptimize();
+
+		if (ImGui::Button("Compact mesh layout (16 bit indices)"))
+			Bench::CompactMeshLayout();
+	}
+
 	ImGui::End();
 }
 
 void Update(float deltaTime)
 {
-	// asset straming
-	if (g_LoadingState.currentlyLoaded < g_LoadingState.loadTarget)
-	{
-		u32 loadedAssets = g_AssetManager.CheckLoadedAssets();
-		g_LoadingState.currentlyLoaded += loadedAssets;
-	}
+	// finished gpu uploads + coroutines waiting for the main thread (Async::NextFrame()), the loaded assets are published
+	// there and their OnLoaded() callbacks run
+	g_ResourceFactory.RetireUploads();
+	Async::RunMainThreadQueue();
+
+	// lru eviction + restreaming, before this frame uses any asset
+	g_AssetManager.UpdateResidency(FRAMES_IN_FLIGHT);
 
 	// camera rotation
 	ImVec2 mousePos = ImGui::GetMousePos();
@@ -1029,6 +1160,22 @@ void Update(float deltaTime)
 		s_CamPos = glm::vec3(0.0f);
 }
 
+// the pipeline is bound. every submesh binds its part of the index buffer (16 or 32 bit)
+static void DrawMesh(VkCommandBuffer cmd, VkPipelineLayout layout, const Mesh& mesh, const glm::mat4& worldMatrix, const glm::mat4& modelMatrix)
+{
+	MeshPushConstant meshPushConst;
+	meshPushConst.worldMatrix = worldMatrix;
+	meshPushConst.modelMatrix = modelMatrix;
+	meshPushConst.vertexBuffer = mesh.GetVertexBufferAddress();
+	vkCmdPushConstants(cmd, layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(MeshPushConstant), &meshPushConst);
+
+	for (const SubmeshDraw& draw : mesh.GetDraws())
+	{
+		vkCmdBindIndexBuffer(cmd, mesh.GetIndexBuffer().buffer, draw.indexBufferOffset, draw.indexType);
+		vkCmdDrawIndexed(cmd, draw.indexCount, 1, 0, draw.vertexOffset, 0);
+	}
+}
+
 void NewFrame()
 {
 	VkDevice device = g_RendererContext.GetDevice();
@@ -1141,13 +1288,14 @@ void NewFrame()
 			renderInfo.pStencilAttachment = nullptr;
 			vkCmdBeginRendering(cmd, &renderInfo);
 
-			bool boundTextureAvail = s_BoundTexture && s_BoundTexture->IsLoaded();
+			Texture* boundTexture = g_AssetManager.Get(s_BoundTexture);
+			bool boundTextureAvail = boundTexture && boundTexture->IsLoaded();
 
 			if (boundTextureAvail)
-				VkUtils::UpdateDescBinding(device, frameData.descriptorGBuffer, s_BoundTexture->GetImage().view, g_TextureSamplerBasic, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 0);
+				VkUtils::UpdateDescBinding(device, frameData.descriptorGBuffer, boundTexture->GetImage().view, g_TextureSamplerBasic, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 0);
 
-			Mesh* modelMesh = g_Meshes[1];
-			if (modelMesh->IsLoaded() && boundTextureAvail)
+			Mesh* modelMesh = g_AssetManager.Get(g_Meshes[1]);
+			if (modelMesh && modelMesh->IsLoaded() && boundTextureAvail)
 			{
 				glm::mat4 modelRotation = glm::rotate(glm::radians(g_MeshTransform.rotation.z), glm::vec3(0.0f, 0.0f, 1.0f))
 					* glm::rotate(glm::radians(g_MeshTransform.rotation.y), glm::vec3(0.0f, 1.0f, 0.0f))
@@ -1155,15 +1303,7 @@ void NewFrame()
 
 				glm::mat4 model = glm::translate(g_MeshTransform.position) * modelRotation * glm::scale(g_MeshTransform.scale);
 
-				MeshPushConstant meshPushConst;
-				meshPushConst.worldMatrix = proj * view * model;
-				meshPushConst.modelMatrix = model;
-				meshPushConst.vertexBuffer = modelMesh->GetVertexBufferAddress();
-				vkCmdPushConstants(cmd, g_GfxPipelineDeferred_GBuffer.layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(MeshPushConstant), &meshPushConst);
-
-				vkCmdBindIndexBuffer(cmd, modelMesh->GetIndexBuffer().buffer, 0, VK_INDEX_TYPE_UINT32);
-				for (const Submesh& submesh : modelMesh->GetSubmeshes())
-					vkCmdDrawIndexed(cmd, submesh.indexCount, 1, submesh.indexOffset, 0, 0);
+				DrawMesh(cmd, g_GfxPipelineDeferred_GBuffer.layout, *modelMesh, proj * view * model, model);
 			}
 
 			vkCmdEndRendering(cmd);
@@ -1207,20 +1347,12 @@ void NewFrame()
 
 			vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, g_GfxPipelineForward_Simple.pipeline);
 
-			Mesh* mesh = g_Meshes[0];
-			if (mesh->IsLoaded())
+			Mesh* mesh = g_AssetManager.Get(g_Meshes[0]);
+			if (mesh && mesh->IsLoaded())
 			{
 				glm::mat4 model = glm::translate(glm::vec3(s_UniBuffLighting.sunPos)) * glm::scale(glm::vec3(0.2f));
 
-				MeshPushConstant meshPushConst;
-				meshPushConst.worldMatrix = proj * view * model;
-				meshPushConst.modelMatrix = model;
-				meshPushConst.vertexBuffer = mesh->GetVertexBufferAddress();
-				vkCmdPushConstants(cmd, g_GfxPipelineForward_Simple.layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(MeshPushConstant), &meshPushConst);
-
-				vkCmdBindIndexBuffer(cmd, mesh->GetIndexBuffer().buffer, 0, VK_INDEX_TYPE_UINT32);
-				for (const Submesh& submesh : mesh->GetSubmeshes())
-					vkCmdDrawIndexed(cmd, submesh.indexCount, 1, submesh.indexOffset, 0, 0);
+				DrawMesh(cmd, g_GfxPipelineForward_Simple.layout, *mesh, proj * view * model, model);
 			}
 
 			vkCmdEndRendering(cmd);
@@ -1261,13 +1393,14 @@ void NewFrame()
 		renderInfo.pStencilAttachment = nullptr;
 		vkCmdBeginRendering(cmd, &renderInfo);
 
-		bool boundTextureAvail = s_BoundTexture && s_BoundTexture->IsLoaded();
+		Texture* boundTexture = g_AssetManager.Get(s_BoundTexture);
+		bool boundTextureAvail = boundTexture && boundTexture->IsLoaded();
 
 		if (boundTextureAvail)
-			VkUtils::UpdateDescBinding(device, frameData.descriptorForward, s_BoundTexture->GetImage().view, g_TextureSamplerBasic, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 0);
+			VkUtils::UpdateDescBinding(device, frameData.descriptorForward, boundTexture->GetImage().view, g_TextureSamplerBasic, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 0);
 
-		Mesh* modelMesh = g_Meshes[1];
-		if (modelMesh->IsLoaded() && boundTextureAvail)
+		Mesh* modelMesh = g_AssetManager.Get(g_Meshes[1]);
+		if (modelMesh && modelMesh->IsLoaded() && boundTextureAvail)
 		{
 			glm::mat4 modelRotation = glm::rotate(glm::radians(g_MeshTransform.rotation.z), glm::vec3(0.0f, 0.0f, 1.0f))
 				* glm::rotate(glm::radians(g_MeshTransform.rotation.y), glm::vec3(0.0f, 1.0f, 0.0f))
@@ -1275,33 +1408,17 @@ void NewFrame()
 
 			glm::mat4 model = glm::translate(g_MeshTransform.position) * modelRotation * glm::scale(g_MeshTransform.scale);
 
-			MeshPushConstant meshPushConst;
-			meshPushConst.worldMatrix = proj * view * model;
-			meshPushConst.modelMatrix = model;
-			meshPushConst.vertexBuffer = modelMesh->GetVertexBufferAddress();
-			vkCmdPushConstants(cmd, g_GfxPipelineForward.layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(MeshPushConstant), &meshPushConst);
-
-			vkCmdBindIndexBuffer(cmd, modelMesh->GetIndexBuffer().buffer, 0, VK_INDEX_TYPE_UINT32);
-			for (const Submesh& submesh : modelMesh->GetSubmeshes())
-				vkCmdDrawIndexed(cmd, submesh.indexCount, 1, submesh.indexOffset, 0, 0);
+			DrawMesh(cmd, g_GfxPipelineForward.layout, *modelMesh, proj * view * model, model);
 		}
 
 		vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, g_GfxPipelineForward_Simple.pipeline);
 		
-		Mesh* debugLightMesh = g_Meshes[0];
-		if (debugLightMesh->IsLoaded())
+		Mesh* debugLightMesh = g_AssetManager.Get(g_Meshes[0]);
+		if (debugLightMesh && debugLightMesh->IsLoaded())
 		{
 			glm::mat4 model = glm::translate(glm::vec3(s_UniBuffLighting.sunPos)) * glm::scale(glm::vec3(0.2f));
 
-			MeshPushConstant meshPushConst;
-			meshPushConst.worldMatrix = proj * view * model;
-			meshPushConst.modelMatrix = model;
-			meshPushConst.vertexBuffer = debugLightMesh->GetVertexBufferAddress();
-			vkCmdPushConstants(cmd, g_GfxPipelineForward_Simple.layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(MeshPushConstant), &meshPushConst);
-
-			vkCmdBindIndexBuffer(cmd, debugLightMesh->GetIndexBuffer().buffer, 0, VK_INDEX_TYPE_UINT32);
-			for (const Submesh& submesh : debugLightMesh->GetSubmeshes())
-				vkCmdDrawIndexed(cmd, submesh.indexCount, 1, submesh.indexOffset, 0, 0);
+			DrawMesh(cmd, g_GfxPipelineForward_Simple.layout, *debugLightMesh, proj * view * model, model);
 		}
 
 		vkCmdEndRendering(cmd);
@@ -1359,6 +1476,20 @@ void NewFrame()
 	g_FrameIndex = (g_FrameIndex + 1) % FRAMES_IN_FLIGHT;
 }
 
+// the loader pool sizes itself from the cpu topology, LOADER_THREADS=n and LOADER_AFFINITY=0 override it
+static TaskPoolConfig GetLoaderPoolConfig()
+{
+	TaskPoolConfig config;
+
+	if (const char* threads = getenv("LOADER_THREADS"))
+		config.threadCount = (u32)atoi(threads);
+
+	if (const char* affinity = getenv("LOADER_AFFINITY"))
+		config.pinThreads = atoi(affinity) != 0;
+
+	return config;
+}
+
 int main()
 {
 	LOG_INFO("Starting!");
@@ -1373,7 +1504,15 @@ int main()
 	InitImgui();
 	
 	g_ResourceFactory.Init(&g_RendererContext);
-	g_AssetManager.Init(4);
+	g_AssetManager.Init(GetLoaderPoolConfig());
+
+	// the main/render thread keeps the first core for itself, the loader workers start from the second one. pinned once
+	// the other threads are running: on linux a thread starts with the affinity of the one creating it
+	SetCurrentThreadAffinity({ GetCpuTopology().GetCoreCpus(0)[0] });
+
+	// written by vk_cook, the pack wins over the manifest
+	g_AssetManager.MountPack(std::filesystem::path("cooked") / COOK_PACK_NAME);
+	g_AssetManager.LoadCookManifest(std::filesystem::path("cooked") / COOK_MANIFEST_NAME);
 	LoadGeometry();
 		
 	while (!glfwWindowShouldClose(g_Window))
@@ -0,0 +1,229 @@
+#include "AssetPack.h"
+#include "Utils.h"
+#include "Async/IOQueue.h"
+
+#include <algorithm>
+#include <fstream>
+
+static inline u64 AlignUp(u64 value, u64 alignment)
+{
+	return (value + alignment - 1) & ~(alignment - 1);
+}
+
+bool AssetPack::Open(const std::filesystem::path& path)
+{
+	Close();
+
+	MappedFile file;
+	if (!file.Open(path))
+		return false;
+
+	if (file.Size() < sizeof(PackHeader))
+	{
+		LOG_ERR("Invalid asset pack: %ls", path.c_str());
+		return false;
+	}
+
+	const PackHeader& header = *(const PackHeader*)file.Data();
+	bool valid = header.magic == PACK_MAGIC && header.version == PACK_VERSION
+		&& header.tocOffset % PACK_TOC_ALIGNMENT == 0
+		&& header.tocOffset <= file.Size() && header.entryCount <= (file.Size() - header.tocOffset) / sizeof(PackEntry)
+		&& header.namesOffset <= file.Size() && header.namesSize <= file.Size() - header.namesOffset
+		&& header.rootLength <= header.namesSize;
+
+	if (!valid)
+	{
+		LOG_ERR("Invalid asset pack (or packed by another version): %ls", path.c_str());
+		return false;
+	}
+
+	std::span<const PackEntry> entries = { (const PackEntry*)(file.Data() + header.tocOffset), header.entryCount };
+	for (const PackEntry& entry : entries)
+	{
+		if (entry.offset > file.Size() || entry.size > file.Size() - entry.offset
+			|| (u64)entry.nameOffset + entry.nameLength > header.namesSize)
+		{
+			LOG_ERR("Invalid asset pack entry in %ls", path.c_str());
+			return false;
+		}
+	}
+
+	m_File = std::move(file);
+	m_Entries = entries;
+	m_Names = (const char*)(m_File.Data() + header.namesOffset);
+	m_RootLength = header.rootLength;
+	return true;
+}
+
+void AssetPack::Close()
+{
+	m_File.Close();
+	m_Entries = {};
+	m_Names = nullptr;
+	m_RootLength = 0;
+}
+
+const PackEntry* AssetPack::Find(std::string_view name) const
+{
+	u64 hash = Utils::Hash64(name.data(), name.size());
+
+	auto it = std::lower_bound(m_Entries.begin(), m_Entries.end(), hash, [](const PackEntry& entry, u64 value) { return entry.nameHash < value; });
+	for (; it != m_Entries.end() && it->nameHash == hash; ++it)
+	{
+		if (GetName(*it) == name)
+			return &*it;
+	}
+	return nullptr;
+}
+
+u32 AssetPack::Prefetch(std::span<const PackEntry*> entries, u64 maxGap) const
+{
+	if (entries.empty())
+		return 0;
+
+	std::sort(entries.begin(), entries.end(), [](const PackEntry* a, const PackEntry* b) { return a->offset < b->offset; });
+
+	u32 requests = 0;
+	u64 rangeBegin = entries[0]->offset;
+	u64 rangeEnd = rangeBegin + entries[0]->size;
+
+	for (size_t i = 1; i <= entries.size(); i++)
+	{
+		if (i < entries.size() && entries[i]->offset <= rangeEnd + maxGap)
+		{
+			rangeEnd = std::max(rangeEnd, entries[i]->offset + entries[i]->size);
+			continue;
+		}
+
+		m_File.Prefetch(rangeBegin, rangeEnd - rangeBegin);
+		requests++;
+
+		if (i < entries.size())
+		{
+			rangeBegin = entries[i]->offset;
+			rangeEnd = rangeBegin + entries[i]->size;
+		}
+	}
+	return requests;
+}
+
+bool AssetPack::Verify(const PackEntry& entry) const
+{
+	std::span<const u8> data = GetData(entry);
+	return Utils::Hash64(data.data(), data.size()) == entry.contentHash;
+}
+
+bool WriteAssetPack(const std::filesystem::path& packPath, const std::string& root, std::vector<PackSource> sources)
+{
+	// data in name order, neighbours on disk are neighbours in the tree
+	std::sort(sources.begin(), sources.end(), [](const PackSource& a, const PackSource& b) { return a.name < b.name; });
+
+	std::string names = root;
+	std::vector<PackEntry> entries(sources.size());
+	for (size_t i = 0; i < sources.size(); i++)
+	{
+		const PackSource& source = sources[i];
+		if (source.name.size() > UINT16_MAX)
+		{
+			LOG_ERR("Asset pack: name too long: %s", source.name.c_str());
+			return false;
+		}
+
+		std::error_code error;
+		u64 size = (u64)std::filesystem::file_size(source.file, error);
+		if (error)
+		{
+			LOG_ERR("Asset pack: unable to read %ls", source.file.c_str());
+			return false;
+		}
+
+		PackEntry& entry = entries[i];
+		entry = {};
+		entry.nameHash = Utils::Hash64(source.name.data(), source.name.size());
+		entry.size = size;
+		entry.rawSize = size;
+		entry.sourceSize = source.sourceSize;
+		entry.sourceTime = source.sourceTime;
+		entry.nameOffset = (u32)names.size();
+		entry.nameLength = (u16)source.name.size();
+		entry.kind = source.kind;
+		entry.compression = EPackCompression::None;
+		names += source.name;
+	}
+
+	PackHeader header = {};
+	header.magic = PACK_MAGIC;
+	header.version = PACK_VERSION;
+	header.entryCount = (u32)entries.size();
+	header.rootLength = (u32)root.size();
+	header.tocOffset = AlignUp(sizeof(PackHeader), PACK_TOC_ALIGNMENT);
+	header.namesOffset = header.tocOffset + entries.size() * sizeof(PackEntry);
+	header.namesSize = names.size();
+	header.dataOffset = AlignUp(header.namesOffset + header.namesSize, PACK_DATA_ALIGNMENT);
+
+	u64 offset = header.dataOffset;
+	for (PackEntry& entry : entries)
+	{
+		entry.offset = offset;
+		offset = AlignUp(offset + entry.size, PACK_DATA_ALIGNMENT);
+	}
+
+	std::filesystem::path tempPath = packPath;
+	tempPath += ".tmp";
+
+	{
+		static const char zeros[PACK_DATA_ALIGNMENT] = {};
+
+		std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+		auto pad = [&file](u64 from, u64 to) {
+			for (; from < to; from += sizeof(zeros))
+				file.write(zeros, (std::streamsize)std::min<u64>(to - from, sizeof(zeros)));
+		};
+
+		// the table of contents goes in last, it needs the content hashes
+		file.write((const char*)&header, sizeof(header));
+		pad(sizeof(header), header.namesOffset);
+		file.write(names.data(), (std::streamsize)names.size());
+		pad(header.namesOffset + header.namesSize, header.dataOffset);
+
+		for (size_t i = 0; i < sources.size() && file; i++)
+		{
+			PackEntry& entry = entries[i];
+			IOBuffer data = IOQueue::ReadFileNow(sources[i].file);
+			if (data.Size() != entry.size)
+			{
+				LOG_ERR("Asset pack: %ls changed while packing", sources[i].file.c_str());
+				file.setstate(std::ios::failbit);
+				break;
+			}
+
+			entry.contentHash = Utils::Hash64(data.Data(), data.Size());
+			file.write((const char*)data.Data(), (std::streamsize)data.Size());
+			pad(entry.offset + entry.size, AlignUp(entry.offset + entry.size, PACK_DATA_ALIGNMENT));
+		}
+
+		// sorted by name hash for Find()
+		std::sort(entries.begin(), entries.end(), [](const PackEntry& a, const PackEntry& b) { return a.nameHash < b.nameHash; });
+		file.seekp((std::streamoff)header.tocOffset);
+		file.write((const char*)entries.data(), (std::streamsize)(entries.size() * sizeof(PackEntry)));
+
+		if (!file)
+		{
+			LOG_ERR("Unable to write asset pack: %ls", tempPath.c_str());
+			file.close();
+			std::error_code error;
+			std::filesystem::remove(tempPath, error);
+			return false;
+		}
+	}
+
+	std::error_code error;
+	std::filesystem::rename(tempPath, packPath, error);
+	if (error)
+	{
+		LOG_ERR("Unable to write asset pack: %ls", packPath.c_str());
+		std::filesystem::remove(tempPath, error);
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include "Core/CoreMinimal.h"
+#include "MappedFile.h"
+
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// .vkpack, many assets in one file: opened and mapped once, every load is a lookup in the table of contents and a view
+// into the mapping. little endian:
+//
+//     PackHeader | PackEntry[entryCount] (sorted by nameHash) | names | data (every entry PACK_DATA_ALIGNMENT aligned)
+//
+// the data is laid out in name order, the assets of a directory are next to each other and load as one read
+
+constexpr u32 PACK_MAGIC = 0x4B504B56; // "VKPK"
+constexpr u32 PACK_VERSION = 1;
+constexpr u64 PACK_TOC_ALIGNMENT = 64;
+constexpr u64 PACK_DATA_ALIGNMENT = 64; // cache line, the cooked formats need 16
+
+// prefetches of entries closer than this are merged into one, reading the gap is cheaper than another request
+constexpr u64 PACK_COALESCE_GAP = 64 * 1024;
+
+enum class EPackEntryKind : u8
+{
+	Raw,     // the file as it was
+	Mesh,    // .vkmesh
+	Texture  // .vktex
+};
+
+enum class EPackCompression : u8
+{
+	None
+};
+
+struct PackHeader
+{
+	u32 magic;
+	u32 version;
+	u32 entryCount;
+	u32 rootLength;    // the root is the first string of the names block
+
+	// bytes from the start of the file
+	u64 tocOffset;
+	u64 namesOffset;
+	u64 namesSize;
+	u64 dataOffset;
+};
+
+struct PackEntry
+{
+	u64 nameHash;      // Utils::Hash64 of the name
+	u64 offset;        // bytes from the start of the file
+	u64 size;          // as stored
+	u64 rawSize;       // after decompression, size for EPackCompression::None
+	u64 contentHash;   // Utils::Hash64 of the stored bytes, see Verify()
+
+	// the source the entry was made from, like the cook manifest
+	u64 sourceSize;
+	s64 sourceTime;
+
+	u32 nameOffset;    // in the names block
+	u16 nameLength;
+	EPackEntryKind kind;
+	EPackCompression compression;
+};
+static_assert(sizeof(PackEntry) == 64);
+
+// read only, thread safe after Open()
+class AssetPack
+{
+public:
+	// maps the file and checks the header and the table of contents, nothing else is read
+	bool Open(const std::filesystem::path& path);
+	void Close();
+
+	inline bool IsOpen() const { return m_File.IsOpen(); }
+
+	// O(log n), nullptr if it's not in the pack. names are relative to the root with '/' separators
+	const PackEntry* Find(std::string_view name) const;
+
+	// the stored bytes, in the mapping: valid until Close()
+	inline std::span<const u8> GetData(const PackEntry& entry) const { return { m_File.Data() + entry.offset, (size_t)entry.size }; }
+	inline std::string_view GetName(const PackEntry& entry) const { return { m_Names + entry.nameOffset, entry.nameLength }; }
+
+	inline std::span<const PackEntry> GetEntries() const { return m_Entries; }
+	// where the names are relative to, as written by the packer (relative to the pack directory)
+	inline std::string_view GetRoot() const { return { m_Names, m_RootLength }; }
+
+	// background read of the entries, sorted by offset and merged into one request per run of neighbours
+	// (gaps up to maxGap). returns the number of requests
+	u32 Prefetch(std::span<const PackEntry*> entries, u64 maxGap = PACK_COALESCE_GAP) const;
+
+	// hashes the entry data, false if it doesn't match the table of contents. reads every page of it
+	bool Verify(const PackEntry& entry) const;
+
+private:
+	MappedFile m_File;
+	std::span<const PackEntry> m_Entries;
+	const char* m_Names = nullptr;
+	u32 m_RootLength = 0;
+};
+
+struct PackSource
+{
+	std::string name;  // in the pack, relative to the root
+	std::filesystem::path file;
+	EPackEntryKind kind = EPackEntryKind::Raw;
+	u64 sourceSize = 0;
+	s64 sourceTime = 0;
+};
+
+// writes every file in one pack, false if one of them can't be read or the pack can't be written
+bool WriteAssetPack(const std::filesystem::path& packPath, const std::string& root, std::vector<PackSource> sources);
@@ -1,10 +1,13 @@
 #pragma once
 
-#include <functional>
-#include <deque>
+#include "Misc/InplaceFunction.h"
+#include <vector>
 
 class DeletionQueue
 {
+public:
+	using DeletionFunc = InplaceFunction<void(), 64>;
+
 public:
 	DeletionQueue() = default;
 
@@ -13,9 +16,9 @@ public:
 		Flush();
 	}
 
-	void PushBack(std::function<void()>&& function)
+	void PushBack(DeletionFunc&& function)
 	{
-		m_DeletionQueue.emplace_back(function);
+		m_DeletionQueue.emplace_back(std::move(function));
 	}
 
 	void Flush()
@@ -24,9 +27,9 @@ public:
 		for (auto it = m_DeletionQueue.rbegin(); it != m_DeletionQueue.rend(); it++)
 			(*it)(); //call functors
 
-		m_DeletionQueue.clear();
+		m_DeletionQueue.clear(); // keeps the capacity, no allocations after the first frames
 	}
 
 private:
-	std::deque<std::function<void()>> m_DeletionQueue;
+	std::vector<DeletionFunc> m_DeletionQueue;
 };
\ No newline at end of file
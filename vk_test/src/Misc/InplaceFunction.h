@@ -0,0 +1,104 @@
+#pragma once
+
+#include "Core/CoreMinimal.h"
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// std::function replacement that never allocates: the callable lives in a fixed inline buffer.
+// move only, a callable that doesn't fit is a compile error (capture a pointer instead of the whole world)
+template<typename Signature, size_t Capacity = 64>
+class InplaceFunction;
+
+template<typename R, typename... Args, size_t Capacity>
+class InplaceFunction<R(Args...), Capacity>
+{
+	struct VTable
+	{
+		R(*invoke)(void* storage, Args&&... args);
+		void(*move)(void* dst, void* src); // move constructs dst and destroys src
+		void(*destroy)(void* storage);
+	};
+
+	template<typename Functor>
+	static constexpr VTable s_VTable = {
+		[](void* storage, Args&&... args) -> R { return (*static_cast<Functor*>(storage))(std::forward<Args>(args)...); },
+		[](void* dst, void* src) { new (dst) Functor(std::move(*static_cast<Functor*>(src))); static_cast<Functor*>(src)->~Functor(); },
+		[](void* storage) { static_cast<Functor*>(storage)->~Functor(); }
+	};
+
+public:
+	static constexpr size_t INLINE_CAPACITY = Capacity;
+
+	InplaceFunction() = default;
+	InplaceFunction(std::nullptr_t) {}
+
+	template<typename F, typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, InplaceFunction>>>
+	InplaceFunction(F&& func)
+	{
+		using Functor = std::decay_t<F>;
+		static_assert(sizeof(Functor) <= Capacity, "InplaceFunction: callable too big for the inline storage");
+		static_assert(alignof(Functor) <= alignof(std::max_align_t), "InplaceFunction: callable is over aligned");
+		static_assert(std::is_invocable_r_v<R, Functor&, Args...>, "InplaceFunction: callable doesn't match the signature");
+
+		new (m_Storage) Functor(std::forward<F>(func));
+		m_VTable = &s_VTable<Functor>;
+	}
+
+	InplaceFunction(InplaceFunction&& other) noexcept
+	{
+		MoveFrom(other);
+	}
+
+	InplaceFunction& operator=(InplaceFunction&& other) noexcept
+	{
+		if (this != &other)
+		{
+			Reset();
+			MoveFrom(other);
+		}
+		return *this;
+	}
+
+	InplaceFunction(const InplaceFunction&) = delete;
+	InplaceFunction& operator=(const InplaceFunction&) = delete;
+
+	~InplaceFunction()
+	{
+		Reset();
+	}
+
+	R operator()(Args... args)
+	{
+		check(m_VTable);
+		return m_VTable->invoke(m_Storage, std::forward<Args>(args)...);
+	}
+
+	void Reset()
+	{
+		if (m_VTable)
+		{
+			m_VTable->destroy(m_Storage);
+			m_VTable = nullptr;
+		}
+	}
+
+	inline explicit operator bool() const { return m_VTable != nullptr; }
+
+private:
+	void MoveFrom(InplaceFunction& other)
+	{
+		if (other.m_VTable)
+		{
+			other.m_VTable->move(m_Storage, other.m_Storage);
+			m_VTable = other.m_VTable;
+			other.m_VTable = nullptr;
+		}
+	}
+
+private:
+	alignas(std::max_align_t) u8 m_Storage[Capacity];
+	const VTable* m_VTable = nullptr;
+};
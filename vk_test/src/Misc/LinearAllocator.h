@@ -0,0 +1,211 @@
+#pragma once
+
+#include "Core/CoreMinimal.h"
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+// bump allocator for short lived temporaries. nothing is freed one by one: take a marker, allocate, roll back to the marker.
+// when the first block is full it chains overflow blocks, they're released when rolling back past them
+// so a big allocation never fails, it just costs a malloc. single threaded, every thread owns its own
+class LinearAllocator
+{
+	struct alignas(std::max_align_t) Block
+	{
+		Block* prev;
+		u64 size;
+		u64 offset;
+
+		inline u8* Data() { return reinterpret_cast<u8*>(this + 1); }
+	};
+
+public:
+	struct Marker
+	{
+		Block* block = nullptr;
+		u64 offset = 0;
+	};
+
+	LinearAllocator() = default;
+	explicit LinearAllocator(u64 blockSize) { Init(blockSize); }
+
+	~LinearAllocator()
+	{
+		while (m_Current)
+		{
+			Block* prev = m_Current->prev;
+			free(m_Current);
+			m_Current = prev;
+		}
+	}
+
+	LinearAllocator(const LinearAllocator&) = delete;
+	LinearAllocator& operator=(const LinearAllocator&) = delete;
+
+	void Init(u64 blockSize)
+	{
+		check(!m_Current);
+		m_BlockSize = blockSize;
+		m_Current = NewBlock(nullptr, blockSize);
+	}
+
+	inline bool IsInitialized() const { return m_Current != nullptr; }
+
+	void* Alloc(u64 size, u64 alignment = alignof(std::max_align_t))
+	{
+		check(m_Current);
+		check(alignment && (alignment & (alignment - 1)) == 0);
+
+		u64 offset = AlignedOffset(m_Current, alignment);
+		if (offset + size > m_Current->size)
+		{
+			m_Current = NewBlock(m_Current, std::max(m_BlockSize, size + alignment));
+			offset = AlignedOffset(m_Current, alignment);
+		}
+
+		// used = sum of the block offsets, padding included, so rolling back is just a subtraction
+		m_Used += offset + size - m_Current->offset;
+		m_Current->offset = offset + size;
+		m_Peak = std::max(m_Peak, m_Used);
+		return m_Current->Data() + offset;
+	}
+
+	template<typename T>
+	inline T* Alloc(u64 count)
+	{
+		return static_cast<T*>(Alloc(count * sizeof(T), alignof(T)));
+	}
+
+	// grows in place when ptr is the last allocation, otherwise allocates and copies
+	void* Realloc(void* ptr, u64 oldSize, u64 newSize)
+	{
+		if (!ptr)
+			return Alloc(newSize);
+
+		u8* bytes = static_cast<u8*>(ptr);
+		if (bytes + oldSize == m_Current->Data() + m_Current->offset && bytes - m_Current->Data() + newSize <= m_Current->size)
+		{
+			m_Used = m_Used - oldSize + newSize;
+			m_Current->offset = (u64)(bytes - m_Current->Data()) + newSize;
+			m_Peak = std::max(m_Peak, m_Used);
+			return ptr;
+		}
+
+		void* newPtr = Alloc(newSize);
+		memcpy(newPtr, ptr, std::min(oldSize, newSize));
+		return newPtr;
+	}
+
+	inline Marker GetMarker() const { return { m_Current, m_Current ? m_Current->offset : 0 }; }
+
+	void ResetTo(const Marker& marker)
+	{
+		check(marker.block);
+
+		while (m_Current != marker.block)
+		{
+			check(m_Current->prev); // marker from another allocator?
+			Block* prev = m_Current->prev;
+			m_Used -= m_Current->offset;
+			free(m_Current);
+			m_Current = prev;
+		}
+
+		m_Used -= m_Current->offset - marker.offset;
+		m_Current->offset = marker.offset;
+	}
+
+	// back to the first block, the overflow ones are released
+	void Reset()
+	{
+		check(m_Current);
+
+		Block* first = m_Current;
+		while (first->prev)
+			first = first->prev;
+
+		ResetTo({ first, 0 });
+	}
+
+	inline u64 GetUsedBytes() const { return m_Used; }
+	inline u64 GetPeakBytes() const { return m_Peak; }
+	inline u64 GetBlockSize() const { return m_BlockSize; }
+
+private:
+	static inline u64 AlignUp(u64 value, u64 alignment) { return (value + alignment - 1) & ~(alignment - 1); }
+
+	// aligns the address, not the offset, so alignments bigger than max_align_t work too
+	static inline u64 AlignedOffset(Block* block, u64 alignment)
+	{
+		u64 base = (u64)(uintptr_t)block->Data();
+		return AlignUp(base + block->offset, alignment) - base;
+	}
+
+	static Block* NewBlock(Block* prev, u64 size)
+	{
+		Block* block = static_cast<Block*>(malloc(sizeof(Block) + size));
+		check(block);
+		block->prev = prev;
+		block->size = size;
+		block->offset = 0;
+		return block;
+	}
+
+private:
+	Block* m_Current = nullptr;
+	u64 m_BlockSize = 0;
+	u64 m_Used = 0;
+	u64 m_Peak = 0;
+};
+
+// rolls the allocator back when leaving the scope
+class ScratchScope
+{
+public:
+	explicit ScratchScope(LinearAllocator& allocator)
+		: m_Allocator(allocator), m_Marker(allocator.GetMarker())
+	{
+	}
+
+	~ScratchScope()
+	{
+		m_Allocator.ResetTo(m_Marker);
+	}
+
+	ScratchScope(const ScratchScope&) = delete;
+	ScratchScope& operator=(const ScratchScope&) = delete;
+
+private:
+	LinearAllocator& m_Allocator;
+	LinearAllocator::Marker m_Marker;
+};
+
+// std allocator on top of a LinearAllocator, deallocate is a no-op (the memory goes away with the scope)
+template<typename T>
+class ScratchAllocator
+{
+public:
+	using value_type = T;
+
+	explicit ScratchAllocator(LinearAllocator& allocator) : m_Allocator(&allocator) {}
+
+	template<typename U>
+	ScratchAllocator(const ScratchAllocator<U>& other) : m_Allocator(other.m_Allocator) {}
+
+	inline T* allocate(size_t count) { return m_Allocator->Alloc<T>(count); }
+	inline void deallocate(T*, size_t) {}
+
+	template<typename U>
+	inline bool operator==(const ScratchAllocator<U>& other) const { return m_Allocator == other.m_Allocator; }
+
+	template<typename U>
+	inline bool operator!=(const ScratchAllocator<U>& other) const { return m_Allocator != other.m_Allocator; }
+
+private:
+	template<typename U>
+	friend class ScratchAllocator;
+
+	LinearAllocator* m_Allocator;
+};
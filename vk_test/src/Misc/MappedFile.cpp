@@ -0,0 +1,120 @@
+#include "MappedFile.h"
+#include <utility>
+#include <algorithm>
+
+#ifdef _WIN32
+	#define WIN32_LEAN_AND_MEAN
+	#define NOMINMAX
+	#include <Windows.h>
+#else
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+	if (this != &other)
+	{
+		Close();
+		m_Data = std::exchange(other.m_Data, nullptr);
+		m_Size = std::exchange(other.m_Size, 0);
+#ifdef _WIN32
+		m_File = std::exchange(other.m_File, nullptr);
+		m_Mapping = std::exchange(other.m_Mapping, nullptr);
+#endif
+	}
+	return *this;
+}
+
+bool MappedFile::Open(const std::filesystem::path& path)
+{
+	Close();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size = {};
+	if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+	{
+		CloseHandle(file);
+		return false;
+	}
+
+	HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	void* data = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+	if (!data)
+	{
+		if (mapping)
+			CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+
+	m_File = file;
+	m_Mapping = mapping;
+	m_Data = (const u8*)data;
+	m_Size = (u64)size.QuadPart;
+#else
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat info = {};
+	if (fstat(fd, &info) != 0 || info.st_size == 0)
+	{
+		close(fd);
+		return false;
+	}
+
+	void* data = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd); // the mapping keeps the file alive
+	if (data == MAP_FAILED)
+		return false;
+
+	m_Data = (const u8*)data;
+	m_Size = (u64)info.st_size;
+#endif
+
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (!m_Data)
+		return;
+
+#ifdef _WIN32
+	UnmapViewOfFile(m_Data);
+	CloseHandle((HANDLE)m_Mapping);
+	CloseHandle((HANDLE)m_File);
+	m_File = nullptr;
+	m_Mapping = nullptr;
+#else
+	munmap((void*)m_Data, (size_t)m_Size);
+#endif
+
+	m_Data = nullptr;
+	m_Size = 0;
+}
+
+void MappedFile::Prefetch(u64 offset, u64 size) const
+{
+	if (!m_Data || offset >= m_Size)
+		return;
+
+	size = std::min(size, m_Size - offset);
+
+#ifdef _WIN32
+	WIN32_MEMORY_RANGE_ENTRY range = { (void*)(m_Data + offset), (SIZE_T)size };
+	PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+	// madvise wants a page aligned start
+	u64 pageSize = (u64)sysconf(_SC_PAGESIZE);
+	u64 alignedOffset = offset & ~(pageSize - 1);
+	madvise((void*)(m_Data + alignedOffset), (size_t)(size + offset - alignedOffset), MADV_WILLNEED);
+#endif
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "Core/CoreMinimal.h"
+#include <filesystem>
+
+// read only view of a whole file. nothing is read up front, the pages come in on first touch
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	~MappedFile() { Close(); }
+
+	MappedFile(MappedFile&& other) noexcept { *this = std::move(other); }
+	MappedFile& operator=(MappedFile&& other) noexcept;
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	// false if the file can't be opened or is empty
+	bool Open(const std::filesystem::path& path);
+	void Close();
+
+	inline const u8* Data() const { return m_Data; }
+	inline u64 Size() const { return m_Size; }
+	inline bool IsOpen() const { return m_Data != nullptr; }
+
+	// asks the os to start reading [offset, offset + size) in the background, one request for the whole range.
+	// only a hint, the pages are still faulted in on touch if it's not done
+	void Prefetch(u64 offset, u64 size) const;
+
+private:
+	const u8* m_Data = nullptr;
+	u64 m_Size = 0;
+#ifdef _WIN32
+	void* m_File = nullptr;    // HANDLE
+	void* m_Mapping = nullptr; // HANDLE
+#endif
+};
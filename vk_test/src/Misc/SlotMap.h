@@ -0,0 +1,165 @@
+#pragma once
+
+#include "Core/CoreMinimal.h"
+
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+// typed reference to an object of a SlotMap. stays valid to copy around after the object is gone,
+// Get() just returns nullptr for it. the default handle is the null one
+template<typename T>
+struct Handle
+{
+	u32 index = 0;
+	u32 generation = 0; // odd while the slot is alive, 0 = null
+
+	inline bool IsNull() const { return generation == 0; }
+	inline explicit operator bool() const { return generation != 0; }
+
+	inline bool operator==(const Handle& other) const { return index == other.index && generation == other.generation; }
+	inline bool operator!=(const Handle& other) const { return !(*this == other); }
+};
+
+// fixed capacity pool of T with generational handles. the objects sit in one contiguous array and never move, so a
+// pointer from Get() stays valid until Destroy(). Create()/Destroy() are thread safe, Get() is lock free and O(1):
+// the slot generation is bumped on every create and destroy, a stale handle doesn't match anymore.
+// it's up to the caller not to destroy an object another thread is still using
+template<typename T>
+class SlotMap
+{
+public:
+	explicit SlotMap(u32 capacity)
+		: m_Capacity(capacity)
+	{
+		m_Objects = static_cast<T*>(::operator new(sizeof(T) * capacity, std::align_val_t(alignof(T))));
+		m_Generations = new std::atomic<u32>[capacity];
+		for (u32 i = 0; i < capacity; i++)
+			m_Generations[i].store(0, std::memory_order_relaxed);
+	}
+
+	~SlotMap()
+	{
+		Clear();
+		delete[] m_Generations;
+		::operator delete(m_Objects, std::align_val_t(alignof(T)));
+	}
+
+	SlotMap(const SlotMap&) = delete;
+	SlotMap& operator=(const SlotMap&) = delete;
+
+	template<typename... Args>
+	Handle<T> Create(Args&&... args)
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+
+		u32 index;
+		if (!m_FreeSlots.empty())
+		{
+			index = m_FreeSlots.back();
+			m_FreeSlots.pop_back();
+		}
+		else
+		{
+			u32 highWater = m_HighWater.load(std::memory_order_relaxed);
+			CORE_ASSERT(highWater < m_Capacity, "SlotMap is full!");
+			index = highWater;
+		}
+
+		new (&m_Objects[index]) T(std::forward<Args>(args)...);
+
+		// published after the object is constructed: a Get() or ForEach() that sees the generation sees the object
+		u32 generation = m_Generations[index].load(std::memory_order_relaxed) + 1;
+		m_Generations[index].store(generation, std::memory_order_release);
+		if (index == m_HighWater.load(std::memory_order_relaxed))
+			m_HighWater.store(index + 1, std::memory_order_release);
+
+		m_Count++;
+		return { index, generation };
+	}
+
+	// false for a stale handle
+	bool Destroy(Handle<T> handle)
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+
+		if (!IsAlive(handle))
+			return false;
+
+		m_Generations[handle.index].store(handle.generation + 1, std::memory_order_release);
+		m_Objects[handle.index].~T();
+		m_FreeSlots.push_back(handle.index);
+		m_Count--;
+		return true;
+	}
+
+	inline T* Get(Handle<T> handle) const
+	{
+		return IsAlive(handle) ? &m_Objects[handle.index] : nullptr;
+	}
+
+	inline bool IsAlive(Handle<T> handle) const
+	{
+		return handle.generation != 0 && handle.index < m_Capacity
+			&& m_Generations[handle.index].load(std::memory_order_acquire) == handle.generation;
+	}
+
+	// pointer back to its handle, null handle if it's not one of ours
+	Handle<T> GetHandle(const T* object) const
+	{
+		if (object < m_Objects || object >= m_Objects + m_Capacity)
+			return {};
+
+		u32 index = (u32)(object - m_Objects);
+		u32 generation = m_Generations[index].load(std::memory_order_acquire);
+		return (generation & 1) ? Handle<T>{ index, generation } : Handle<T>{};
+	}
+
+	// fn(Handle<T>, T&) on every live object, in slot order. a linear walk over the slots used so far,
+	// objects created meanwhile may or may not be visited, destroying them meanwhile is not allowed
+	template<typename F>
+	void ForEach(F&& fn)
+	{
+		u32 highWater = m_HighWater.load(std::memory_order_acquire);
+		for (u32 i = 0; i < highWater; i++)
+		{
+			u32 generation = m_Generations[i].load(std::memory_order_acquire);
+			if (generation & 1)
+				fn(Handle<T>{ i, generation }, m_Objects[i]);
+		}
+	}
+
+	// destroys every object, the handles given out so far become stale
+	void Clear()
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+
+		u32 highWater = m_HighWater.load(std::memory_order_relaxed);
+		for (u32 i = 0; i < highWater; i++)
+		{
+			u32 generation = m_Generations[i].load(std::memory_order_relaxed);
+			if (generation & 1)
+			{
+				m_Generations[i].store(generation + 1, std::memory_order_release);
+				m_Objects[i].~T();
+				m_FreeSlots.push_back(i);
+			}
+		}
+		m_Count.store(0, std::memory_order_relaxed);
+	}
+
+	inline u32 GetCount() const { return m_Count.load(std::memory_order_relaxed); }
+	inline u32 GetCapacity() const { return m_Capacity; }
+
+private:
+	T* m_Objects = nullptr;
+	std::atomic<u32>* m_Generations = nullptr;
+	u32 m_Capacity = 0;
+	std::atomic<u32> m_HighWater = 0;
+
+	std::mutex m_Lock;
+	std::vector<u32> m_FreeSlots; // guarded by m_Lock
+	std::atomic<u32> m_Count = 0; // written under m_Lock
+};
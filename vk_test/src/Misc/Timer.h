@@ -19,6 +19,12 @@ public:
 		return std::chrono::duration_cast<std::chrono::milliseconds>(now - m_Start).count();
 	}
 
+	u64 ElapsedUs()
+	{
+		auto now = clock::now();
+		return std::chrono::duration_cast<std::chrono::microseconds>(now - m_Start).count();
+	}
+
 private:
 	std::chrono::time_point<clock> m_Start;
 };
\ No newline at end of file
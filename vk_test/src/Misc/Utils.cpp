@@ -2,6 +2,14 @@
 #include <fstream>
 #include <iostream>
 
+#ifdef _WIN32
+	#define WIN32_LEAN_AND_MEAN
+	#include <Windows.h>
+	#include <Psapi.h>
+#else
+	#include <unistd.h>
+#endif
+
 std::vector<char> Utils::ReadFileBinary(std::string_view path)
 {
 	std::ifstream file(path.data(), std::ios::binary);
@@ -28,3 +36,32 @@ float Utils::BytesToMegabytes(u64 sizeBytes)
 	sizeBytesReal /= 1000;
 	return sizeBytesReal;
 }
+
+u64 Utils::GetProcessResidentBytes()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters = {};
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return 0;
+	return counters.WorkingSetSize;
+#else
+	// statm: total and resident size in pages
+	std::ifstream statm("/proc/self/statm");
+	u64 totalPages = 0, residentPages = 0;
+	if (!(statm >> totalPages >> residentPages))
+		return 0;
+	return residentPages * (u64)sysconf(_SC_PAGESIZE);
+#endif
+}
+
+u64 Utils::Hash64(const void* data, u64 size, u64 seed)
+{
+	const u8* bytes = (const u8*)data;
+	u64 hash = seed;
+	for (u64 i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
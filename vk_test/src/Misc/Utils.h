@@ -9,4 +9,11 @@ namespace Utils {
 	std::vector<char> ReadFileBinary(std::string_view path);
 	float BytesToMegabytes(u64 sizeBytes);
 
+	// working set of the process (resident pages), 0 if the os doesn't tell
+	u64 GetProcessResidentBytes();
+
+	// 64 bit FNV-1a, chain calls by passing the previous result as seed. not for anything adversarial
+	constexpr u64 HASH64_SEED = 0xcbf29ce484222325ull;
+	u64 Hash64(const void* data, u64 size, u64 seed = HASH64_SEED);
+
 }
\ No newline at end of file
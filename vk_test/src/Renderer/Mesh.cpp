@@ -6,6 +6,21 @@
 
 #include "Engine.h"
 #include "ResourceFactory.h"
+#include "MeshFormat.h"
+#include "VertexDecode.h"
+#include "MeshOptimizer.h"
+#include "Async/IOQueue.h"
+#include "Misc/Utils.h"
+
+#include <fstream>
+#include <limits>
+
+// vertices per ParallelFor chunk for the whole-mesh passes
+constexpr u64 VERTEX_GRAIN_SIZE = 16 * 1024;
+// vertices (or indices) per decode chunk: a big primitive is split so a single mesh spreads over the workers too
+constexpr u64 DECODE_GRAIN_SIZE = 64 * 1024;
+// vertices a chunk decodes at a time on the stack (12 KB) before writing them to the destination
+constexpr u64 DECODE_BLOCK_SIZE = 256;
 
 void PrintNodes(fastgltf::Expected<fastgltf::Asset>& gltf, fastgltf::Node* node, int tabCount = 0)
 {
@@ -21,124 +36,540 @@ void PrintNodes(fastgltf::Expected<fastgltf::Asset>& gltf, fastgltf::Node* node,
     }
 }
 
-void Mesh::Load(const std::filesystem::path& path)
+struct PrimitiveRange
+{
+    u32 meshIndex;
+    u32 primitiveIndex;
+    u64 vertexOffset;
+    u64 indexOffset;
+};
+
+// a slice of a primitive, in elements of its accessors. the output range in m_Vertices/m_Indices follows
+struct DecodeRange
 {
-    fastgltf::Expected<fastgltf::GltfDataBuffer> data = fastgltf::GltfDataBuffer::FromPath(path);
-    if (!data)
+    u32 primitive; // in MeshLoadJob::primitives
+    u64 vertexBegin;
+    u64 vertexEnd;
+    u64 indexBegin;
+    u64 indexEnd;
+
+    // of the positions decoded, merged by FinishLoad()
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+};
+
+// fn(element, index) for the elements [begin, end) of the accessor, what fastgltf::iterateAccessorWithIndex does for all of them
+template<typename T, typename F>
+static void IterateAccessorRange(const fastgltf::Asset& asset, const fastgltf::Accessor& accessor, u64 begin, u64 end, F&& fn)
+{
+    if ((accessor.sparse && accessor.sparse->count > 0) || !accessor.bufferViewIndex)
     {
-        LOG_ERR("Unable to load mesh file: %ls", path.c_str());
+        // rare: sparse elements are looked up one by one, no buffer view reads as zeros
+        for (u64 i = begin; i < end; i++)
+            fn(fastgltf::getAccessorElement<T>(asset, accessor, i), i);
         return;
     }
-    
-    constexpr auto gltfOptions = /*fastgltf::Options::LoadGLBBuffers | */ fastgltf::Options::LoadExternalBuffers;
+
+    const fastgltf::BufferView& view = asset.bufferViews[*accessor.bufferViewIndex];
+    u64 stride = view.byteStride.value_or(fastgltf::getElementByteSize(accessor.type, accessor.componentType));
+    const std::byte* bytes = fastgltf::DefaultBufferDataAdapter()(asset, *accessor.bufferViewIndex).subspan(accessor.byteOffset).data();
+
+    for (u64 i = begin; i < end; i++)
+        fn(fastgltf::internal::getAccessorElementAt<T>(accessor.componentType, bytes + i * stride, accessor.normalized), i);
+}
+
+// the elements [begin, ...) of the accessor in place, for the bulk kernels. false if they can't read it:
+// sparse, no buffer view (zeros) or components they don't take, those go through IterateAccessorRange
+static bool GetAttributeStream(const fastgltf::Asset& asset, const fastgltf::Accessor& accessor, u64 begin, AttributeStream& outStream)
+{
+    if ((accessor.sparse && accessor.sparse->count > 0) || !accessor.bufferViewIndex)
+        return false;
+
+    switch (accessor.componentType)
+    {
+    case fastgltf::ComponentType::Byte:
+        outStream.componentType = EComponentType::S8;
+        break;
+    case fastgltf::ComponentType::UnsignedByte:
+        outStream.componentType = EComponentType::U8;
+        break;
+    case fastgltf::ComponentType::Short:
+        outStream.componentType = EComponentType::S16;
+        break;
+    case fastgltf::ComponentType::UnsignedShort:
+        outStream.componentType = EComponentType::U16;
+        break;
+    case fastgltf::ComponentType::UnsignedInt:
+        outStream.componentType = EComponentType::U32;
+        break;
+    case fastgltf::ComponentType::Float:
+        outStream.componentType = EComponentType::Float;
+        break;
+    default:
+        return false;
+    }
+
+    u32 componentCount = (u32)fastgltf::getNumComponents(accessor.type);
+    if (componentCount > 4)
+        return false;
+
+    const fastgltf::BufferView& view = asset.bufferViews[*accessor.bufferViewIndex];
+    outStream.stride = view.byteStride.value_or(fastgltf::getElementByteSize(accessor.type, accessor.componentType));
+    outStream.data = (const u8*)fastgltf::DefaultBufferDataAdapter()(asset, *accessor.bufferViewIndex).subspan(accessor.byteOffset).data() + begin * outStream.stride;
+    outStream.componentCount = componentCount;
+    outStream.normalized = accessor.normalized;
+    return true;
+}
+
+// id of the glb binary chunk while it's parsed, becomes a ByteView into the file right after
+constexpr fastgltf::CustomBufferId GLB_CHUNK_BUFFER_ID = 1;
+
+// lets fastgltf parse the file bytes in place (the read io buffer or the mapping) instead of copying them into a
+// GltfDataBuffer. the json is parsed where it is if there's padding behind it, and the glb binary chunk isn't copied
+// at all: MapBinaryChunk hands the parser the chunk itself as the memory to read it into
+class GlbDataGetter : public fastgltf::GltfDataGetter
+{
+public:
+    // readablePadding: bytes past the end that can be read, IO_BUFFER_PADDING for an io buffer, 0 for a mapping
+    GlbDataGetter(const u8* data, u64 size, u64 readablePadding) : m_Data(data), m_Size(size), m_ReadablePadding(readablePadding) {}
+
+    void read(void* ptr, std::size_t count) override
+    {
+        // the binary chunk "mapped" onto itself, nothing to copy
+        if (ptr != m_Data + m_Offset)
+            memcpy(ptr, m_Data + m_Offset, count);
+        m_Offset += count;
+
+        // the header of the chunk after the json, the binary one
+        m_AtBinaryChunk = m_JsonRead && count == 2 * sizeof(u32);
+    }
+
+    fastgltf::span<std::byte> read(std::size_t count, std::size_t padding) override
+    {
+        fastgltf::span<std::byte> span((std::byte*)m_Data + m_Offset, count);
+        if (m_Offset + count + padding > m_Size + m_ReadablePadding)
+        {
+            // the json runs to the end of a mapped file, simdjson reads past it: a padded copy
+            m_PaddedCopy.assign(count + padding, std::byte(0));
+            memcpy(m_PaddedCopy.data(), m_Data + m_Offset, count);
+            span = fastgltf::span<std::byte>(m_PaddedCopy.data(), count);
+        }
+        m_Offset += count;
+        m_JsonRead = true;
+        return span;
+    }
+
+    void reset() override { m_Offset = 0; }
+    std::size_t bytesRead() override { return m_Offset; }
+    std::size_t totalSize() override { return m_Size; }
+
+    // fastgltf::BufferMapCallback, the parser is asking where to put the binary chunk it's about to read
+    static fastgltf::BufferInfo MapBinaryChunk(std::uint64_t size, void* userPointer)
+    {
+        GlbDataGetter* getter = (GlbDataGetter*)userPointer;
+
+        // the parser writes into what's returned here, only the binary chunk (right after its header) can be the file
+        // itself. a data uri gets nullptr, fastgltf decodes it into its own memory then
+        if (!getter->m_AtBinaryChunk || getter->m_BinaryChunk || size > getter->m_Size - getter->m_Offset)
+            return { nullptr, 0 };
+
+        getter->m_BinaryChunk = getter->m_Data + getter->m_Offset;
+        getter->m_BinaryChunkSize = size;
+        return { (void*)getter->m_BinaryChunk, GLB_CHUNK_BUFFER_ID };
+    }
+
+    // the parsed glb buffer reads straight from the file
+    void PointAtBinaryChunk(fastgltf::Asset& asset) const
+    {
+        for (fastgltf::Buffer& buffer : asset.buffers)
+        {
+            const fastgltf::sources::CustomBuffer* custom = std::get_if<fastgltf::sources::CustomBuffer>(&buffer.data);
+            if (custom && custom->id == GLB_CHUNK_BUFFER_ID)
+                buffer.data = fastgltf::sources::ByteView{ fastgltf::span<const std::byte>((const std::byte*)m_BinaryChunk, m_BinaryChunkSize), fastgltf::MimeType::GltfBuffer };
+        }
+    }
+
+private:
+    const u8* m_Data;
+    u64 m_Size;
+    u64 m_ReadablePadding;
+    std::size_t m_Offset = 0;
+    bool m_JsonRead = false;
+    bool m_AtBinaryChunk = false;
+
+    const u8* m_BinaryChunk = nullptr;
+    u64 m_BinaryChunkSize = 0;
+    std::vector<std::byte> m_PaddedCopy;
+};
+
+struct MeshLoadJob
+{
+    std::filesystem::path path;
+    // the file, read or mapped. the parsed glb buffer points into it, released with the job
+    IOBuffer file;
+    MappedFile mappedFile;
+    // starts as an error, becomes valid after Parse()
+    fastgltf::Expected<fastgltf::Asset> gltf = fastgltf::Error::InvalidPath;
+
+    // where every primitive goes in m_Vertices/m_Indices and how it's split, known after Parse()
+    std::vector<PrimitiveRange> primitives;
+    std::vector<DecodeRange> chunks;
+
+    // the decode output: m_Vertices/m_Indices, the reserved staging range or the scratch below, set by Parse()
+    bool decodeToStaging = false;
+    Vertex* vertices = nullptr;
+    Index* indices = nullptr;
+
+    // staged, what FinishLoad() reads (Processing) is decoded here and written to the staging range in the gpu layout
+    // after. the staged pointers are where it goes, null if it was decoded there or it's already written
+    std::vector<Vertex> vertexScratch;
+    std::vector<Index> indexScratch;
+    u8* stagedVertices = nullptr;
+    u8* stagedIndices = nullptr;
+};
+
+void Mesh::Load(const std::filesystem::path& path)
+{
+    if (IsCookedUpToDate(path) && LoadCooked(GetCookedPath(path)))
+        return;
+
+    LoadGltf(path);
+}
+
+void Mesh::LoadGltf(const std::filesystem::path& path, EMeshFileAccess access)
+{
+    MeshLoadJob* job = BeginLoad(path);
+    if (access == EMeshFileAccess::Map)
+        MapFile(job);
+    else
+        ReadFile(job);
+
+    // every chunk writes its own slice, the calling thread helps the workers
+    u32 chunkCount = Parse(job);
+    g_AssetManager.GetTaskPool().ParallelFor(0, chunkCount, 1, [this, job](u64 begin, u64 end) {
+        for (u64 i = begin; i < end; i++)
+            DecodeChunk(job, (u32)i);
+    });
+
+    FinishLoad(job);
+}
+
+MeshLoadJob* Mesh::BeginLoad(const std::filesystem::path& path, bool decodeToStaging)
+{
+    MeshLoadJob* job = new MeshLoadJob();
+    job->path = path;
+    job->decodeToStaging = decodeToStaging;
+    return job;
+}
+
+void Mesh::ReadFile(MeshLoadJob* job)
+{
+    SetFile(job, IOQueue::ReadFileNow(job->path));
+}
+
+void Mesh::SetFile(MeshLoadJob* job, IOBuffer&& file)
+{
+    job->file = std::move(file);
+    if (job->file.IsEmpty())
+        LOG_ERR("Unable to load mesh file: %ls", job->path.c_str());
+}
+
+u64 Mesh::MapFile(MeshLoadJob* job)
+{
+    if (!job->mappedFile.Open(job->path))
+    {
+        LOG_ERR("Unable to load mesh file: %ls", job->path.c_str());
+        return 0;
+    }
+    return job->mappedFile.Size();
+}
+
+u32 Mesh::Parse(MeshLoadJob* job)
+{
+    if (job->file.IsEmpty() && !job->mappedFile.IsOpen())
+        return 0;
+
+    // the io buffer is padded (IO_BUFFER_PADDING matches SIMDJSON_PADDING), the mapping isn't
+    GlbDataGetter data = job->mappedFile.IsOpen() ? GlbDataGetter(job->mappedFile.Data(), job->mappedFile.Size(), 0)
+        : GlbDataGetter(job->file.Data(), job->file.Size(), IO_BUFFER_PADDING);
+
+    // no LoadGLBBuffers: the binary chunk goes through MapBinaryChunk and stays in the file
+    constexpr auto gltfOptions = fastgltf::Options::LoadExternalBuffers;
     fastgltf::Parser parser;
-    fastgltf::Expected<fastgltf::Asset> gltf = parser.loadGltfBinary(data.get(), path.parent_path(), gltfOptions);
-    check(gltf);
+    parser.setUserPointer(&data);
+    parser.setBufferAllocationCallback(GlbDataGetter::MapBinaryChunk);
+    job->gltf = parser.loadGltfBinary(data, job->path.parent_path(), gltfOptions);
+    check(job->gltf);
+    if (!job->gltf)
+        return 0;
+
+    data.PointAtBinaryChunk(job->gltf.get());
+
+    fastgltf::Expected<fastgltf::Asset>& gltf = job->gltf;
 
     u64 totalVertexCount = 0;
     u64 totalIndexCount = 0;
 
     // megatodo: iterate gltf->nodes to fix transform and stuff of meshes
 
+    m_Submeshes.clear();
     m_Submeshes.reserve(gltf->meshes.size());
-    for (fastgltf::Mesh& mesh : gltf->meshes)
+    for (u32 i = 0; i < (u32)gltf->meshes.size(); i++)
     {
+        fastgltf::Mesh& mesh = gltf->meshes[i];
+
         Submesh submesh = {};
         submesh.indexOffset = totalIndexCount;
-        for (const auto& primitive : mesh.primitives)
+        submesh.vertexOffset = totalVertexCount;
+        for (u32 j = 0; j < (u32)mesh.primitives.size(); j++)
         {
+            const fastgltf::Primitive& primitive = mesh.primitives[j];
+
             u64 primitiveVertexCount = gltf->accessors[primitive.findAttribute("POSITION")->accessorIndex].count;
             u64 primitiveIndexCount = gltf->accessors[primitive.indicesAccessor.value()].count;
 
+            PrimitiveRange& range = job->primitives.emplace_back();
+            range.meshIndex = i;
+            range.primitiveIndex = j;
+            range.vertexOffset = totalVertexCount;
+            range.indexOffset = totalIndexCount;
+
+            // vertices and indices cut in the same number of slices, proportionally
+            u64 chunkCount = std::max<u64>(1, (std::max(primitiveVertexCount, primitiveIndexCount) + DECODE_GRAIN_SIZE - 1) / DECODE_GRAIN_SIZE);
+            for (u64 c = 0; c < chunkCount; c++)
+            {
+                DecodeRange& chunk = job->chunks.emplace_back();
+                chunk.primitive = (u32)job->primitives.size() - 1;
+                chunk.vertexBegin = primitiveVertexCount * c / chunkCount;
+                chunk.vertexEnd = primitiveVertexCount * (c + 1) / chunkCount;
+                chunk.indexBegin = primitiveIndexCount * c / chunkCount;
+                chunk.indexEnd = primitiveIndexCount * (c + 1) / chunkCount;
+            }
+
             totalVertexCount += primitiveVertexCount;
             totalIndexCount += primitiveIndexCount;
 
             submesh.indexCount += primitiveIndexCount;
+            submesh.vertexCount += primitiveVertexCount;
         }
         m_Submeshes.push_back(submesh);
     }
 
-    m_Vertices.resize(totalVertexCount);
-    m_Indices.reserve(totalIndexCount);
+    // the data only going to the gpu is decoded straight into staging memory, in the gpu layout (vertices then indices):
+    // the upload copies it from there. in ram if it's kept or if there's no room right now. the index buffer can only
+    // get smaller after the processing (a submesh under 65536 vertices once its unused ones are out)
+    m_CompactIndices = Processing.compactIndices;
+    u64 vertexBytes = totalVertexCount * sizeof(Vertex);
+    if (job->decodeToStaging && !KeepCPUData)
+        m_StagingRange = g_ResourceFactory.TryReserveStaging(vertexBytes + BuildLayout());
 
-    u64 loadedVertexCount = 0;
+    // every primitive writes its own slice, no push_back so they can be decoded in parallel
+    if (m_StagingRange)
+    {
+        // what FinishLoad() reads is decoded in ram, staging memory can be write combined
+        job->stagedVertices = m_StagingRange.data;
+        if (Processing.ReadsVertices())
+        {
+            job->vertexScratch.resize(totalVertexCount);
+            job->vertices = job->vertexScratch.data();
+        }
+        else
+        {
+            job->vertices = (Vertex*)job->stagedVertices;
+            job->stagedVertices = nullptr;
+        }
 
-    for (u32 i = 0; i < (u32)gltf->meshes.size(); i++)
+        job->stagedIndices = m_StagingRange.data + vertexBytes;
+        if (Processing.ReadsIndices())
+        {
+            job->indexScratch.resize(totalIndexCount);
+            job->indices = job->indexScratch.data();
+        }
+        else
+        {
+            job->indices = (Index*)job->stagedIndices;
+            job->stagedIndices = nullptr;
+        }
+    }
+    else
+    {
+        m_Vertices.resize(totalVertexCount);
+        m_Indices.resize(totalIndexCount);
+        job->vertices = m_Vertices.data();
+        job->indices = m_Indices.data();
+    }
+    m_VertexView = { job->vertices, (size_t)totalVertexCount };
+    m_IndexView = { job->indices, (size_t)totalIndexCount };
+
+    return (u32)job->chunks.size();
+}
+
+void Mesh::DecodeChunk(MeshLoadJob* job, u32 chunkIndex)
+{
+    fastgltf::Expected<fastgltf::Asset>& gltf = job->gltf;
+    DecodeRange& chunk = job->chunks[chunkIndex];
+    const PrimitiveRange& range = job->primitives[chunk.primitive];
+
+    // primitive (triangoli, quad, etc..)
+    const fastgltf::Primitive& primitive = gltf->meshes[range.meshIndex].primitives[range.primitiveIndex];
+    check(primitive.type == fastgltf::PrimitiveType::Triangles);
+
+    const u64 vertexOffset = range.vertexOffset;
+    const u64 indexOffset = range.indexOffset;
+
+    // load indexes
+    fastgltf::Accessor& indexAccessor = gltf->accessors[primitive.indicesAccessor.value()];
+    AttributeStream indexStream;
+    bool bulkIndices = GetAttributeStream(gltf.get(), indexAccessor, chunk.indexBegin, indexStream)
+        && (indexStream.componentType == EComponentType::U8 || indexStream.componentType == EComponentType::U16 || indexStream.componentType == EComponentType::U32);
+    if (bulkIndices)
+    {
+        DecodeIndices(job->indices + indexOffset + chunk.indexBegin, chunk.indexEnd - chunk.indexBegin, indexStream, (Index)vertexOffset);
+    }
+    else
+    {
+        IterateAccessorRange<std::uint32_t>(gltf.get(), indexAccessor, chunk.indexBegin, chunk.indexEnd,
+            [&](std::uint32_t idx, size_t index) {
+                job->indices[indexOffset + index] = (Index)(idx + vertexOffset);
+            });
+    }
+
+    // load vertices: every attribute the kernels can read in place in one pass, the missing ones get their defaults
+    // (normal (1, 0, 0), uv 0, color 1). the others are patched after, element by element
+    const fastgltf::Accessor* accessors[4] = {};
+    accessors[(u32)EVertexAttribute::Position] = &gltf->accessors[primitive.findAttribute("POSITION")->accessorIndex];
+
+    auto normals = primitive.findAttribute("NORMAL");
+    if (normals != primitive.attributes.end())
+        accessors[(u32)EVertexAttribute::Normal] = &gltf->accessors[(*normals).accessorIndex];
+
+    auto uv = primitive.findAttribute("TEXCOORD_0");
+    if (uv != primitive.attributes.end())
+        accessors[(u32)EVertexAttribute::UV] = &gltf->accessors[(*uv).accessorIndex];
+
+    auto colors = primitive.findAttribute("COLOR_0");
+    if (colors != primitive.attributes.end())
+        accessors[(u32)EVertexAttribute::Color] = &gltf->accessors[(*colors).accessorIndex];
+
+    VertexStreams streams;
+    AttributeStream* attributeStreams[4] = { &streams.position, &streams.normal, &streams.uv, &streams.color };
+    bool patch[4] = {};
+    for (u32 a = 0; a < 4; a++)
     {
-        const fastgltf::Mesh& mesh = gltf->meshes[i];
-        const Submesh& meshDesc = m_Submeshes[i];
-        
-        // primitive (triangoli, quad, etc..)
-        for (const auto& primitive : mesh.primitives)
+        if (!accessors[a])
+            continue;
+
+        AttributeStream stream;
+        if (GetAttributeStream(gltf.get(), *accessors[a], chunk.vertexBegin, stream) && stream.componentType != EComponentType::U32)
+            *attributeStreams[a] = stream;
+        else
+            patch[a] = true;
+    }
+
+    // a block at a time on the stack: the patches, the color override and the bounds work on it while it's in L1, then
+    // it's written to the destination once and in order. staging memory can be write combined, it's never read back
+    Vertex* vertices = job->vertices + vertexOffset;
+    Vertex block[DECODE_BLOCK_SIZE];
+    glm::vec3 boundsMin(std::numeric_limits<float>::max());
+    glm::vec3 boundsMax(std::numeric_limits<float>::lowest());
+
+    for (u64 blockBegin = chunk.vertexBegin; blockBegin < chunk.vertexEnd; blockBegin += DECODE_BLOCK_SIZE)
+    {
+        u64 blockEnd = std::min(blockBegin + DECODE_BLOCK_SIZE, chunk.vertexEnd);
+        u64 blockCount = blockEnd - blockBegin;
+
+        VertexStreams blockStreams = streams;
+        AttributeStream* blockAttributeStreams[4] = { &blockStreams.position, &blockStreams.normal, &blockStreams.uv, &blockStreams.color };
+        for (AttributeStream* stream : blockAttributeStreams)
         {
-            check(primitive.type == fastgltf::PrimitiveType::Triangles);
+            if (stream->data)
+                stream->data += (blockBegin - chunk.vertexBegin) * stream->stride;
+        }
+        DecodeVertices(block, blockCount, blockStreams);
 
-            // load indexes
-            fastgltf::Accessor& indexAccessor = gltf->accessors[primitive.indicesAccessor.value()];
-            fastgltf::iterateAccessor<std::uint32_t>(gltf.get(), indexAccessor,
-                [&](std::uint32_t idx) {
-                    m_Indices.push_back(idx + loadedVertexCount);
+        if (patch[(u32)EVertexAttribute::Position])
+        {
+            IterateAccessorRange<glm::vec3>(gltf.get(), *accessors[(u32)EVertexAttribute::Position], blockBegin, blockEnd,
+                [&](glm::vec3 v, size_t index) {
+                    block[index - blockBegin].position = v;
                 });
+        }
 
-            // load vertices
-            fastgltf::Accessor& posAccessor = gltf->accessors[primitive.findAttribute("POSITION")->accessorIndex];
-            fastgltf::iterateAccessorWithIndex<glm::vec3>(gltf.get(), posAccessor,
+        if (patch[(u32)EVertexAttribute::Normal])
+        {
+            IterateAccessorRange<glm::vec3>(gltf.get(), *accessors[(u32)EVertexAttribute::Normal], blockBegin, blockEnd,
                 [&](glm::vec3 v, size_t index) {
-                    Vertex newvtx;
-                    newvtx.position = v;
-                    newvtx.normal = { 1, 0, 0 };
-                    newvtx.color = glm::vec4{ 1.f };
-                    newvtx.uv_x = 0;
-                    newvtx.uv_y = 0;
-
-                    m_Vertices[loadedVertexCount + index] = newvtx;
+                    block[index - blockBegin].normal = v;
                 });
+        }
 
-            // load vertex normals
-            auto normals = primitive.findAttribute("NORMAL");
-            if (normals != primitive.attributes.end())
-            {
-                fastgltf::iterateAccessorWithIndex<glm::vec3>(gltf.get(), gltf->accessors[(*normals).accessorIndex],
-                    [&](glm::vec3 v, size_t index) {
-                        m_Vertices[loadedVertexCount + index].normal = v;
-                    });
-            }
+        if (patch[(u32)EVertexAttribute::UV])
+        {
+            IterateAccessorRange<glm::vec2>(gltf.get(), *accessors[(u32)EVertexAttribute::UV], blockBegin, blockEnd,
+                [&](glm::vec2 v, size_t index) {
+                    block[index - blockBegin].uv_x = v.x;
+                    block[index - blockBegin].uv_y = v.y;
+                });
+        }
 
-            // load UVs
-            auto uv = primitive.findAttribute("TEXCOORD_0");
-            if (uv != primitive.attributes.end())
-            {
-                fastgltf::iterateAccessorWithIndex<glm::vec2>(gltf.get(), gltf->accessors[(*uv).accessorIndex],
-                    [&](glm::vec2 v, size_t index) {
-                        m_Vertices[loadedVertexCount + index].uv_x = v.x;
-                        m_Vertices[loadedVertexCount + index].uv_y = v.y;
-                    });
-            }
+        if (patch[(u32)EVertexAttribute::Color])
+        {
+            IterateAccessorRange<glm::vec4>(gltf.get(), *accessors[(u32)EVertexAttribute::Color], blockBegin, blockEnd,
+                [&](glm::vec4 v, size_t index) {
+                    block[index - blockBegin].color = v;
+                });
+        }
 
-            // load vertex colors
-            auto colors = primitive.findAttribute("COLOR_0");
-            if (colors != primitive.attributes.end())
-            {
-                fastgltf::iterateAccessorWithIndex<glm::vec4>(gltf.get(), gltf->accessors[(*colors).accessorIndex],
-                    [&](glm::vec4 v, size_t index) {
-                        m_Vertices[loadedVertexCount + index].color = v;
-                    });
-            }
+        constexpr bool kOverrideColors = true;
+        for (u64 i = 0; i < blockCount; i++)
+        {
+            if constexpr (kOverrideColors)
+                block[i].color = glm::vec4(block[i].normal, 1.0f);
 
-            loadedVertexCount += posAccessor.count;
+            boundsMin = glm::min(boundsMin, block[i].position);
+            boundsMax = glm::max(boundsMax, block[i].position);
         }
+
+        memcpy(vertices + blockBegin, block, blockCount * sizeof(Vertex));
     }
-    
-    //PrintNodes(gltf, &gltf->nodes[0], 0);
 
-    constexpr bool kOverrideColors = true;
-    if constexpr (kOverrideColors)
+    chunk.boundsMin = boundsMin;
+    chunk.boundsMax = boundsMax;
+}
+
+void Mesh::FinishLoad(MeshLoadJob* job)
+{
+    //PrintNodes(job->gltf, &job->gltf->nodes[0], 0);
+
+    // the colors were overridden by the decode and the bounds are per chunk, the vertices aren't read back
+    m_BoundsMin = glm::vec3(std::numeric_limits<float>::max());
+    m_BoundsMax = glm::vec3(std::numeric_limits<float>::lowest());
+    for (const DecodeRange& chunk : job->chunks)
     {
-        for (Vertex& v : m_Vertices)
-            v.color = glm::vec4(v.normal, 1.0f);
+        m_BoundsMin = glm::min(m_BoundsMin, chunk.boundsMin);
+        m_BoundsMax = glm::max(m_BoundsMax, chunk.boundsMax);
     }
-    
-    DebugName = path.string();
+
+    if (m_VertexView.empty())
+        m_BoundsMin = m_BoundsMax = glm::vec3(0.0f);
+
+    DebugName = job->path.string();
+
+    if (Processing.Reorders())
+        ProcessData(job);
+
+    WriteLayout(job);
+
+    delete job;
+}
+
+void Mesh::AbortLoad(MeshLoadJob* job)
+{
+    // the staging range too, if Parse() got that far
+    ClearData();
+    m_Submeshes.clear();
+    m_Draws.clear();
+    delete job;
 }
 
 void Mesh::SetData(TBufferView<Vertex> vertices, TBufferView<Index> indices, TBufferView<Submesh> submeshes)
@@ -151,6 +582,15 @@ void Mesh::SetData(TBufferView<Vertex> vertices, TBufferView<Index> indices, TBu
 
     m_Submeshes.resize(submeshes.Count);
     memcpy(m_Submeshes.data(), submeshes.Data, submeshes.Count * sizeof(Submesh));
+
+    m_VertexView = m_Vertices;
+    m_IndexView = m_Indices;
+    ComputeBounds();
+    ComputeSubmeshRanges();
+
+    // the layout of Processing, the data is taken as it is
+    m_CompactIndices = Processing.compactIndices;
+    WriteLayout(nullptr);
 }
 
 void Mesh::ClearData()
@@ -160,6 +600,448 @@ void Mesh::ClearData()
 
     m_Indices.clear();
     m_Indices.shrink_to_fit(); // same
+
+    m_LayoutData.clear();
+    m_LayoutData.shrink_to_fit();
+
+    m_VertexView = {};
+    m_IndexView = {};
+    m_VertexData = {};
+    m_IndexData = {};
+    m_CookedFile.Close();
+
+    // the upload is done with it
+    g_ResourceFactory.ReleaseStaging(m_StagingRange);
+    m_StagingRange = {};
+}
+
+bool Mesh::LoadCooked(const std::filesystem::path& cookedPath)
+{
+    MappedFile file;
+    if (!file.Open(cookedPath))
+        return false;
+
+    if (!LoadCooked({ file.Data(), (size_t)file.Size() }, cookedPath.string()))
+        return false;
+
+    // the views point into the mapping
+    m_CookedFile = std::move(file);
+    return true;
+}
+
+bool Mesh::LoadCooked(std::span<const u8> cooked, const std::string& name)
+{
+    if (cooked.size() < sizeof(CookedMeshHeader) || (u64)cooked.data() % COOKED_MESH_ALIGNMENT != 0)
+    {
+        LOG_ERR("Invalid cooked mesh: %s", name.c_str());
+        return false;
+    }
+
+    // only the header is checked, the arrays are used as they are
+    const CookedMeshHeader header = *(const CookedMeshHeader*)cooked.data();
+    auto fits = [&cooked](u64 offset, u64 count, u64 stride) {
+        return offset % COOKED_MESH_ALIGNMENT == 0 && offset <= cooked.size() && count <= (cooked.size() - offset) / stride;
+    };
+
+    bool compact = (header.layout & COOKED_MESH_COMPACT_INDICES) != 0;
+
+    bool valid = header.magic == COOKED_MESH_MAGIC && header.version == COOKED_MESH_VERSION
+        && header.vertexStride == sizeof(Vertex) && (header.layout & ~COOKED_MESH_COMPACT_INDICES) == 0
+        && fits(header.submeshOffset, header.submeshCount, sizeof(Submesh))
+        && fits(header.vertexOffset, header.vertexCount, sizeof(Vertex))
+        && fits(header.indexOffset, header.indexBufferSize, 1);
+
+    if (!valid)
+    {
+        LOG_ERR("Invalid cooked mesh (or cooked by another version): %s", name.c_str());
+        return false;
+    }
+
+    ClearData();
+    const u8* base = cooked.data();
+
+    // the draws need the submeshes after ClearData(), they're a few bytes
+    const Submesh* submeshes = (const Submesh*)(base + header.submeshOffset);
+    m_Submeshes.assign(submeshes, submeshes + header.submeshCount);
+
+    m_CompactIndices = compact;
+    if (BuildLayout() > header.indexBufferSize)
+    {
+        LOG_ERR("Invalid cooked mesh (the submeshes don't fit in the index buffer): %s", name.c_str());
+        m_Submeshes.clear();
+        m_Draws.clear();
+        return false;
+    }
+
+    m_VertexData = { base + header.vertexOffset, (size_t)(header.vertexCount * sizeof(Vertex)) };
+    m_IndexData = { base + header.indexOffset, (size_t)header.indexBufferSize };
+
+    // the decoded data, where the layout didn't change it
+    m_VertexView = { (const Vertex*)m_VertexData.data(), (size_t)header.vertexCount };
+    if (!compact)
+        m_IndexView = { (const Index*)m_IndexData.data(), (size_t)(header.indexBufferSize / sizeof(Index)) };
+
+    m_BoundsMin = { header.boundsMin[0], header.boundsMin[1], header.boundsMin[2] };
+    m_BoundsMax = { header.boundsMax[0], header.boundsMax[1], header.boundsMax[2] };
+
+    m_LayoutStats.fullBytes = header.fullBytes;
+    m_LayoutStats.bytes = m_VertexData.size() + m_IndexData.size();
+    m_LayoutStats.fullFetchBytes = header.fullFetchBytes;
+    m_LayoutStats.fetchBytes = header.fetchBytes;
+
+    DebugName = name;
+    if (compact)
+        LogLayoutStats();
+    return true;
+}
+
+bool Mesh::SaveCooked(const std::filesystem::path& cookedPath) const
+{
+    if (m_VertexData.empty())
+        return false;
+
+    auto align = [](u64 offset) { return (offset + COOKED_MESH_ALIGNMENT - 1) & ~(COOKED_MESH_ALIGNMENT - 1); };
+
+    CookedMeshHeader header = {};
+    header.magic = COOKED_MESH_MAGIC;
+    header.version = COOKED_MESH_VERSION;
+    header.vertexStride = sizeof(Vertex);
+    header.layout = m_CompactIndices ? COOKED_MESH_COMPACT_INDICES : 0;
+    header.submeshCount = m_Submeshes.size();
+    header.vertexCount = GetVertexBufferSize() / sizeof(Vertex);
+    header.indexBufferSize = GetIndexBufferSize();
+    header.submeshOffset = align(sizeof(CookedMeshHeader));
+    header.vertexOffset = align(header.submeshOffset + header.submeshCount * sizeof(Submesh));
+    header.indexOffset = align(header.vertexOffset + GetVertexBufferSize());
+    memcpy(header.boundsMin, &m_BoundsMin, sizeof(header.boundsMin));
+    memcpy(header.boundsMax, &m_BoundsMax, sizeof(header.boundsMax));
+    header.fullBytes = m_LayoutStats.fullBytes;
+    header.fullFetchBytes = m_LayoutStats.fullFetchBytes;
+    header.fetchBytes = m_LayoutStats.fetchBytes;
+
+    // written under another name and renamed, nobody maps a half written file
+    std::filesystem::path tempPath = cookedPath;
+    tempPath += ".tmp";
+
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        u64 written = 0;
+        auto writeAt = [&file, &written](u64 offset, const void* data, u64 size) {
+            static const char zeros[COOKED_MESH_ALIGNMENT] = {};
+            file.write(zeros, (std::streamsize)(offset - written));
+            file.write((const char*)data, (std::streamsize)size);
+            written = offset + size;
+        };
+
+        writeAt(0, &header, sizeof(header));
+        writeAt(header.submeshOffset, m_Submeshes.data(), header.submeshCount * sizeof(Submesh));
+        writeAt(header.vertexOffset, m_VertexData.data(), GetVertexBufferSize());
+        writeAt(header.indexOffset, m_IndexData.data(), GetIndexBufferSize());
+
+        if (!file)
+        {
+            LOG_ERR("Unable to write cooked mesh: %ls", tempPath.c_str());
+            file.close();
+            std::filesystem::remove(tempPath);
+            return false;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(tempPath, cookedPath, error);
+    if (error)
+    {
+        LOG_ERR("Unable to write cooked mesh: %ls", cookedPath.c_str());
+        std::filesystem::remove(tempPath, error);
+        return false;
+    }
+    return true;
+}
+
+std::filesystem::path Mesh::GetCookedPath(const std::filesystem::path& path)
+{
+    std::filesystem::path cookedPath = path;
+    cookedPath.replace_extension(".vkmesh");
+    return cookedPath;
+}
+
+bool Mesh::IsCookedUpToDate(const std::filesystem::path& path)
+{
+    std::error_code error;
+    std::filesystem::file_time_type cookedTime = std::filesystem::last_write_time(GetCookedPath(path), error);
+    if (error)
+        return false;
+
+    // no source is fine, the cooked file can ship alone
+    std::filesystem::file_time_type sourceTime = std::filesystem::last_write_time(path, error);
+    return error || cookedTime >= sourceTime;
+}
+
+void Mesh::ComputeBounds()
+{
+    using MinMax = std::pair<glm::vec3, glm::vec3>;
+
+    if (m_VertexView.empty())
+    {
+        m_BoundsMin = m_BoundsMax = glm::vec3(0.0f);
+        return;
+    }
+
+    const MinMax empty = { glm::vec3(std::numeric_limits<float>::max()), glm::vec3(std::numeric_limits<float>::lowest()) };
+    MinMax bounds = g_AssetManager.GetTaskPool().ParallelReduce(0, m_VertexView.size(), VERTEX_GRAIN_SIZE, empty,
+        [this, &empty](u64 begin, u64 end) {
+            MinMax chunk = empty;
+            for (u64 i = begin; i < end; i++)
+            {
+                chunk.first = glm::min(chunk.first, m_VertexView[i].position);
+                chunk.second = glm::max(chunk.second, m_VertexView[i].position);
+            }
+            return chunk;
+        },
+        [](const MinMax& a, const MinMax& b) {
+            return MinMax(glm::min(a.first, b.first), glm::max(a.second, b.second));
+        });
+
+    m_BoundsMin = bounds.first;
+    m_BoundsMax = bounds.second;
+}
+
+void Mesh::ProcessData(MeshLoadJob* job)
+{
+    std::span<Index> indices(job->indices, m_IndexView.size());
+    std::span<const Vertex> vertices(job->vertices, m_VertexView.size());
+
+    // every submesh on its own, they're drawn one by one
+    if (Processing.optimizeVertexCache || Processing.optimizeOverdraw)
+    {
+        std::vector<VertexCacheStats> before(m_Submeshes.size());
+        std::vector<VertexCacheStats> after(m_Submeshes.size());
+        g_AssetManager.GetTaskPool().ParallelFor(0, m_Submeshes.size(), 1, [&](u64 begin, u64 end) {
+            for (u64 i = begin; i < end; i++)
+            {
+                std::span<Index> submeshIndices = indices.subspan(m_Submeshes[i].indexOffset, m_Submeshes[i].indexCount);
+                before[i] = AnalyzeVertexCache(submeshIndices);
+
+                if (Processing.optimizeVertexCache)
+                    OptimizeVertexCache(submeshIndices);
+                if (Processing.optimizeOverdraw)
+                    OptimizeOverdraw(submeshIndices, vertices);
+
+                after[i] = AnalyzeVertexCache(submeshIndices);
+            }
+        });
+
+        VertexCacheStats total[2];
+        for (u64 i = 0; i < m_Submeshes.size(); i++)
+        {
+            total[0].Add(before[i]);
+            total[1].Add(after[i]);
+        }
+
+        LOG_INFO("Mesh %s: vertex cache (%u entries) ACMR %.3f -> %.3f, ATVR %.3f -> %.3f%s", DebugName.c_str(), VERTEX_CACHE_SIZE,
+            total[0].acmr, total[1].acmr, total[0].atvr, total[1].atvr, Processing.optimizeOverdraw ? ", overdraw clusters sorted" : "");
+    }
+
+    // the whole vertex buffer, after the triangle order it follows
+    if (Processing.optimizeVertexFetch && !indices.empty())
+    {
+        VertexFetchStats before = AnalyzeVertexFetch(indices);
+
+        // staged as they are: straight into the staging range. otherwise a new array, swapped in
+        std::vector<Vertex> reordered;
+        Vertex* destination = (Vertex*)job->stagedVertices;
+        if (!destination)
+        {
+            reordered.resize(vertices.size());
+            destination = reordered.data();
+        }
+
+        OptimizeVertexFetch(destination, vertices, indices);
+
+        if (destination == (Vertex*)job->stagedVertices)
+        {
+            // written, the scratch is left behind
+            job->vertices = destination;
+            job->stagedVertices = nullptr;
+        }
+        else if (job->vertices == m_Vertices.data())
+        {
+            m_Vertices.swap(reordered);
+            job->vertices = m_Vertices.data();
+        }
+        else
+        {
+            job->vertexScratch.swap(reordered);
+            job->vertices = job->vertexScratch.data();
+        }
+        m_VertexView = { job->vertices, vertices.size() };
+
+        // the vertices of every submesh are together now, without the unused ones
+        ComputeSubmeshRanges();
+
+        VertexFetchStats after = AnalyzeVertexFetch(indices);
+        LOG_INFO("Mesh %s: vertex fetch (%u lines of 64 bytes) overfetch %.3f -> %.3f", DebugName.c_str(), VERTEX_FETCH_CACHE_LINES,
+            before.overfetch, after.overfetch);
+    }
+}
+
+void Mesh::ComputeSubmeshRanges()
+{
+    for (Submesh& submesh : m_Submeshes)
+    {
+        std::span<const Index> indices = m_IndexView.subspan(submesh.indexOffset, submesh.indexCount);
+        submesh.vertexOffset = 0;
+        submesh.vertexCount = 0;
+        if (!indices.empty())
+        {
+            auto [minIndex, maxIndex] = std::minmax_element(indices.begin(), indices.end());
+            submesh.vertexOffset = *minIndex;
+            submesh.vertexCount = *maxIndex - *minIndex + 1;
+        }
+    }
+}
+
+u64 Mesh::BuildLayout()
+{
+    // compact: the submeshes one after the other, each in its own index type at a 4 byte aligned offset (what
+    // vkCmdBindIndexBuffer wants for both). otherwise the decoded indices as they are
+    m_Draws.resize(m_Submeshes.size());
+    u64 indexBytes = 0;
+    for (u64 i = 0; i < m_Submeshes.size(); i++)
+    {
+        const Submesh& submesh = m_Submeshes[i];
+        SubmeshDraw& draw = m_Draws[i];
+
+        bool index16 = m_CompactIndices && submesh.vertexCount <= 0xFFFF;
+        draw.indexType = index16 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+        draw.indexCount = submesh.indexCount;
+        draw.vertexOffset = m_CompactIndices ? (s32)submesh.vertexOffset : 0;
+
+        if (m_CompactIndices)
+        {
+            draw.indexBufferOffset = indexBytes;
+            indexBytes += ((u64)submesh.indexCount * (index16 ? sizeof(u16) : sizeof(u32)) + 3) & ~3ull;
+        }
+        else
+        {
+            draw.indexBufferOffset = (u64)submesh.indexOffset * sizeof(Index);
+            indexBytes = std::max<u64>(indexBytes, draw.indexBufferOffset + (u64)submesh.indexCount * sizeof(Index));
+        }
+    }
+    return indexBytes;
+}
+
+// indices - vertexOffset in the index type, every index in [vertexOffset, vertexOffset + 65535] for the 16 bit one.
+// written in order, the destination can be staging memory
+static void WriteIndices(void* destination, std::span<const Index> indices, Index vertexOffset, VkIndexType indexType)
+{
+    if (indexType == VK_INDEX_TYPE_UINT16)
+    {
+        u16* out = (u16*)destination;
+        for (size_t i = 0; i < indices.size(); i++)
+            out[i] = (u16)(indices[i] - vertexOffset);
+    }
+    else
+    {
+        u32* out = (u32*)destination;
+        for (size_t i = 0; i < indices.size(); i++)
+            out[i] = indices[i] - vertexOffset;
+    }
+}
+
+void Mesh::WriteLayout(MeshLoadJob* job)
+{
+    u64 vertexBytes = m_VertexView.size_bytes();
+    u64 indexBytes = BuildLayout();
+    if (!m_CompactIndices)
+        indexBytes = m_IndexView.size_bytes(); // the decoded indices as they are
+
+    // where the gpu layout goes: the staging range (vertices then indices), m_LayoutData for the compact indices, or
+    // nowhere
+    u8* vertexData = (u8*)m_VertexView.data();
+    u8* indexData = (u8*)m_IndexView.data();
+    if (m_StagingRange)
+    {
+        check(vertexBytes + indexBytes <= m_StagingRange.size);
+        vertexData = m_StagingRange.data;
+        indexData = m_StagingRange.data + vertexBytes;
+    }
+    else if (m_CompactIndices)
+    {
+        m_LayoutData.assign(indexBytes, 0);
+        indexData = m_LayoutData.data();
+    }
+
+    if (job && job->stagedVertices)
+        memcpy(job->stagedVertices, m_VertexView.data(), vertexBytes);
+
+    if (m_CompactIndices)
+    {
+        g_AssetManager.GetTaskPool().ParallelFor(0, m_Submeshes.size(), 1, [this, indexData](u64 begin, u64 end) {
+            for (u64 i = begin; i < end; i++)
+            {
+                const Submesh& submesh = m_Submeshes[i];
+                WriteIndices(indexData + m_Draws[i].indexBufferOffset, m_IndexView.subspan(submesh.indexOffset, submesh.indexCount),
+                    submesh.vertexOffset, m_Draws[i].indexType);
+            }
+        });
+    }
+    else if (job && job->stagedIndices)
+    {
+        // one sequential write into the staging range
+        memcpy(job->stagedIndices, m_IndexView.data(), indexBytes);
+    }
+
+    // what a draw of every submesh reads: the indices, and the lines of the vertices the post transform cache misses.
+    // the indices decoded straight into staging memory aren't read back for it
+    m_LayoutStats = {};
+    m_LayoutStats.fullBytes = m_VertexView.size_bytes() + m_IndexView.size_bytes();
+    m_LayoutStats.bytes = vertexBytes + indexBytes;
+    bool indicesInRam = !m_StagingRange || !job->indexScratch.empty();
+    if (m_CompactIndices && indicesInRam)
+    {
+        u64 vertexFetchBytes = AnalyzeVertexFetch(m_IndexView, sizeof(Vertex)).bytesFetched;
+        m_LayoutStats.fullFetchBytes = m_IndexView.size_bytes() + vertexFetchBytes;
+        m_LayoutStats.fetchBytes = indexBytes + vertexFetchBytes;
+    }
+
+    m_VertexData = { vertexData, (size_t)vertexBytes };
+    m_IndexData = { indexData, (size_t)indexBytes };
+
+    // the decoded data the gpu layout replaced: the scratch goes with the job, the array unless it's kept
+    if (m_StagingRange)
+    {
+        m_VertexView = { (const Vertex*)vertexData, m_VertexView.size() };
+        m_IndexView = m_CompactIndices ? std::span<const Index>() : std::span<const Index>((const Index*)indexData, m_IndexView.size());
+    }
+    else if (!KeepCPUData && m_CompactIndices)
+    {
+        m_Indices.clear();
+        m_Indices.shrink_to_fit();
+        m_IndexView = {};
+    }
+
+    if (m_CompactIndices)
+        LogLayoutStats();
+}
+
+void Mesh::LogLayoutStats() const
+{
+    u32 index16Count = 0;
+    for (const SubmeshDraw& draw : m_Draws)
+        index16Count += draw.indexType == VK_INDEX_TYPE_UINT16 ? 1 : 0;
+
+    const MeshLayoutStats& stats = m_LayoutStats;
+    auto saved = [](u64 full, u64 compact) { return full ? 100.0 * (1.0 - (double)compact / (double)full) : 0.0; };
+
+    LOG_INFO("Mesh %s: 16 bit indices in %u/%u submeshes. buffers %.2f -> %.2f MB (-%.0f%%)", DebugName.c_str(), index16Count,
+        (u32)m_Draws.size(), Utils::BytesToMegabytes(stats.fullBytes), Utils::BytesToMegabytes(stats.bytes), saved(stats.fullBytes, stats.bytes));
+
+    if (stats.fullFetchBytes)
+    {
+        LOG_INFO("Mesh %s: read by a draw (indices + vertex lines) %.2f -> %.2f MB (-%.0f%%)", DebugName.c_str(),
+            Utils::BytesToMegabytes(stats.fullFetchBytes), Utils::BytesToMegabytes(stats.fetchBytes), saved(stats.fullFetchBytes, stats.fetchBytes));
+    }
 }
 
 void Mesh::CreateOnGPU()
@@ -3,6 +3,9 @@
 #include "Core/Core.h"
 #include <glm/glm.hpp>
 #include "VkUtils.h"
+#include "Misc/MappedFile.h"
+#include "StagingAllocator.h"
+#include <span>
 
 struct Vertex
 {
@@ -15,30 +18,124 @@ struct Vertex
 
 struct Submesh
 {
-	u32 indexOffset;
+	u32 indexOffset; // in GetIndices()
 	u32 indexCount;
+	// the vertices its indices use, what the compact indices are relative to. set by the loads
+	u32 vertexOffset;
+	u32 vertexCount;
+};
+
+// a submesh in the gpu buffers, what its draw binds
+struct SubmeshDraw
+{
+	u64 indexBufferOffset; // bytes
+	VkIndexType indexType;
+	u32 indexCount;
+	s32 vertexOffset; // of the draw, added to the indices
+};
+
+// the gpu buffers of a mesh against the full layout (Vertex, 32 bit indices)
+struct MeshLayoutStats
+{
+	u64 fullBytes = 0; // vertex + index buffers
+	u64 bytes = 0;
+	u64 fullFetchBytes = 0; // read by a draw of every submesh: the indices and the vertex lines (AnalyzeVertexFetch). 0 = unknown
+	u64 fetchBytes = 0;
 };
 
 using Index = u32;
 
+// how a gltf load gets at the file
+enum class EMeshFileAccess
+{
+	Read, // the whole file read into memory
+	Map   // mapped, the pages come in as the parse and the decode touch them. no copy of the file on the heap
+};
+
+// what the gltf loads do to the decoded data before it goes anywhere, the cooker bakes it into the .vkmesh
+struct MeshProcessing
+{
+	// MeshOptimizer.h, applied in this order
+	bool optimizeVertexCache = false; // the triangles of every submesh reordered for the post transform cache
+	bool optimizeOverdraw = false;    // then cut in clusters, the ones facing out of the submesh drawn first
+	bool optimizeVertexFetch = false; // the vertices moved in the order the indices use them
+	// the layout of the index buffer, the cpu data (GetIndices) stays 32 bit
+	bool compactIndices = false; // the indices of a submesh relative to its first vertex, 16 bit under 65536 vertices
+
+	inline bool Reorders() const { return optimizeVertexCache || optimizeOverdraw || optimizeVertexFetch; }
+	inline bool Any() const { return Reorders() || compactIndices; }
+	// what has to be in ram for it, a staged load decodes it there instead of into staging memory
+	inline bool ReadsIndices() const { return Reorders() || compactIndices; }
+	inline bool ReadsVertices() const { return optimizeOverdraw || optimizeVertexFetch; }
+};
+
+// state shared by the loading stages, see Mesh.cpp
+struct MeshLoadJob;
+class IOBuffer;
+
 class Mesh
 {
 public:
 	Mesh() = default;
 	~Mesh() = default;
 
+	// takes the cooked .vkmesh next to the file if it's newer than the file, the gltf otherwise
 	void Load(const std::filesystem::path& path);
+	// the glb binary chunk isn't copied by the parser in either mode, the decode reads the attributes from the file bytes
+	void LoadGltf(const std::filesystem::path& path, EMeshFileAccess access = EMeshFileAccess::Read);
+
+	// cooked mesh (MeshFormat.h): the file is mapped, the vertices and indices point into it until ClearData().
+	// false if it's missing or not a valid .vkmesh of this build
+	bool LoadCooked(const std::filesystem::path& cookedPath);
+	// same from memory that outlives the mesh data (a mounted AssetPack), nothing is copied
+	bool LoadCooked(std::span<const u8> cooked, const std::string& name);
+	bool SaveCooked(const std::filesystem::path& cookedPath) const; // needs the gpu data in ram (not staged)
+
+	static std::filesystem::path GetCookedPath(const std::filesystem::path& path); // assets/car.glb -> assets/car.vkmesh
+	static bool IsCookedUpToDate(const std::filesystem::path& path);
+
+	// staged loading, LoadGltf() runs them with the decode on the task pool. the async loader spreads them over the pool too:
+	// BeginLoad (no io) -> ReadFile, SetFile or MapFile -> Parse -> DecodeChunk (every chunk, any thread, any order) -> FinishLoad.
+	// the file stays in the job until FinishLoad, the decode reads it.
+	// decodeToStaging: without KeepCPUData the data is decoded straight into a staging range reserved by Parse (if there's
+	// room), the upload copies it from there and ClearData() gives it back. only for the gpu, it's not read on the cpu.
+	// FinishLoad() applies Processing, what it reads is decoded in ram then (and written to the staging range after)
+	MeshLoadJob* BeginLoad(const std::filesystem::path& path, bool decodeToStaging = false);
+	void ReadFile(MeshLoadJob* job); // blocking read on the calling thread
+	void SetFile(MeshLoadJob* job, IOBuffer&& file); // file read somewhere else (IOQueue)
+	u64 MapFile(MeshLoadJob* job); // nothing read up front, returns the file size (0 if it can't be opened)
+	u32 Parse(MeshLoadJob* job); // returns the number of chunks to decode: every primitive, the big ones in slices
+	void DecodeChunk(MeshLoadJob* job, u32 chunkIndex);
+	void FinishLoad(MeshLoadJob* job); // deletes the job
+	void AbortLoad(MeshLoadJob* job);  // instead of FinishLoad when Parse() found nothing to decode: deletes the job, no data
+
 	void SetData(TBufferView<Vertex> vertices, TBufferView<Index> indices, TBufferView<Submesh> submeshes);
 	void ClearData();
 
 	void CreateOnGPU();
 
-	inline const std::vector<Vertex>& GetVertices() const { return m_Vertices; }
-	inline const std::vector<Index>& GetIndices() const { return m_Indices; }
+	// decoded data, the mapped cooked file or the staging range. the indices are dropped once the compact ones are built
+	// from them unless KeepCPUData, a cooked mesh only has the compact ones then
+	inline std::span<const Vertex> GetVertices() const { return m_VertexView; }
+	inline std::span<const Index> GetIndices() const { return m_IndexView; }
 	inline const std::vector<Submesh>& GetSubmeshes() const { return m_Submeshes; }
 
-	inline u64 GetVertexBufferSize() const { return m_Vertices.size() * sizeof(Vertex); }
-	inline u64 GetIndexBufferSize() const { return m_Indices.size() * sizeof(Index); }
+	// what the upload copies to the gpu buffers: the decoded data itself, or the compact indices (ram, staging range or
+	// cooked file)
+	inline std::span<const u8> GetVertexData() const { return m_VertexData; }
+	inline std::span<const u8> GetIndexData() const { return m_IndexData; }
+	inline u64 GetVertexBufferSize() const { return m_VertexData.size(); }
+	inline u64 GetIndexBufferSize() const { return m_IndexData.size(); }
+
+	inline const std::vector<SubmeshDraw>& GetDraws() const { return m_Draws; }
+	inline const MeshLayoutStats& GetLayoutStats() const { return m_LayoutStats; }
+
+	// object space, set by the loads
+	inline const glm::vec3& GetBoundsMin() const { return m_BoundsMin; }
+	inline const glm::vec3& GetBoundsMax() const { return m_BoundsMax; }
+
+	// the data waits for the upload in staging memory, not in ram
+	inline bool HasStagedData() const { return (bool)m_StagingRange; }
 
 	// bytes
 	inline u64 GetMemoryFootprint() const
@@ -59,9 +156,33 @@ private:
 	friend class ResourceFactory;
 	friend class AssetManager;
 
+	void ComputeBounds();
+	void ComputeSubmeshRanges();
+	void ProcessData(MeshLoadJob* job);
+	u64 BuildLayout(); // m_Draws from the submeshes, returns the index buffer size
+	void WriteLayout(MeshLoadJob* job);
+	void LogLayoutStats() const;
+
 	std::vector<Vertex> m_Vertices;
 	std::vector<Index> m_Indices;
 	std::vector<Submesh> m_Submeshes;
+	std::vector<SubmeshDraw> m_Draws;
+
+	// the decoded data: m_Vertices/m_Indices, the cooked file or the staging range
+	std::span<const Vertex> m_VertexView;
+	std::span<const Index> m_IndexView;
+	// what the upload reads: the views above, or the compact indices in m_LayoutData, the cooked file or the staging range
+	std::span<const u8> m_VertexData;
+	std::span<const u8> m_IndexData;
+	std::vector<u8> m_LayoutData;
+	MappedFile m_CookedFile;
+	StagingRange m_StagingRange;
+
+	bool m_CompactIndices = false;
+	MeshLayoutStats m_LayoutStats;
+
+	glm::vec3 m_BoundsMin = glm::vec3(0.0f);
+	glm::vec3 m_BoundsMax = glm::vec3(0.0f);
 
 	VkUtils::Buffer m_VertexBuffer;
 	VkUtils::Buffer m_IndexBuffer;
@@ -70,4 +191,5 @@ private:
 
 public:
 	bool KeepCPUData = false;
+	MeshProcessing Processing; // gltf loads, a cooked mesh was processed by the cooker
 };
\ No newline at end of file
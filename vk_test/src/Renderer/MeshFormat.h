@@ -0,0 +1,41 @@
+#pragma once
+
+#include "Core/CoreMinimal.h"
+
+// .vkmesh, the cooked mesh: the buffers Mesh uploads after a gltf load, in the layout the gpu takes them (Vertex, the
+// compact indices relative to the first vertex of their submesh, 16 or 32 bit). loading one is mapping the file and
+// pointing into it, nothing is parsed or converted. little endian, arrays at 16 byte aligned offsets:
+//
+//     CookedMeshHeader | Submesh[submeshCount] | vertex buffer | index buffer
+
+constexpr u32 COOKED_MESH_MAGIC = 0x534D4B56; // "VKMS"
+constexpr u32 COOKED_MESH_VERSION = 2;
+constexpr u64 COOKED_MESH_ALIGNMENT = 16;
+
+// CookedMeshHeader::layout
+constexpr u32 COOKED_MESH_COMPACT_INDICES = 1 << 0;
+
+struct CookedMeshHeader
+{
+	u32 magic;
+	u32 version;
+	u32 vertexStride; // sizeof(Vertex) when it was cooked, a layout change needs a recook
+	u32 layout;       // COOKED_MESH_* flags
+
+	u64 submeshCount;
+	u64 vertexCount;
+	u64 indexBufferSize; // bytes, the submeshes say where theirs are (Mesh::GetDraws())
+
+	// bytes from the start of the file
+	u64 submeshOffset;
+	u64 vertexOffset;
+	u64 indexOffset;
+
+	float boundsMin[3];
+	float boundsMax[3];
+
+	// MeshLayoutStats when it was cooked
+	u64 fullBytes;
+	u64 fullFetchBytes;
+	u64 fetchBytes;
+};
\ No newline at end of file
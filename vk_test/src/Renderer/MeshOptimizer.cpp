@@ -0,0 +1,477 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+static void GetIndexRange(std::span<const Index> indices, Index& outMin, Index& outMax)
+{
+    outMin = std::numeric_limits<Index>::max();
+    outMax = 0;
+    for (Index index : indices)
+    {
+        outMin = std::min(outMin, index);
+        outMax = std::max(outMax, index);
+    }
+}
+
+void VertexCacheStats::Add(const VertexCacheStats& other)
+{
+    triangleCount += other.triangleCount;
+    vertexCount += other.vertexCount;
+    transformCount += other.transformCount;
+    acmr = triangleCount ? (double)transformCount / (double)triangleCount : 0.0;
+    atvr = vertexCount ? (double)transformCount / (double)vertexCount : 0.0;
+}
+
+void VertexFetchStats::Add(const VertexFetchStats& other)
+{
+    bytesFetched += other.bytesFetched;
+    vertexBytes += other.vertexBytes;
+    overfetch = vertexBytes ? (double)bytesFetched / (double)vertexBytes : 0.0;
+}
+
+void OverdrawStats::Add(const OverdrawStats& other)
+{
+    pixelsCovered += other.pixelsCovered;
+    pixelsShaded += other.pixelsShaded;
+    overdraw = pixelsCovered ? (double)pixelsShaded / (double)pixelsCovered : 0.0;
+}
+
+VertexCacheStats AnalyzeVertexCache(std::span<const Index> indices, u32 cacheSize)
+{
+    VertexCacheStats stats;
+    u64 indexCount = indices.size() / 3 * 3;
+    if (indexCount == 0)
+        return stats;
+
+    Index minIndex, maxIndex;
+    GetIndexRange(indices.first(indexCount), minIndex, maxIndex);
+
+    // fifo: a vertex is in the cache until cacheSize others went in after it. the transform that put it there, 0 = never
+    std::vector<u32> transformedAt((u64)maxIndex - minIndex + 1, 0);
+    u32 transforms = 0;
+    for (u64 i = 0; i < indexCount; i++)
+    {
+        u32& at = transformedAt[indices[i] - minIndex];
+        if (at == 0)
+            stats.vertexCount++;
+
+        if (at == 0 || transforms - at >= cacheSize)
+            at = ++transforms;
+    }
+
+    stats.triangleCount = indexCount / 3;
+    stats.transformCount = transforms;
+    stats.Add({}); // the ratios
+    return stats;
+}
+
+void OptimizeVertexCache(std::span<Index> indices, u32 cacheSize)
+{
+    u64 triangleCount = indices.size() / 3;
+    if (triangleCount < 2)
+        return;
+
+    check(triangleCount * 3 <= std::numeric_limits<u32>::max());
+
+    Index minIndex, maxIndex;
+    GetIndexRange(indices.first(triangleCount * 3), minIndex, maxIndex);
+    const u32 vertexCount = maxIndex - minIndex + 1;
+    auto vertexOf = [&indices, minIndex](u64 corner) { return indices[corner] - minIndex; };
+
+    // the triangles of every vertex, the live count goes down as they're emitted
+    std::vector<u32> liveTriangles(vertexCount, 0);
+    for (u64 i = 0; i < triangleCount * 3; i++)
+        liveTriangles[vertexOf(i)]++;
+
+    std::vector<u32> adjacencyOffsets(vertexCount + 1, 0);
+    for (u32 v = 0; v < vertexCount; v++)
+        adjacencyOffsets[v + 1] = adjacencyOffsets[v] + liveTriangles[v];
+
+    std::vector<u32> adjacency(triangleCount * 3);
+    {
+        std::vector<u32> next(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+        for (u64 i = 0; i < triangleCount * 3; i++)
+            adjacency[next[vertexOf(i)]++] = (u32)(i / 3);
+    }
+
+    // time a vertex went in the cache, the clock starts past cacheSize so nobody is in it
+    std::vector<u32> cachedAt(vertexCount, 0);
+    u32 time = cacheSize + 1;
+
+    std::vector<u8> emitted(triangleCount, 0);
+    std::vector<Index> output;
+    output.reserve(triangleCount * 3);
+
+    // vertices of the emitted triangles, newest last: where to go on when the fan has no neighbour left
+    std::vector<u32> deadEnds;
+    deadEnds.reserve(triangleCount * 3);
+    std::vector<u32> candidates;
+    u32 cursor = 0; // the lowest vertex that can still have triangles, the last resort
+
+    s64 fanning = vertexOf(0);
+    while (fanning >= 0)
+    {
+        // every triangle left around the vertex
+        candidates.clear();
+        for (u32 a = adjacencyOffsets[fanning]; a < adjacencyOffsets[fanning + 1]; a++)
+        {
+            u32 triangle = adjacency[a];
+            if (emitted[triangle])
+                continue;
+
+            emitted[triangle] = 1;
+            for (u32 corner = 0; corner < 3; corner++)
+            {
+                u32 v = vertexOf((u64)triangle * 3 + corner);
+                output.push_back(indices[(u64)triangle * 3 + corner]);
+                deadEnds.push_back(v);
+                candidates.push_back(v);
+                liveTriangles[v]--;
+
+                if (time - cachedAt[v] > cacheSize)
+                    cachedAt[v] = time++;
+            }
+        }
+
+        // next: the oldest neighbour still in the cache once its own triangles are emitted, so its fan hits the cache
+        fanning = -1;
+        s64 bestPriority = -1;
+        for (u32 v : candidates)
+        {
+            if (liveTriangles[v] == 0)
+                continue;
+
+            s64 priority = 0;
+            if (time - cachedAt[v] + 2 * liveTriangles[v] <= cacheSize)
+                priority = time - cachedAt[v];
+
+            if (priority > bestPriority)
+            {
+                bestPriority = priority;
+                fanning = v;
+            }
+        }
+
+        // dead end: the last vertex emitted with triangles left, or the next one in order
+        while (fanning < 0 && !deadEnds.empty())
+        {
+            u32 v = deadEnds.back();
+            deadEnds.pop_back();
+            if (liveTriangles[v] > 0)
+                fanning = v;
+        }
+
+        for (; fanning < 0 && cursor < vertexCount; cursor++)
+        {
+            if (liveTriangles[cursor] > 0)
+                fanning = cursor;
+        }
+    }
+
+    check(output.size() == triangleCount * 3);
+    std::copy(output.begin(), output.end(), indices.begin());
+}
+
+void OptimizeOverdraw(std::span<Index> indices, std::span<const Vertex> vertices, float threshold)
+{
+    const u64 triangleCount = indices.size() / 3;
+    if (triangleCount < 2)
+        return;
+
+    check(triangleCount <= std::numeric_limits<u32>::max());
+
+    Index minIndex, maxIndex;
+    GetIndexRange(indices.first(triangleCount * 3), minIndex, maxIndex);
+    check(maxIndex < vertices.size());
+
+    // the post transform cache again, a cluster starts with it empty (the one before can be anywhere once sorted)
+    std::vector<u32> cachedAt((u64)maxIndex - minIndex + 1, 0);
+    u32 time = VERTEX_CACHE_SIZE + 1;
+    auto transform = [&](u64 triangle) {
+        u32 misses = 0;
+        for (u32 corner = 0; corner < 3; corner++)
+        {
+            u32& at = cachedAt[indices[triangle * 3 + corner] - minIndex];
+            if (time - at > VERTEX_CACHE_SIZE)
+            {
+                at = time++;
+                misses++;
+            }
+        }
+        return misses;
+    };
+    auto flush = [&time]() { time += VERTEX_CACHE_SIZE + 1; };
+
+    // hard boundaries: the cache order starts over there anyway (the 3 vertices of the triangle miss)
+    std::vector<u32> hardClusters = { 0 };
+    for (u64 t = 0; t < triangleCount; t++)
+    {
+        if (transform(t) == 3 && t > 0)
+            hardClusters.push_back((u32)t);
+    }
+    hardClusters.push_back((u32)triangleCount);
+
+    // soft ones: a hard cluster is cut as soon as the part so far, started from an empty cache, has an ACMR within
+    // threshold of the whole cluster. small clusters sort better, too small ones lose the cache hits
+    std::vector<u32> clusters;
+    for (u64 h = 0; h + 1 < hardClusters.size(); h++)
+    {
+        const u32 begin = hardClusters[h];
+        const u32 end = hardClusters[h + 1];
+
+        flush();
+        u32 clusterMisses = 0;
+        for (u32 t = begin; t < end; t++)
+            clusterMisses += transform(t);
+        const float limit = threshold * (float)clusterMisses / (float)(end - begin);
+
+        flush();
+        u32 start = begin;
+        u32 misses = 0;
+        clusters.push_back(begin);
+        for (u32 t = begin; t < end; t++)
+        {
+            misses += transform(t);
+            if (t + 1 < end && (float)misses / (float)(t + 1 - start) <= limit)
+            {
+                clusters.push_back(t + 1);
+                start = t + 1;
+                misses = 0;
+                flush();
+            }
+        }
+    }
+    clusters.push_back((u32)triangleCount);
+
+    // area weighted: the centroid of the mesh, and the centroid and the normal of every cluster
+    struct ClusterKey
+    {
+        u32 cluster;
+        float outward;
+    };
+    std::vector<ClusterKey> keys(clusters.size() - 1);
+    std::vector<glm::vec3> centroids(keys.size());
+    std::vector<glm::vec3> normals(keys.size());
+    glm::vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+
+    for (u64 c = 0; c < keys.size(); c++)
+    {
+        glm::vec3 centroid(0.0f);
+        glm::vec3 normal(0.0f);
+        float area = 0.0f;
+        for (u64 t = clusters[c]; t < clusters[c + 1]; t++)
+        {
+            const glm::vec3& a = vertices[indices[t * 3 + 0]].position;
+            const glm::vec3& b = vertices[indices[t * 3 + 1]].position;
+            const glm::vec3& d = vertices[indices[t * 3 + 2]].position;
+
+            glm::vec3 cross = glm::cross(b - a, d - a); // 2 * area * normal
+            float triangleArea = glm::length(cross);
+            centroid += (a + b + d) * (triangleArea / 3.0f);
+            normal += cross;
+            area += triangleArea;
+        }
+
+        meshCentroid += centroid;
+        meshArea += area;
+        centroids[c] = area > 0.0f ? centroid / area : centroid;
+        normals[c] = normal;
+    }
+
+    if (meshArea > 0.0f)
+        meshCentroid /= meshArea;
+
+    // how far out the cluster sits along where it faces: the outer shells and the sides facing away from the middle first
+    for (u32 c = 0; c < (u32)keys.size(); c++)
+    {
+        float length = glm::length(normals[c]);
+        keys[c].cluster = c;
+        keys[c].outward = length > 0.0f ? glm::dot(centroids[c] - meshCentroid, normals[c] / length) : 0.0f;
+    }
+
+    std::stable_sort(keys.begin(), keys.end(), [](const ClusterKey& a, const ClusterKey& b) { return a.outward > b.outward; });
+
+    std::vector<Index> output;
+    output.reserve(triangleCount * 3);
+    for (const ClusterKey& key : keys)
+        output.insert(output.end(), indices.begin() + clusters[key.cluster] * 3ull, indices.begin() + clusters[key.cluster + 1] * 3ull);
+
+    std::copy(output.begin(), output.end(), indices.begin());
+}
+
+void OptimizeVertexFetch(Vertex* destination, std::span<const Vertex> vertices, std::span<Index> indices)
+{
+    constexpr Index UNUSED = std::numeric_limits<Index>::max();
+    check(vertices.size() < UNUSED);
+
+    // new index of every vertex, by first use
+    std::vector<Index> remap(vertices.size(), UNUSED);
+    Index next = 0;
+    for (Index& index : indices)
+    {
+        check(index < vertices.size());
+        if (remap[index] == UNUSED)
+            remap[index] = next++;
+        index = remap[index];
+    }
+
+    for (Index& newIndex : remap)
+    {
+        if (newIndex == UNUSED)
+            newIndex = next++;
+    }
+
+    // the other way around, the destination is written front to back
+    std::vector<Index> order(vertices.size());
+    for (u64 v = 0; v < vertices.size(); v++)
+        order[remap[v]] = (Index)v;
+
+    for (u64 i = 0; i < vertices.size(); i++)
+        destination[i] = vertices[order[i]];
+}
+
+VertexFetchStats AnalyzeVertexFetch(std::span<const Index> indices, u32 vertexSize)
+{
+    constexpr u64 LINE_SIZE = 64;
+
+    VertexFetchStats stats;
+    u64 indexCount = indices.size() / 3 * 3;
+    if (indexCount == 0)
+        return stats;
+
+    Index minIndex, maxIndex;
+    GetIndexRange(indices.first(indexCount), minIndex, maxIndex);
+
+    // the post transform cache first, the hits aren't fetched. then a fifo of lines, like the transforms
+    std::vector<u32> transformedAt((u64)maxIndex - minIndex + 1, 0);
+    u32 transforms = 0;
+
+    const u64 firstLine = (u64)minIndex * vertexSize / LINE_SIZE;
+    std::vector<u32> fetchedAt(((u64)maxIndex + 1) * vertexSize / LINE_SIZE - firstLine + 1, 0);
+    u32 lineFetches = 0;
+
+    u64 usedVertices = 0;
+    for (u64 i = 0; i < indexCount; i++)
+    {
+        u32& at = transformedAt[indices[i] - minIndex];
+        if (at == 0)
+            usedVertices++;
+
+        if (at != 0 && transforms - at < VERTEX_CACHE_SIZE)
+            continue;
+
+        at = ++transforms;
+
+        u64 begin = (u64)indices[i] * vertexSize / LINE_SIZE;
+        u64 end = ((u64)indices[i] * vertexSize + vertexSize - 1) / LINE_SIZE;
+        for (u64 line = begin; line <= end; line++)
+        {
+            u32& lineAt = fetchedAt[line - firstLine];
+            if (lineAt == 0 || lineFetches - lineAt >= VERTEX_FETCH_CACHE_LINES)
+            {
+                lineAt = ++lineFetches;
+                stats.bytesFetched += LINE_SIZE;
+            }
+        }
+    }
+
+    stats.vertexBytes = usedVertices * vertexSize;
+    stats.Add({}); // the ratio
+    return stats;
+}
+
+// one orthographic view looking along direction
+static void RasterizeView(std::span<const Index> indices, std::span<const Vertex> vertices, glm::vec3 direction, glm::vec3 center, float radius,
+    u32 resolution, std::vector<float>& depth, OverdrawStats& stats)
+{
+    // right x up = -direction, a triangle counter clockwise for the viewer has a positive area
+    glm::vec3 helper = std::abs(direction.y) < 0.9f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+    glm::vec3 right = glm::normalize(glm::cross(direction, helper));
+    glm::vec3 up = glm::cross(right, direction);
+
+    const float scale = (float)resolution / (2.0f * radius);
+    auto project = [&](const glm::vec3& p) {
+        glm::vec3 local = p - center;
+        return glm::vec3((glm::dot(local, right) + radius) * scale, (glm::dot(local, up) + radius) * scale, glm::dot(local, direction));
+    };
+
+    std::fill(depth.begin(), depth.end(), std::numeric_limits<float>::max());
+
+    for (u64 t = 0; t + 2 < indices.size(); t += 3)
+    {
+        glm::vec3 a = project(vertices[indices[t + 0]].position);
+        glm::vec3 b = project(vertices[indices[t + 1]].position);
+        glm::vec3 c = project(vertices[indices[t + 2]].position);
+
+        float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+        if (area <= 0.0f)
+            continue; // back facing or degenerate
+
+        s32 minX = std::max(0, (s32)std::floor(std::min({ a.x, b.x, c.x })));
+        s32 minY = std::max(0, (s32)std::floor(std::min({ a.y, b.y, c.y })));
+        s32 maxX = std::min((s32)resolution - 1, (s32)std::ceil(std::max({ a.x, b.x, c.x })));
+        s32 maxY = std::min((s32)resolution - 1, (s32)std::ceil(std::max({ a.y, b.y, c.y })));
+
+        // pixel centers, edge functions over the bounding box. shared edges can be counted twice, it's an estimate
+        for (s32 y = minY; y <= maxY; y++)
+        {
+            for (s32 x = minX; x <= maxX; x++)
+            {
+                float px = (float)x + 0.5f;
+                float py = (float)y + 0.5f;
+                float w0 = (c.x - b.x) * (py - b.y) - (c.y - b.y) * (px - b.x);
+                float w1 = (a.x - c.x) * (py - c.y) - (a.y - c.y) * (px - c.x);
+                float w2 = (b.x - a.x) * (py - a.y) - (b.y - a.y) * (px - a.x);
+                if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f)
+                    continue;
+
+                float z = (w0 * a.z + w1 * b.z + w2 * c.z) / area;
+                float& stored = depth[(u64)y * resolution + x];
+                if (z < stored)
+                {
+                    stored = z;
+                    stats.pixelsShaded++;
+                }
+            }
+        }
+    }
+
+    for (float z : depth)
+    {
+        if (z != std::numeric_limits<float>::max())
+            stats.pixelsCovered++;
+    }
+}
+
+OverdrawStats AnalyzeOverdraw(std::span<const Index> indices, std::span<const Vertex> vertices, u32 resolution)
+{
+    OverdrawStats stats;
+    if (indices.size() < 3 || vertices.empty())
+        return stats;
+
+    glm::vec3 boundsMin(std::numeric_limits<float>::max());
+    glm::vec3 boundsMax(std::numeric_limits<float>::lowest());
+    for (Index index : indices)
+    {
+        boundsMin = glm::min(boundsMin, vertices[index].position);
+        boundsMax = glm::max(boundsMax, vertices[index].position);
+    }
+
+    glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+    float radius = std::max(glm::length(boundsMax - center), 1e-6f);
+
+    const glm::vec3 directions[] = {
+        { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 },
+        { 1, 1, 1 }, { 1, 1, -1 }, { 1, -1, 1 }, { 1, -1, -1 }, { -1, 1, 1 }, { -1, 1, -1 }, { -1, -1, 1 }, { -1, -1, -1 },
+    };
+
+    std::vector<float> depth((u64)resolution * resolution);
+    for (const glm::vec3& direction : directions)
+        RasterizeView(indices, vertices, glm::normalize(direction), center, radius, resolution, depth, stats);
+
+    stats.Add({}); // the ratio
+    return stats;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "Core/CoreMinimal.h"
+#include "Mesh.h"
+
+#include <span>
+
+// triangle and vertex order for the gpu, in the order a load applies them:
+//  - vertex cache: the post transform cache keeps the last vertices the vertex shader ran on, a triangle reusing them
+//    doesn't run it again. the triangles are reordered (tipsify, Sander et al. 2007) so the ones sharing vertices come
+//    close together. linear in the triangle count, cheap enough to run on the loads
+//  - overdraw: the cache ordered triangles cut in clusters that keep most of the cache hits, the clusters facing out
+//    of the mesh drawn first (same paper): from most view directions the front ones fill the depth buffer early
+//  - vertex fetch: the vertices moved in the order the indices first use them, the vertex pulling reads the buffer
+//    almost linearly instead of jumping around it
+// the stats simulate what the gpu does with the result, the overdraw one rasterizes the mesh on the cpu
+
+// entries of the fifo the stats simulate and the reordering aims at, about what the desktop gpus reuse
+constexpr u32 VERTEX_CACHE_SIZE = 16;
+// 64 byte lines the vertex fetch stats keep, a small L1
+constexpr u32 VERTEX_FETCH_CACHE_LINES = 64;
+// a cluster can cost that much more vertex shading than the cache order it's cut from (1.05 = 5%)
+constexpr float OVERDRAW_CLUSTER_THRESHOLD = 1.05f;
+// pixels of the side of the views the overdraw stats render
+constexpr u32 OVERDRAW_RESOLUTION = 256;
+
+struct VertexCacheStats
+{
+	u64 triangleCount = 0;
+	u64 vertexCount = 0;    // the ones the indices use
+	u64 transformCount = 0; // vertex shader runs, the cache misses
+	double acmr = 0.0;      // transforms per triangle: 3 at worst, ~0.5 at best on a big regular grid
+	double atvr = 0.0;      // transforms per vertex: 1 at best
+
+	void Add(const VertexCacheStats& other); // the ratios of the sum
+};
+
+struct VertexFetchStats
+{
+	u64 bytesFetched = 0; // cache lines read by the vertices the post transform cache missed
+	u64 vertexBytes = 0;  // the vertices the indices use
+	double overfetch = 0.0; // fetched / vertex bytes, 1 = every byte read once
+
+	void Add(const VertexFetchStats& other);
+};
+
+struct OverdrawStats
+{
+	u64 pixelsCovered = 0; // by the mesh, over every view
+	u64 pixelsShaded = 0;  // that passed the depth test
+	double overdraw = 0.0; // shaded / covered, 1 = every pixel shaded once
+
+	void Add(const OverdrawStats& other);
+};
+
+// triangle lists. the indices can point anywhere in a bigger vertex buffer, they're taken relative to the smallest one
+VertexCacheStats AnalyzeVertexCache(std::span<const Index> indices, u32 cacheSize = VERTEX_CACHE_SIZE);
+// in place, same triangles (and same winding) in another order
+void OptimizeVertexCache(std::span<Index> indices, u32 cacheSize = VERTEX_CACHE_SIZE);
+
+// indices into vertices (the whole buffer, they're not rebased). the clusters of the cache order are sorted by how much
+// they face out of the mesh, the triangles inside a cluster keep their order. run on the output of OptimizeVertexCache()
+void OptimizeOverdraw(std::span<Index> indices, std::span<const Vertex> vertices, float threshold = OVERDRAW_CLUSTER_THRESHOLD);
+
+// writes the vertices to destination in the order the indices use them first (the unused ones after) and rewrites the
+// indices to match: same triangles, same order. destination doesn't alias vertices and gets written in order (it can be
+// staging memory)
+void OptimizeVertexFetch(Vertex* destination, std::span<const Vertex> vertices, std::span<Index> indices);
+
+VertexFetchStats AnalyzeVertexFetch(std::span<const Index> indices, u32 vertexSize = sizeof(Vertex));
+// back faces culled (counter clockwise is front, like gltf), depth tested in index order. orthographic views from the
+// 6 axes and the 8 diagonals, the mesh fit in each
+OverdrawStats AnalyzeOverdraw(std::span<const Index> indices, std::span<const Vertex> vertices, u32 resolution = OVERDRAW_RESOLUTION);
@@ -149,6 +149,7 @@ void RendererDevice::Init(VkInstance instance, VkSurfaceKHR surface)
 	deviceFeatures_12.pNext = &deviceFeatures_13;
 	deviceFeatures_12.bufferDeviceAddress = true;
 	deviceFeatures_12.descriptorIndexing = true;
+	deviceFeatures_12.timelineSemaphore = true; // gpu upload completion (ResourceFactory)
 
 	VkDeviceCreateInfo deviceCreateInfo = {};
 	deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
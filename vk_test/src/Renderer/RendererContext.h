@@ -50,7 +50,7 @@ public:
 	inline VkInstance GetInstance() const { return m_Instance; }
 	inline VkSurfaceKHR GetSurface() const { return m_Surface; }
 
-	inline void QueueShutdownFunc(std::function<void()>&& func) { m_DeletionQueue.PushBack(std::move(func)); }
+	inline void QueueShutdownFunc(DeletionQueue::DeletionFunc&& func) { m_DeletionQueue.PushBack(std::move(func)); }
 
 private:
 	void CreateInstance();
@@ -1,17 +1,51 @@
 #include "ResourceFactory.h"
 #include "VkUtils.h"
 
-constexpr u64 STAGING_BUFFER_SIZE = 256 * 1024 * 1024; // 256MB total staging mapped memory
+#include <algorithm>
+#include <chrono>
+
+constexpr u64 STAGING_BUFFER_SIZE = 256 * 1024 * 1024; // 256MB total staging mapped memory, split between the upload slots
+constexpr u64 DECODE_STAGING_SIZE = 256 * 1024 * 1024; // 256MB more the loads decode into (TryReserveStaging)
+constexpr u64 DECODE_STAGING_ALIGNMENT = 256; // the biggest nonCoherentAtomSize around, a reserved range can be flushed on its own
+constexpr u64 UPLOAD_PROMOTE_MS = 100; // a queued upload climbs one priority class every 100ms
+
+// ring sizes, a full ring makes its producer wait for the other side to catch up
+constexpr u32 INCOMING_UPLOAD_CAPACITY = 4096;
+constexpr u32 SUBMITTED_UPLOAD_CAPACITY = 4096;
+constexpr u32 PRIORITY_CHANGE_CAPACITY = 1024;
+
+static u64 NowMs()
+{
+    using namespace std::chrono;
+    return (u64)duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+static u32 EffectiveUploadPriority(const PendingLoadingRes& res, u64 nowMs)
+{
+    u32 priority = (u32)res.priority;
+    u64 promotion = (nowMs - std::min(nowMs, res.queuedAtMs)) / UPLOAD_PROMOTE_MS;
+    return priority - (u32)std::min<u64>(priority, promotion);
+}
 
 ResourceFactory::ResourceFactory()
 	: m_Context(nullptr)
 	, m_Device(VK_NULL_HANDLE)
+    , m_IncomingUploads(INCOMING_UPLOAD_CAPACITY)
+    , m_PriorityChanges(PRIORITY_CHANGE_CAPACITY)
+    , m_LoaderWakeups(0)
+    , m_StopLoaderThread(false)
     , m_MappedStagingBuffer(nullptr)
     , m_StagingQueue(VK_NULL_HANDLE)
     , m_StagingCmdPool(VK_NULL_HANDLE)
-    , m_StagingCmd(VK_NULL_HANDLE)
-    , m_StagingFence(VK_NULL_HANDLE)
-    , m_StopLoaderThread(false)
+    , m_MappedDecodeStagingBuffer(nullptr)
+    , m_UploadCount(0)
+    , m_CopiedUploadBytes(0)
+    , m_PrestagedUploadBytes(0)
+    , m_SubmittedUploads(SUBMITTED_UPLOAD_CAPACITY)
+    , m_UploadTimeline(VK_NULL_HANDLE)
+    , m_UploadSubmittedValue(0)
+    , m_UploadCompletedValue(0)
+    , m_PendingUploadBytes(0)
 {
 }
 
@@ -28,6 +62,10 @@ void ResourceFactory::Init(RendererContext* context)
 
     m_StagingBuffer = VkUtils::CreateBuffer(m_Device, STAGING_BUFFER_SIZE, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
     vkCheck(vkMapMemory(m_Device, m_StagingBuffer.memory, 0, STAGING_BUFFER_SIZE, 0, &m_MappedStagingBuffer));
+
+    m_DecodeStagingBuffer = VkUtils::CreateBuffer(m_Device, DECODE_STAGING_SIZE, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+    vkCheck(vkMapMemory(m_Device, m_DecodeStagingBuffer.memory, 0, DECODE_STAGING_SIZE, 0, &m_MappedDecodeStagingBuffer));
+    m_DecodeStaging.Init((u8*)m_MappedDecodeStagingBuffer, DECODE_STAGING_SIZE, DECODE_STAGING_ALIGNMENT);
     
     check(context->GetRendererDevice().GetTransferQueues().size());
 
@@ -50,68 +88,131 @@ void ResourceFactory::Init(RendererContext* context)
     commandPoolInfo.queueFamilyIndex = m_StagingQueue.familyIndex;
     vkCheck(vkCreateCommandPool(m_Device, &commandPoolInfo, nullptr, &m_StagingCmdPool));
 
-    VkCommandBufferAllocateInfo cmdAllocInfo = {};
-    cmdAllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    cmdAllocInfo.pNext = nullptr;
-    cmdAllocInfo.commandPool = m_StagingCmdPool;
-    cmdAllocInfo.commandBufferCount = 1;
-    cmdAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    vkCheck(vkAllocateCommandBuffers(m_Device, &cmdAllocInfo, &m_StagingCmd));
+    // one command buffer + staging slice per upload slot
+    for (u32 i = 0; i < UPLOAD_SLOT_COUNT; i++)
+    {
+        VkCommandBufferAllocateInfo cmdAllocInfo = {};
+        cmdAllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        cmdAllocInfo.pNext = nullptr;
+        cmdAllocInfo.commandPool = m_StagingCmdPool;
+        cmdAllocInfo.commandBufferCount = 1;
+        cmdAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        vkCheck(vkAllocateCommandBuffers(m_Device, &cmdAllocInfo, &m_UploadSlots[i].cmd));
+
+        m_UploadSlots[i].stagingOffset = i * (STAGING_BUFFER_SIZE / UPLOAD_SLOT_COUNT);
+    }
+
+    VkSemaphoreTypeCreateInfo timelineInfo = {};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    timelineInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    timelineInfo.initialValue = 0;
 
-    VkFenceCreateInfo fenceInfo = {};
-    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-    vkCheck(vkCreateFence(m_Device, &fenceInfo, nullptr, &m_StagingFence));
+    VkSemaphoreCreateInfo semaphoreInfo = {};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphoreInfo.pNext = &timelineInfo;
+    vkCheck(vkCreateSemaphore(m_Device, &semaphoreInfo, nullptr, &m_UploadTimeline));
 
     m_GPULoaderThread = std::thread([this]() {
+        ThreadContext& context = GetThreadContext();
+
         while (true)
         {
-            std::unique_lock<std::mutex> lock(m_PendingLoadingLock);
-            m_GPULoaderThread_CondVar.wait(lock, [this]() { return m_PendingLoading.size() > 0 || m_StopLoaderThread; });
+            // only blocks when every slot is still being copied by the gpu
+            UploadSlot& slot = AcquireUploadSlot_LoaderThread();
 
-            if (m_StopLoaderThread)
-            {
-                lock.unlock();
+            ScratchScope scratchScope(context.scratch);
+
+            // read before draining: a push that lands after the drain bumps it, the wait below returns right away
+            u32 wakeups = m_LoaderWakeups.load(std::memory_order_acquire);
+            DrainIncomingUploads_LoaderThread();
+
+            if (m_StopLoaderThread.load(std::memory_order_acquire))
                 break;
+
+            if (m_PendingLoading.empty())
+            {
+                m_LoaderWakeups.wait(wakeups, std::memory_order_acquire);
+                continue;
             }
 
-            u64 staginMemoryLeft = STAGING_BUFFER_SIZE;
-            std::vector<PendingLoadingRes> loadBatch; // todo: linear allocator
-            
-            for (const PendingLoadingRes& res : m_PendingLoading)
+            // most urgent first, fifo inside the same class. old requests get promoted so nothing starves
+            u64 nowMs = NowMs();
+            std::stable_sort(m_PendingLoading.begin(), m_PendingLoading.end(), [nowMs](const PendingLoadingRes& a, const PendingLoadingRes& b) {
+                return EffectiveUploadPriority(a, nowMs) < EffectiveUploadPriority(b, nowMs);
+            });
+
+            u64 staginMemoryLeft = STAGING_BUFFER_SIZE / UPLOAD_SLOT_COUNT;
+            LoadBatch loadBatch{ ScratchAllocator<PendingLoadingRes>(context.scratch) };
+            loadBatch.reserve(m_PendingLoading.size());
+
+            // whatever doesn't fit stays in the queue, in order
+            size_t keptCount = 0;
+            for (size_t i = 0; i < m_PendingLoading.size(); i++)
             {
-                if (res.size < staginMemoryLeft)
+                const PendingLoadingRes& res = m_PendingLoading[i];
+                u64 slotBytes = GetSlotBytes(res);
+                if (slotBytes < staginMemoryLeft)
                 {
-                    staginMemoryLeft -= res.size;
+                    staginMemoryLeft -= slotBytes;
                     loadBatch.push_back(res);
                 }
+                else
+                {
+                    m_PendingLoading[keptCount++] = res;
+                }
             }
 
             LOG_INFO("GPU Loader: %d in the queue, starting a batch of %d", m_PendingLoading.size(), loadBatch.size());
-            m_PendingLoading.erase(m_PendingLoading.begin(), m_PendingLoading.begin() + loadBatch.size());
-            lock.unlock();
+            m_PendingLoading.resize(keptCount);
 
-            LoadPendingResources_LoaderThread(loadBatch);
+            LoadPendingResources_LoaderThread(slot, loadBatch);
         }
     });
+
+    // mostly memcpy + submit: smt sibling of the main thread core, the loader workers have the other cores
+    const std::vector<u32>& mainCore = GetCpuTopology().GetCoreCpus(0);
+    if (mainCore.size() > 1)
+        SetThreadAffinity(m_GPULoaderThread, std::vector<u32>(mainCore.begin() + 1, mainCore.end()));
+    else
+        ResetThreadAffinity(m_GPULoaderThread);
 }
 
 void ResourceFactory::Shutdown()
 {
     // stop loader thread
-    {
-        std::lock_guard<std::mutex> lock(m_PendingLoadingLock);
-        m_StopLoaderThread = true;
-    }
-    m_GPULoaderThread_CondVar.notify_all();
+    m_StopLoaderThread.store(true, std::memory_order_release);
+    m_LoaderWakeups.fetch_add(1, std::memory_order_release);
+    m_LoaderWakeups.notify_all();
 
     if(m_GPULoaderThread.joinable())
         m_GPULoaderThread.join();
 
+    // let the last batches land, their waiters are dropped (the pools are stopped)
+    if (m_UploadSubmittedValue)
+    {
+        VkSemaphoreWaitInfo waitInfo = {};
+        waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+        waitInfo.semaphoreCount = 1;
+        waitInfo.pSemaphores = &m_UploadTimeline;
+        waitInfo.pValues = &m_UploadSubmittedValue;
+        vkWaitSemaphores(m_Device, &waitInfo, UINT64_MAX);
+    }
+
     vkUnmapMemory(m_Device, m_StagingBuffer.memory);
     VkUtils::DestroyBuffer(m_Device, m_StagingBuffer);
 
-    vkDestroyFence(m_Device, m_StagingFence, nullptr);
+    // the meshes still holding a range (loads cut short) just forget it, ReleaseStaging() is a no-op from now on
+    m_DecodeStaging.Reset();
+    vkUnmapMemory(m_Device, m_DecodeStagingBuffer.memory);
+    VkUtils::DestroyBuffer(m_Device, m_DecodeStagingBuffer);
+
+    vkDestroySemaphore(m_Device, m_UploadTimeline, nullptr);
     vkDestroyCommandPool(m_Device, m_StagingCmdPool, nullptr);
+
+    // the task pools are stopped by now, nobody is using these anymore
+    for (VkCommandPool pool : m_ThreadCommandPools)
+        vkDestroyCommandPool(m_Device, pool, nullptr);
+    m_ThreadCommandPools.clear();
 }
 
 static VkFormat GetVkFormat(EImageFormat format)
@@ -190,52 +291,200 @@ void ResourceFactory::DestroyTexture(Texture* texture)
 
 void ResourceFactory::PushLoading(const PendingLoadingRes& res)
 {
-    std::lock_guard<std::mutex> lock(m_PendingLoadingLock);
-    m_PendingLoading.push_back(res);
+    check(GetSlotBytes(res) < STAGING_BUFFER_SIZE / UPLOAD_SLOT_COUNT); // would never fit in a slot
 
-    m_GPULoaderThread_CondVar.notify_all(); // is all needed?
+    m_PendingUploadBytes.fetch_add(res.size, std::memory_order_relaxed);
+
+    PendingLoadingRes queued = res;
+    queued.queuedAtMs = NowMs();
+
+    // full only when the loader thread sits behind the gpu with thousands of uploads queued, give it time to catch up
+    while (!m_IncomingUploads.TryPush(queued))
+        std::this_thread::yield();
+
+    // cheap when the loader isn't sleeping
+    m_LoaderWakeups.fetch_add(1, std::memory_order_release);
+    m_LoaderWakeups.notify_one();
+}
+
+void ResourceFactory::SetUploadPriority(const void* resource, ETaskPriority priority)
+{
+    // only a hint, the uploads climb by age anyway: with the loader that far behind the change is dropped
+    if (!m_PriorityChanges.TryPush(UploadPriorityChange{ resource, priority }))
+        LOG_WARN("GPU Loader: priority change dropped, %u already queued", m_PriorityChanges.GetCapacity());
 }
 
-u32 ResourceFactory::PullLoaded(std::vector<PendingLoadingRes>& outLoadedRes)
+void ResourceFactory::DrainIncomingUploads_LoaderThread()
 {
-    u32 loaded = 0;
-#if 1
-    if (m_LoadedLock.try_lock())
+    PendingLoadingRes res;
+    while (m_IncomingUploads.TryPop(res))
+        m_PendingLoading.push_back(res);
+
+    UploadPriorityChange change;
+    while (m_PriorityChanges.TryPop(change))
     {
-        for (PendingLoadingRes& res : m_Loaded)
-            outLoadedRes.push_back(res);
+        for (PendingLoadingRes& queued : m_PendingLoading)
+        {
+            const void* queuedRes = queued.type == EResourceType::Texture ? (const void*)queued.texture : (const void*)queued.mesh;
+            if (queuedRes == change.resource)
+                queued.priority = change.priority;
+        }
+    }
+}
 
-        loaded = m_Loaded.size();
-        m_Loaded.clear();
+u64 ResourceFactory::GetStagingBufferSize() const
+{
+    return STAGING_BUFFER_SIZE;
+}
+
+UploadCopyStats ResourceFactory::GetUploadCopyStats() const
+{
+    UploadCopyStats stats;
+    stats.uploads = m_UploadCount.load(std::memory_order_relaxed);
+    stats.copiedBytes = m_CopiedUploadBytes.load(std::memory_order_relaxed);
+    stats.prestagedBytes = m_PrestagedUploadBytes.load(std::memory_order_relaxed);
+    return stats;
+}
+
+StagingRange ResourceFactory::TryReserveStaging(u64 size)
+{
+    return m_DecodeStaging.TryAllocate(size);
+}
 
-        m_LoadedLock.unlock();
+void ResourceFactory::ReleaseStaging(const StagingRange& range)
+{
+    if (m_DecodeStaging.IsInitialized())
+        m_DecodeStaging.Free(range);
+}
+
+u64 ResourceFactory::GetSlotBytes(const PendingLoadingRes& res)
+{
+    if (res.type == EResourceType::MeshBuffer && res.mesh->HasStagedData())
+        return 0;
+
+    return res.size;
+}
+
+u64 ResourceFactory::RetireUploads()
+{
+    u64 completed = 0;
+    vkCheck(vkGetSemaphoreCounterValue(m_Device, m_UploadTimeline, &completed));
+
+    // in timeline order, the first one not done yet stops the walk. a batch the loader thread hasn't queued yet is
+    // picked up by the next call
+    while (SubmittedUpload* upload = m_SubmittedUploads.Peek())
+    {
+        if (upload->timelineValue > completed)
+            break;
+
+        PendingLoadingRes res = upload->res;
+        if (res.onUploadedValue)
+            *res.onUploadedValue = upload->timelineValue;
+        m_SubmittedUploads.Pop();
+
+        m_PendingUploadBytes.fetch_sub(res.size, std::memory_order_relaxed);
+
+        // a continuation without a pool runs right here
+        if (res.onUploaded)
+            res.onUploaded.Schedule();
     }
-#else
 
+    if (completed == m_UploadCompletedValue.load(std::memory_order_relaxed))
+        return completed;
+
+    std::vector<Async::Continuation> waiters;
     {
-        std::lock_guard<std::mutex> lock(m_LoadedLock);
+        std::lock_guard<std::mutex> lock(m_UploadLock);
 
-        for (PendingLoadingRes& res : m_Loaded)
-            outLoadedRes.push_back(res);
+        size_t keptCount = 0;
+        for (size_t i = 0; i < m_UploadWaiters.size(); i++)
+        {
+            if (m_UploadWaiters[i].first <= completed)
+                waiters.push_back(m_UploadWaiters[i].second);
+            else
+                m_UploadWaiters[keptCount++] = m_UploadWaiters[i];
+        }
+        m_UploadWaiters.resize(keptCount);
 
-        loaded = m_Loaded.size();
-        m_Loaded.clear();
+        m_UploadCompletedValue.store(completed, std::memory_order_release);
     }
 
-#endif
+    // outside of the lock, a continuation without a pool runs right here
+    for (Async::Continuation& waiter : waiters)
+        waiter.Schedule();
 
-    return loaded;
+    return completed;
 }
 
-void ResourceFactory::LoadPendingResources_LoaderThread(const std::vector<PendingLoadingRes>& loadBatch)
+bool ResourceFactory::AddUploadWaiter(u64 value, const Async::Continuation& continuation)
 {
+    std::lock_guard<std::mutex> lock(m_UploadLock);
+
+    // the completed value only moves under the lock, so a retire can't slip between the check and the push
+    if (m_UploadCompletedValue.load(std::memory_order_relaxed) >= value)
+        return false;
+
+    m_UploadWaiters.emplace_back(value, continuation);
+    return true;
+}
+
+ResourceFactory::UploadSlot& ResourceFactory::AcquireUploadSlot_LoaderThread()
+{
+    while (true)
+    {
+        // the staging slice is free once the gpu copied it, retiring the uploads is the main thread's job
+        u64 completed = 0;
+        vkCheck(vkGetSemaphoreCounterValue(m_Device, m_UploadTimeline, &completed));
+
+        u64 oldestInFlight = UINT64_MAX;
+        for (UploadSlot& slot : m_UploadSlots)
+        {
+            if (slot.timelineValue <= completed)
+                return slot;
+
+            oldestInFlight = std::min(oldestInFlight, slot.timelineValue);
+        }
+
+        // staging memory is full: wait for the oldest batch, the other slots keep the gpu busy meanwhile
+        VkSemaphoreWaitInfo waitInfo = {};
+        waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+        waitInfo.semaphoreCount = 1;
+        waitInfo.pSemaphores = &m_UploadTimeline;
+        waitInfo.pValues = &oldestInFlight;
+        vkCheck(vkWaitSemaphores(m_Device, &waitInfo, UINT64_MAX));
+    }
+}
+
+VkCommandPool ResourceFactory::GetThreadCommandPool(ThreadContext& context)
+{
+    check(&context == &GetThreadContext()); // command pools are externally synchronized, only the owner thread can use it
+
+    if (context.commandPool == VK_NULL_HANDLE)
+    {
+        VkCommandPoolCreateInfo commandPoolInfo = {};
+        commandPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        commandPoolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+        commandPoolInfo.queueFamilyIndex = m_StagingQueue.familyIndex;
+        vkCheck(vkCreateCommandPool(m_Device, &commandPoolInfo, nullptr, &context.commandPool));
+
+        std::lock_guard<std::mutex> lock(m_ResourceMutex);
+        m_ThreadCommandPools.push_back(context.commandPool);
+    }
+
+    return context.commandPool;
+}
+
+void ResourceFactory::LoadPendingResources_LoaderThread(UploadSlot& slot, const LoadBatch& loadBatch)
+{
+    VkCommandBuffer cmd = slot.cmd;
+
     // record commands
     VkCommandBufferBeginInfo cmdBeginInfo = {};
     cmdBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
     cmdBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-    vkBeginCommandBuffer(m_StagingCmd, &cmdBeginInfo);
+    vkBeginCommandBuffer(cmd, &cmdBeginInfo);
 
-    u64 stagingMemoryOffset = 0;
+    u64 stagingMemoryOffset = slot.stagingOffset;
     for (const PendingLoadingRes& res : loadBatch)
     {
         if (res.type == EResourceType::Texture)
@@ -243,7 +492,8 @@ void ResourceFactory::LoadPendingResources_LoaderThread(const std::vector<Pendin
             // Texture upload WORK IN PROGRESS
 
             Texture* texture = res.texture;
-            memcpy((void*)((u64)(m_MappedStagingBuffer)+stagingMemoryOffset), texture->m_Data.data(), res.size);
+            memcpy((void*)((u64)(m_MappedStagingBuffer)+stagingMemoryOffset), texture->GetData().data(), res.size);
+            m_CopiedUploadBytes.fetch_add(res.size, std::memory_order_relaxed);
 
             // change layout: undefined -> transfer
             {
@@ -261,7 +511,7 @@ void ResourceFactory::LoadPendingResources_LoaderThread(const std::vector<Pendin
                 barrier.subresourceRange.baseArrayLayer = 0;
                 barrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
                 barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-                vkCmdPipelineBarrier(m_StagingCmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
                     0, nullptr, 0, nullptr, 1, &barrier);
                 
                 VkBufferImageCopy imgRegion = {};
@@ -269,7 +519,7 @@ void ResourceFactory::LoadPendingResources_LoaderThread(const std::vector<Pendin
                 imgRegion.imageExtent = { texture->m_Desc.width, texture->m_Desc.height, 1 };
                 imgRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
                 imgRegion.imageSubresource.layerCount = 1;
-                vkCmdCopyBufferToImage(m_StagingCmd, m_StagingBuffer.buffer, texture->m_Image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &imgRegion);
+                vkCmdCopyBufferToImage(cmd, m_StagingBuffer.buffer, texture->m_Image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &imgRegion);
             }
 
             // change layout: transfer -> read optimal + change queue family for exclusive sharing: transfer -> graphics
@@ -291,7 +541,7 @@ void ResourceFactory::LoadPendingResources_LoaderThread(const std::vector<Pendin
                 barrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
                 barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 
-                vkCmdPipelineBarrier(m_StagingCmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
                     0, nullptr, 0, nullptr, 1, &barrier);
             }
 
@@ -300,50 +550,89 @@ void ResourceFactory::LoadPendingResources_LoaderThread(const std::vector<Pendin
         else if (res.type == EResourceType::MeshBuffer)
         {
             Mesh* mesh = res.mesh;
-            memcpy((void*)((u64)(m_MappedStagingBuffer) + stagingMemoryOffset), mesh->m_Vertices.data(), mesh->GetVertexBufferSize());
-            memcpy((void*)((u64)(m_MappedStagingBuffer) + stagingMemoryOffset + mesh->GetVertexBufferSize()), mesh->m_Indices.data(), mesh->GetIndexBufferSize());
+
+            // written in place by the load in the gpu layout (vertices then indices), the gpu copies it from there
+            VkBuffer srcBuffer = m_StagingBuffer.buffer;
+            u64 srcOffset = stagingMemoryOffset;
+            if (mesh->HasStagedData())
+            {
+                srcBuffer = m_DecodeStagingBuffer.buffer;
+                srcOffset = mesh->m_StagingRange.offset;
+
+                // the load wrote it on another thread, done before it was pushed. the range is aligned for the flush
+                VkMappedMemoryRange stagedMemory = {};
+                stagedMemory.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+                stagedMemory.memory = m_DecodeStagingBuffer.memory;
+                stagedMemory.offset = mesh->m_StagingRange.offset;
+                stagedMemory.size = mesh->m_StagingRange.size;
+                vkFlushMappedMemoryRanges(m_Device, 1, &stagedMemory);
+
+                m_PrestagedUploadBytes.fetch_add(res.size, std::memory_order_relaxed);
+            }
+            else
+            {
+                memcpy((void*)((u64)(m_MappedStagingBuffer) + stagingMemoryOffset), mesh->GetVertexData().data(), mesh->GetVertexBufferSize());
+                memcpy((void*)((u64)(m_MappedStagingBuffer) + stagingMemoryOffset + mesh->GetVertexBufferSize()), mesh->GetIndexData().data(), mesh->GetIndexBufferSize());
+                m_CopiedUploadBytes.fetch_add(res.size, std::memory_order_relaxed);
+            }
 
             VkBufferCopy vertexBufferCopy;
-            vertexBufferCopy.srcOffset = stagingMemoryOffset;
+            vertexBufferCopy.srcOffset = srcOffset;
             vertexBufferCopy.dstOffset = 0;
             vertexBufferCopy.size = mesh->GetVertexBufferSize();
-            vkCmdCopyBuffer(m_StagingCmd, m_StagingBuffer.buffer, mesh->m_VertexBuffer.buffer, 1, &vertexBufferCopy);
+            vkCmdCopyBuffer(cmd, srcBuffer, mesh->m_VertexBuffer.buffer, 1, &vertexBufferCopy);
 
             VkBufferCopy indexBufferCopy;
-            indexBufferCopy.srcOffset = stagingMemoryOffset + mesh->GetVertexBufferSize();
+            indexBufferCopy.srcOffset = srcOffset + mesh->GetVertexBufferSize();
             indexBufferCopy.dstOffset = 0;
             indexBufferCopy.size = mesh->GetIndexBufferSize();
-            vkCmdCopyBuffer(m_StagingCmd, m_StagingBuffer.buffer, mesh->m_IndexBuffer.buffer, 1, &indexBufferCopy);
+            vkCmdCopyBuffer(cmd, srcBuffer, mesh->m_IndexBuffer.buffer, 1, &indexBufferCopy);
         }
 
-        stagingMemoryOffset += res.size;
+        stagingMemoryOffset += GetSlotBytes(res);
     }
 
-    vkEndCommandBuffer(m_StagingCmd);
+    m_UploadCount.fetch_add(loadBatch.size(), std::memory_order_relaxed);
+
+    vkEndCommandBuffer(cmd);
 
     // flush staging memory
     VkMappedMemoryRange stagingMappedMemory = {};
     stagingMappedMemory.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
     stagingMappedMemory.memory = m_StagingBuffer.memory;
-    stagingMappedMemory.offset = 0;
-    stagingMappedMemory.size = STAGING_BUFFER_SIZE;
+    stagingMappedMemory.offset = slot.stagingOffset;
+    stagingMappedMemory.size = STAGING_BUFFER_SIZE / UPLOAD_SLOT_COUNT;
     vkFlushMappedMemoryRanges(m_Device, 1, &stagingMappedMemory);
 
-    // execute and wait
+    // execute, the batch signals the next timeline value. nobody waits here: RetireUploads() notices when it's done
+    u64 timelineValue = ++m_UploadSubmittedValue;
+
+    VkTimelineSemaphoreSubmitInfo timelineSubmitInfo = {};
+    timelineSubmitInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineSubmitInfo.signalSemaphoreValueCount = 1;
+    timelineSubmitInfo.pSignalSemaphoreValues = &timelineValue;
+
     VkSubmitInfo submitInfo = {};
     submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.pNext = &timelineSubmitInfo;
     submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &m_StagingCmd;
-    vkCheck(vkQueueSubmit(m_StagingQueue.queue, 1, &submitInfo, m_StagingFence));
+    submitInfo.pCommandBuffers = &cmd;
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &m_UploadTimeline;
 
-    // wait...
-    vkWaitForFences(m_Device, 1, &m_StagingFence, VK_TRUE, 0xffffffffffffffff);
-    vkResetFences(m_Device, 1, &m_StagingFence);
+    // in flight until the timeline reaches the value
+    slot.timelineValue = timelineValue;
+    vkCheck(vkQueueSubmit(m_StagingQueue.queue, 1, &submitInfo, VK_NULL_HANDLE));
 
-    // add resources to completed list
+    // to the main thread for RetireUploads(). everything in the ring is submitted, so a full ring always drains
+    for (const PendingLoadingRes& res : loadBatch)
     {
-        std::lock_guard<std::mutex> lock(m_LoadedLock);
-        for (const PendingLoadingRes& res : loadBatch)
-            m_Loaded.push_back(res);
+        while (!m_SubmittedUploads.TryPush(SubmittedUpload{ res, timelineValue }))
+        {
+            // shutting down: nobody retires anymore, the waiters are dropped
+            if (m_StopLoaderThread.load(std::memory_order_acquire))
+                return;
+            std::this_thread::yield();
+        }
     }
 }
\ No newline at end of file
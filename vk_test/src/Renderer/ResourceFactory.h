@@ -4,9 +4,12 @@
 #include "VkUtils.h"
 
 #include "Async/TaskPool.h"
+#include "Async/AsyncTask.h"
+#include "Async/RingQueue.h"
 
 #include "Mesh.h"
 #include "Texture.h"
+#include "StagingAllocator.h"
 
 enum class EResourceType
 {
@@ -23,8 +26,25 @@ struct PendingLoadingRes
 	};
 	u64 size;
 	EResourceType type;
+	ETaskPriority priority = ETaskPriority::Visible;
+	u64 queuedAtMs = 0; // set by PushLoading()
+
+	// resumed when the copy is done on the gpu, the batch timeline value is written to onUploadedValue first (see Upload())
+	Async::Continuation onUploaded;
+	u64* onUploadedValue = nullptr;
 };
 
+// cpu copies of the gpu loader since Init(), diff two samples for a window
+struct UploadCopyStats
+{
+	u64 uploads = 0;
+	u64 copiedBytes = 0;    // memcpy'd into the upload slots by the loader thread
+	u64 prestagedBytes = 0; // decoded straight into staging memory by the loads, copied by the gpu only
+};
+
+// one batch of the gpu loader, lives in the loader thread scratch
+using LoadBatch = std::vector<PendingLoadingRes, ScratchAllocator<PendingLoadingRes>>;
+
 class ResourceFactory
 {
 public:
@@ -40,33 +60,151 @@ public:
 	void DestroyMesh(Mesh* mesh);
 	void DestroyTexture(Texture* texture);
 
+	// fire and forget, use Upload() to know when it's done. any thread, lock free
 	void PushLoading(const PendingLoadingRes& res);
-	u32 PullLoaded(std::vector<PendingLoadingRes>& outLoadedRes);
+	// moves a queued upload (mesh or texture pointer) to another priority, no-op if it's already uploading.
+	// main thread only, applied by the loader thread before its next batch
+	void SetUploadPriority(const void* resource, ETaskPriority priority);
+
+	// co_await g_ResourceFactory.Upload(res): queues the upload, the coroutine continues (on its pool) once the copy
+	// is done on the gpu. returns the upload timeline value of the batch it went in
+	struct UploadAwaiter
+	{
+		ResourceFactory* factory;
+		PendingLoadingRes res;
+		u64 timelineValue = 0;
+
+		inline bool await_ready() const noexcept { return false; }
+
+		template<typename Promise>
+		void await_suspend(std::coroutine_handle<Promise> h)
+		{
+			res.onUploaded = Async::MakeContinuation(h, res.priority);
+			res.onUploadedValue = &timelineValue;
+			factory->PushLoading(res);
+		}
+
+		inline u64 await_resume() const noexcept { return timelineValue; }
+	};
+
+	inline UploadAwaiter Upload(const PendingLoadingRes& res) { return { this, res }; }
+
+	// co_await g_ResourceFactory.WaitForUpload(value): continues once the upload timeline reached the value
+	struct TimelineAwaiter
+	{
+		ResourceFactory* factory;
+		u64 value;
+
+		inline bool await_ready() const noexcept { return factory->GetCompletedUploadValue() >= value; }
+
+		template<typename Promise>
+		bool await_suspend(std::coroutine_handle<Promise> h)
+		{
+			return factory->AddUploadWaiter(value, Async::MakeContinuation(h));
+		}
+
+		inline void await_resume() const noexcept {}
+	};
+
+	inline TimelineAwaiter WaitForUpload(u64 timelineValue) { return { this, timelineValue }; }
+
+	// the upload timeline semaphore is signaled with an increasing value per batch
+	inline VkSemaphore GetUploadTimeline() const { return m_UploadTimeline; }
+	inline u64 GetCompletedUploadValue() const { return m_UploadCompletedValue.load(std::memory_order_acquire); }
+
+	// cpu side data waiting for the gpu: queued + in the batches not retired yet
+	inline u64 GetPendingUploadBytes() const { return m_PendingUploadBytes.load(std::memory_order_relaxed); }
+	u64 GetStagingBufferSize() const;
+	UploadCopyStats GetUploadCopyStats() const;
+
+	// staging memory a load decodes into directly (apart from the upload slots), held until the gpu copied it: the upload
+	// reads it in place, no memcpy on the loader thread. empty if it doesn't fit right now (or before Init()), the load
+	// keeps its data in ram and goes through the slots. write only for the cpu, the memory can be uncached. any thread
+	StagingRange TryReserveStaging(u64 size);
+	void ReleaseStaging(const StagingRange& range);
+	inline StagingAllocatorStats GetDecodeStagingStats() const { return m_DecodeStaging.GetStats(); }
+
+	// non blocking: hands the batches the gpu finished to their waiters. main thread only, every frame
+	u64 RetireUploads();
+
+	// command pool owned by the calling thread (transfer family), created the first time a thread asks for it
+	VkCommandPool GetThreadCommandPool(ThreadContext& context);
 
 private:
-	void LoadPendingResources_LoaderThread(const std::vector<PendingLoadingRes>& loadBatch);
+	// a slice of the staging buffer + its command buffer, reused once the gpu is done with the batch it carries.
+	// loader thread only
+	struct UploadSlot
+	{
+		VkCommandBuffer cmd = VK_NULL_HANDLE;
+		u64 stagingOffset = 0;
+		u64 timelineValue = 0; // 0 = free
+	};
+
+	// an upload in a submitted batch, handed to the main thread to retire
+	struct SubmittedUpload
+	{
+		PendingLoadingRes res;
+		u64 timelineValue = 0;
+	};
+
+	struct UploadPriorityChange
+	{
+		const void* resource = nullptr;
+		ETaskPriority priority = ETaskPriority::Visible;
+	};
+
+	static constexpr u32 UPLOAD_SLOT_COUNT = 2;
+
+	// false if the value is already reached (the continuation is not taken)
+	bool AddUploadWaiter(u64 value, const Async::Continuation& continuation);
+
+	UploadSlot& AcquireUploadSlot_LoaderThread();
+	// moves what the other threads pushed since the last call into m_PendingLoading
+	void DrainIncomingUploads_LoaderThread();
+	// what the upload takes from its slot, 0 for a mesh decoded straight into staging memory
+	static u64 GetSlotBytes(const PendingLoadingRes& res);
+	void LoadPendingResources_LoaderThread(UploadSlot& slot, const LoadBatch& loadBatch);
 
 private:
 	RendererContext* m_Context;
 	VkDevice m_Device;
 
 	std::mutex m_ResourceMutex;
+	std::vector<VkCommandPool> m_ThreadCommandPools; // guarded by m_ResourceMutex
 
-	// ram -> vram
-	std::mutex m_PendingLoadingLock;
-	std::vector<PendingLoadingRes> m_PendingLoading;
+	// ram -> vram: any thread -> loader thread, the loader keeps what didn't fit in a batch in its own queue
+	MPSCRing<PendingLoadingRes> m_IncomingUploads;
+	SPSCRing<UploadPriorityChange> m_PriorityChanges; // main thread -> loader thread
+	std::vector<PendingLoadingRes> m_PendingLoading;  // loader thread only
 
-	std::condition_variable m_GPULoaderThread_CondVar;
+	// bumped after every push, the idle loader thread sleeps on it
+	std::atomic<u32> m_LoaderWakeups;
+	std::atomic<bool> m_StopLoaderThread;
 	std::thread m_GPULoaderThread;
-	bool m_StopLoaderThread;
-
-	std::mutex m_LoadedLock;
-	std::vector<PendingLoadingRes> m_Loaded;
 
 	VkUtils::Buffer m_StagingBuffer;
 	void* m_MappedStagingBuffer;
 	Queue m_StagingQueue;
 	VkCommandPool m_StagingCmdPool;
-	VkCommandBuffer m_StagingCmd;
-	VkFence m_StagingFence;
+
+	// TryReserveStaging(), its own buffer: the slots don't shrink
+	VkUtils::Buffer m_DecodeStagingBuffer;
+	void* m_MappedDecodeStagingBuffer;
+	StagingAllocator m_DecodeStaging;
+
+	// loader thread writes, any thread reads
+	std::atomic<u64> m_UploadCount;
+	std::atomic<u64> m_CopiedUploadBytes;
+	std::atomic<u64> m_PrestagedUploadBytes;
+
+	// gpu side of the uploads: the loader thread only waits when every slot is still in flight
+	UploadSlot m_UploadSlots[UPLOAD_SLOT_COUNT];
+	SPSCRing<SubmittedUpload> m_SubmittedUploads; // loader thread -> main thread, in timeline order
+
+	std::mutex m_UploadLock;
+	std::vector<std::pair<u64, Async::Continuation>> m_UploadWaiters; // guarded by m_UploadLock
+	VkSemaphore m_UploadTimeline;
+	u64 m_UploadSubmittedValue; // loader thread only
+	std::atomic<u64> m_UploadCompletedValue;
+	std::atomic<u64> m_PendingUploadBytes;
 };
\ No newline at end of file
@@ -0,0 +1,109 @@
+#include "StagingAllocator.h"
+
+#include <algorithm>
+
+void StagingAllocator::Init(u8* data, u64 size, u64 alignment)
+{
+    check(alignment > 0 && (alignment & (alignment - 1)) == 0); // power of 2
+
+    std::lock_guard<std::mutex> lock(m_Lock);
+    m_Data = data;
+    m_Size = size & ~(alignment - 1);
+    m_Alignment = alignment;
+    m_FreeBlocks.assign(1, FreeBlock{ 0, m_Size });
+    m_UsedBytes = 0;
+    m_PeakUsedBytes = 0;
+}
+
+void StagingAllocator::Reset()
+{
+    std::lock_guard<std::mutex> lock(m_Lock);
+    m_Data = nullptr;
+    m_Size = 0;
+    m_FreeBlocks.clear();
+    m_UsedBytes = 0;
+}
+
+StagingRange StagingAllocator::TryAllocate(u64 size)
+{
+    if (size == 0)
+        return {};
+
+    size = (size + m_Alignment - 1) & ~(m_Alignment - 1);
+
+    std::lock_guard<std::mutex> lock(m_Lock);
+    for (size_t i = 0; i < m_FreeBlocks.size(); i++)
+    {
+        FreeBlock& block = m_FreeBlocks[i];
+        if (block.size < size)
+            continue;
+
+        StagingRange range;
+        range.data = m_Data + block.offset;
+        range.offset = block.offset;
+        range.size = size;
+
+        block.offset += size;
+        block.size -= size;
+        if (block.size == 0)
+            m_FreeBlocks.erase(m_FreeBlocks.begin() + i);
+
+        m_UsedBytes += size;
+        m_PeakUsedBytes = std::max(m_PeakUsedBytes, m_UsedBytes);
+        m_AllocationCount++;
+        return range;
+    }
+
+    m_FailedCount++;
+    return {};
+}
+
+void StagingAllocator::Free(const StagingRange& range)
+{
+    if (!range)
+        return;
+
+    std::lock_guard<std::mutex> lock(m_Lock);
+    check(range.offset + range.size <= m_Size && m_UsedBytes >= range.size);
+    m_UsedBytes -= range.size;
+
+    // first block after the range, the range goes right before it
+    auto next = std::lower_bound(m_FreeBlocks.begin(), m_FreeBlocks.end(), range.offset, [](const FreeBlock& block, u64 offset) {
+        return block.offset < offset;
+    });
+
+    bool mergePrev = next != m_FreeBlocks.begin() && std::prev(next)->offset + std::prev(next)->size == range.offset;
+    bool mergeNext = next != m_FreeBlocks.end() && range.offset + range.size == next->offset;
+
+    if (mergePrev && mergeNext)
+    {
+        std::prev(next)->size += range.size + next->size;
+        m_FreeBlocks.erase(next);
+    }
+    else if (mergePrev)
+    {
+        std::prev(next)->size += range.size;
+    }
+    else if (mergeNext)
+    {
+        next->offset = range.offset;
+        next->size += range.size;
+    }
+    else
+    {
+        m_FreeBlocks.insert(next, FreeBlock{ range.offset, range.size });
+    }
+}
+
+StagingAllocatorStats StagingAllocator::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(m_Lock);
+
+    StagingAllocatorStats stats;
+    stats.capacityBytes = m_Size;
+    stats.usedBytes = m_UsedBytes;
+    stats.peakUsedBytes = m_PeakUsedBytes;
+    stats.allocations = m_AllocationCount;
+    stats.failedAllocations = m_FailedCount;
+    return stats;
+}
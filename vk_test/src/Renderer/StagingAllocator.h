@@ -0,0 +1,61 @@
+#pragma once
+
+#include "Core/CoreMinimal.h"
+
+#include <mutex>
+#include <vector>
+
+// a range of mapped staging memory reserved by a load: the decode writes the final data in it and the upload copies
+// it to the gpu from there, the cpu never touches it again. empty = nothing reserved
+struct StagingRange
+{
+	u8* data = nullptr;
+	u64 offset = 0; // in the staging buffer
+	u64 size = 0;
+
+	inline explicit operator bool() const { return data != nullptr; }
+};
+
+struct StagingAllocatorStats
+{
+	u64 capacityBytes = 0;
+	u64 usedBytes = 0;
+	u64 peakUsedBytes = 0;
+	u64 allocations = 0;
+	u64 failedAllocations = 0; // didn't fit, the caller went another way
+};
+
+// first fit over the free blocks of a mapped buffer, neighbours merged on free. any thread, nothing waits: an
+// allocation that doesn't fit comes back empty. the loads hold their range from the parse to the end of the gpu copy,
+// they free in any order
+class StagingAllocator
+{
+public:
+	// alignment: of the offsets and the sizes (the flushes of non coherent memory go by nonCoherentAtomSize)
+	void Init(u8* data, u64 size, u64 alignment);
+	void Reset();
+
+	StagingRange TryAllocate(u64 size);
+	void Free(const StagingRange& range);
+
+	inline bool IsInitialized() const { return m_Data != nullptr; }
+	StagingAllocatorStats GetStats() const;
+
+private:
+	struct FreeBlock
+	{
+		u64 offset;
+		u64 size;
+	};
+
+	mutable std::mutex m_Lock;
+	std::vector<FreeBlock> m_FreeBlocks; // sorted by offset
+	u8* m_Data = nullptr;
+	u64 m_Size = 0;
+	u64 m_Alignment = 1;
+
+	u64 m_UsedBytes = 0;
+	u64 m_PeakUsedBytes = 0;
+	u64 m_AllocationCount = 0;
+	u64 m_FailedCount = 0;
+};
@@ -2,6 +2,10 @@
 #include "stb/stb_image.h"
 #include "Engine.h"
 #include "Renderer/ResourceFactory.h"
+#include "Async/ThreadContext.h"
+#include "TextureFormat.h"
+
+#include <fstream>
 
 void Texture::Load(const std::filesystem::path& path)
 {
@@ -16,13 +20,20 @@ void Texture::Load(const std::filesystem::path& path)
         return;
     }
 
-    stbi_uc* data = stbi_load_from_file(file, &width, &height, &channels, 4);
-    check(data);
+    {
+        // stb allocates from the thread scratch (see stb_image.cpp), copy the pixels out before the scope rolls it back
+        ScratchScope scratchScope(GetThreadContext().scratch);
 
-    u64 sizeBytes = width * height * 4;
+        stbi_uc* data = stbi_load_from_file(file, &width, &height, &channels, 4);
+        fclose(file);
+        check(data);
 
-    m_Data.resize(sizeBytes);
-    memcpy(m_Data.data(), data, sizeBytes);
+        u64 sizeBytes = (u64)width * height * 4;
+
+        m_Data.resize(sizeBytes);
+        memcpy(m_Data.data(), data, sizeBytes);
+        m_DataView = m_Data;
+    }
 
     m_Desc.format = EImageFormat::RGBA8;
     m_Desc.width = (u32)width;
@@ -31,6 +42,34 @@ void Texture::Load(const std::filesystem::path& path)
     DebugName = path.string();
 }
 
+void Texture::LoadFromMemory(const u8* fileData, u64 fileSize)
+{
+    int width, height;
+    int channels;
+
+    {
+        // same as Load(), the decoded pixels come from the thread scratch
+        ScratchScope scratchScope(GetThreadContext().scratch);
+
+        stbi_uc* data = stbi_load_from_memory(fileData, (int)fileSize, &width, &height, &channels, 4);
+        if (!data)
+        {
+            LOG_ERR("Unable to decode texture %s: %s", DebugName.c_str(), stbi_failure_reason());
+            return;
+        }
+
+        u64 sizeBytes = (u64)width * height * 4;
+
+        m_Data.resize(sizeBytes);
+        memcpy(m_Data.data(), data, sizeBytes);
+        m_DataView = m_Data;
+    }
+
+    m_Desc.format = EImageFormat::RGBA8;
+    m_Desc.width = (u32)width;
+    m_Desc.height = (u32)height;
+}
+
 static u32 GetPixelSize(EImageFormat format)
 {
     switch (format)
@@ -50,6 +89,7 @@ void Texture::SetData(const void* data, u64 size, const TextureDesc& desc)
 
     m_Data.resize(size);
     memcpy(m_Data.data(), data, size);
+    m_DataView = m_Data;
 
     m_Desc = desc;
 }
@@ -59,9 +99,103 @@ void Texture::ClearData()
     m_Data.clear();
     m_Data.shrink_to_fit(); // free actual memory
 
+    m_DataView = {};
+    m_CookedFile.Close();
+
     m_Desc = {};
 }
 
+bool Texture::LoadCooked(const std::filesystem::path& cookedPath)
+{
+    MappedFile file;
+    if (!file.Open(cookedPath))
+        return false;
+
+    if (!LoadCooked({ file.Data(), (size_t)file.Size() }, cookedPath.string()))
+        return false;
+
+    // the pixels point into the mapping
+    m_CookedFile = std::move(file);
+    return true;
+}
+
+bool Texture::LoadCooked(std::span<const u8> cooked, const std::string& name)
+{
+    if (cooked.size() < sizeof(CookedTextureHeader))
+    {
+        LOG_ERR("Invalid cooked texture: %s", name.c_str());
+        return false;
+    }
+
+    const CookedTextureHeader header = *(const CookedTextureHeader*)cooked.data();
+    bool valid = header.magic == COOKED_TEXTURE_MAGIC && header.version == COOKED_TEXTURE_VERSION
+        && header.format == EImageFormat::RGBA8 && header.dataOffset % COOKED_TEXTURE_ALIGNMENT == 0
+        && header.dataOffset <= cooked.size() && header.dataSize <= cooked.size() - header.dataOffset
+        && header.dataSize == (u64)header.width * header.height * GetPixelSize((EImageFormat)header.format);
+
+    if (!valid)
+    {
+        LOG_ERR("Invalid cooked texture (or cooked by another version): %s", name.c_str());
+        return false;
+    }
+
+    ClearData();
+    m_DataView = { cooked.data() + header.dataOffset, (size_t)header.dataSize };
+
+    m_Desc.format = (EImageFormat)header.format;
+    m_Desc.width = header.width;
+    m_Desc.height = header.height;
+
+    DebugName = name;
+    return true;
+}
+
+bool Texture::SaveCooked(const std::filesystem::path& cookedPath) const
+{
+    if (m_DataView.empty())
+        return false;
+
+    CookedTextureHeader header = {};
+    header.magic = COOKED_TEXTURE_MAGIC;
+    header.version = COOKED_TEXTURE_VERSION;
+    header.width = m_Desc.width;
+    header.height = m_Desc.height;
+    header.format = m_Desc.format;
+    header.dataOffset = (sizeof(CookedTextureHeader) + COOKED_TEXTURE_ALIGNMENT - 1) & ~(COOKED_TEXTURE_ALIGNMENT - 1);
+    header.dataSize = m_DataView.size();
+
+    // written under another name and renamed, nobody maps a half written file
+    std::filesystem::path tempPath = cookedPath;
+    tempPath += ".tmp";
+
+    {
+        static const char zeros[COOKED_TEXTURE_ALIGNMENT] = {};
+
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        file.write((const char*)&header, sizeof(header));
+        file.write(zeros, (std::streamsize)(header.dataOffset - sizeof(header)));
+        file.write((const char*)m_DataView.data(), (std::streamsize)m_DataView.size());
+
+        if (!file)
+        {
+            LOG_ERR("Unable to write cooked texture: %ls", tempPath.c_str());
+            file.close();
+            std::filesystem::remove(tempPath);
+            return false;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(tempPath, cookedPath, error);
+    if (error)
+    {
+        LOG_ERR("Unable to write cooked texture: %ls", cookedPath.c_str());
+        std::filesystem::remove(tempPath, error);
+        return false;
+    }
+    return true;
+}
+
 void Texture::CreateOnGPU()
 {
     g_ResourceFactory.CreateTexture(this);
@@ -2,6 +2,8 @@
 
 #include "Core/Core.h"
 #include "VkUtils.h"
+#include "Misc/MappedFile.h"
+#include <span>
 
 enum EImageFormat
 {
@@ -25,18 +27,27 @@ public:
 	~Texture() = default;
 
 	void Load(const std::filesystem::path& path);
+	void LoadFromMemory(const u8* fileData, u64 fileSize); // encoded file already in memory (png, jpg, ...)
 	void SetData(const void* data, u64 size, const TextureDesc& desc);
 	void ClearData();
 
+	// cooked texture (TextureFormat.h): the file is mapped, the pixels point into it until ClearData().
+	// false if it's missing or not a valid .vktex of this build
+	bool LoadCooked(const std::filesystem::path& cookedPath);
+	// same from memory that outlives the texture data (a mounted AssetPack), nothing is copied
+	bool LoadCooked(std::span<const u8> cooked, const std::string& name);
+	bool SaveCooked(const std::filesystem::path& cookedPath) const; // needs the cpu data
+
 	void CreateOnGPU();
 
-	inline const std::vector<u8>& GetData() const { return m_Data; }
+	// decoded pixels or the mapped cooked file
+	inline std::span<const u8> GetData() const { return m_DataView; }
 	inline const TextureDesc& GetDesc() const { return m_Desc; }
 
 	// bytes
 	inline u64 GetMemoryFootprint() const
 	{
-		return m_Data.size();
+		return m_DataView.size();
 	}
 
 	inline const VkUtils::Image& GetImage() const { return m_Image; }
@@ -50,6 +61,8 @@ private:
 	friend class AssetManager;
 
 	std::vector<u8> m_Data;
+	std::span<const u8> m_DataView; // what the upload reads: m_Data or the cooked file
+	MappedFile m_CookedFile;
 	VkUtils::Image m_Image;
 	TextureDesc m_Desc;
 
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "Core/CoreMinimal.h"
+
+// .vktex, the cooked texture: the decoded pixels as they go in the staging buffer, loaded by mapping the file.
+// little endian:
+//
+//     CookedTextureHeader | pixels (dataSize bytes at dataOffset, 16 byte aligned)
+
+constexpr u32 COOKED_TEXTURE_MAGIC = 0x58544B56; // "VKTX"
+constexpr u32 COOKED_TEXTURE_VERSION = 1;
+constexpr u64 COOKED_TEXTURE_ALIGNMENT = 16;
+
+struct CookedTextureHeader
+{
+	u32 magic;
+	u32 version;
+	u32 width;
+	u32 height;
+	u32 format; // EImageFormat
+	u32 reserved;
+
+	// bytes from the start of the file
+	u64 dataOffset;
+	u64 dataSize;
+};
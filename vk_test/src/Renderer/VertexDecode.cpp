@@ -0,0 +1,328 @@
+#include "VertexDecode.h"
+#include "VertexDecodeKernels.h"
+
+#ifdef _WIN32
+    #include <intrin.h>
+#else
+    #include <cpuid.h>
+#endif
+
+// vertices per block of DecodeVertices: 3 KB of output, stays in L1 while every attribute is written into it
+constexpr u64 DECODE_BLOCK_SIZE = 64;
+
+static const float ATTRIBUTE_DEFAULTS[4][4] = {
+    { 0.0f, 0.0f, 0.0f, 0.0f }, // position
+    { 1.0f, 0.0f, 0.0f, 0.0f }, // normal
+    { 0.0f, 0.0f, 0.0f, 0.0f }, // uv
+    { 1.0f, 1.0f, 1.0f, 1.0f }, // color
+};
+
+static ESimdLevel DetectSimdLevel()
+{
+    constexpr u32 OSXSAVE_BIT = 1u << 27; // cpuid 1, ecx
+    constexpr u32 AVX_BIT = 1u << 28;     // cpuid 1, ecx
+    constexpr u32 AVX2_BIT = 1u << 5;     // cpuid 7, ebx
+
+    u32 features = 0;
+    u32 extendedFeatures = 0;
+    u64 enabledStates = 0; // xcr0
+
+#ifdef _WIN32
+    int info[4] = {};
+    __cpuid(info, 0);
+    int maxLeaf = info[0];
+
+    __cpuid(info, 1);
+    features = (u32)info[2];
+
+    if (maxLeaf >= 7)
+    {
+        __cpuidex(info, 7, 0);
+        extendedFeatures = (u32)info[1];
+    }
+
+    if (features & OSXSAVE_BIT)
+        enabledStates = _xgetbv(0);
+#else
+    u32 eax, ebx, ecx, edx;
+    u32 maxLeaf = __get_cpuid_max(0, nullptr);
+
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+        features = ecx;
+
+    if (maxLeaf >= 7)
+    {
+        __cpuid_count(7, 0, eax, ebx, ecx, edx);
+        extendedFeatures = ebx;
+    }
+
+    if (features & OSXSAVE_BIT)
+    {
+        u32 low, high;
+        __asm__ volatile("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+        enabledStates = ((u64)high << 32) | low;
+    }
+#endif
+
+    // the cpu having avx2 isn't enough, the os has to save the ymm registers too (xcr0 bits 1 and 2)
+    bool avx2 = (features & AVX_BIT) && (features & OSXSAVE_BIT) && (enabledStates & 0x6) == 0x6 && (extendedFeatures & AVX2_BIT);
+
+    // sse2 is part of x64
+    return avx2 ? ESimdLevel::AVX2 : ESimdLevel::SSE2;
+}
+
+ESimdLevel GetSimdLevel()
+{
+    static const ESimdLevel level = DetectSimdLevel();
+    return level;
+}
+
+const char* GetSimdLevelName(ESimdLevel level)
+{
+    switch (level)
+    {
+    case ESimdLevel::SSE2:
+        return "sse2";
+    case ESimdLevel::AVX2:
+        return "avx2";
+    default:
+        return "scalar";
+    }
+}
+
+template<typename C>
+static float ConvertComponent(const u8* src, float divisor, float minValue)
+{
+    C value;
+    memcpy(&value, src, sizeof(C));
+
+    if constexpr (std::is_same_v<C, float>)
+        return value;
+    else
+        return std::max((float)value / divisor, minValue);
+}
+
+template<EVertexAttribute Attribute>
+static void StoreAttributeScalar(Vertex& vertex, const float* v)
+{
+    if constexpr (Attribute == EVertexAttribute::Position)
+    {
+        vertex.position = { v[0], v[1], v[2] };
+    }
+    else if constexpr (Attribute == EVertexAttribute::Normal)
+    {
+        vertex.normal = { v[0], v[1], v[2] };
+    }
+    else if constexpr (Attribute == EVertexAttribute::UV)
+    {
+        vertex.uv_x = v[0];
+        vertex.uv_y = v[1];
+    }
+    else
+    {
+        vertex.color = { v[0], v[1], v[2], v[3] };
+    }
+}
+
+struct AttributeKernelScalar
+{
+    template<typename C, EVertexAttribute Attribute>
+    static void Run(const AttributeBlock& block)
+    {
+        const float divisor = ComponentDivisor<C>(block.normalized);
+        const float minValue = ComponentMin(block.normalized);
+
+        const u8* src = block.src;
+        for (u64 i = 0; i < block.count; i++, src += block.stride)
+        {
+            float v[4];
+            for (u32 c = 0; c < 4; c++)
+                v[c] = c < block.componentCount ? ConvertComponent<C>(src + c * sizeof(C), divisor, minValue) : block.defaults[c];
+
+            StoreAttributeScalar<Attribute>(block.out[i], v);
+        }
+    }
+};
+
+struct AttributeKernelSSE
+{
+    template<typename C, EVertexAttribute Attribute>
+    static void Run(const AttributeBlock& block)
+    {
+        DecodeAttributeRangeSSE<C, Attribute>(block, 0, MakeConstants<C>(block));
+    }
+};
+
+template<EVertexAttribute Attribute>
+static void FillDefault(Vertex* out, u64 count)
+{
+    for (u64 i = 0; i < count; i++)
+        StoreAttributeScalar<Attribute>(out[i], ATTRIBUTE_DEFAULTS[(u32)Attribute]);
+}
+
+// the first elements of the range that can be read 4 components at a time without going past its last byte
+static u64 GetFullLoadCount(const AttributeStream& stream, u64 count)
+{
+    u64 componentSize = GetComponentSize(stream.componentType);
+    u64 loadSize = 4 * componentSize;
+    u64 rangeSize = (count - 1) * stream.stride + stream.componentCount * componentSize;
+    if (rangeSize < loadSize)
+        return 0;
+
+    return std::min(count, (rangeSize - loadSize) / stream.stride + 1);
+}
+
+static void CheckAttributeStream(const AttributeStream& stream)
+{
+    check(!stream.data || (stream.componentCount >= 1 && stream.componentCount <= 4 && stream.stride > 0 && stream.componentType != EComponentType::U32));
+}
+
+static void DecodeBlock(Vertex* out, u64 count, u64 fullLoadCount, const AttributeStream& stream, EVertexAttribute attribute, ESimdLevel level)
+{
+    if (!stream.data)
+    {
+        switch (attribute)
+        {
+        case EVertexAttribute::Position:
+            FillDefault<EVertexAttribute::Position>(out, count);
+            break;
+        case EVertexAttribute::Normal:
+            FillDefault<EVertexAttribute::Normal>(out, count);
+            break;
+        case EVertexAttribute::UV:
+            FillDefault<EVertexAttribute::UV>(out, count);
+            break;
+        case EVertexAttribute::Color:
+            FillDefault<EVertexAttribute::Color>(out, count);
+            break;
+        }
+        return;
+    }
+
+    AttributeBlock block;
+    block.out = out;
+    block.count = count;
+    block.fullLoadCount = fullLoadCount;
+    block.src = stream.data;
+    block.stride = stream.stride;
+    block.componentCount = stream.componentCount;
+    block.componentType = stream.componentType;
+    block.normalized = stream.normalized;
+    block.defaults = ATTRIBUTE_DEFAULTS[(u32)attribute];
+
+    switch (level)
+    {
+    case ESimdLevel::AVX2:
+        DecodeAttributeAVX2(block, attribute);
+        break;
+    case ESimdLevel::SSE2:
+        DispatchAttribute<AttributeKernelSSE>(block, attribute);
+        break;
+    default:
+        DispatchAttribute<AttributeKernelScalar>(block, attribute);
+        break;
+    }
+}
+
+void DecodeVertices(Vertex* out, u64 count, const VertexStreams& streams, ESimdLevel level)
+{
+    if (count == 0)
+        return;
+
+    level = std::min(level, GetSimdLevel());
+
+    const AttributeStream* attributes[] = { &streams.position, &streams.normal, &streams.uv, &streams.color };
+    u64 fullLoadCounts[4] = {};
+    for (u32 a = 0; a < 4; a++)
+    {
+        CheckAttributeStream(*attributes[a]);
+        if (attributes[a]->data)
+            fullLoadCounts[a] = GetFullLoadCount(*attributes[a], count);
+    }
+
+    // block by block, every attribute of a block before the next one: the vertices are written to memory once
+    for (u64 begin = 0; begin < count; begin += DECODE_BLOCK_SIZE)
+    {
+        u64 blockCount = std::min(DECODE_BLOCK_SIZE, count - begin);
+        for (u32 a = 0; a < 4; a++)
+        {
+            AttributeStream blockStream = *attributes[a];
+            if (blockStream.data)
+                blockStream.data += begin * blockStream.stride;
+
+            u64 fullLoadCount = fullLoadCounts[a] > begin ? std::min(fullLoadCounts[a] - begin, blockCount) : 0;
+            DecodeBlock(out + begin, blockCount, fullLoadCount, blockStream, (EVertexAttribute)a, level);
+        }
+    }
+}
+
+void DecodeAttribute(Vertex* out, u64 count, const AttributeStream& stream, EVertexAttribute attribute, ESimdLevel level)
+{
+    if (count == 0)
+        return;
+
+    CheckAttributeStream(stream);
+    DecodeBlock(out, count, stream.data ? GetFullLoadCount(stream, count) : 0, stream, attribute, std::min(level, GetSimdLevel()));
+}
+
+static void DecodeIndicesSSE(Index* out, u64 count, const u8* src, EComponentType componentType, Index offset)
+{
+    const __m128i add = _mm_set1_epi32((s32)offset);
+    const __m128i zero = _mm_setzero_si128();
+
+    u64 i = 0;
+    switch (componentType)
+    {
+    case EComponentType::U8:
+        for (; i + 16 <= count; i += 16)
+        {
+            __m128i bytes = _mm_loadu_si128((const __m128i*)(src + i));
+            __m128i low = _mm_unpacklo_epi8(bytes, zero);
+            __m128i high = _mm_unpackhi_epi8(bytes, zero);
+            _mm_storeu_si128((__m128i*)(out + i), _mm_add_epi32(_mm_unpacklo_epi16(low, zero), add));
+            _mm_storeu_si128((__m128i*)(out + i + 4), _mm_add_epi32(_mm_unpackhi_epi16(low, zero), add));
+            _mm_storeu_si128((__m128i*)(out + i + 8), _mm_add_epi32(_mm_unpacklo_epi16(high, zero), add));
+            _mm_storeu_si128((__m128i*)(out + i + 12), _mm_add_epi32(_mm_unpackhi_epi16(high, zero), add));
+        }
+        break;
+    case EComponentType::U16:
+        for (; i + 8 <= count; i += 8)
+        {
+            __m128i shorts = _mm_loadu_si128((const __m128i*)(src + i * 2));
+            _mm_storeu_si128((__m128i*)(out + i), _mm_add_epi32(_mm_unpacklo_epi16(shorts, zero), add));
+            _mm_storeu_si128((__m128i*)(out + i + 4), _mm_add_epi32(_mm_unpackhi_epi16(shorts, zero), add));
+        }
+        break;
+    default:
+        for (; i + 4 <= count; i += 4)
+            _mm_storeu_si128((__m128i*)(out + i), _mm_add_epi32(_mm_loadu_si128((const __m128i*)(src + i * 4)), add));
+        break;
+    }
+
+    u64 componentSize = GetComponentSize(componentType);
+    for (; i < count; i++)
+        out[i] = LoadIndex(src + i * componentSize, componentType) + offset;
+}
+
+void DecodeIndices(Index* out, u64 count, const AttributeStream& stream, Index offset, ESimdLevel level)
+{
+    check(stream.componentType == EComponentType::U8 || stream.componentType == EComponentType::U16 || stream.componentType == EComponentType::U32);
+
+    // gltf doesn't allow a stride on indices, a strided one still works through the scalar loop
+    u64 componentSize = GetComponentSize(stream.componentType);
+    level = stream.stride == componentSize ? std::min(level, GetSimdLevel()) : ESimdLevel::Scalar;
+
+    switch (level)
+    {
+    case ESimdLevel::AVX2:
+        DecodeIndicesAVX2(out, count, stream.data, stream.componentType, offset);
+        break;
+    case ESimdLevel::SSE2:
+        DecodeIndicesSSE(out, count, stream.data, stream.componentType, offset);
+        break;
+    default:
+        for (u64 i = 0; i < count; i++)
+            out[i] = LoadIndex(stream.data + i * stream.stride, stream.componentType) + offset;
+        break;
+    }
+}
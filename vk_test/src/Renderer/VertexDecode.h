@@ -0,0 +1,63 @@
+#pragma once
+
+#include "Core/CoreMinimal.h"
+#include "Mesh.h"
+
+// bulk conversion of gltf accessors (strided arrays of float or integer components) into the interleaved Vertex.
+// DecodeVertices writes every attribute of a small block of vertices while the block is still in L1, the output
+// goes to memory once instead of once per attribute. sse2 and avx2 paths, picked from cpuid, and a scalar fallback
+
+enum class EComponentType : u8
+{
+	S8,
+	U8,
+	S16,
+	U16,
+	U32, // indices only
+	Float,
+};
+
+// a range of one accessor, read in place. data == nullptr: the attribute is missing, its default is written
+struct AttributeStream
+{
+	const u8* data = nullptr;
+	u64 stride = 0;         // bytes between elements
+	u32 componentCount = 0; // 1..4, the components the destination has and the source doesn't get the default
+	EComponentType componentType = EComponentType::Float;
+	bool normalized = false; // gltf rules: integer / max, signed ones clamped to -1
+};
+
+enum class EVertexAttribute : u8
+{
+	Position, // 3 components, default 0
+	Normal,   // 3, default (1, 0, 0)
+	UV,       // 2, default 0
+	Color,    // 4, default 1
+};
+
+struct VertexStreams
+{
+	AttributeStream position;
+	AttributeStream normal;
+	AttributeStream uv;
+	AttributeStream color;
+};
+
+enum class ESimdLevel : u8
+{
+	Scalar,
+	SSE2,
+	AVX2,
+};
+
+ESimdLevel GetSimdLevel(); // the best one the cpu (and the os) supports, read once
+const char* GetSimdLevelName(ESimdLevel level);
+
+// the level is there for the benchmarks, one the cpu doesn't have is lowered
+
+// fills count vertices, every attribute
+void DecodeVertices(Vertex* out, u64 count, const VertexStreams& streams, ESimdLevel level = GetSimdLevel());
+// one attribute, the other fields are left alone
+void DecodeAttribute(Vertex* out, u64 count, const AttributeStream& stream, EVertexAttribute attribute, ESimdLevel level = GetSimdLevel());
+// u8, u16 or u32 indices + offset
+void DecodeIndices(Index* out, u64 count, const AttributeStream& stream, Index offset, ESimdLevel level = GetSimdLevel());
@@ -0,0 +1,97 @@
+#include "VertexDecodeKernels.h"
+
+// built with /arch:AVX2 (see the vcxproj), only called when the cpu has it. the integer formats are widened two
+// elements at a time, the floats are just moved: for them it's the same as sse2
+
+// two elements, 4 components each, to 8 floats
+template<typename C>
+static __m256 ConvertPairAVX2(const u8* first, const u8* second, __m256 divisor, __m256 minValue)
+{
+    if constexpr (std::is_same_v<C, float>)
+    {
+        return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps((const float*)first)), _mm_loadu_ps((const float*)second), 1);
+    }
+    else
+    {
+        __m128i packed;
+        if constexpr (sizeof(C) == 1)
+        {
+            s32 a, b;
+            memcpy(&a, first, sizeof(a));
+            memcpy(&b, second, sizeof(b));
+            packed = _mm_unpacklo_epi32(_mm_cvtsi32_si128(a), _mm_cvtsi32_si128(b));
+        }
+        else
+        {
+            packed = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i*)first), _mm_loadl_epi64((const __m128i*)second));
+        }
+
+        __m256i wide;
+        if constexpr (std::is_same_v<C, s8>)
+            wide = _mm256_cvtepi8_epi32(packed);
+        else if constexpr (std::is_same_v<C, u8>)
+            wide = _mm256_cvtepu8_epi32(packed);
+        else if constexpr (std::is_same_v<C, s16>)
+            wide = _mm256_cvtepi16_epi32(packed);
+        else
+            wide = _mm256_cvtepu16_epi32(packed);
+
+        return _mm256_max_ps(_mm256_div_ps(_mm256_cvtepi32_ps(wide), divisor), minValue);
+    }
+}
+
+struct AttributeKernelAVX2
+{
+    template<typename C, EVertexAttribute Attribute>
+    static void Run(const AttributeBlock& block)
+    {
+        const ConvertConstants k = MakeConstants<C>(block);
+        const __m256 divisor = _mm256_set_m128(k.divisor, k.divisor);
+        const __m256 minValue = _mm256_set_m128(k.minValue, k.minValue);
+        const __m256 sourceMask = _mm256_set_m128(k.sourceMask, k.sourceMask);
+        const __m256 defaults = _mm256_set_m128(k.defaults, k.defaults);
+
+        u64 i = 0;
+        const u8* src = block.src;
+        for (; i + 1 < block.fullLoadCount; i += 2, src += 2 * block.stride)
+        {
+            __m256 v = _mm256_blendv_ps(defaults, ConvertPairAVX2<C>(src, src + block.stride, divisor, minValue), sourceMask);
+            StoreAttributeSSE<Attribute>(block.out[i], _mm256_castps256_ps128(v));
+            StoreAttributeSSE<Attribute>(block.out[i + 1], _mm256_extractf128_ps(v, 1));
+        }
+
+        // odd one out and the tail
+        DecodeAttributeRangeSSE<C, Attribute>(block, i, k);
+    }
+};
+
+void DecodeAttributeAVX2(const AttributeBlock& block, EVertexAttribute attribute)
+{
+    DispatchAttribute<AttributeKernelAVX2>(block, attribute);
+}
+
+void DecodeIndicesAVX2(Index* out, u64 count, const u8* src, EComponentType componentType, Index offset)
+{
+    const __m256i add = _mm256_set1_epi32((s32)offset);
+
+    u64 i = 0;
+    switch (componentType)
+    {
+    case EComponentType::U8:
+        for (; i + 8 <= count; i += 8)
+            _mm256_storeu_si256((__m256i*)(out + i), _mm256_add_epi32(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(src + i))), add));
+        break;
+    case EComponentType::U16:
+        for (; i + 8 <= count; i += 8)
+            _mm256_storeu_si256((__m256i*)(out + i), _mm256_add_epi32(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(src + i * 2))), add));
+        break;
+    default:
+        for (; i + 8 <= count; i += 8)
+            _mm256_storeu_si256((__m256i*)(out + i), _mm256_add_epi32(_mm256_loadu_si256((const __m256i*)(src + i * 4)), add));
+        break;
+    }
+
+    u64 componentSize = GetComponentSize(componentType);
+    for (; i < count; i++)
+        out[i] = LoadIndex(src + i * componentSize, componentType) + offset;
+}
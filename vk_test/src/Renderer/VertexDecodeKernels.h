@@ -0,0 +1,240 @@
+#pragma once
+
+// internals of VertexDecode.cpp and VertexDecodeAVX2.cpp, nothing else includes this.
+// the helpers have internal linkage on purpose: VertexDecodeAVX2.cpp is built with /arch:AVX2, one copy shared by the
+// two files could come out of that one with avx2 instructions in it and be what the sse2 path calls
+
+#include "VertexDecode.h"
+
+#include <immintrin.h>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+
+// one attribute over a block of vertices, what the kernels take
+struct AttributeBlock
+{
+	Vertex* out;
+	u64 count;
+	u64 fullLoadCount; // the first ones can be read 4 components at a time (past the element), the rest piece by piece
+	const u8* src;
+	u64 stride;
+	u32 componentCount;
+	EComponentType componentType;
+	bool normalized;
+	const float* defaults; // 4
+};
+
+// VertexDecodeAVX2.cpp, only called when the cpu has it
+void DecodeAttributeAVX2(const AttributeBlock& block, EVertexAttribute attribute);
+void DecodeIndicesAVX2(Index* out, u64 count, const u8* src, EComponentType componentType, Index offset);
+
+namespace {
+
+	inline u64 GetComponentSize(EComponentType componentType)
+	{
+		switch (componentType)
+		{
+		case EComponentType::S8:
+		case EComponentType::U8:
+			return 1;
+		case EComponentType::S16:
+		case EComponentType::U16:
+			return 2;
+		default:
+			return 4;
+		}
+	}
+
+	inline Index LoadIndex(const u8* src, EComponentType componentType)
+	{
+		if (componentType == EComponentType::U8)
+			return *src;
+
+		if (componentType == EComponentType::U16)
+		{
+			u16 index;
+			memcpy(&index, src, sizeof(index));
+			return index;
+		}
+
+		u32 index;
+		memcpy(&index, src, sizeof(index));
+		return index;
+	}
+
+	// a normalized integer is divided by its max and clamped to -1 (the gltf rule, fastgltf does the same).
+	// the others go through the same math with 1 and lowest, exact, so every path gives the same bits
+	template<typename C>
+	inline float ComponentDivisor(bool normalized)
+	{
+		return normalized ? (float)std::numeric_limits<C>::max() : 1.0f;
+	}
+
+	inline float ComponentMin(bool normalized)
+	{
+		return normalized ? -1.0f : std::numeric_limits<float>::lowest();
+	}
+
+	struct ConvertConstants
+	{
+		__m128 divisor;
+		__m128 minValue;
+		__m128 sourceMask; // the lanes the source has
+		__m128 defaults;   // for the others
+	};
+
+	template<typename C>
+	inline ConvertConstants MakeConstants(const AttributeBlock& block)
+	{
+		ConvertConstants k;
+		if constexpr (std::is_integral_v<C>)
+		{
+			k.divisor = _mm_set1_ps(ComponentDivisor<C>(block.normalized));
+			k.minValue = _mm_set1_ps(ComponentMin(block.normalized));
+		}
+		else
+		{
+			k.divisor = _mm_set1_ps(1.0f); // unused, floats are copied
+			k.minValue = _mm_set1_ps(0.0f);
+		}
+
+		s32 count = (s32)block.componentCount;
+		k.sourceMask = _mm_castsi128_ps(_mm_cmpgt_epi32(_mm_set1_epi32(count), _mm_set_epi32(3, 2, 1, 0)));
+		k.defaults = _mm_loadu_ps(block.defaults);
+		return k;
+	}
+
+	// 4 components widened to 32 bits, reads 4 * sizeof(C) bytes
+	template<typename C>
+	inline __m128i LoadIntegersSSE(const u8* src)
+	{
+		if constexpr (sizeof(C) == 1)
+		{
+			s32 bits;
+			memcpy(&bits, src, sizeof(bits));
+			__m128i v = _mm_cvtsi32_si128(bits);
+			if constexpr (std::is_signed_v<C>)
+			{
+				// every byte to the top of its lane, then shifted back down with the sign
+				v = _mm_unpacklo_epi8(v, v);
+				return _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 24);
+			}
+			else
+			{
+				__m128i zero = _mm_setzero_si128();
+				return _mm_unpacklo_epi16(_mm_unpacklo_epi8(v, zero), zero);
+			}
+		}
+		else
+		{
+			__m128i v = _mm_loadl_epi64((const __m128i*)src);
+			if constexpr (std::is_signed_v<C>)
+				return _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+			else
+				return _mm_unpacklo_epi16(v, _mm_setzero_si128());
+		}
+	}
+
+	// one element to 4 floats, the lanes the source doesn't have get the defaults. reads 4 components
+	template<typename C>
+	inline __m128 ConvertElementSSE(const u8* src, const ConvertConstants& k)
+	{
+		__m128 v;
+		if constexpr (std::is_same_v<C, float>)
+			v = _mm_loadu_ps((const float*)src);
+		else
+			v = _mm_max_ps(_mm_div_ps(_mm_cvtepi32_ps(LoadIntegersSSE<C>(src)), k.divisor), k.minValue);
+
+		return _mm_or_ps(_mm_and_ps(k.sourceMask, v), _mm_andnot_ps(k.sourceMask, k.defaults));
+	}
+
+	// writes the components of the attribute, nothing else of the vertex
+	template<EVertexAttribute Attribute>
+	inline void StoreAttributeSSE(Vertex& vertex, __m128 v)
+	{
+		if constexpr (Attribute == EVertexAttribute::Position || Attribute == EVertexAttribute::Normal)
+		{
+			// xy + z, the uv component behind them is left alone
+			float* dst = Attribute == EVertexAttribute::Position ? &vertex.position.x : &vertex.normal.x;
+			_mm_storel_pi((__m64*)dst, v);
+			_mm_store_ss(dst + 2, _mm_movehl_ps(v, v));
+		}
+		else if constexpr (Attribute == EVertexAttribute::UV)
+		{
+			_mm_store_ss(&vertex.uv_x, v);
+			_mm_store_ss(&vertex.uv_y, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1)));
+		}
+		else
+		{
+			_mm_storeu_ps(&vertex.color.x, v);
+		}
+	}
+
+	// the elements [begin, count) of the block, one at a time
+	template<typename C, EVertexAttribute Attribute>
+	inline void DecodeAttributeRangeSSE(const AttributeBlock& block, u64 begin, const ConvertConstants& k)
+	{
+		const u8* src = block.src + begin * block.stride;
+		u64 i = begin;
+		for (; i < block.fullLoadCount; i++, src += block.stride)
+			StoreAttributeSSE<Attribute>(block.out[i], ConvertElementSSE<C>(src, k));
+
+		// the last ones, a 4 component read would go past the end of the range
+		for (; i < block.count; i++, src += block.stride)
+		{
+			u8 element[16] = {};
+			memcpy(element, src, block.componentCount * sizeof(C));
+			StoreAttributeSSE<Attribute>(block.out[i], ConvertElementSSE<C>(element, k));
+		}
+	}
+
+	// Kernel::Run<C, Attribute>(block) with the block's component type
+	template<typename Kernel, EVertexAttribute Attribute>
+	inline void DispatchComponentType(const AttributeBlock& block)
+	{
+		switch (block.componentType)
+		{
+		case EComponentType::S8:
+			Kernel::template Run<s8, Attribute>(block);
+			break;
+		case EComponentType::U8:
+			Kernel::template Run<u8, Attribute>(block);
+			break;
+		case EComponentType::S16:
+			Kernel::template Run<s16, Attribute>(block);
+			break;
+		case EComponentType::U16:
+			Kernel::template Run<u16, Attribute>(block);
+			break;
+		case EComponentType::Float:
+			Kernel::template Run<float, Attribute>(block);
+			break;
+		default:
+			check(false); // u32 is for indices
+			break;
+		}
+	}
+
+	template<typename Kernel>
+	inline void DispatchAttribute(const AttributeBlock& block, EVertexAttribute attribute)
+	{
+		switch (attribute)
+		{
+		case EVertexAttribute::Position:
+			DispatchComponentType<Kernel, EVertexAttribute::Position>(block);
+			break;
+		case EVertexAttribute::Normal:
+			DispatchComponentType<Kernel, EVertexAttribute::Normal>(block);
+			break;
+		case EVertexAttribute::UV:
+			DispatchComponentType<Kernel, EVertexAttribute::UV>(block);
+			break;
+		case EVertexAttribute::Color:
+			DispatchComponentType<Kernel, EVertexAttribute::Color>(block);
+			break;
+		}
+	}
+
+}